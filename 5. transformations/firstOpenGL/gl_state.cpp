@@ -0,0 +1,264 @@
+#include "gl_state.h"
+#include <iostream>
+
+GLStateCache* GLStateCache::active = nullptr;
+
+GLStateCache::GLStateCache() {
+	invalidate();
+}
+
+GLStateCache::~GLStateCache() {
+	uninstall();
+}
+
+bool GLStateCache::install() {
+	if (active) {
+		std::cout << "ERROR::GL_STATE_CACHE::ALREADY_INSTALLED" << std::endl;
+		return false;
+	}
+	if (!glad_glUseProgram || !glad_glBindTexture) {
+		std::cout << "ERROR::GL_STATE_CACHE::GLAD_NOT_LOADED" << std::endl;
+		return false;
+	}
+	real.useProgram = glad_glUseProgram;
+	real.deleteProgram = glad_glDeleteProgram;
+	real.bindVertexArray = glad_glBindVertexArray;
+	real.deleteVertexArrays = glad_glDeleteVertexArrays;
+	real.bindBuffer = glad_glBindBuffer;
+	real.bindBufferBase = glad_glBindBufferBase;
+	real.bindBufferRange = glad_glBindBufferRange;
+	real.deleteBuffers = glad_glDeleteBuffers;
+	real.activeTexture = glad_glActiveTexture;
+	real.bindTexture = glad_glBindTexture;
+	real.deleteTextures = glad_glDeleteTextures;
+	real.clearColor = glad_glClearColor;
+	real.viewport = glad_glViewport;
+
+	glad_glUseProgram = useProgram;
+	glad_glDeleteProgram = deleteProgram;
+	glad_glBindVertexArray = bindVertexArray;
+	glad_glDeleteVertexArrays = deleteVertexArrays;
+	glad_glBindBuffer = bindBuffer;
+	glad_glBindBufferBase = bindBufferBase;
+	glad_glBindBufferRange = bindBufferRange;
+	glad_glDeleteBuffers = deleteBuffers;
+	glad_glActiveTexture = activeTexture;
+	glad_glBindTexture = bindTexture;
+	glad_glDeleteTextures = deleteTextures;
+	glad_glClearColor = clearColor;
+	glad_glViewport = viewport;
+
+	active = this;
+	installed = true;
+	invalidate();
+	return true;
+}
+
+void GLStateCache::uninstall() {
+	if (!installed)
+		return;
+	glad_glUseProgram = real.useProgram;
+	glad_glDeleteProgram = real.deleteProgram;
+	glad_glBindVertexArray = real.bindVertexArray;
+	glad_glDeleteVertexArrays = real.deleteVertexArrays;
+	glad_glBindBuffer = real.bindBuffer;
+	glad_glBindBufferBase = real.bindBufferBase;
+	glad_glBindBufferRange = real.bindBufferRange;
+	glad_glDeleteBuffers = real.deleteBuffers;
+	glad_glActiveTexture = real.activeTexture;
+	glad_glBindTexture = real.bindTexture;
+	glad_glDeleteTextures = real.deleteTextures;
+	glad_glClearColor = real.clearColor;
+	glad_glViewport = real.viewport;
+	active = nullptr;
+	installed = false;
+}
+
+void GLStateCache::invalidate() {
+	program = unknown;
+	vertexArray = unknown;
+	for (unsigned int& buffer : buffers)
+		buffer = unknown;
+	activeUnit = unknown;
+	for (auto& unit : textures) {
+		for (unsigned int& texture : unit)
+			texture = unknown;
+	}
+	clearColorKnown = false;
+	viewportKnown = false;
+}
+
+int GLStateCache::bufferIndex(GLenum target) {
+	switch (target) {
+	case GL_ARRAY_BUFFER: return ARRAY_BUFFER;
+	case GL_ELEMENT_ARRAY_BUFFER: return ELEMENT_ARRAY_BUFFER;
+	case GL_UNIFORM_BUFFER: return UNIFORM_BUFFER;
+	case GL_COPY_READ_BUFFER: return COPY_READ_BUFFER;
+	case GL_COPY_WRITE_BUFFER: return COPY_WRITE_BUFFER;
+	case GL_PIXEL_PACK_BUFFER: return PIXEL_PACK_BUFFER;
+	case GL_PIXEL_UNPACK_BUFFER: return PIXEL_UNPACK_BUFFER;
+	case GL_TEXTURE_BUFFER: return TEXTURE_BUFFER;
+	case GL_TRANSFORM_FEEDBACK_BUFFER: return TRANSFORM_FEEDBACK_BUFFER;
+	case GL_DRAW_INDIRECT_BUFFER: return DRAW_INDIRECT_BUFFER;
+	}
+	return -1;
+}
+
+int GLStateCache::textureIndex(GLenum target) {
+	switch (target) {
+	case GL_TEXTURE_1D: return TEXTURE_1D;
+	case GL_TEXTURE_2D: return TEXTURE_2D;
+	case GL_TEXTURE_3D: return TEXTURE_3D;
+	case GL_TEXTURE_CUBE_MAP: return TEXTURE_CUBE_MAP;
+	case GL_TEXTURE_1D_ARRAY: return TEXTURE_1D_ARRAY;
+	case GL_TEXTURE_2D_ARRAY: return TEXTURE_2D_ARRAY;
+	case GL_TEXTURE_RECTANGLE: return TEXTURE_RECTANGLE;
+	case GL_TEXTURE_BUFFER: return TEXTURE_BUFFER_TARGET;
+	case GL_TEXTURE_2D_MULTISAMPLE: return TEXTURE_2D_MULTISAMPLE;
+	case GL_TEXTURE_CUBE_MAP_ARRAY: return TEXTURE_CUBE_MAP_ARRAY;
+	}
+	return -1;
+}
+
+bool GLStateCache::change(unsigned int& shadow, unsigned int value) {
+	if (shadow == value) {
+		calls.elided++;
+		return false;
+	}
+	shadow = value;
+	calls.issued++;
+	return true;
+}
+
+void APIENTRY GLStateCache::useProgram(GLuint program) {
+	if (active->change(active->program, program))
+		active->real.useProgram(program);
+}
+
+void APIENTRY GLStateCache::deleteProgram(GLuint program) {
+	// a deleted program stays in use until another one is, but its name may be handed out again
+	if (program && active->program == program)
+		active->program = unknown;
+	active->real.deleteProgram(program);
+}
+
+void APIENTRY GLStateCache::bindVertexArray(GLuint array) {
+	if (active->change(active->vertexArray, array)) {
+		// the element array binding belongs to the vertex array
+		active->buffers[ELEMENT_ARRAY_BUFFER] = unknown;
+		active->real.bindVertexArray(array);
+	}
+}
+
+void APIENTRY GLStateCache::deleteVertexArrays(GLsizei n, const GLuint* arrays) {
+	for (GLsizei i = 0; i < n; i++) {
+		// deleting the bound vertex array binds 0
+		if (arrays[i] && active->vertexArray == arrays[i]) {
+			active->vertexArray = 0;
+			active->buffers[ELEMENT_ARRAY_BUFFER] = unknown;
+		}
+	}
+	active->real.deleteVertexArrays(n, arrays);
+}
+
+void APIENTRY GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+	int index = bufferIndex(target);
+	if (index < 0) {
+		active->calls.issued++;
+		active->real.bindBuffer(target, buffer);
+	}
+	else if (active->change(active->buffers[index], buffer)) {
+		active->real.bindBuffer(target, buffer);
+	}
+}
+
+void APIENTRY GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+	// indexed binding points are not shadowed, but the call also binds the generic target
+	int slot = bufferIndex(target);
+	if (slot >= 0)
+		active->buffers[slot] = buffer;
+	active->calls.issued++;
+	active->real.bindBufferBase(target, index, buffer);
+}
+
+void APIENTRY GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+	int slot = bufferIndex(target);
+	if (slot >= 0)
+		active->buffers[slot] = buffer;
+	active->calls.issued++;
+	active->real.bindBufferRange(target, index, buffer, offset, size);
+}
+
+void APIENTRY GLStateCache::deleteBuffers(GLsizei n, const GLuint* buffers) {
+	for (GLsizei i = 0; i < n; i++) {
+		if (!buffers[i])
+			continue;
+		for (unsigned int& bound : active->buffers) {
+			if (bound == buffers[i])
+				bound = 0;
+		}
+	}
+	active->real.deleteBuffers(n, buffers);
+}
+
+void APIENTRY GLStateCache::activeTexture(GLenum texture) {
+	if (active->change(active->activeUnit, texture - GL_TEXTURE0))
+		active->real.activeTexture(texture);
+}
+
+void APIENTRY GLStateCache::bindTexture(GLenum target, GLuint texture) {
+	int index = textureIndex(target);
+	unsigned int unit = active->activeUnit;
+	if (index < 0 || unit >= maxTextureUnits) {
+		active->calls.issued++;
+		active->real.bindTexture(target, texture);
+	}
+	else if (active->change(active->textures[unit][index], texture)) {
+		active->real.bindTexture(target, texture);
+	}
+}
+
+void APIENTRY GLStateCache::deleteTextures(GLsizei n, const GLuint* textures) {
+	// deleting a bound texture binds 0 on every unit it was bound to
+	for (GLsizei i = 0; i < n; i++) {
+		if (!textures[i])
+			continue;
+		for (auto& unit : active->textures) {
+			for (unsigned int& bound : unit) {
+				if (bound == textures[i])
+					bound = 0;
+			}
+		}
+	}
+	active->real.deleteTextures(n, textures);
+}
+
+void APIENTRY GLStateCache::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+	float* shadow = active->clearColorValue;
+	if (active->clearColorKnown && shadow[0] == red && shadow[1] == green && shadow[2] == blue && shadow[3] == alpha) {
+		active->calls.elided++;
+		return;
+	}
+	shadow[0] = red;
+	shadow[1] = green;
+	shadow[2] = blue;
+	shadow[3] = alpha;
+	active->clearColorKnown = true;
+	active->calls.issued++;
+	active->real.clearColor(red, green, blue, alpha);
+}
+
+void APIENTRY GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	int* shadow = active->viewportValue;
+	if (active->viewportKnown && shadow[0] == x && shadow[1] == y && shadow[2] == width && shadow[3] == height) {
+		active->calls.elided++;
+		return;
+	}
+	shadow[0] = x;
+	shadow[1] = y;
+	shadow[2] = width;
+	shadow[3] = height;
+	active->viewportKnown = true;
+	active->calls.issued++;
+	active->real.viewport(x, y, width, height);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// shadows the bind state of the GL context and drops calls that would not change it
+// install() swaps the glad function pointers (glad_glUseProgram, glad_glBindTexture, ...) for wrappers,
+// so every glUseProgram / glBindTexture / ... in the program goes through the cache without changes
+// at the call sites. only for the thread the context is current on, one instance at a time
+//
+// tracked: program, vertex array, buffer per target (the element array buffer per vertex array),
+// active texture unit and the texture per unit and target, clear colour, viewport
+// deleting a bound object resets its shadow the way GL resets the binding
+class GLStateCache {
+public:
+	struct Counters {
+		unsigned long long issued = 0;
+		unsigned long long elided = 0;
+	};
+
+	GLStateCache();
+	~GLStateCache();
+
+	GLStateCache(const GLStateCache&) = delete;
+	GLStateCache& operator=(const GLStateCache&) = delete;
+
+	// call after gladLoadGLLoader, the shadows start unknown so the first call of each kind is issued
+	bool install();
+	// put the original glad pointers back
+	void uninstall();
+	// forget the shadowed state, for when GL state was changed behind the cache's back
+	void invalidate();
+
+	const Counters& counters() const { return calls; }
+	void resetCounters() { calls = Counters(); }
+
+	static const unsigned int maxTextureUnits = 32;
+
+private:
+	static const unsigned int unknown = 0xFFFFFFFFu;
+	enum BufferTarget { ARRAY_BUFFER, ELEMENT_ARRAY_BUFFER, UNIFORM_BUFFER, COPY_READ_BUFFER, COPY_WRITE_BUFFER,
+		PIXEL_PACK_BUFFER, PIXEL_UNPACK_BUFFER, TEXTURE_BUFFER, TRANSFORM_FEEDBACK_BUFFER, DRAW_INDIRECT_BUFFER,
+		BUFFER_TARGETS };
+	enum TextureTarget { TEXTURE_1D, TEXTURE_2D, TEXTURE_3D, TEXTURE_CUBE_MAP, TEXTURE_1D_ARRAY, TEXTURE_2D_ARRAY,
+		TEXTURE_RECTANGLE, TEXTURE_BUFFER_TARGET, TEXTURE_2D_MULTISAMPLE, TEXTURE_CUBE_MAP_ARRAY, TEXTURE_TARGETS };
+
+	// the functions the wrappers forward to
+	struct Functions {
+		PFNGLUSEPROGRAMPROC useProgram;
+		PFNGLDELETEPROGRAMPROC deleteProgram;
+		PFNGLBINDVERTEXARRAYPROC bindVertexArray;
+		PFNGLDELETEVERTEXARRAYSPROC deleteVertexArrays;
+		PFNGLBINDBUFFERPROC bindBuffer;
+		PFNGLBINDBUFFERBASEPROC bindBufferBase;
+		PFNGLBINDBUFFERRANGEPROC bindBufferRange;
+		PFNGLDELETEBUFFERSPROC deleteBuffers;
+		PFNGLACTIVETEXTUREPROC activeTexture;
+		PFNGLBINDTEXTUREPROC bindTexture;
+		PFNGLDELETETEXTURESPROC deleteTextures;
+		PFNGLCLEARCOLORPROC clearColor;
+		PFNGLVIEWPORTPROC viewport;
+	};
+
+	Functions real = {};
+	bool installed = false;
+	Counters calls;
+
+	unsigned int program;
+	unsigned int vertexArray;
+	unsigned int buffers[BUFFER_TARGETS];
+	unsigned int activeUnit;
+	unsigned int textures[maxTextureUnits][TEXTURE_TARGETS];
+	bool clearColorKnown;
+	float clearColorValue[4];
+	bool viewportKnown;
+	int viewportValue[4];
+
+	// the installed instance, the wrappers are plain functions
+	static GLStateCache* active;
+
+	static int bufferIndex(GLenum target);
+	static int textureIndex(GLenum target);
+	// true if the call has to be issued, counts it either way
+	bool change(unsigned int& shadow, unsigned int value);
+
+	static void APIENTRY useProgram(GLuint program);
+	static void APIENTRY deleteProgram(GLuint program);
+	static void APIENTRY bindVertexArray(GLuint array);
+	static void APIENTRY deleteVertexArrays(GLsizei n, const GLuint* arrays);
+	static void APIENTRY bindBuffer(GLenum target, GLuint buffer);
+	static void APIENTRY bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	static void APIENTRY bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	static void APIENTRY deleteBuffers(GLsizei n, const GLuint* buffers);
+	static void APIENTRY activeTexture(GLenum texture);
+	static void APIENTRY bindTexture(GLenum target, GLuint texture);
+	static void APIENTRY deleteTextures(GLsizei n, const GLuint* textures);
+	static void APIENTRY clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+	static void APIENTRY viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+};
+
+#endif
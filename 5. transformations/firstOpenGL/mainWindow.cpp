@@ -4,12 +4,29 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include "gl_state.h"
 #include "shader_s.h"
+#include "program_cache.h"
+#include "shader_batch.h"
+#include "shader_reload.h"
+#include "shader_source.h"
+#include "texture_loader.h"
+#include "thread_pool.h"
+#include "uniform_buffer.h"
 #include "stb_image.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+// uniforms that change every frame, mirrors the Frame block in shaders/frame.glsl
+struct FrameUniforms {
+	glm::mat4 transform;
+	float lerpVal;
+};
+typedef Std140Layout<FrameUniforms,
+	STD140_MEMBER(FrameUniforms, transform),
+	STD140_MEMBER(FrameUniforms, lerpVal)> FrameLayout;
+
 // function prototypes
 
 // register a callback function on then window that get called when window is resized
@@ -21,6 +38,11 @@ void processInput(GLFWwindow* window);
 int main() {
 	// initialize the GLFW library
 	glfwInit();
+	// glfwTerminate destroys the context, the objects below that own GL objects (frameUniforms) have to be
+	// destroyed first. declared before all of them, this runs after their destructors on every return
+	struct GlfwSession {
+		~GlfwSession() { glfwTerminate(); }
+	} glfwSession;
 	// setting the OpenGL version
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -32,7 +54,6 @@ int main() {
 	GLFWwindow* window = glfwCreateWindow(800, 600, "LEARNING OPENGL", NULL, NULL);
 	if (window == NULL) {
 		std::cout << "FALIED TO CREATE WINDOW" << std::endl;
-		glfwTerminate();
 		return -1;
 	}
 	// tell GLFW to make the context of our window the main context on the current thread
@@ -44,6 +65,10 @@ int main() {
 		std::cout << "FAILED TO INITIALIZE GLAD" << std::endl;
 		return -1;
 	}
+	// binds that would not change anything (the same program, textures and clear colour every frame)
+	// are dropped before they reach the driver
+	GLStateCache glState;
+	glState.install();
 
 	// telling OpenGL the size of the rendering window
 	// first 2 params: location of the lower left corner of the window
@@ -117,79 +142,61 @@ int main() {
 	glEnableVertexAttribArray(2);
 
 
-	// generating a texture
-	unsigned int texture1, texture2;
-	// pars: num of textures to generate, store them in a unsigned int array
-	glGenTextures(1, &texture1);
-	// bind it so subsequent texture commands configure the currently bound texture
-	glBindTexture(GL_TEXTURE_2D, texture1);
-
-	// set the texture wrapping/filtering options (on currently bound texture)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// loading an image
-	int width, height, nrChannels;
-	// tell stbi to flip loaded textures on the y axis
-	stbi_set_flip_vertically_on_load(true);
-	// stbi_load: location. width, height, number of color channels
-	unsigned char* data = stbi_load("../../5. transformations/firstOpenGL/pic1.png", &width, &height, &nrChannels, 0);
-
-	if (data) {
-		// generate a texture using previously loaded image data
-		/*
-		pars:
-			texture target
-			mipmaplevel for which to create a texture for
-			what format to store the texture
-			width
-			height
-			0 (legacy stuff)
-			format of the source image
-			data type of the source image
-		*/
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-			GL_UNSIGNED_BYTE, data);
-		// automatically generate all the required mipmaps for the currently bound texture
-		glGenerateMipmap(GL_TEXTURE_2D);
-		// free the image memory
-		
-	}
-	else {
-		std::cout << "FAILED TO LOAD TEXTURE" << std::endl;
-	}
-	stbi_image_free(data);
-
-	// generate 2nd texture
-	glGenTextures(1, &texture2);
-	glBindTexture(GL_TEXTURE_2D, texture2);
-	// wrapping parms
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// filter parms
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// loading 2nd image
-	data = stbi_load("../../5. transformations/firstOpenGL/pic2.png", &width, &height, &nrChannels, 0);
-	if (data) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		
-	}
-	else {
-		std::cout << "FAILED TO LOAD TEXTURE" << std::endl;
+	// worker threads for file reads and image decodes, shaders are read in parallel and compiled as one batch
+	ThreadPool pool;
+
+	// the images are decoded on the pool and uploaded by textureLoader.update() in the render loop
+	// until then both textures show a white texel, the first frame does not wait for stb_image
+	TextureLoader textureLoader(pool);
+	// block compressed textures, encoded on the first run and mapped from the cache after that
+	textureLoader.enableCompression("../../5. transformations/firstOpenGL/texture_cache");
+	// flip loaded textures on the y axis
+	unsigned int texture1 = textureLoader.request("../../5. transformations/firstOpenGL/pic1.png", true);
+	unsigned int texture2 = textureLoader.request("../../5. transformations/firstOpenGL/pic2.png", true);
+	for (unsigned int texture : { texture1, texture2 }) {
+		// bind it so subsequent texture commands configure the currently bound texture
+		glBindTexture(GL_TEXTURE_2D, texture);
+		// set the texture wrapping/filtering options (on currently bound texture)
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		// the loader uploads every level down to 1x1, so minification blends between the two closest levels
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	}
-	stbi_image_free(data);
 
-	Shader testShader("../../5. transformations/firstOpenGL/shaders/shader.vert", "../../5. transformations/firstOpenGL/shaders/shader.frag");
+	// linked program binaries are kept on disk so later launches skip compiling
+	ProgramCache programCache("../../5. transformations/firstOpenGL/shader_cache");
+	programCache.load((GLADloadproc)glfwGetProcAddress);
+
+	// compiled stages stay in shaderSources so a hot reload only recompiles what was edited
+	ShaderSources shaderSources;
+	ShaderBatch shaderBatch(pool, &programCache, &shaderSources);
+	shaderBatch.load((GLADloadproc)glfwGetProcAddress);
+	const char* vertexShaderPath = "../../5. transformations/firstOpenGL/shaders/shader.vert";
+	const char* fragmentShaderPath = "../../5. transformations/firstOpenGL/shaders/shader.frag";
+	size_t testShaderIndex = shaderBatch.add(vertexShaderPath, fragmentShaderPath);
+	std::vector<Shader> shaders = shaderBatch.build();
+	Shader& testShader = shaders[testShaderIndex];
+	const ShaderBatch::ProgramStats& shaderStats = shaderBatch.stats()[testShaderIndex];
+	std::cout << "SHADER BUILD (ms) READ: " << shaderStats.readMs << " COMPILE: " << shaderStats.compileMs <<
+		" LINK: " << shaderStats.linkMs << (shaderStats.fromCache ? " (CACHED)" : "") << std::endl;
+
+	// rebuild the shader whenever its files are saved, without restarting
+	ShaderReloader shaderReloader(shaderSources);
+	shaderReloader.add(testShader, vertexShaderPath, fragmentShaderPath);
 
 	// set which texture unit each shader sampler belongs to by setting each sampler
 	// only have to be set once
 	testShader.use(); // DO NOT FORGET TO ACTIVATE/USE THE SHDAER BEFORE SETTING UNIFORMS
-	glUniform1i(glGetUniformLocation(testShader.ID, "texture1"), 0);
-	glUniform1i(glGetUniformLocation(testShader.ID, "texture2"), 1);
+	testShader.set(testShader.uniform<int>("texture1"), 0);
+	testShader.set(testShader.uniform<int>("texture2"), 1);
+
+	// the per-frame uniforms live in the Frame block (shaders/frame.glsl), written once per frame into a
+	// uniform buffer instead of one glUniform call each per draw
+	UniformRing frameUniforms(FrameLayout::size);
+	frameUniforms.load((GLADloadproc)glfwGetProcAddress);
+	testShader.bindBlock("Frame", FrameLayout::size);
+	const unsigned int frameBinding = Shader::blockBinding("Frame");
 
 	// GLM
 	// vector to translate
@@ -204,17 +211,18 @@ int main() {
 	vec = trans * vec;
 	//std::cout << vec.x << vec.y << vec.z << std::endl;
 
-	// get the location of the uniform variable
-	unsigned int transformLoc = glGetUniformLocation(testShader.ID, "transform");
-	// pars: uniform's location, how many matrices to send, transpose, actual matrix data
-	glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(trans));
-
 	// a simple render loop 
 	// check at the start of each loop if GLFW has been instructed to close
 	while (!glfwWindowShouldClose(window)) {
 		// check for input on every frame of the render loop
 		processInput(window);
 
+		// upload images the workers finished decoding, at most ~2 ms of uploads per frame
+		textureLoader.update(2.0);
+
+		// swap in edited shaders between frames, uniform values and block bindings carry over
+		shaderReloader.update();
+
 		// ----------- rendering commands go here -------------//
 
 		// clear the screen's color buffer 
@@ -240,21 +248,19 @@ int main() {
 		glBindTexture(GL_TEXTURE_2D, texture2);
 
 		testShader.use();
-		// setting the uniform 
+		// waits only if the GPU still reads the slot written framesInFlight frames ago
+		frameUniforms.beginFrame();
+		FrameUniforms frame;
 		float timeValue = glfwGetTime();
-		float greenValue = (sin(timeValue) / 2.0f) + 0.5f;
-		testShader.setFloat("lerpVal", greenValue);
-		//std::cout << greenValue << std::endl;
+		frame.lerpVal = (sin(timeValue) / 2.0f) + 0.5f;
 
 		// transformation matrix
-		glm::mat4 trans = glm::mat4(1.0f);
-		trans = glm::translate(trans, glm::vec3(0.5f, -0.5f, 0.0f));
-		trans = glm::rotate(trans, (float)glfwGetTime(),
+		frame.transform = glm::mat4(1.0f);
+		frame.transform = glm::translate(frame.transform, glm::vec3(0.5f, -0.5f, 0.0f));
+		frame.transform = glm::rotate(frame.transform, (float)glfwGetTime(),
 			glm::vec3(0.0f, 0.0f, 1.0f));
-		// get the location of the uniform variable
-		unsigned int transformLoc = glGetUniformLocation(testShader.ID, "transform");
-		// pars: uniform's location, how many matrices to send, transpose, actual matrix data
-		glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(trans));
+		// packed with std140 padding straight into the buffer and bound with one glBindBufferRange
+		frameUniforms.push<FrameLayout>(frameBinding, frame);
 
 		
 
@@ -267,6 +273,7 @@ int main() {
 		// par: primitive type, number of elements, type of indices, offset
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 		glBindVertexArray(0);
+		frameUniforms.endFrame();
 
 		// ----------------------------------------------------//
 
@@ -276,8 +283,9 @@ int main() {
 		glfwSwapBuffers(window);
 	}
 
-	// clean / delete allocated GLFW resources upon exiting the render loop
-	glfwTerminate();
+	std::cout << "GL STATE CALLS ISSUED: " << glState.counters().issued << " ELIDED: " << glState.counters().elided << std::endl;
+
+	// clean / delete allocated GLFW resources upon exiting the render loop: glfwSession, after the GL objects
 	return 0;
 
 }
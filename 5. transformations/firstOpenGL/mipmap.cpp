@@ -0,0 +1,531 @@
+#include "mipmap.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MIPMAP_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles AVX2 intrinsics without /arch:AVX2, the CPU check decides if they run
+#define MIPMAP_AVX2
+#else
+#include <cpuid.h>
+#define MIPMAP_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+	// ---------------------------------------------------------------------------------------------
+	// vertical step of the box filter: sum two rows element by element into a wider type
+	// horizontal step: add neighbouring pixels of the sums and divide by 4
+	// ---------------------------------------------------------------------------------------------
+
+	void sumRowsU8Scalar(const uint8_t* a, const uint8_t* b, uint16_t* sums, size_t count) {
+		for (size_t i = 0; i < count; i++)
+			sums[i] = (uint16_t)(a[i] + b[i]);
+	}
+
+	void sumRowsU16Scalar(const uint16_t* a, const uint16_t* b, uint32_t* sums, size_t count) {
+		for (size_t i = 0; i < count; i++)
+			sums[i] = (uint32_t)a[i] + b[i];
+	}
+
+	void sumRowsF32Scalar(const float* a, const float* b, float* sums, size_t count) {
+		for (size_t i = 0; i < count; i++)
+			sums[i] = a[i] + b[i];
+	}
+
+	// 4 channels, srcWidth >= 2
+	void halveU8x4Scalar(const uint16_t* sums, uint8_t* dst, int dstWidth) {
+		for (int x = 0; x < dstWidth; x++) {
+			for (int c = 0; c < 4; c++)
+				dst[x * 4 + c] = (uint8_t)((sums[x * 8 + c] + sums[x * 8 + 4 + c] + 2) >> 2);
+		}
+	}
+
+#ifdef MIPMAP_X86
+	void sumRowsU8Sse2(const uint8_t* a, const uint8_t* b, uint16_t* sums, size_t count) {
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+			__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+			__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+			__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+			_mm_storeu_si128((__m128i*)(sums + i), low);
+			_mm_storeu_si128((__m128i*)(sums + i + 8), high);
+		}
+		sumRowsU8Scalar(a + i, b + i, sums + i, count - i);
+	}
+
+	void sumRowsU16Sse2(const uint16_t* a, const uint16_t* b, uint32_t* sums, size_t count) {
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+			__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+			__m128i low = _mm_add_epi32(_mm_unpacklo_epi16(va, zero), _mm_unpacklo_epi16(vb, zero));
+			__m128i high = _mm_add_epi32(_mm_unpackhi_epi16(va, zero), _mm_unpackhi_epi16(vb, zero));
+			_mm_storeu_si128((__m128i*)(sums + i), low);
+			_mm_storeu_si128((__m128i*)(sums + i + 4), high);
+		}
+		sumRowsU16Scalar(a + i, b + i, sums + i, count - i);
+	}
+
+	void sumRowsF32Sse2(const float* a, const float* b, float* sums, size_t count) {
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+			_mm_storeu_ps(sums + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		sumRowsF32Scalar(a + i, b + i, sums + i, count - i);
+	}
+
+	void halveU8x4Sse2(const uint16_t* sums, uint8_t* dst, int dstWidth) {
+		const __m128i two = _mm_set1_epi16(2);
+		int x = 0;
+		// 8 summed source pixels in, 4 pixels out
+		for (; x + 4 <= dstWidth; x += 4) {
+			const uint16_t* s = sums + x * 8;
+			__m128i p01 = _mm_loadu_si128((const __m128i*)s);
+			__m128i p23 = _mm_loadu_si128((const __m128i*)(s + 8));
+			__m128i p45 = _mm_loadu_si128((const __m128i*)(s + 16));
+			__m128i p67 = _mm_loadu_si128((const __m128i*)(s + 24));
+			__m128i even = _mm_add_epi16(_mm_unpacklo_epi64(p01, p23), _mm_unpackhi_epi64(p01, p23));
+			__m128i odd = _mm_add_epi16(_mm_unpacklo_epi64(p45, p67), _mm_unpackhi_epi64(p45, p67));
+			even = _mm_srli_epi16(_mm_add_epi16(even, two), 2);
+			odd = _mm_srli_epi16(_mm_add_epi16(odd, two), 2);
+			_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(even, odd));
+		}
+		halveU8x4Scalar(sums + x * 8, dst + x * 4, dstWidth - x);
+	}
+
+	MIPMAP_AVX2 void sumRowsU8Avx2(const uint8_t* a, const uint8_t* b, uint16_t* sums, size_t count) {
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+			__m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+			_mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi16(va, vb));
+		}
+		sumRowsU8Scalar(a + i, b + i, sums + i, count - i);
+	}
+
+	MIPMAP_AVX2 void sumRowsU16Avx2(const uint16_t* a, const uint16_t* b, uint32_t* sums, size_t count) {
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i va = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(a + i)));
+			__m256i vb = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(b + i)));
+			_mm256_storeu_si256((__m256i*)(sums + i), _mm256_add_epi32(va, vb));
+		}
+		sumRowsU16Scalar(a + i, b + i, sums + i, count - i);
+	}
+
+	MIPMAP_AVX2 void sumRowsF32Avx2(const float* a, const float* b, float* sums, size_t count) {
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+			_mm256_storeu_ps(sums + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+		sumRowsF32Scalar(a + i, b + i, sums + i, count - i);
+	}
+
+	bool cpuHasAvx2() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		// the OS has to save the ymm registers too
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		unsigned int a, b, c, d;
+		if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_OSXSAVE) || !(c & bit_AVX))
+			return false;
+		unsigned int low, high;
+		__asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		if ((low & 6) != 6)
+			return false;
+		return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2);
+#endif
+	}
+#endif
+
+	struct Kernels {
+		void (*sumRowsU8)(const uint8_t*, const uint8_t*, uint16_t*, size_t);
+		void (*sumRowsU16)(const uint16_t*, const uint16_t*, uint32_t*, size_t);
+		void (*sumRowsF32)(const float*, const float*, float*, size_t);
+		void (*halveU8x4)(const uint16_t*, uint8_t*, int);
+	};
+
+	std::atomic<bool> simdEnabled(true);
+
+	const Kernels& kernels() {
+		static const Kernels scalar = { sumRowsU8Scalar, sumRowsU16Scalar, sumRowsF32Scalar, halveU8x4Scalar };
+#ifdef MIPMAP_X86
+		static const Kernels best = cpuHasAvx2() ?
+			Kernels{ sumRowsU8Avx2, sumRowsU16Avx2, sumRowsF32Avx2, halveU8x4Sse2 } :
+			Kernels{ sumRowsU8Sse2, sumRowsU16Sse2, sumRowsF32Sse2, halveU8x4Sse2 };
+		if (simdEnabled.load(std::memory_order_relaxed))
+			return best;
+#endif
+		return scalar;
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// sRGB
+	// ---------------------------------------------------------------------------------------------
+
+	struct SrgbTables {
+		float toLinear[256];
+		// linear value * 4095 -> sRGB byte
+		uint8_t fromLinear[4096];
+
+		SrgbTables() {
+			for (int i = 0; i < 256; i++) {
+				float v = i / 255.0f;
+				toLinear[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; i++) {
+				float v = i / 4095.0f;
+				float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+				fromLinear[i] = (uint8_t)(s * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const SrgbTables& srgbTables() {
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	uint8_t encodeSrgb(float linear) {
+		linear = std::min(std::max(linear, 0.0f), 1.0f);
+		return srgbTables().fromLinear[(int)(linear * 4095.0f + 0.5f)];
+	}
+
+	// the alpha channel of 2 and 4 channel images is never sRGB encoded
+	bool isAlpha(int channel, int channels) {
+		return (channels == 2 || channels == 4) && channel == channels - 1;
+	}
+
+	size_t typeSize(MipType type) {
+		return type == MIP_UNSIGNED_BYTE ? 1 : type == MIP_UNSIGNED_SHORT ? 2 : 4;
+	}
+
+	// one level to the next, only destination rows [yBegin, yEnd)
+	struct LevelJob {
+		const unsigned char* src;
+		int srcWidth;
+		int srcHeight;
+		unsigned char* dst;
+		int dstWidth;
+		int dstHeight;
+		int channels;
+		MipType type;
+		bool srgb;
+	};
+
+	// ---------------------------------------------------------------------------------------------
+	// box filter
+	// ---------------------------------------------------------------------------------------------
+
+	template <typename Sum, typename Out>
+	void halveRow(const Sum* sums, Out* dst, int srcWidth, int dstWidth, int channels) {
+		for (int x = 0; x < dstWidth; x++) {
+			int x0 = 2 * x, x1 = std::min(2 * x + 1, srcWidth - 1);
+			for (int c = 0; c < channels; c++)
+				dst[x * channels + c] = (Out)((sums[x0 * channels + c] + sums[x1 * channels + c] + 2) >> 2);
+		}
+	}
+
+	void halveRow(const float* sums, float* dst, int srcWidth, int dstWidth, int channels) {
+		for (int x = 0; x < dstWidth; x++) {
+			int x0 = 2 * x, x1 = std::min(2 * x + 1, srcWidth - 1);
+			for (int c = 0; c < channels; c++)
+				dst[x * channels + c] = (sums[x0 * channels + c] + sums[x1 * channels + c]) * 0.25f;
+		}
+	}
+
+	void boxSrgbRows(const LevelJob& job, int yBegin, int yEnd) {
+		const SrgbTables& tables = srgbTables();
+		int channels = job.channels;
+		size_t srcStride = (size_t)job.srcWidth * channels;
+		for (int y = yBegin; y < yEnd; y++) {
+			const uint8_t* r0 = job.src + (size_t)(2 * y) * srcStride;
+			const uint8_t* r1 = job.src + (size_t)std::min(2 * y + 1, job.srcHeight - 1) * srcStride;
+			uint8_t* out = job.dst + (size_t)y * job.dstWidth * channels;
+			for (int x = 0; x < job.dstWidth; x++) {
+				int x0 = 2 * x * channels, x1 = std::min(2 * x + 1, job.srcWidth - 1) * channels;
+				for (int c = 0; c < channels; c++) {
+					if (isAlpha(c, channels)) {
+						out[x * channels + c] = (uint8_t)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+					}
+					else {
+						float sum = tables.toLinear[r0[x0 + c]] + tables.toLinear[r0[x1 + c]] +
+							tables.toLinear[r1[x0 + c]] + tables.toLinear[r1[x1 + c]];
+						out[x * channels + c] = encodeSrgb(sum * 0.25f);
+					}
+				}
+			}
+		}
+	}
+
+	void boxRows(const LevelJob& job, int yBegin, int yEnd) {
+		if (job.type == MIP_UNSIGNED_BYTE && job.srgb) {
+			boxSrgbRows(job, yBegin, yEnd);
+			return;
+		}
+		const Kernels& k = kernels();
+		int channels = job.channels;
+		size_t count = (size_t)job.srcWidth * channels;
+		size_t rowBytes = count * typeSize(job.type);
+		size_t dstRowBytes = (size_t)job.dstWidth * channels * typeSize(job.type);
+		std::vector<uint32_t> sums32;
+		std::vector<uint16_t> sums16;
+		std::vector<float> sumsF;
+		for (int y = yBegin; y < yEnd; y++) {
+			const unsigned char* r0 = job.src + (size_t)(2 * y) * rowBytes;
+			const unsigned char* r1 = job.src + (size_t)std::min(2 * y + 1, job.srcHeight - 1) * rowBytes;
+			unsigned char* out = job.dst + (size_t)y * dstRowBytes;
+			switch (job.type) {
+			case MIP_UNSIGNED_BYTE:
+				sums16.resize(count);
+				k.sumRowsU8(r0, r1, sums16.data(), count);
+				if (channels == 4 && job.srcWidth >= 2)
+					k.halveU8x4(sums16.data(), out, job.dstWidth);
+				else
+					halveRow(sums16.data(), (uint8_t*)out, job.srcWidth, job.dstWidth, channels);
+				break;
+			case MIP_UNSIGNED_SHORT:
+				sums32.resize(count);
+				k.sumRowsU16((const uint16_t*)r0, (const uint16_t*)r1, sums32.data(), count);
+				halveRow(sums32.data(), (uint16_t*)out, job.srcWidth, job.dstWidth, channels);
+				break;
+			case MIP_FLOAT:
+				sumsF.resize(count);
+				k.sumRowsF32((const float*)r0, (const float*)r1, sumsF.data(), count);
+				halveRow(sumsF.data(), (float*)out, job.srcWidth, job.dstWidth, channels);
+				break;
+			}
+		}
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// Kaiser filter: separable, in float, horizontal pass over the needed source rows then vertical
+	// ---------------------------------------------------------------------------------------------
+
+	const int kaiserTaps = 8;
+
+	// weights for the source pixels 2x-3 .. 2x+4 around the destination pixel centre at 2x+0.5
+	struct KaiserWeights {
+		float w[kaiserTaps];
+
+		static double besselI0(double x) {
+			double sum = 1.0, term = 1.0;
+			for (int k = 1; k < 32; k++) {
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+			}
+			return sum;
+		}
+
+		KaiserWeights() {
+			const double alpha = 4.0, radius = 4.0, pi = 3.14159265358979323846;
+			double total = 0.0;
+			for (int t = 0; t < kaiserTaps; t++) {
+				double d = t - 3.5;
+				// low pass at half the source rate: sinc(d / 2)
+				double x = pi * d * 0.5;
+				double sinc = x == 0.0 ? 1.0 : std::sin(x) / x;
+				double r = d / radius;
+				double window = besselI0(alpha * std::sqrt(std::max(0.0, 1.0 - r * r))) / besselI0(alpha);
+				w[t] = (float)(sinc * window);
+				total += w[t];
+			}
+			for (int t = 0; t < kaiserTaps; t++)
+				w[t] = (float)(w[t] / total);
+		}
+	};
+
+	const KaiserWeights& kaiserWeights() {
+		static const KaiserWeights weights;
+		return weights;
+	}
+
+	void toFloatRow(const LevelJob& job, int y, float* row) {
+		size_t count = (size_t)job.srcWidth * job.channels;
+		const SrgbTables& tables = srgbTables();
+		switch (job.type) {
+		case MIP_UNSIGNED_BYTE: {
+			const uint8_t* src = job.src + (size_t)y * count;
+			for (size_t i = 0; i < count; i++)
+				row[i] = job.srgb && !isAlpha((int)(i % job.channels), job.channels) ? tables.toLinear[src[i]] : src[i] / 255.0f;
+			break;
+		}
+		case MIP_UNSIGNED_SHORT: {
+			const uint16_t* src = (const uint16_t*)job.src + (size_t)y * count;
+			for (size_t i = 0; i < count; i++)
+				row[i] = src[i] / 65535.0f;
+			break;
+		}
+		case MIP_FLOAT:
+			std::memcpy(row, (const float*)job.src + (size_t)y * count, count * sizeof(float));
+			break;
+		}
+	}
+
+	void fromFloatRow(const LevelJob& job, int y, const float* row) {
+		size_t count = (size_t)job.dstWidth * job.channels;
+		switch (job.type) {
+		case MIP_UNSIGNED_BYTE: {
+			uint8_t* dst = job.dst + (size_t)y * count;
+			for (size_t i = 0; i < count; i++) {
+				if (job.srgb && !isAlpha((int)(i % job.channels), job.channels))
+					dst[i] = encodeSrgb(row[i]);
+				else
+					dst[i] = (uint8_t)(std::min(std::max(row[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+			}
+			break;
+		}
+		case MIP_UNSIGNED_SHORT: {
+			uint16_t* dst = (uint16_t*)job.dst + (size_t)y * count;
+			for (size_t i = 0; i < count; i++)
+				dst[i] = (uint16_t)(std::min(std::max(row[i], 0.0f), 1.0f) * 65535.0f + 0.5f);
+			break;
+		}
+		case MIP_FLOAT: {
+			// the negative lobes can ring below zero next to bright HDR pixels
+			float* dst = (float*)job.dst + (size_t)y * count;
+			for (size_t i = 0; i < count; i++)
+				dst[i] = std::max(row[i], 0.0f);
+			break;
+		}
+		}
+	}
+
+	void kaiserRows(const LevelJob& job, int yBegin, int yEnd) {
+		const float* w = kaiserWeights().w;
+		int channels = job.channels;
+		size_t srcCount = (size_t)job.srcWidth * channels;
+		size_t dstCount = (size_t)job.dstWidth * channels;
+		// source rows this band reads, filtered horizontally once each
+		int firstRow = std::max(2 * yBegin - 3, 0);
+		int lastRow = std::min(2 * (yEnd - 1) + 4, job.srcHeight - 1);
+		std::vector<float> row(srcCount);
+		std::vector<float> horizontal((size_t)(lastRow - firstRow + 1) * dstCount);
+		for (int y = firstRow; y <= lastRow; y++) {
+			toFloatRow(job, y, row.data());
+			float* out = horizontal.data() + (size_t)(y - firstRow) * dstCount;
+			for (int x = 0; x < job.dstWidth; x++) {
+				for (int c = 0; c < channels; c++) {
+					float sum = 0.0f;
+					for (int t = 0; t < kaiserTaps; t++) {
+						int sx = std::min(std::max(2 * x - 3 + t, 0), job.srcWidth - 1);
+						sum += w[t] * row[(size_t)sx * channels + c];
+					}
+					out[(size_t)x * channels + c] = sum;
+				}
+			}
+		}
+		std::vector<float> result(dstCount);
+		for (int y = yBegin; y < yEnd; y++) {
+			std::fill(result.begin(), result.end(), 0.0f);
+			for (int t = 0; t < kaiserTaps; t++) {
+				int sy = std::min(std::max(2 * y - 3 + t, 0), job.srcHeight - 1);
+				const float* in = horizontal.data() + (size_t)(sy - firstRow) * dstCount;
+				for (size_t i = 0; i < dstCount; i++)
+					result[i] += w[t] * in[i];
+			}
+			fromFloatRow(job, y, result.data());
+		}
+	}
+
+	// below this many destination values a level is not worth splitting across threads
+	const size_t parallelThreshold = 1 << 16;
+
+	void runLevel(const LevelJob& job, MipFilter filter, ThreadPool* pool) {
+		void (*rows)(const LevelJob&, int, int) = filter == MIP_KAISER ? kaiserRows : boxRows;
+		size_t values = (size_t)job.dstWidth * job.dstHeight * job.channels;
+		if (!pool || values < parallelThreshold || job.dstHeight < 2) {
+			rows(job, 0, job.dstHeight);
+			return;
+		}
+		// one band per worker plus one for this thread
+		int bands = std::min((int)pool->size() + 1, job.dstHeight);
+		std::vector<std::future<void>> running;
+		for (int band = 1; band < bands; band++) {
+			int begin = job.dstHeight * band / bands, end = job.dstHeight * (band + 1) / bands;
+			running.push_back(pool->submit([&job, rows, begin, end]() { rows(job, begin, end); }));
+		}
+		rows(job, 0, job.dstHeight / bands);
+		for (std::future<void>& band : running)
+			band.get();
+	}
+}
+
+void MipChain::useSimd(bool enabled) {
+	simdEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool MipChain::build(const void* pixels, int width, int height, int channels, MipType type,
+	MipFilter filter, bool srgb, ThreadPool* pool) {
+	chain.clear();
+	storage.clear();
+	base = pixels;
+	this->channels = channels;
+	this->type = type;
+	if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+		std::cout << "ERROR::MIPMAP::INVALID_IMAGE" << std::endl;
+		return false;
+	}
+
+	size_t pixelSize = typeSize(type) * channels;
+	chain.push_back(Level{ width, height, 0 });
+	size_t total = 0;
+	while (width > 1 || height > 1) {
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+		chain.push_back(Level{ width, height, total });
+		total += (size_t)width * height * pixelSize;
+	}
+	storage.resize(total);
+
+	// a level is computed from the one before it, the rows of a level in parallel
+	for (size_t i = 1; i < chain.size(); i++) {
+		LevelJob job;
+		job.src = (const unsigned char*)data((int)i - 1);
+		job.srcWidth = chain[i - 1].width;
+		job.srcHeight = chain[i - 1].height;
+		job.dst = storage.data() + chain[i].offset;
+		job.dstWidth = chain[i].width;
+		job.dstHeight = chain[i].height;
+		job.channels = channels;
+		job.type = type;
+		job.srgb = srgb && type == MIP_UNSIGNED_BYTE;
+		runLevel(job, filter, pool);
+	}
+	return true;
+}
+
+const void* MipChain::data(int i) const {
+	return i == 0 ? base : storage.data() + chain[i].offset;
+}
+
+void MipChain::upload(GLenum target, GLint internalFormat) const {
+	static const GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	GLenum format = formats[channels - 1];
+	GLenum glType = type == MIP_UNSIGNED_BYTE ? GL_UNSIGNED_BYTE : type == MIP_UNSIGNED_SHORT ? GL_UNSIGNED_SHORT : GL_FLOAT;
+	// levels are tightly packed, GL expects 4 byte aligned rows by default
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < levels(); i++)
+		glTexImage2D(target, i, internalFormat, chain[i].width, chain[i].height, 0, format, glType, data(i));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
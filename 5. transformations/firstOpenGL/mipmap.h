@@ -0,0 +1,54 @@
+#pragma once
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+enum MipType { MIP_UNSIGNED_BYTE, MIP_UNSIGNED_SHORT, MIP_FLOAT };
+// BOX: 2x2 average, what drivers usually do. KAISER: 8 tap Kaiser windowed sinc, sharper, less aliasing
+enum MipFilter { MIP_BOX, MIP_KAISER };
+
+// mip chain computed on the CPU from the pixels stb_image returns
+// (stbi_load: unsigned char, stbi_load_16: unsigned short, stbi_loadf: float), 1 to 4 interleaved channels
+// every level is half the previous one rounded down, down to 1x1
+// box filtering of 8 bit, 16 bit and float images runs on SSE2, or AVX2 when the CPU has it
+class MipChain {
+public:
+	struct Level {
+		int width;
+		int height;
+		size_t offset;
+	};
+
+	MipChain() {}
+
+	// level 0 is not copied, pixels must stay valid as long as data(0) and upload() are used
+	// srgb: 8 bit colour channels are sRGB encoded and averaged in linear space (alpha stays linear)
+	// with a pool the rows of each large level are split across the workers and the call waits for them,
+	// never pass the pool this call is running on
+	bool build(const void* pixels, int width, int height, int channels, MipType type,
+		MipFilter filter = MIP_BOX, bool srgb = false, ThreadPool* pool = nullptr);
+
+	int levels() const { return (int)chain.size(); }
+	const Level& level(int i) const { return chain[i]; }
+	const void* data(int i) const;
+
+	// glTexImage2D for every level of the texture bound to target
+	void upload(GLenum target, GLint internalFormat) const;
+
+	// false forces the scalar kernels, to compare against the SIMD ones
+	static void useSimd(bool enabled);
+
+private:
+	const void* base = nullptr;
+	std::vector<Level> chain;
+	std::vector<unsigned char> storage;
+	int channels = 0;
+	MipType type = MIP_UNSIGNED_BYTE;
+};
+
+#endif
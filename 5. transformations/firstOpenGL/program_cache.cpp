@@ -0,0 +1,184 @@
+#include "program_cache.h"
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+	// layout of the header written in front of every cached binary
+	struct BinaryHeader {
+		char magic[4];
+		std::uint32_t format;
+		std::uint32_t length;
+		std::uint32_t reserved;
+		std::uint64_t key;
+	};
+	const char binaryMagic[4] = { 'G', 'L', 'P', 'B' };
+
+	// 64-bit FNV-1a, continued across several strings
+	std::uint64_t hashString(const std::string& text, std::uint64_t hash) {
+		for (unsigned char c : text) {
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		// separator so ("ab", "c") and ("a", "bc") differ
+		hash ^= 0xff;
+		hash *= 1099511628211ull;
+		return hash;
+	}
+
+	std::string glString(GLenum name) {
+		const GLubyte* value = glGetString(name);
+		return value ? (const char*)value : "";
+	}
+}
+
+ProgramCache::ProgramCache(const std::string& directory) : directory(directory) {
+}
+
+bool ProgramCache::load(GLADloadproc loader) {
+	getProgramBinary = (PROGRAMCACHE_GETPROGRAMBINARY)loader("glGetProgramBinary");
+	programBinary = (PROGRAMCACHE_PROGRAMBINARY)loader("glProgramBinary");
+	programParameteri = (PROGRAMCACHE_PROGRAMPARAMETERI)loader("glProgramParameteri");
+	enabled = false;
+	if (!getProgramBinary || !programBinary || !programParameteri)
+		return false;
+
+	// a driver may expose the entry points and still support no formats
+	int formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0)
+		return false;
+
+	driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	enabled = true;
+	return true;
+}
+
+std::uint64_t ProgramCache::key(const std::string& vertexCode, const std::string& fragmentCode) const {
+	std::uint64_t hash = 14695981039346656037ull;
+	hash = hashString(driver, hash);
+	hash = hashString(vertexCode, hash);
+	hash = hashString(fragmentCode, hash);
+	return hash;
+}
+
+std::uint64_t ProgramCache::key(std::uint64_t vertexHash, std::uint64_t fragmentHash) const {
+	std::uint64_t hash = 14695981039346656037ull;
+	hash = hashString(driver, hash);
+	for (int i = 0; i < 8; i++)
+		hash = (hash ^ ((vertexHash >> (i * 8)) & 0xff)) * 1099511628211ull;
+	for (int i = 0; i < 8; i++)
+		hash = (hash ^ ((fragmentHash >> (i * 8)) & 0xff)) * 1099511628211ull;
+	return hash;
+}
+
+std::string ProgramCache::pathFor(std::uint64_t programKey) const {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)programKey);
+	return directory + "/" + name;
+}
+
+unsigned int ProgramCache::loadProgram(std::uint64_t programKey) {
+	if (!enabled)
+		return 0;
+
+	std::string path = pathFor(programKey);
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	std::streamoff fileSize = file ? (std::streamoff)file.tellg() : 0;
+	BinaryHeader header;
+	if (!file || !file.seekg(0) || !file.read((char*)&header, sizeof(header)) ||
+		std::memcmp(header.magic, binaryMagic, sizeof(binaryMagic)) != 0 || header.key != programKey) {
+		counters.misses++;
+		return 0;
+	}
+	// the length comes from the file, a truncated or corrupt one must not ask for gigabytes
+	if (header.length == 0 || (std::streamoff)header.length > fileSize - (std::streamoff)sizeof(header)) {
+		counters.misses++;
+		return 0;
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size())) {
+		counters.misses++;
+		return 0;
+	}
+	file.close();
+
+	unsigned int program = glCreateProgram();
+	programBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+	// a driver update can invalidate binaries even when the version string did not change
+	int success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(program);
+		std::remove(path.c_str());
+		counters.rejected++;
+		counters.misses++;
+		return 0;
+	}
+	counters.hits++;
+	return program;
+}
+
+void ProgramCache::prepareProgram(unsigned int program) const {
+	if (enabled)
+		programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::storeProgram(std::uint64_t programKey, unsigned int program) {
+	if (!enabled)
+		return;
+
+	int length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	getProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+		return;
+
+	BinaryHeader header;
+	std::memcpy(header.magic, binaryMagic, sizeof(binaryMagic));
+	header.format = format;
+	header.length = (std::uint32_t)written;
+	header.reserved = 0;
+	header.key = programKey;
+
+	// written to a temporary file first and renamed, a reader never sees half a binary
+	std::string path = pathFor(programKey);
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (file) {
+			file.write((const char*)&header, sizeof(header));
+			file.write(binary.data(), written);
+		}
+		if (!file) {
+			std::cout << "ERROR::PROGRAM_CACHE::FILE_NOT_SUCCESFULLY_WRITTEN" << std::endl;
+			file.close();
+			std::remove(temporary.c_str());
+			return;
+		}
+	}
+	// rename does not replace an existing file on Windows
+	std::remove(path.c_str());
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+		std::remove(temporary.c_str());
+		return;
+	}
+	counters.stored++;
+}
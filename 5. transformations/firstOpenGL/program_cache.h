@@ -0,0 +1,68 @@
+#pragma once
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <string>
+#include <cstdint>
+
+// glad is generated for GL 4.0 core, program binaries are GL 4.1 / ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+
+typedef void (APIENTRYP PROGRAMCACHE_GETPROGRAMBINARY)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PROGRAMCACHE_PROGRAMBINARY)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PROGRAMCACHE_PROGRAMPARAMETERI)(GLuint program, GLenum pname, GLint value);
+
+// on-disk cache of linked program binaries
+// a program is keyed by a hash of its stage sources and the driver's vendor/renderer/version strings,
+// so a driver update or any source/#define change misses instead of loading a stale binary
+class ProgramCache {
+public:
+	struct Stats {
+		unsigned int hits = 0;
+		unsigned int misses = 0;
+		// binaries found on disk but refused by glProgramBinary
+		unsigned int rejected = 0;
+		unsigned int stored = 0;
+	};
+
+	explicit ProgramCache(const std::string& directory);
+
+	// load the program binary entry points with the same loader given to gladLoadGLLoader
+	// returns false (and the cache stays disabled) if the driver supports no binary formats
+	bool load(GLADloadproc loader);
+	bool available() const { return enabled; }
+
+	// key for a program built from the given stage sources
+	std::uint64_t key(const std::string& vertexCode, const std::string& fragmentCode) const;
+	// same, from the content hashes of already assembled stages (see StageSource)
+	std::uint64_t key(std::uint64_t vertexHash, std::uint64_t fragmentHash) const;
+
+	// create a program from a cached binary, 0 on a miss or if the driver rejected the binary
+	unsigned int loadProgram(std::uint64_t programKey);
+	// call before glLinkProgram so the driver keeps the binary around
+	void prepareProgram(unsigned int program) const;
+	// write a successfully linked program to the cache
+	void storeProgram(std::uint64_t programKey, unsigned int program);
+
+	const Stats& stats() const { return counters; }
+
+private:
+	std::string directory;
+	std::string driver;
+	bool enabled = false;
+	Stats counters;
+
+	PROGRAMCACHE_GETPROGRAMBINARY getProgramBinary = nullptr;
+	PROGRAMCACHE_PROGRAMBINARY programBinary = nullptr;
+	PROGRAMCACHE_PROGRAMPARAMETERI programParameteri = nullptr;
+
+	std::string pathFor(std::uint64_t programKey) const;
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "shader_batch.h"
+#include "thread_pool.h"
+#include "program_cache.h"
+#include "shader_source.h"
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	struct Source {
+		StageSource stage;
+		double readMs = 0.0;
+	};
+
+	Source readOnWorker(ShaderSources* sources, const std::string& path, const std::vector<std::string>& defines) {
+		Source source;
+		Clock::time_point start = Clock::now();
+		source.stage = sources->assemble(path, defines);
+		source.readMs = millisecondsSince(start);
+		return source;
+	}
+
+	// everything in flight for one program between submission and the final status checks
+	struct Pending {
+		std::future<Source> vertexSource;
+		std::future<Source> fragmentSource;
+		unsigned int vertex = 0;
+		unsigned int fragment = 0;
+		unsigned int program = 0;
+		std::uint64_t key = 0;
+		Clock::time_point compileStart;
+		Clock::time_point linkStart;
+		// without parallel compilation: time spent in this program's compile and link calls so far
+		double compileCallsMs = 0.0;
+		double linkCallsMs = 0.0;
+		bool vertexDone = false;
+		bool fragmentDone = false;
+		bool linkDone = false;
+	};
+
+	bool hasExtension(const char* name) {
+		int count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (int i = 0; i < count; i++) {
+			const GLubyte* extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (extension && std::strcmp((const char*)extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+ShaderBatch::ShaderBatch(ThreadPool& pool, ProgramCache* cache, ShaderSources* sources)
+	: pool(pool), cache(cache), sources(sources) {
+	if (!sources) {
+		ownedSources.reset(new ShaderSources());
+		this->sources = ownedSources.get();
+	}
+}
+
+ShaderBatch::~ShaderBatch() {
+}
+
+bool ShaderBatch::load(GLADloadproc loader) {
+	maxCompilerThreads = nullptr;
+	if (hasExtension("GL_KHR_parallel_shader_compile"))
+		maxCompilerThreads = (SHADERBATCH_MAXSHADERCOMPILERTHREADS)loader("glMaxShaderCompilerThreadsKHR");
+	else if (hasExtension("GL_ARB_parallel_shader_compile"))
+		maxCompilerThreads = (SHADERBATCH_MAXSHADERCOMPILERTHREADS)loader("glMaxShaderCompilerThreadsARB");
+	if (!maxCompilerThreads)
+		return false;
+	// 0xFFFFFFFF: let the driver use as many compiler threads as it likes
+	maxCompilerThreads(0xFFFFFFFFu);
+	return true;
+}
+
+size_t ShaderBatch::add(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines) {
+	entries.push_back(Entry{ vertexPath, fragmentPath, defines });
+	return entries.size() - 1;
+}
+
+std::vector<Shader> ShaderBatch::build() {
+	std::vector<Pending> pending(entries.size());
+	programStats.assign(entries.size(), ProgramStats());
+
+	// 1. map and preprocess every source file on the worker threads
+	for (size_t i = 0; i < entries.size(); i++) {
+		ShaderSources* sources = this->sources;
+		const Entry& entry = entries[i];
+		pending[i].vertexSource = pool.submit([sources, entry]() { return readOnWorker(sources, entry.vertexPath, entry.defines); });
+		pending[i].fragmentSource = pool.submit([sources, entry]() { return readOnWorker(sources, entry.fragmentPath, entry.defines); });
+	}
+
+	// 2. submit both stages of each program as soon as its files are in, no status queries
+	// a stage with the same content as one submitted before is not compiled again
+	for (size_t i = 0; i < entries.size(); i++) {
+		Pending& p = pending[i];
+		Source vertexSource = p.vertexSource.get();
+		Source fragmentSource = p.fragmentSource.get();
+		programStats[i].readMs = vertexSource.readMs + fragmentSource.readMs;
+		if (!vertexSource.stage.valid || !fragmentSource.stage.valid) {
+			p.linkDone = true;
+			continue;
+		}
+
+		if (cache && cache->available()) {
+			p.key = cache->key(vertexSource.stage.hash, fragmentSource.stage.hash);
+			p.program = cache->loadProgram(p.key);
+			if (p.program) {
+				programStats[i].fromCache = true;
+				programStats[i].success = true;
+				p.linkDone = true;
+				continue;
+			}
+		}
+
+		bool isNew;
+		p.compileStart = Clock::now();
+		p.vertex = sources->submit(GL_VERTEX_SHADER, vertexSource.stage, isNew);
+		p.fragment = sources->submit(GL_FRAGMENT_SHADER, fragmentSource.stage, isNew);
+		p.compileCallsMs = millisecondsSince(p.compileStart);
+	}
+
+	// 3. submit every link, still without waiting on any compile
+	for (size_t i = 0; i < pending.size(); i++) {
+		Pending& p = pending[i];
+		if (p.linkDone)
+			continue;
+		p.program = glCreateProgram();
+		glAttachShader(p.program, p.vertex);
+		glAttachShader(p.program, p.fragment);
+		if (cache)
+			cache->prepareProgram(p.program);
+		p.linkStart = Clock::now();
+		glLinkProgram(p.program);
+		p.linkCallsMs = millisecondsSince(p.linkStart);
+	}
+
+	// 4. with parallel compilation, poll the non-blocking completion status to time each program
+	// without it the first status query below blocks until the driver is done with that program
+	if (parallelCompile()) {
+		bool waiting = true;
+		while (waiting) {
+			waiting = false;
+			for (size_t i = 0; i < pending.size(); i++) {
+				Pending& p = pending[i];
+				if (p.linkDone)
+					continue;
+				int done = 0;
+				if (!p.vertexDone || !p.fragmentDone) {
+					if (!p.vertexDone)
+						glGetShaderiv(p.vertex, GL_COMPLETION_STATUS_KHR, &done);
+					p.vertexDone = p.vertexDone || done;
+					done = 0;
+					if (!p.fragmentDone)
+						glGetShaderiv(p.fragment, GL_COMPLETION_STATUS_KHR, &done);
+					p.fragmentDone = p.fragmentDone || done;
+					if (p.vertexDone && p.fragmentDone)
+						programStats[i].compileMs = millisecondsSince(p.compileStart);
+				}
+				done = 0;
+				glGetProgramiv(p.program, GL_COMPLETION_STATUS_KHR, &done);
+				if (done) {
+					programStats[i].linkMs = millisecondsSince(p.linkStart);
+					if (!p.vertexDone || !p.fragmentDone)
+						programStats[i].compileMs = programStats[i].linkMs;
+					p.linkDone = true;
+				}
+				else {
+					waiting = true;
+				}
+			}
+			if (waiting)
+				std::this_thread::yield();
+		}
+	}
+
+	// 5. deferred status queries and error reporting, once per compiled stage
+	std::vector<Shader> shaders;
+	shaders.reserve(pending.size());
+	std::map<unsigned int, bool> stageStatus;
+	for (size_t i = 0; i < pending.size(); i++) {
+		Pending& p = pending[i];
+		if (p.vertex) {
+			// the first status query of a stage blocks until the driver compiled it
+			Clock::time_point queryStart = Clock::now();
+			if (!stageStatus.count(p.vertex))
+				stageStatus[p.vertex] = sources->checkCompiled(p.vertex, entries[i].vertexPath);
+			if (!stageStatus.count(p.fragment))
+				stageStatus[p.fragment] = sources->checkCompiled(p.fragment, entries[i].fragmentPath);
+			bool compiled = stageStatus[p.vertex] && stageStatus[p.fragment];
+			if (!parallelCompile())
+				programStats[i].compileMs = p.compileCallsMs + millisecondsSince(queryStart);
+
+			int success;
+			char infoLog[512];
+			queryStart = Clock::now();
+			glGetProgramiv(p.program, GL_LINK_STATUS, &success);
+			if (!parallelCompile())
+				programStats[i].linkMs = p.linkCallsMs + millisecondsSince(queryStart);
+			if (!success) {
+				glGetProgramInfoLog(p.program, 512, NULL, infoLog);
+				std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED " << entries[i].vertexPath << "\n" <<
+					infoLog << std::endl;
+			}
+			else if (cache) {
+				cache->storeProgram(p.key, p.program);
+			}
+			programStats[i].success = compiled && success;
+		}
+		shaders.emplace_back(p.program);
+	}
+	// the stages are linked into the programs, only a caller's ShaderSources keeps them for later
+	if (ownedSources)
+		sources->release();
+	entries.clear();
+	return shaders;
+}
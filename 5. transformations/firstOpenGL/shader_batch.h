@@ -0,0 +1,74 @@
+#pragma once
+#ifndef SHADER_BATCH_H
+#define SHADER_BATCH_H
+
+#include <glad/glad.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "shader_s.h"
+
+// KHR_parallel_shader_compile (also exposed as ARB_parallel_shader_compile)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP SHADERBATCH_MAXSHADERCOMPILERTHREADS)(GLuint count);
+
+class ThreadPool;
+class ProgramCache;
+class ShaderSources;
+
+// builds many programs at once
+// every stage of every program is submitted before the first status query, so a driver
+// with parallel shader compilation can work on all of them while the render thread keeps going
+class ShaderBatch {
+public:
+	// milliseconds. with parallel compilation: latency from submission until the driver reported completion
+	// without it the driver only finishes a program when asked, and the time the later programs' queries wait
+	// includes the earlier ones: the time spent in this program's own calls instead, submission plus the
+	// first status query that waits for it (a stage shared with an earlier program costs it nothing)
+	struct ProgramStats {
+		double readMs = 0.0;
+		double compileMs = 0.0;
+		double linkMs = 0.0;
+		bool fromCache = false;
+		bool success = false;
+	};
+
+	// without a ShaderSources the batch uses its own and deletes the compiled stages after linking,
+	// with one the stages stay compiled in it for programs built later
+	explicit ShaderBatch(ThreadPool& pool, ProgramCache* cache = nullptr, ShaderSources* sources = nullptr);
+	~ShaderBatch();
+
+	// enable KHR_parallel_shader_compile if the driver has it, with the loader given to gladLoadGLLoader
+	bool load(GLADloadproc loader);
+	bool parallelCompile() const { return maxCompilerThreads != nullptr; }
+
+	// queue a program, returns its index in the vector returned by build()
+	size_t add(const char* vertexPath, const char* fragmentPath,
+		const std::vector<std::string>& defines = std::vector<std::string>());
+
+	// map and preprocess every file on the pool, compile and link everything, then check the results
+	// failed programs are still returned, with an unusable program ID, and reported in stats()
+	std::vector<Shader> build();
+
+	const std::vector<ProgramStats>& stats() const { return programStats; }
+
+private:
+	struct Entry {
+		std::string vertexPath;
+		std::string fragmentPath;
+		std::vector<std::string> defines;
+	};
+
+	ThreadPool& pool;
+	ProgramCache* cache;
+	ShaderSources* sources;
+	std::unique_ptr<ShaderSources> ownedSources;
+	std::vector<Entry> entries;
+	std::vector<ProgramStats> programStats;
+	SHADERBATCH_MAXSHADERCOMPILERTHREADS maxCompilerThreads = nullptr;
+};
+
+#endif
@@ -0,0 +1,325 @@
+#include "shader_reload.h"
+#include "shader_s.h"
+#include "shader_source.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+	std::string directoryOf(const std::string& path) {
+		size_t slash = path.find_last_of('/');
+		return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+	}
+
+	// glUniform* by type, for copying a value read back with glGetUniform*
+	void setFloats(GLenum type, int location, const float* v) {
+		switch (type) {
+		case GL_FLOAT: glUniform1fv(location, 1, v); break;
+		case GL_FLOAT_VEC2: glUniform2fv(location, 1, v); break;
+		case GL_FLOAT_VEC3: glUniform3fv(location, 1, v); break;
+		case GL_FLOAT_VEC4: glUniform4fv(location, 1, v); break;
+		case GL_FLOAT_MAT2: glUniformMatrix2fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT3: glUniformMatrix3fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT4: glUniformMatrix4fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT2x3: glUniformMatrix2x3fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT2x4: glUniformMatrix2x4fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT3x2: glUniformMatrix3x2fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT3x4: glUniformMatrix3x4fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT4x2: glUniformMatrix4x2fv(location, 1, GL_FALSE, v); break;
+		case GL_FLOAT_MAT4x3: glUniformMatrix4x3fv(location, 1, GL_FALSE, v); break;
+		}
+	}
+
+	bool isFloatType(GLenum type) {
+		switch (type) {
+		case GL_FLOAT: case GL_FLOAT_VEC2: case GL_FLOAT_VEC3: case GL_FLOAT_VEC4:
+		case GL_FLOAT_MAT2: case GL_FLOAT_MAT3: case GL_FLOAT_MAT4:
+		case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT3x2:
+		case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x2: case GL_FLOAT_MAT4x3:
+			return true;
+		}
+		return false;
+	}
+
+	// components of int-like uniforms, samplers count as one int, 0 for anything else
+	int intComponents(GLenum type) {
+		switch (type) {
+		case GL_INT: case GL_BOOL: case GL_UNSIGNED_INT:
+		case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+		case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_MULTISAMPLE:
+		case GL_SAMPLER_BUFFER: case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D:
+			return 1;
+		case GL_INT_VEC2: case GL_BOOL_VEC2: case GL_UNSIGNED_INT_VEC2: return 2;
+		case GL_INT_VEC3: case GL_BOOL_VEC3: case GL_UNSIGNED_INT_VEC3: return 3;
+		case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_UNSIGNED_INT_VEC4: return 4;
+		}
+		return 0;
+	}
+
+	bool isUnsignedType(GLenum type) {
+		return type == GL_UNSIGNED_INT || type == GL_UNSIGNED_INT_VEC2 || type == GL_UNSIGNED_INT_VEC3 ||
+			type == GL_UNSIGNED_INT_VEC4;
+	}
+
+	// arrays are reported as "name[0]"
+	std::string baseName(const char* name, int length) {
+		std::string base(name, length);
+		if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+			base.resize(base.size() - 3);
+		return base;
+	}
+}
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+	descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (descriptor < 0)
+		std::cout << "ERROR::FILE_WATCHER::INOTIFY_INIT_FAILED" << std::endl;
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (descriptor >= 0)
+		close(descriptor);
+#endif
+}
+
+void FileWatcher::watch(const std::string& path) {
+	if (!files.insert(path).second)
+		return;
+#ifdef __linux__
+	std::string directory = directoryOf(path);
+	if (descriptor < 0)
+		return;
+	for (const auto& entry : directories) {
+		if (entry.second == directory)
+			return;
+	}
+	// close-after-write for editors saving in place, moved-to for editors saving through a rename
+	int watchDescriptor = inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watchDescriptor >= 0)
+		directories[watchDescriptor] = directory;
+#else
+	struct stat info;
+	modified[path] = stat(path.c_str(), &info) == 0 ? (long long)info.st_mtime : 0;
+#endif
+}
+
+std::vector<std::string> FileWatcher::poll() {
+	std::set<std::string> changed;
+#ifdef __linux__
+	if (descriptor < 0)
+		return std::vector<std::string>();
+	alignas(struct inotify_event) char buffer[4096];
+	for (;;) {
+		ssize_t length = read(descriptor, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+		for (char* p = buffer; p < buffer + length;) {
+			const struct inotify_event* event = (const struct inotify_event*)p;
+			auto directory = directories.find(event->wd);
+			if (directory != directories.end() && event->len > 0) {
+				std::string path = directory->second == "." ? std::string(event->name) :
+					directory->second + "/" + event->name;
+				if (files.count(path))
+					changed.insert(path);
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+#else
+	// a few stat calls four times a second, not every frame
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - lastPoll < std::chrono::milliseconds(250))
+		return std::vector<std::string>();
+	lastPoll = now;
+	for (auto& entry : modified) {
+		struct stat info;
+		long long time = stat(entry.first.c_str(), &info) == 0 ? (long long)info.st_mtime : 0;
+		if (time != entry.second) {
+			entry.second = time;
+			changed.insert(entry.first);
+		}
+	}
+#endif
+	return std::vector<std::string>(changed.begin(), changed.end());
+}
+
+ShaderReloader::ShaderReloader(ShaderSources& sources) : sources(sources) {
+}
+
+void ShaderReloader::add(Shader& shader, const char* vertexPath, const char* fragmentPath,
+	const std::vector<std::string>& defines) {
+	Program program;
+	program.shader = &shader;
+	program.vertexPath = vertexPath;
+	program.fragmentPath = fragmentPath;
+	program.defines = defines;
+	// assembling again only walks the already mapped files to learn the include graph
+	StageSource vertexStage = sources.assemble(vertexPath, defines);
+	StageSource fragmentStage = sources.assemble(fragmentPath, defines);
+	program.files.insert(vertexStage.files.begin(), vertexStage.files.end());
+	program.files.insert(fragmentStage.files.begin(), fragmentStage.files.end());
+	program.vertex = sources.find(GL_VERTEX_SHADER, vertexStage);
+	program.fragment = sources.find(GL_FRAGMENT_SHADER, fragmentStage);
+	for (const std::string& file : program.files)
+		watcher.watch(file);
+	programs.push_back(program);
+}
+
+bool ShaderReloader::update() {
+	std::vector<std::string> changed = watcher.poll();
+	if (changed.empty())
+		return false;
+	for (const std::string& file : changed)
+		sources.invalidate(file);
+
+	bool swapped = false;
+	for (Program& program : programs) {
+		bool affected = false;
+		for (const std::string& file : changed)
+			affected = affected || program.files.count(file) > 0;
+		if (affected)
+			swapped = rebuild(program) || swapped;
+	}
+	return swapped;
+}
+
+bool ShaderReloader::rebuild(Program& program) {
+	StageSource vertexStage = sources.assemble(program.vertexPath, program.defines);
+	StageSource fragmentStage = sources.assemble(program.fragmentPath, program.defines);
+	// includes may have been added or removed
+	program.files.clear();
+	program.files.insert(vertexStage.files.begin(), vertexStage.files.end());
+	program.files.insert(fragmentStage.files.begin(), fragmentStage.files.end());
+	for (const std::string& file : program.files)
+		watcher.watch(file);
+	if (!vertexStage.valid || !fragmentStage.valid)
+		return false;
+
+	// the stage that did not change hits the compiled index, only the edited one is compiled
+	// a stage that fails to compile makes the link fail, the error is printed by compile()
+	unsigned int vertex = sources.compile(GL_VERTEX_SHADER, vertexStage);
+	unsigned int fragment = sources.compile(GL_FRAGMENT_SHADER, fragmentStage);
+	unsigned int replacement = glCreateProgram();
+	glAttachShader(replacement, vertex);
+	glAttachShader(replacement, fragment);
+	glLinkProgram(replacement);
+
+	int success;
+	char infoLog[512];
+	glGetProgramiv(replacement, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(replacement, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::RELOAD::LINKING_FAILED " << program.vertexPath << " (keeping the previous program)\n" <<
+			infoLog << std::endl;
+		glDeleteProgram(replacement);
+		// the broken stages are not kept, every save would add another one
+		if (vertex != program.vertex)
+			discardStage(program, vertex);
+		if (fragment != program.fragment)
+			discardStage(program, fragment);
+		return false;
+	}
+
+	unsigned int previous = program.shader->ID;
+	copyUniforms(previous, replacement);
+	program.shader->reset(replacement);
+	glDeleteProgram(previous);
+	// the stages of the previous version, otherwise every save keeps one more shader object
+	unsigned int previousVertex = program.vertex, previousFragment = program.fragment;
+	program.vertex = vertex;
+	program.fragment = fragment;
+	if (previousVertex != vertex)
+		discardStage(program, previousVertex);
+	if (previousFragment != fragment)
+		discardStage(program, previousFragment);
+	std::cout << "SHADER RELOADED: " << program.vertexPath << " " << program.fragmentPath << std::endl;
+	return true;
+}
+
+void ShaderReloader::discardStage(const Program& program, unsigned int stage) {
+	if (!stage)
+		return;
+	for (const Program& other : programs) {
+		if (&other != &program && (other.vertex == stage || other.fragment == stage))
+			return;
+	}
+	sources.discard(stage);
+}
+
+void ShaderReloader::copyUniforms(unsigned int from, unsigned int to) {
+	// glUniform* writes to the program in use
+	int current = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	glUseProgram(to);
+
+	// type and array size of every uniform of the new program, by name without "[0]"
+	// a uniform whose declaration changed is left at its default, the old value would go through the wrong glUniform*
+	std::map<std::string, std::pair<GLenum, int>> targets;
+	int count = 0, maxLength = 0;
+	glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(to, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength > 0 ? maxLength : 1);
+	for (int i = 0; i < count; i++) {
+		int length = 0, size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(to, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+		targets[baseName(name.data(), length)] = std::make_pair(type, size);
+	}
+
+	glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(from, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	name.resize(maxLength > 0 ? maxLength : 1);
+	for (int i = 0; i < count; i++) {
+		int length = 0, size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(from, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+		std::string base = baseName(name.data(), length);
+		auto target = targets.find(base);
+		if (target == targets.end() || target->second.first != type)
+			continue;
+		// an array that shrank keeps the elements it still has
+		size = std::min(size, target->second.second);
+
+		for (int element = 0; element < size; element++) {
+			std::string elementName = size > 1 ? base + "[" + std::to_string(element) + "]" : base;
+			int fromLocation = glGetUniformLocation(from, elementName.c_str());
+			int toLocation = glGetUniformLocation(to, elementName.c_str());
+			if (fromLocation < 0 || toLocation < 0)
+				continue;
+
+			if (isFloatType(type)) {
+				float value[16];
+				glGetUniformfv(from, fromLocation, value);
+				setFloats(type, toLocation, value);
+			}
+			else if (isUnsignedType(type)) {
+				GLuint value[4];
+				glGetUniformuiv(from, fromLocation, value);
+				int components = intComponents(type);
+				if (components == 1) glUniform1uiv(toLocation, 1, value);
+				else if (components == 2) glUniform2uiv(toLocation, 1, value);
+				else if (components == 3) glUniform3uiv(toLocation, 1, value);
+				else glUniform4uiv(toLocation, 1, value);
+			}
+			else if (int components = intComponents(type)) {
+				int value[4];
+				glGetUniformiv(from, fromLocation, value);
+				if (components == 1) glUniform1iv(toLocation, 1, value);
+				else if (components == 2) glUniform2iv(toLocation, 1, value);
+				else if (components == 3) glUniform3iv(toLocation, 1, value);
+				else glUniform4iv(toLocation, 1, value);
+			}
+		}
+	}
+	glUseProgram((unsigned int)current == from ? to : (unsigned int)current);
+}
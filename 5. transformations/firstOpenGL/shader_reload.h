@@ -0,0 +1,83 @@
+#pragma once
+#ifndef SHADER_RELOAD_H
+#define SHADER_RELOAD_H
+
+#include <glad/glad.h>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class Shader;
+class ShaderSources;
+
+// reports files that were written since the last poll
+// inotify on linux (one watch per directory, editors that save through a rename are seen too),
+// modification time polling elsewhere
+class FileWatcher {
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// path as produced by ShaderSources::normalizePath
+	void watch(const std::string& path);
+	// never blocks, each changed file is listed once
+	std::vector<std::string> poll();
+
+private:
+	std::set<std::string> files;
+#ifdef __linux__
+	int descriptor = -1;
+	// watch descriptor -> directory
+	std::map<int, std::string> directories;
+#else
+	std::map<std::string, long long> modified;
+	std::chrono::steady_clock::time_point lastPoll;
+#endif
+};
+
+// rebuilds shaders whose files change on disk while the program runs
+// only the stages whose text changed are compiled again (unchanged stages come from the
+// ShaderSources index), only the programs using a changed file are relinked,
+// and a program that fails to compile or link leaves the previous one in place
+class ShaderReloader {
+public:
+	// sources must be the one the shaders were built through, and must keep its compiled stages
+	explicit ShaderReloader(ShaderSources& sources);
+
+	// keep shader in sync with its files, the shader must outlive the reloader
+	void add(Shader& shader, const char* vertexPath, const char* fragmentPath,
+		const std::vector<std::string>& defines = std::vector<std::string>());
+
+	// call on the render thread between frames
+	// returns true if any program was swapped, uniform handles of that shader need to be looked up again
+	bool update();
+
+private:
+	struct Program {
+		Shader* shader;
+		std::string vertexPath;
+		std::string fragmentPath;
+		std::vector<std::string> defines;
+		std::set<std::string> files;
+		// the stages the current program is linked with, 0 when they are not in the ShaderSources index
+		unsigned int vertex = 0;
+		unsigned int fragment = 0;
+	};
+
+	ShaderSources& sources;
+	FileWatcher watcher;
+	std::vector<Program> programs;
+
+	bool rebuild(Program& program);
+	// discard a stage that program no longer uses, unless another watched program is linked with it
+	void discardStage(const Program& program, unsigned int stage);
+	// copy the current value of every uniform the two programs share
+	static void copyUniforms(unsigned int from, unsigned int to);
+};
+
+#endif
@@ -1,70 +1,60 @@
-#include <../../4. textures/firstOpenGL/shader_s.h>
+#include "shader_s.h"
+#include "program_cache.h"
+#include "shader_source.h"
+#include "glm/gtc/type_ptr.hpp"
+#include <map>
 
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-	// 1. retrieve the vertex/fragment source code from filePath
-	std::string vertexCode;
-	std::string fragmentCode;
+Shader::Shader(const char* vertexPath, const char* fragmentPath, ProgramCache* cache) {
+	// through ShaderSources as well, so files with #include "file" build here too
+	// the stages belong to this program alone and are deleted once it is linked
+	ShaderSources sources;
+	build(sources, vertexPath, fragmentPath, std::vector<std::string>(), cache);
+	sources.release();
+}
 
-	// input file streams
-	std::ifstream vShaderFile;
-	std::ifstream fShaderFile;
-	// ensure ifstream objects can throw exceptions:
-	vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-	try {
-		// open files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		std::stringstream vShaderStream, fShaderStream;
-		// read files buffer contents into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		// close file handlers
-		vShaderFile.close();
-		fShaderFile.close();
-		// convert stream into string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-	}
-	catch (std::ifstream::failure e){
-		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+Shader::Shader(ShaderSources& sources, const char* vertexPath, const char* fragmentPath,
+	const std::vector<std::string>& defines, ProgramCache* cache) {
+	build(sources, vertexPath, fragmentPath, defines, cache);
+}
+
+void Shader::build(ShaderSources& sources, const char* vertexPath, const char* fragmentPath,
+	const std::vector<std::string>& defines, ProgramCache* cache) {
+	// 1. map the files and resolve #includes, the text is handed to GL as pieces without copying
+	StageSource vertexStage = sources.assemble(vertexPath, defines);
+	StageSource fragmentStage = sources.assemble(fragmentPath, defines);
+	ID = 0;
+	if (!vertexStage.valid || !fragmentStage.valid)
+		return;
+
+	// 2. load a previously linked binary of the same sources
+	std::uint64_t programKey = 0;
+	if (cache && cache->available()) {
+		programKey = cache->key(vertexStage.hash, fragmentStage.hash);
+		ID = cache->loadProgram(programKey);
+		if (ID) {
+			cacheUniforms();
+			return;
+		}
 	}
-	const char* vShaderCode = vertexCode.c_str();
-	const char* fShaderCode = fragmentCode.c_str();
 
-	// 2. compile shaders
-	unsigned int vertex, fragment;
+	// 3. compile, stages already compiled for another program are reused
+	// the shader objects belong to sources and are not deleted here
+	unsigned int vertex = sources.compile(GL_VERTEX_SHADER, vertexStage);
+	unsigned int fragment = sources.compile(GL_FRAGMENT_SHADER, fragmentStage);
+	link(vertex, fragment, cache, programKey);
+
+	cacheUniforms();
+}
+
+void Shader::link(unsigned int vertex, unsigned int fragment, ProgramCache* cache, std::uint64_t programKey) {
 	int success;
 	char infoLog[512];
-	// vertex Shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	// print compile errors if any
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success){
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" <<
-			infoLog << std::endl;
-		infoLog[0] = '\0';
-	};
-	// similar for fragment shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	// print compile errors if any
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if (!success){
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" <<
-			infoLog << std::endl;
-		infoLog[0] = '\0';
-	};
-
 	ID = glCreateProgram();
 	glAttachShader(ID, vertex);
 	glAttachShader(ID, fragment);
+	if (cache)
+		cache->prepareProgram(ID);
 	glLinkProgram(ID);
 	// print linking errors if any
 	glGetProgramiv(ID, GL_LINK_STATUS, &success);
@@ -75,10 +65,47 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
 			infoLog << std::endl;
 		infoLog[0] = '\0';
 	}
-	// delete shaders; theyre linked into our program and no longer necessary
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
+	else if (cache) {
+		cache->storeProgram(programKey, ID);
+	}
+}
+
+Shader::Shader(unsigned int programID) : ID(programID) {
+	// 0: the program could not be built
+	if (ID)
+		cacheUniforms();
+}
+
+void Shader::reset(unsigned int programID) {
+	ID = programID;
+	cacheUniforms();
+	// block bindings are program state, the new program starts without them
+	std::vector<std::pair<std::string, size_t>> bound;
+	bound.swap(blocks);
+	for (const auto& block : bound)
+		bindBlock(block.first.c_str(), block.second);
+}
 
+bool Shader::readSource(const char* path, std::string& code) {
+	// input file stream
+	std::ifstream shaderFile;
+	// ensure ifstream objects can throw exceptions:
+	shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	try {
+		// open file
+		shaderFile.open(path);
+		std::stringstream shaderStream;
+		// read files buffer contents into stream
+		shaderStream << shaderFile.rdbuf();
+		// close file handler
+		shaderFile.close();
+		// convert stream into string
+		code = shaderStream.str();
+	}
+	catch (const std::ifstream::failure&) {
+		return false;
+	}
+	return true;
 }
 
 void Shader::use() {
@@ -86,18 +113,173 @@ void Shader::use() {
 }
 
 void Shader::setBool(const std::string& name, bool value) const {
-	// glGetUniformLocation: query for the location of the uniform with the given name
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	// uniformLocation: look the uniform up in the table built after linking
+	glUniform1i(uniformLocation(name.c_str()), (int)value);
 }
 
 void Shader::setInt(const std::string& name, int value) const {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1i(uniformLocation(name.c_str()), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	glUniform1f(uniformLocation(name.c_str()), value);
 }
 
 void Shader::setVec4(const std::string& name, float v0, float v1, float v2, float v3) const {
-	glUniform4f(glGetUniformLocation(ID, name.c_str()), v0, v1, v2, v3);
-}
\ No newline at end of file
+	glUniform4f(uniformLocation(name.c_str()), v0, v1, v2, v3);
+}
+
+void Shader::set(Uniform<bool> handle, bool value) const {
+	glUniform1i(handle.location, (int)value);
+}
+
+void Shader::set(Uniform<int> handle, int value) const {
+	glUniform1i(handle.location, value);
+}
+
+void Shader::set(Uniform<float> handle, float value) const {
+	glUniform1f(handle.location, value);
+}
+
+void Shader::set(Uniform<glm::vec4> handle, const glm::vec4& value) const {
+	glUniform4fv(handle.location, 1, glm::value_ptr(value));
+}
+
+void Shader::set(Uniform<glm::mat4> handle, const glm::mat4& value) const {
+	glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+unsigned int Shader::blockBinding(const std::string& blockName) {
+	static std::map<std::string, unsigned int> bindings;
+	auto found = bindings.find(blockName);
+	if (found != bindings.end())
+		return found->second;
+	unsigned int binding = (unsigned int)bindings.size();
+	bindings[blockName] = binding;
+	return binding;
+}
+
+bool Shader::bindBlock(const char* blockName, size_t expectedSize) {
+	unsigned int index = glGetUniformBlockIndex(ID, blockName);
+	if (index == GL_INVALID_INDEX) {
+		std::cout << "ERROR::SHADER::UNIFORM_BLOCK::NOT_FOUND " << blockName << std::endl;
+		return false;
+	}
+	if (expectedSize) {
+		// the buffer range bound to the block has to cover at least what the driver expects
+		int size = 0;
+		glGetActiveUniformBlockiv(ID, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+		if ((size_t)size > expectedSize) {
+			std::cout << "ERROR::SHADER::UNIFORM_BLOCK::SIZE_MISMATCH " << blockName << " GL: " << size <<
+				" C++: " << expectedSize << std::endl;
+			return false;
+		}
+	}
+	unsigned int binding = blockBinding(blockName);
+	int maxBindings = 0;
+	glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &maxBindings);
+	if ((int)binding >= maxBindings) {
+		std::cout << "ERROR::SHADER::UNIFORM_BLOCK::OUT_OF_BINDINGS " << blockName << std::endl;
+		return false;
+	}
+	glUniformBlockBinding(ID, index, binding);
+	for (const auto& block : blocks) {
+		if (block.first == blockName)
+			return true;
+	}
+	blocks.push_back(std::make_pair(std::string(blockName), expectedSize));
+	return true;
+}
+
+int Shader::uniformLocation(const char* name) const {
+	GLenum type;
+	return lookupUniform(name, type);
+}
+
+int Shader::uniformLocation(std::uint32_t nameHash) const {
+	const UniformSlot* slot = findUniform(nameHash);
+	return slot ? slot->location : -1;
+}
+
+const Shader::UniformSlot* Shader::findUniform(std::uint32_t nameHash) const {
+	if (uniforms.empty())
+		return nullptr;
+	size_t mask = uniforms.size() - 1;
+	for (size_t i = nameHash & mask; uniforms[i].used; i = (i + 1) & mask) {
+		if (uniforms[i].hash == nameHash)
+			return &uniforms[i];
+	}
+	return nullptr;
+}
+
+const Shader::UniformSlot* Shader::findUniform(const char* name) const {
+	if (uniforms.empty())
+		return nullptr;
+	std::uint32_t nameHash = uniformHash(name);
+	size_t mask = uniforms.size() - 1;
+	for (size_t i = nameHash & mask; uniforms[i].used; i = (i + 1) & mask) {
+		if (uniforms[i].hash == nameHash && uniforms[i].name == name)
+			return &uniforms[i];
+	}
+	return nullptr;
+}
+
+int Shader::lookupUniform(const char* name, GLenum& type) const {
+	const UniformSlot* slot = findUniform(name);
+	if (slot) {
+		type = slot->type;
+		return slot->location;
+	}
+	// array elements other than the first are not in the table, they have the type of their array
+	type = 0;
+	int location = glGetUniformLocation(ID, name);
+	if (location >= 0) {
+		std::string base(name);
+		size_t bracket = base.find('[');
+		if (bracket != std::string::npos) {
+			slot = findUniform(base.substr(0, bracket).c_str());
+			if (slot)
+				type = slot->type;
+		}
+	}
+	return location;
+}
+
+void Shader::cacheUniforms() {
+	// one driver round-trip per active uniform, here instead of every frame
+	int count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	// keep the table at most half full so probe sequences stay short
+	size_t capacity = 4;
+	while (capacity < (size_t)count * 2)
+		capacity *= 2;
+	uniforms.assign(capacity, UniformSlot());
+
+	std::vector<char> name(maxLength > 0 ? maxLength : 1);
+	for (int i = 0; i < count; i++) {
+		int length = 0, size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+		int location = glGetUniformLocation(ID, name.data());
+		// uniform arrays are reported as "name[0]", store them under their plain name
+		if (length > 3 && std::string(name.data() + length - 3) == "[0]")
+			name[length - 3] = '\0';
+		// uniforms inside uniform blocks have no location
+		if (location < 0)
+			continue;
+
+		std::uint32_t hash = uniformHash(name.data());
+		size_t mask = capacity - 1;
+		size_t slot = hash & mask;
+		// active names are unique, two of them with the same hash both get a slot and the name tells them apart
+		while (uniforms[slot].used)
+			slot = (slot + 1) & mask;
+		uniforms[slot].hash = hash;
+		uniforms[slot].location = location;
+		uniforms[slot].type = type;
+		uniforms[slot].used = true;
+		uniforms[slot].name = name.data();
+	}
+}
@@ -7,14 +7,48 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <cstdint>
+#include "glm/glm.hpp"
+
+// FNV-1a hash of a uniform name
+// constexpr so names known at compile time can be hashed once: uniformHash("transform")
+constexpr std::uint32_t uniformHash(const char* name, std::uint32_t hash = 2166136261u) {
+	return *name ? uniformHash(name + 1, (hash ^ (std::uint32_t)(unsigned char)*name) * 16777619u) : hash;
+}
+
+// typed handle to an active uniform, resolved once after linking
+// setting a value through a handle is a plain glUniform* call, no name lookup
+template <typename T>
+struct Uniform {
+	int location = -1;
+	bool valid() const { return location >= 0; }
+};
+
+class ProgramCache;
+class ShaderSources;
 
 class Shader {
 public:
 	// program ID
 	unsigned int ID;
 
-	// constructor reads and builds the shader
-	Shader(const char* vertexPath, const char* fragmentPath);
+	// constructor reads and builds the shader, #include "file" is resolved like with ShaderSources below
+	// with a program cache, a cached binary is loaded instead of compiling when one matches the sources
+	Shader(const char* vertexPath, const char* fragmentPath, ProgramCache* cache = nullptr);
+	// build from memory mapped sources with #include resolved and the given #defines injected,
+	// stages identical to ones already compiled through sources are not compiled again
+	Shader(ShaderSources& sources, const char* vertexPath, const char* fragmentPath,
+		const std::vector<std::string>& defines = std::vector<std::string>(), ProgramCache* cache = nullptr);
+	// wrap an already linked program, e.g. one built by a ShaderBatch
+	explicit Shader(unsigned int programID);
+
+	// switch to a newly linked program, e.g. after a hot reload, and rebuild the uniform table
+	// handles from uniform<T>() must be looked up again afterwards
+	void reset(unsigned int programID);
+
+	// read a whole shader source file, safe to call from worker threads
+	static bool readSource(const char* path, std::string& code);
 
 	// use / activate the shader
 	void use();
@@ -25,6 +59,84 @@ public:
 	void setInt(const std::string& name, int value) const;
 	void setFloat(const std::string& name, float value) const;
 	void setVec4(const std::string& name, float v0, float v1, float v2, float v3) const;
+
+	// location of an active uniform from the table built after linking, -1 if the uniform is not active
+	// names the table does not hold (array elements such as "lights[2]") are asked from the driver
+	int uniformLocation(const char* name) const;
+	// by hash alone: a name that is not active but hashes like an active one gets that one's location
+	int uniformLocation(std::uint32_t nameHash) const;
+
+	// typed uniform handles: look these up once, outside of the render loop
+	template <typename T>
+	Uniform<T> uniform(const char* name) const {
+		Uniform<T> handle;
+		GLenum type = 0;
+		int location = lookupUniform(name, type);
+		if (location >= 0 && typeMatches<T>(type))
+			handle.location = location;
+		return handle;
+	}
+	template <typename T>
+	Uniform<T> uniform(std::uint32_t nameHash) const {
+		Uniform<T> handle;
+		const UniformSlot* slot = findUniform(nameHash);
+		if (slot && typeMatches<T>(slot->type))
+			handle.location = slot->location;
+		return handle;
+	}
+
+	void set(Uniform<bool> handle, bool value) const;
+	void set(Uniform<int> handle, int value) const;
+	void set(Uniform<float> handle, float value) const;
+	void set(Uniform<glm::vec4> handle, const glm::vec4& value) const;
+	void set(Uniform<glm::mat4> handle, const glm::mat4& value) const;
+
+	// binding point of a uniform block, the same for every shader using a block of that name
+	// assigned on first use
+	static unsigned int blockBinding(const std::string& blockName);
+	// attach this program's uniform block to its shared binding point, kept across reset()
+	// expectedSize (Layout::size of a Std140Layout) is checked against the size the driver reports
+	bool bindBlock(const char* blockName, size_t expectedSize = 0);
+
+private:
+	// one entry of the flat open addressing uniform table
+	struct UniformSlot {
+		std::uint32_t hash = 0;
+		int location = -1;
+		GLenum type = 0;
+		bool used = false;
+		// compared on lookups by name, the hash alone does not tell two names apart
+		std::string name;
+	};
+	// power of two sized, linear probing
+	std::vector<UniformSlot> uniforms;
+	// blocks attached with bindBlock, and the sizes they were checked against
+	std::vector<std::pair<std::string, size_t>> blocks;
+
+	// assemble, compile and link the stages through sources, or load the program from the cache
+	void build(ShaderSources& sources, const char* vertexPath, const char* fragmentPath,
+		const std::vector<std::string>& defines, ProgramCache* cache);
+	// create, link and check the program, then store it in the cache if there is one
+	void link(unsigned int vertex, unsigned int fragment, ProgramCache* cache, std::uint64_t programKey);
+	// enumerate GL_ACTIVE_UNIFORMS once and fill the table
+	void cacheUniforms();
+	const UniformSlot* findUniform(std::uint32_t nameHash) const;
+	const UniformSlot* findUniform(const char* name) const;
+	// location and type of a uniform by name, from the table or else from the driver, -1 if it is not active
+	int lookupUniform(const char* name, GLenum& type) const;
+
+	template <typename T>
+	static bool typeMatches(GLenum type);
 };
 
-#endif
\ No newline at end of file
+template <> inline bool Shader::typeMatches<bool>(GLenum type) { return type == GL_BOOL; }
+template <> inline bool Shader::typeMatches<float>(GLenum type) { return type == GL_FLOAT; }
+template <> inline bool Shader::typeMatches<glm::vec4>(GLenum type) { return type == GL_FLOAT_VEC4; }
+template <> inline bool Shader::typeMatches<glm::mat4>(GLenum type) { return type == GL_FLOAT_MAT4; }
+// samplers are set with glUniform1i too
+template <> inline bool Shader::typeMatches<int>(GLenum type) {
+	return type == GL_INT || type == GL_SAMPLER_2D || type == GL_SAMPLER_3D || type == GL_SAMPLER_CUBE ||
+		type == GL_SAMPLER_2D_ARRAY;
+}
+
+#endif
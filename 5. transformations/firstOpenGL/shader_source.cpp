@@ -0,0 +1,307 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "shader_source.h"
+#include <cstring>
+#include <iostream>
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return;
+	file = handle;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize))
+		return;
+	length = (size_t)fileSize.QuadPart;
+	opened = true;
+	// empty files cannot be mapped
+	if (length == 0)
+		return;
+	mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		bytes = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	opened = bytes != nullptr;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat info;
+	if (fstat(fd, &info) == 0) {
+		length = (size_t)info.st_size;
+		opened = true;
+		// empty files cannot be mapped
+		if (length > 0) {
+			void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			bytes = address == MAP_FAILED ? nullptr : (const char*)address;
+			opened = bytes != nullptr;
+		}
+	}
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+	if (bytes)
+		UnmapViewOfFile(bytes);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+#else
+	if (bytes)
+		munmap((void*)bytes, length);
+#endif
+}
+
+namespace {
+	const char newline[] = "\n";
+
+	std::uint64_t hashBytes(const char* data, size_t length, std::uint64_t hash) {
+		for (size_t i = 0; i < length; i++) {
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	void addPiece(StageSource& stage, const char* begin, const char* end) {
+		if (end > begin) {
+			stage.strings.push_back(begin);
+			stage.lengths.push_back((GLint)(end - begin));
+		}
+	}
+
+	std::string directoryOf(const std::string& path) {
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	const char* skipBlanks(const char* p, const char* end) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		return p;
+	}
+
+	// true if the line is the given preprocessor directive, rest points behind the directive name
+	bool isDirective(const char* line, const char* end, const char* name, const char*& rest) {
+		const char* p = skipBlanks(line, end);
+		if (p == end || *p != '#')
+			return false;
+		p = skipBlanks(p + 1, end);
+		size_t length = std::strlen(name);
+		if ((size_t)(end - p) < length || std::strncmp(p, name, length) != 0)
+			return false;
+		rest = p + length;
+		return true;
+	}
+
+	bool hasVersion(const char* begin, const char* end) {
+		for (const char* line = begin; line < end;) {
+			const char* lineEnd = (const char*)std::memchr(line, '\n', end - line);
+			lineEnd = lineEnd ? lineEnd + 1 : end;
+			const char* rest;
+			if (isDirective(line, lineEnd, "version", rest))
+				return true;
+			line = lineEnd;
+		}
+		return false;
+	}
+}
+
+std::string ShaderSources::normalizePath(const std::string& path) {
+	std::vector<std::string> parts;
+	size_t start = 0;
+	while (start <= path.size()) {
+		size_t slash = path.find_first_of("/\\", start);
+		if (slash == std::string::npos)
+			slash = path.size();
+		std::string part = path.substr(start, slash - start);
+		if (part == ".." && !parts.empty() && parts.back() != ".." && !parts.back().empty())
+			parts.pop_back();
+		else if (part != "." && !(part.empty() && !parts.empty()))
+			parts.push_back(part);
+		start = slash + 1;
+	}
+	std::string normalized;
+	for (size_t i = 0; i < parts.size(); i++)
+		normalized += (i ? "/" : "") + parts[i];
+	return normalized;
+}
+
+const MappedFile* ShaderSources::map(const std::string& path) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<MappedFile>& file = files[path];
+	if (!file)
+		file.reset(new MappedFile(path));
+	return file.get();
+}
+
+StageSource ShaderSources::assemble(const std::string& path, const std::vector<std::string>& defines) {
+	StageSource stage;
+	stage.path = normalizePath(path);
+
+	const std::string* preamble = nullptr;
+	if (!defines.empty()) {
+		std::string text;
+		for (const std::string& define : defines)
+			text += "#define " + define + "\n";
+		std::lock_guard<std::mutex> lock(mutex);
+		preamble = &*preambles.insert(text).first;
+	}
+
+	std::vector<std::string> stack(1, stage.path);
+	std::set<std::string> included;
+	included.insert(stage.path);
+	stage.valid = appendFile(stage.path, stack, included, stage, preamble);
+
+	std::uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < stage.strings.size(); i++)
+		hash = hashBytes(stage.strings[i], (size_t)stage.lengths[i], hash);
+	stage.hash = hash;
+	return stage;
+}
+
+bool ShaderSources::appendFile(const std::string& path, std::vector<std::string>& stack, std::set<std::string>& included,
+	StageSource& stage, const std::string* preamble) {
+	const MappedFile* file = map(path);
+	// listed even when missing, so a file watcher notices it appearing
+	stage.files.push_back(path);
+	if (!file->valid()) {
+		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+		return false;
+	}
+	const char* begin = file->data();
+	const char* end = begin + file->size();
+
+	// defines go right behind #version, or first when there is no #version line
+	if (preamble && !hasVersion(begin, end)) {
+		addPiece(stage, preamble->data(), preamble->data() + preamble->size());
+		preamble = nullptr;
+	}
+
+	const char* pieceStart = begin;
+	for (const char* line = begin; line < end;) {
+		const char* lineEnd = (const char*)std::memchr(line, '\n', end - line);
+		lineEnd = lineEnd ? lineEnd + 1 : end;
+		const char* rest;
+
+		if (preamble && isDirective(line, lineEnd, "version", rest)) {
+			addPiece(stage, pieceStart, lineEnd);
+			if (lineEnd[-1] != '\n')
+				addPiece(stage, newline, newline + 1);
+			addPiece(stage, preamble->data(), preamble->data() + preamble->size());
+			preamble = nullptr;
+			pieceStart = lineEnd;
+		}
+		else if (isDirective(line, lineEnd, "include", rest)) {
+			const char* open = skipBlanks(rest, lineEnd);
+			char closing = (open < lineEnd && *open == '<') ? '>' : '"';
+			const char* close = open < lineEnd ? (const char*)std::memchr(open + 1, closing, lineEnd - open - 1) : nullptr;
+			if (open == lineEnd || (*open != '"' && *open != '<') || !close) {
+				std::cout << "ERROR::SHADER::INCLUDE::MALFORMED " << path << std::endl;
+				return false;
+			}
+			std::string includePath = normalizePath(directoryOf(path) + std::string(open + 1, close));
+
+			addPiece(stage, pieceStart, line);
+			pieceStart = lineEnd;
+			for (const std::string& parent : stack) {
+				if (parent == includePath) {
+					std::cout << "ERROR::SHADER::INCLUDE::CYCLE " << path << " -> " << includePath << std::endl;
+					return false;
+				}
+			}
+			// every file ends up in a stage once, however many files include it
+			if (!included.insert(includePath).second) {
+				line = lineEnd;
+				continue;
+			}
+			stack.push_back(includePath);
+			bool ok = appendFile(includePath, stack, included, stage, nullptr);
+			stack.pop_back();
+			if (!ok)
+				return false;
+			// the included file may not end with a newline
+			addPiece(stage, newline, newline + 1);
+		}
+		line = lineEnd;
+	}
+	addPiece(stage, pieceStart, end);
+	return true;
+}
+
+unsigned int ShaderSources::submit(GLenum type, const StageSource& stage, bool& isNew) {
+	isNew = false;
+	if (!stage.valid)
+		return 0;
+	std::uint64_t key = hashBytes((const char*)&type, sizeof(type), stage.hash);
+	unsigned int& shader = compiled[key];
+	if (shader)
+		return shader;
+
+	isNew = true;
+	shader = glCreateShader(type);
+	glShaderSource(shader, (GLsizei)stage.strings.size(), stage.strings.data(), stage.lengths.data());
+	glCompileShader(shader);
+	return shader;
+}
+
+unsigned int ShaderSources::find(GLenum type, const StageSource& stage) const {
+	if (!stage.valid)
+		return 0;
+	auto found = compiled.find(hashBytes((const char*)&type, sizeof(type), stage.hash));
+	return found == compiled.end() ? 0 : found->second;
+}
+
+void ShaderSources::discard(unsigned int shader) {
+	for (auto entry = compiled.begin(); entry != compiled.end(); ++entry) {
+		if (entry->second == shader) {
+			glDeleteShader(shader);
+			compiled.erase(entry);
+			return;
+		}
+	}
+}
+
+bool ShaderSources::checkCompiled(unsigned int shader, const std::string& name) {
+	int success;
+	char infoLog[512];
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success) {
+		glGetShaderInfoLog(shader, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPILATION_FAILED " << name << "\n" <<
+			infoLog << std::endl;
+	}
+	return success != 0;
+}
+
+unsigned int ShaderSources::compile(GLenum type, const StageSource& stage) {
+	bool isNew;
+	unsigned int shader = submit(type, stage, isNew);
+	if (isNew)
+		checkCompiled(shader, stage.path);
+	return shader;
+}
+
+void ShaderSources::invalidate(const std::string& path) {
+	std::lock_guard<std::mutex> lock(mutex);
+	files.erase(normalizePath(path));
+}
+
+void ShaderSources::release() {
+	for (const auto& entry : compiled)
+		glDeleteShader(entry.second);
+	compiled.clear();
+}
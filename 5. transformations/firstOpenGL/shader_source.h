@@ -0,0 +1,96 @@
+#pragma once
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// read-only memory mapping of a whole file
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool valid() const { return opened; }
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const char* bytes = nullptr;
+	size_t length = 0;
+	bool opened = false;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
+
+// one shader stage as a list of string pieces for glShaderSource
+// the pieces point into mapped files and interned #define blocks owned by ShaderSources,
+// the source text itself is never copied or concatenated
+struct StageSource {
+	std::vector<const GLchar*> strings;
+	std::vector<GLint> lengths;
+	// hash of the text the pieces add up to, identical stages hash the same
+	std::uint64_t hash = 0;
+	std::string path;
+	// every file the stage was assembled from, the stage file first
+	std::vector<std::string> files;
+	bool valid = false;
+};
+
+// memory maps shader files, resolves #include "file" directives and injects #define variants
+// compiled stages are indexed by content hash so a stage shared by many programs is compiled once
+// assemble() may be called from worker threads, compile() and release() need the GL context
+class ShaderSources {
+public:
+	// build the piece list for a stage file, defines are "NAME" or "NAME VALUE"
+	// each file is included at most once per stage, include cycles are reported as errors
+	StageSource assemble(const std::string& path, const std::vector<std::string>& defines = std::vector<std::string>());
+
+	// compile a stage or return the already compiled shader with the same type and content
+	// the shader object stays owned by ShaderSources, compile errors are reported once
+	unsigned int compile(GLenum type, const StageSource& stage);
+	// deferred variant for batches: submits the compile, the status is checked later with checkCompiled
+	unsigned int submit(GLenum type, const StageSource& stage, bool& isNew);
+	bool checkCompiled(unsigned int shader, const std::string& name);
+	// the compiled shader with the same type and content, 0 when there is none. never compiles
+	unsigned int find(GLenum type, const StageSource& stage) const;
+	// delete one compiled stage no program will be linked with again, e.g. the previous version of an edited file
+	// programs already linked with it keep working, GL frees it once they are deleted too
+	void discard(unsigned int shader);
+
+	// forget the mapping of a file that changed on disk, the next assemble() maps it again
+	void invalidate(const std::string& path);
+
+	// delete every compiled stage, e.g. once all programs are linked
+	// the mapped files stay, the GL objects are not freed before this is called
+	void release();
+
+	size_t compiledStages() const { return compiled.size(); }
+
+	// collapse "dir/../" and "./" so one file reached through different relative paths has one name
+	static std::string normalizePath(const std::string& path);
+
+private:
+	std::mutex mutex;
+	std::map<std::string, std::unique_ptr<MappedFile>> files;
+	// interned #define blocks, set nodes keep their addresses
+	std::set<std::string> preambles;
+	std::map<std::uint64_t, unsigned int> compiled;
+
+	const MappedFile* map(const std::string& path);
+	bool appendFile(const std::string& path, std::vector<std::string>& stack, std::set<std::string>& included,
+		StageSource& stage, const std::string* preamble);
+};
+
+#endif
@@ -0,0 +1,5 @@
+// values that change every frame, filled from a uniform buffer (FrameLayout in mainWindow.cpp)
+layout (std140) uniform Frame {
+	mat4 transform;
+	float lerpVal;
+};
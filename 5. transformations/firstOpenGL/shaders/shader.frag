@@ -6,7 +6,7 @@ in vec2 TexCoord;
 uniform sampler2D texture1;
 uniform sampler2D texture2;
 
-uniform float lerpVal;
+#include "frame.glsl"
 
 void main()
 {
@@ -3,7 +3,7 @@ layout (location = 0) in vec3 aPos; // position has attribute position 0
 layout (location = 1) in vec3 aColor;
 layout (location = 2) in vec2 aTexCoord; // texture coordinates
 
-uniform mat4 transform; //  the transtorm matrix
+#include "frame.glsl" // the transtorm matrix comes from the Frame block
 
 out vec3 vertexColor; // specify a color output to the fragment shader
 out vec2 TexCoord;
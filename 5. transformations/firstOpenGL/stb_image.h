@@ -301,6 +301,12 @@ RECENT REVISION HISTORY:
 //     stbi_ldr_to_hdr_scale(1.0f);
 //     stbi_ldr_to_hdr_gamma(2.2f);
 //
+// The same values can come as IEEE half floats, the GL_HALF_FLOAT bits that
+// glm::packHalf1x16 makes, at half the memory. Radiance files go straight from
+// RGBE to halfs:
+//
+//    stbi_us *data = stbi_loadh(filename, &x, &y, &n, 0);
+//
 // Finally, given a filename (or an open file or memory block--see header
 // file for details) containing image data, you can query for the "most
 // appropriate" interface to use (that is, whether the image is HDR or
@@ -422,6 +428,14 @@ typedef struct
 STBIDEF stbi_uc *stbi_load_from_memory   (stbi_uc           const *buffer, int len   , int *x, int *y, int *channels_in_file, int desired_channels);
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk  , void *user, int *x, int *y, int *channels_in_file, int desired_channels);
 
+// decodes into memory you own instead of a new allocation: desired_channels (1..4) bytes per pixel,
+// rows stride bytes apart (0 for packed rows), bottom row first when flip is set (the flip-on-load
+// settings are ignored). channel conversion, 16 to 8 bit and the flip happen while rows are written,
+// and non-interlaced PNGs without palette or tRNS are unfiltered straight into the buffer.
+// *x, *y and *channels_in_file are set as soon as the header is read, so a call with a buffer that is
+// too small fails with the size out_size needs: (y-1)*stride + x*desired_channels. returns 1 on success
+STBIDEF int      stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *channels_in_file, int desired_channels);
+
 #ifndef STBI_NO_STDIO
 STBIDEF stbi_uc *stbi_load            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
@@ -430,8 +444,29 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
+
+// animated GIFs one frame at a time, in memory that doesn't grow with the number of frames. the
+// frames are the layers stbi_load_gif_from_memory would give: composited, desired_channels (4 when
+// 0) per pixel, flipped if flip-on-load is set, and valid until the next call. the buffer has to
+// stay valid until stbi_gif_end
+typedef struct stbi__gif_frames stbi_gif_frames;
+
+STBIDEF stbi_gif_frames *stbi_gif_begin(stbi_uc const *buffer, int len, int *x, int *y, int desired_channels);
+// the next frame and its delay in milliseconds; NULL after the last frame, or on a corrupt one
+STBIDEF stbi_uc *stbi_gif_next(stbi_gif_frames *f, int *delay);
+// frame 'index', counting from 0. frames that cover everything before them are remembered as they
+// are decoded, and the seek decodes on from the last of those at or before the index
+STBIDEF stbi_uc *stbi_gif_frame(stbi_gif_frames *f, int index, int *delay);
+// -1 until the last frame has been passed
+STBIDEF int      stbi_gif_frame_count(stbi_gif_frames *f);
+STBIDEF void     stbi_gif_end(stbi_gif_frames *f);
 #endif
 
+// decodes JPEGs at 1/scale_denom of their size (scale_denom 1, 2, 4 or 8, sizes rounded up) with
+// reduced IDCTs, much faster and smaller than decoding them whole and downsampling. other formats
+// decode at full size, *x and *y tell which one you got
+STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int scale_denom, int *x, int *y, int *channels_in_file, int desired_channels);
+
 #ifdef STBI_WINDOWS_UTF8
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -461,6 +496,15 @@ STBIDEF stbi_us *stbi_load_from_file_16(FILE *f, int *x, int *y, int *channels_i
    STBIDEF float *stbi_loadf            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
    STBIDEF float *stbi_loadf_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
    #endif
+
+   // the stbi_loadf values as half floats, rounded to nearest even
+   STBIDEF stbi_us *stbi_loadh_from_memory   (stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels);
+   STBIDEF stbi_us *stbi_loadh_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y,  int *channels_in_file, int desired_channels);
+
+   #ifndef STBI_NO_STDIO
+   STBIDEF stbi_us *stbi_loadh          (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
+   STBIDEF stbi_us *stbi_loadh_from_file(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
+   #endif
 #endif
 
 #ifndef STBI_NO_HDR
@@ -523,6 +567,108 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// stb_image never creates threads. to spread work over your own threads (the seven
+// passes of an interlaced PNG, the restart intervals, progressive IDCT and color
+// conversion of a JPEG, the images of stbi_load_from_memory_batch), install a
+// parallel-for: it must call task(task_data, i) once for every i in [0,count), on any
+// threads in any order, and return once all calls have returned. it is also called
+// from inside tasks, so it must not deadlock when nested.
+typedef void stbi_parallel_for(void *user, int count, void (*task)(void *task_data, int index), void *task_data);
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *func, void *user);
+
+typedef struct
+{
+   stbi_uc const *buffer;          // in: the encoded image
+   int            len;
+   stbi_uc       *data;            // out: as stbi_load_from_memory returns it, free with stbi_image_free
+   int            x, y, channels_in_file;
+   const char    *failure_reason;  // out: NULL when data is set
+} stbi_batch_image;
+
+// decodes every image, in parallel through the installed parallel-for; the flip setting of the
+// calling thread applies to all of them. returns the number of images decoded
+STBIDEF int stbi_load_from_memory_batch(stbi_batch_image *images, int count, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+// stbi_load through a read-only memory mapping of the file instead of stdio: no read calls and no
+// copies through a FILE buffer, and the file gets the paths only memory gets (such as the parallel
+// JPEG restart intervals). the file must not shrink while it loads. files that can't be mapped go
+// through stbi_load, and so does everything when STBI_NO_MMAP is defined
+STBIDEF stbi_uc *stbi_load_mapped(char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
+
+// loads the files one after another into images[i] (buffer and len are not used), asking for the
+// next file to be read in while the current one decodes. returns the number of images loaded
+STBIDEF int stbi_load_mapped_batch(char const * const *filenames, stbi_batch_image *images, int count, int desired_channels);
+#endif
+
+// scratch memory for stbi_load_from_memory_into. nothing allocated during such a decode outlives
+// it, so with an arena installed on the thread its allocations bump through memory you provide
+// instead of going through STBI_MALLOC/STBI_FREE, and the arena starts empty for every decode.
+// allocations that do not fit fall back to STBI_MALLOC. an arena belongs to one thread at a time;
+// parallel-for tasks on other threads use STBI_MALLOC. like the other _thread functions, this one
+// needs thread-local variables. pass NULL to uninstall
+typedef struct
+{
+   void  *memory;     // in: size bytes, any alignment
+   size_t size;
+   size_t peak;       // out: the most bytes the last decode had in the arena, counting fallbacks too,
+                      //      an arena of this size (plus 15 for alignment) never falls back
+   size_t fallback;   // out: bytes the last decode allocated with STBI_MALLOC because the arena was full
+   size_t used, virtual_used; // internal
+} stbi_arena;
+
+STBIDEF void stbi_set_scratch_arena_thread(stbi_arena *arena);
+
+// incremental decoding: feed the file in chunks of any size as it arrives, and get the rows of
+// the image as soon as they are decoded, top-down whatever the flip setting. PNGs that aren't
+// interlaced and baseline JPEGs report rows while their data arrives; other files, including
+// interlaced PNGs and progressive JPEGs, are decoded and reported at stbi_stream_end. rows are
+// 8-bit, desired_channels (or channels_in_file when 0) per pixel, and stay where they are in
+// the image stbi_stream_end returns
+typedef struct stbi__stream stbi_stream;
+typedef void stbi_stream_rows(void *user, stbi_uc const *rows, int y0, int y1); // rows y0 .. y1-1, one after the other
+
+STBIDEF stbi_stream *stbi_stream_begin(int desired_channels, stbi_stream_rows *callback, void *user);
+// returns 0 once the file turned out to be corrupt, stbi_stream_end then says why
+STBIDEF int      stbi_stream_feed(stbi_stream *st, stbi_uc const *data, int len);
+// returns 1 once the size is known: after the headers of a streamed PNG or JPEG, at the end otherwise
+STBIDEF int      stbi_stream_info(stbi_stream *st, int *x, int *y, int *channels_in_file);
+// decodes whatever is left and frees the stream. returns the image as stbi_load_from_memory would
+STBIDEF stbi_uc *stbi_stream_end(stbi_stream *st, int *x, int *y, int *channels_in_file);
+
+// stbi_info for many files: the first bytes of the file pick the one format parser to run,
+// instead of stbi_info trying each in turn (files without a signature, like TGA, still go
+// through all of them). a file whose signature matches but whose header doesn't parse is
+// reported as corrupt. stbi_probe reads the file with pread a block at a time, usually just the
+// first block, or through stdio where there is no pread
+typedef struct
+{
+   int x, y;
+   int channels_in_file;
+   int is_16_bit;     // as stbi_is_16_bit
+   int is_hdr;        // as stbi_is_hdr
+} stbi_image_info;
+
+STBIDEF int stbi_probe_from_memory(stbi_uc const *buffer, int len, stbi_image_info *info);
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_probe(char const *filename, stbi_image_info *info);
+
+// an index of stbi_probe results kept in a file, so the next run doesn't read the images again.
+// an entry is used while the image's size and modification time (to the second outside
+// Windows) are what they were when it was probed; paths are compared as given. failed probes
+// are kept too. an index that is missing or corrupt starts out empty. not thread-safe
+typedef struct stbi__info_cache stbi_info_cache;
+
+// returns NULL only when out of memory
+STBIDEF stbi_info_cache *stbi_info_cache_open(char const *index_filename);
+// stbi_probe, answered from the index when the file hasn't changed
+STBIDEF int      stbi_info_cache_probe(stbi_info_cache *cache, char const *filename, stbi_image_info *info);
+// writes the index if anything changed, replacing the old one in a single rename
+STBIDEF int      stbi_info_cache_save(stbi_info_cache *cache);
+// saves and frees
+STBIDEF void     stbi_info_cache_close(stbi_info_cache *cache);
+#endif
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -749,7 +895,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -760,7 +906,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -773,6 +919,49 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are compiled for the AVX2 target function by function and only called after a CPUID
+// check, so they need no compiler flag. #define STBI_NO_AVX2 to leave them out
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2)
+#if defined(_MSC_VER) && _MSC_VER >= 1700 && !defined(__clang__)
+#define STBI_AVX2
+#define STBI__AVX2_TARGET
+#elif defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+#define STBI_AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef STBI_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,0);
+   if (info[0] < 7) return 0;
+   __cpuid(info,1);
+   // the OS has to save the ymm registers too
+   if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return (info[1] >> 5) & 1;
+}
+#else
+#include <cpuid.h>
+static int stbi__avx2_available(void)
+{
+   unsigned int a,b,c,d,lo,hi;
+   if (__get_cpuid_max(0, NULL) < 7) return 0;
+   __cpuid(1,a,b,c,d);
+   if (!(c & (1 << 27)) || !(c & (1 << 28))) return 0;
+   // the OS has to save the ymm registers too
+   __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+   if ((lo & 6) != 6) return 0;
+   __cpuid_count(7,0,a,b,c,d);
+   return (b >> 5) & 1;
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -799,12 +988,24 @@ static int stbi__sse2_available(void)
 //
 //  stbi__context struct and start_xxx functions
 
+// caller-owned 8-bit image that decoded rows are converted into, see stbi_load_from_memory_into
+typedef struct
+{
+   stbi_uc *data;      // where row 0 of the decoded image goes
+   ptrdiff_t stride;   // from one decoded row to the next, negative when flipping
+   int w, h, channels;
+   int written;        // set by a loader that wrote every row itself
+   int simd;           // stbi__convert_simd()
+} stbi__into;
+
 // stbi__context structure is our basic context used by all images, so it
 // contains all the IO context, plus some basic image information
 typedef struct
 {
    stbi__uint32 img_x, img_y;
    int img_n, img_out_n;
+   stbi__into *into;   // NULL unless decoding into a caller buffer
+   int scale_shift;    // jpeg decodes at 1/(1<<scale_shift) size
 
    stbi_io_callbacks io;
    void *io_user_data;
@@ -825,6 +1026,8 @@ static void stbi__refill_buffer(stbi__context *s);
 static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
    s->io.read = NULL;
+   s->into = NULL;
+   s->scale_shift = 0;
    s->read_from_callbacks = 0;
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
@@ -836,6 +1039,8 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
 {
    s->io = *c;
    s->io_user_data = user;
+   s->into = NULL;
+   s->scale_shift = 0;
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
@@ -939,6 +1144,7 @@ static int      stbi__psd_is16(stbi__context *s);
 #ifndef STBI_NO_HDR
 static int      stbi__hdr_test(stbi__context *s);
 static float   *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
+static void    *stbi__hdr_decode(stbi__context *s, int *x, int *y, int *comp, int req_comp, int half);
 static int      stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
@@ -962,6 +1168,8 @@ static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 static int      stbi__pnm_is16(stbi__context *s);
 #endif
 
+static int      stbi__info_main(stbi__context *s, int *x, int *y, int *comp);
+
 static
 #ifdef STBI_THREAD_LOCAL
 STBI_THREAD_LOCAL
@@ -981,9 +1189,190 @@ static int stbi__err(const char *str)
 }
 #endif
 
+#ifdef STBI_THREAD_LOCAL
+// every block starts with a header, so blocks can be freed and resized without the caller's sizes.
+// used is the real top of the arena, virtual_used the top of an arena big enough to never fall back
+typedef struct
+{
+   size_t size, virtual_start;
+} stbi__arena_block;
+
+#define STBI__ARENA_HEADER  16
+#define STBI__ARENA_ROUND(n)  (((n) + 15) & ~(size_t) 15)
+
+static STBI_THREAD_LOCAL stbi_arena *stbi__arena_thread;  // installed on this thread
+static STBI_THREAD_LOCAL stbi_arena *stbi__arena_active;  // during a decode into a caller buffer
+
+STBIDEF void stbi_set_scratch_arena_thread(stbi_arena *arena)
+{
+   stbi__arena_thread = arena;
+}
+
+static stbi_uc *stbi__arena_base(stbi_arena *a)
+{
+   return (stbi_uc *) (((size_t) a->memory + 15) & ~(size_t) 15);
+}
+
+static size_t stbi__arena_capacity(stbi_arena *a)
+{
+   size_t skip = (size_t) (stbi__arena_base(a) - (stbi_uc *) a->memory);
+   return a->size > skip ? a->size - skip : 0;
+}
+
+static int stbi__arena_owns(stbi_arena *a, void *p)
+{
+   stbi_uc *base = stbi__arena_base(a);
+   return (stbi_uc *) p >= base && (stbi_uc *) p < base + stbi__arena_capacity(a);
+}
+
+// the real placement of a block: on top of the arena, or STBI_MALLOC when it does not fit.
+// returns the header
+static stbi__arena_block *stbi__arena_place(stbi_arena *a, size_t size)
+{
+   size_t block = STBI__ARENA_HEADER + STBI__ARENA_ROUND(size);
+   stbi__arena_block *h;
+   if (block <= stbi__arena_capacity(a) - a->used) {
+      h = (stbi__arena_block *) (stbi__arena_base(a) + a->used);
+      a->used += block;
+   } else {
+      h = (stbi__arena_block *) STBI_MALLOC(block);
+      if (h == NULL) return NULL;
+      a->fallback += block;
+   }
+   h->size = size;
+   return h;
+}
+
+// bump arenas only take back the block on top
+static void stbi__arena_release(stbi_arena *a, stbi__arena_block *h)
+{
+   size_t block = STBI__ARENA_HEADER + STBI__ARENA_ROUND(h->size);
+   if (!stbi__arena_owns(a, h))
+      STBI_FREE(h);
+   else if ((stbi_uc *) h + block == stbi__arena_base(a) + a->used)
+      a->used -= block;
+}
+
+// the same in an arena big enough to never fall back, to measure the peak
+static void stbi__arena_virtual_place(stbi_arena *a, stbi__arena_block *h, size_t start)
+{
+   h->virtual_start = start;
+   a->virtual_used = start + STBI__ARENA_HEADER + STBI__ARENA_ROUND(h->size);
+   if (a->virtual_used > a->peak) a->peak = a->virtual_used;
+}
+
+static int stbi__arena_virtual_top(stbi_arena *a, stbi__arena_block *h)
+{
+   return h->virtual_start + STBI__ARENA_HEADER + STBI__ARENA_ROUND(h->size) == a->virtual_used;
+}
+
+static void *stbi__arena_alloc(stbi_arena *a, size_t size)
+{
+   stbi__arena_block *h;
+   if (size > ((size_t) -1) / 2) return NULL;
+   h = stbi__arena_place(a, size);
+   if (h == NULL) return NULL;
+   stbi__arena_virtual_place(a, h, a->virtual_used);
+   return (stbi_uc *) h + STBI__ARENA_HEADER;
+}
+
+static void stbi__arena_free(stbi_arena *a, void *ptr)
+{
+   stbi__arena_block *h = (stbi__arena_block *) ((stbi_uc *) ptr - STBI__ARENA_HEADER);
+   if (stbi__arena_virtual_top(a, h))
+      a->virtual_used = h->virtual_start;
+   stbi__arena_release(a, h);
+}
+
+static void *stbi__arena_realloc(stbi_arena *a, void *ptr, size_t newsz)
+{
+   stbi__arena_block *h = (stbi__arena_block *) ((stbi_uc *) ptr - STBI__ARENA_HEADER), *q;
+   size_t block = STBI__ARENA_HEADER + STBI__ARENA_ROUND(h->size);
+   size_t new_block = STBI__ARENA_HEADER + STBI__ARENA_ROUND(newsz);
+   size_t virtual_start = stbi__arena_virtual_top(a, h) ? h->virtual_start : a->virtual_used;
+   if (newsz > ((size_t) -1) / 2) return NULL;
+   if (stbi__arena_owns(a, h) && (stbi_uc *) h + block == stbi__arena_base(a) + a->used &&
+       new_block <= stbi__arena_capacity(a) - (a->used - block)) {
+      // the block on top grows in place, like zlib output and PNG IDAT data usually do
+      a->used = a->used - block + new_block;
+      h->size = newsz;
+      q = h;
+   } else {
+      q = stbi__arena_place(a, newsz);
+      if (q == NULL) return NULL;
+      memcpy((stbi_uc *) q + STBI__ARENA_HEADER, ptr, h->size < newsz ? h->size : newsz);
+      stbi__arena_release(a, h);
+   }
+   stbi__arena_virtual_place(a, q, virtual_start);
+   return (stbi_uc *) q + STBI__ARENA_HEADER;
+}
+
+// makes the thread's arena serve the allocations until stbi__arena_end, returns the one it replaces
+static stbi_arena *stbi__arena_begin(void)
+{
+   stbi_arena *prev = stbi__arena_active;
+   stbi_arena *a = stbi__arena_thread;
+   if (a != NULL && a != prev) {
+      a->used = a->virtual_used = 0;
+      a->peak = a->fallback = 0;
+      stbi__arena_active = a;
+   }
+   return prev;
+}
+
+static void stbi__arena_end(stbi_arena *prev)
+{
+   stbi__arena_active = prev;
+}
+#endif
+
 static void *stbi__malloc(size_t size)
 {
-    return STBI_MALLOC(size);
+#ifdef STBI_THREAD_LOCAL
+   if (stbi__arena_active) return stbi__arena_alloc(stbi__arena_active, size);
+#endif
+   return STBI_MALLOC(size);
+}
+
+static void stbi__free(void *p)
+{
+#ifdef STBI_THREAD_LOCAL
+   if (stbi__arena_active) {
+      if (p) stbi__arena_free(stbi__arena_active, p);
+      return;
+   }
+#endif
+   STBI_FREE(p);
+}
+
+static void *stbi__realloc_sized(void *p, size_t oldsz, size_t newsz)
+{
+#ifdef STBI_THREAD_LOCAL
+   if (stbi__arena_active)
+      return p ? stbi__arena_realloc(stbi__arena_active, p, newsz) : stbi__arena_alloc(stbi__arena_active, newsz);
+#endif
+   STBI_NOTUSED(oldsz);
+   return STBI_REALLOC_SIZED(p, oldsz, newsz);
+}
+
+static stbi_parallel_for *stbi__parallel_for_func = NULL;
+static void *stbi__parallel_for_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for *func, void *user)
+{
+   stbi__parallel_for_func = func;
+   stbi__parallel_for_user = user;
+}
+
+// calls task for every index, through the installed parallel-for if there is one
+static void stbi__parallel_run(int count, void (*task)(void *task_data, int index), void *task_data)
+{
+   int i;
+   if (stbi__parallel_for_func && count > 1)
+      stbi__parallel_for_func(stbi__parallel_for_user, count, task, task_data);
+   else
+      for (i=0; i < count; ++i)
+         task(task_data, i);
 }
 
 // stb_image uses ints pervasively, including for offset calculations.
@@ -1135,6 +1524,10 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
 
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
+   // decoding into a caller buffer converts channels while the rows are written, so most loaders
+   // return the channels of the file. jpeg and hdr convert during their colour conversion anyway
+   int file_comp = s->into ? 0 : req_comp;
+   STBI_NOTUSED(file_comp); // with only the jpeg and hdr loaders
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
    ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
    ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
@@ -1143,36 +1536,40 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    // test the formats with a very explicit header first (at least a FOURCC
    // or distinctive magic number first)
    #ifndef STBI_NO_PNG
-   if (stbi__png_test(s))  return stbi__png_load(s,x,y,comp,req_comp, ri);
+   if (stbi__png_test(s))  return stbi__png_load(s,x,y,comp,file_comp, ri);
    #endif
    #ifndef STBI_NO_BMP
-   if (stbi__bmp_test(s))  return stbi__bmp_load(s,x,y,comp,req_comp, ri);
+   if (stbi__bmp_test(s))  return stbi__bmp_load(s,x,y,comp,file_comp, ri);
    #endif
    #ifndef STBI_NO_GIF
-   if (stbi__gif_test(s))  return stbi__gif_load(s,x,y,comp,req_comp, ri);
+   if (stbi__gif_test(s))  return stbi__gif_load(s,x,y,comp,file_comp, ri);
    #endif
    #ifndef STBI_NO_PSD
-   if (stbi__psd_test(s))  return stbi__psd_load(s,x,y,comp,req_comp, ri, bpc);
+   if (stbi__psd_test(s))  return stbi__psd_load(s,x,y,comp,file_comp, ri, bpc);
    #else
    STBI_NOTUSED(bpc);
    #endif
    #ifndef STBI_NO_PIC
-   if (stbi__pic_test(s))  return stbi__pic_load(s,x,y,comp,req_comp, ri);
+   if (stbi__pic_test(s))  return stbi__pic_load(s,x,y,comp,file_comp, ri);
    #endif
 
    // then the formats that can end up attempting to load with just 1 or 2
    // bytes matching expectations; these are prone to false positives, so
    // try them later
    #ifndef STBI_NO_JPEG
-   if (stbi__jpeg_test(s)) return stbi__jpeg_load(s,x,y,comp,req_comp, ri);
+   if (stbi__jpeg_test(s)) {
+      ri->num_channels = req_comp;
+      return stbi__jpeg_load(s,x,y,comp,req_comp, ri);
+   }
    #endif
    #ifndef STBI_NO_PNM
-   if (stbi__pnm_test(s))  return stbi__pnm_load(s,x,y,comp,req_comp, ri);
+   if (stbi__pnm_test(s))  return stbi__pnm_load(s,x,y,comp,file_comp, ri);
    #endif
 
    #ifndef STBI_NO_HDR
    if (stbi__hdr_test(s)) {
       float *hdr = stbi__hdr_load(s, x,y,comp,req_comp, ri);
+      ri->num_channels = req_comp;
       return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
    }
    #endif
@@ -1180,112 +1577,725 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    #ifndef STBI_NO_TGA
    // test tga last because it's a crappy test!
    if (stbi__tga_test(s))
-      return stbi__tga_load(s,x,y,comp,req_comp, ri);
+      return stbi__tga_load(s,x,y,comp,file_comp, ri);
    #endif
 
    return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
-static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
+//////////////////////////////////////////////////////////////////////////////
+//
+//  conversion kernels
+//
+//  the channel, bit depth and hdr conversions work on runs of pixels. the
+//  simd versions convert what they can and return how many pixels that was,
+//  the scalar loops do the rest, and every path gives the same bytes
+
+// which kernels the machine can run: 0 scalar, 1 sse2 or neon, 2 avx2 as well
+static int stbi__convert_simd(void)
 {
-   int i;
-   int img_len = w * h * channels;
-   stbi_uc *reduced;
+#ifdef STBI_AVX2
+   if (stbi__avx2_available()) return 2;
+#endif
+#ifdef STBI_SSE2
+   return stbi__sse2_available();
+#elif defined(STBI_NEON)
+   return 1;
+#else
+   return 0;
+#endif
+}
 
-   reduced = (stbi_uc *) stbi__malloc(img_len);
-   if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
+#ifdef STBI_AVX2
+// source channel of every output channel, -1 for opaque alpha, -2 for luma. [img_n-1][req_comp-1]
+static signed char const stbi__convert_map[4][4][4] =
+{
+   { {  0 }, {  0,-1 }, { 0,0,0 }, { 0,0,0,-1 } },
+   { {  0 }, {  0, 1 }, { 0,0,0 }, { 0,0,0, 1 } },
+   { { -2 }, { -2,-1 }, { 0,1,2 }, { 0,1,2,-1 } },
+   { { -2 }, { -2, 3 }, { 0,1,2 }, { 0,1,2, 3 } },
+};
 
-   for (i = 0; i < img_len; ++i)
-      reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
+// the shuffles only need ssse3, which every avx2 machine has; 16 bytes a step keeps up with memory.
+// a channel reorder is one shuffle and an or for the alpha bytes. luma takes 4 pixels a step:
+// (r,g) and (b,0) word pairs through madd, then the alpha shuffled into the second byte.
+// es is the bytes per channel, luma only comes in 8 bits
+static STBI__AVX2_TARGET int stbi__convert_row_avx2(stbi_uc *dest, stbi_uc const *src, int img_n, int req_comp, int es, int n)
+{
+   signed char const *map = stbi__convert_map[img_n-1][req_comp-1];
+   stbi_uc shuf[16], fill[16], rg[16], bl[16], pack[16];
+   int i = 0, k, p, c, b, px, in_bytes = img_n*es, out_bytes = req_comp*es;
+   __m128i m, a;
+
+   for (k=0; k < 16; ++k) {
+      shuf[k] = rg[k] = bl[k] = pack[k] = 0x80;
+      fill[k] = 0;
+   }
+   if (map[0] == -2) {
+      __m128i m_rg, m_b, w_rg = _mm_set1_epi32(77 | (150 << 16)), w_b = _mm_set1_epi32(29);
+      if (es != 1) return 0;
+      for (p=0; p < 4; ++p) {
+         rg[p*4+0] = (stbi_uc) (p*img_n+0);
+         rg[p*4+2] = (stbi_uc) (p*img_n+1);
+         bl[p*4+0] = (stbi_uc) (p*img_n+2);
+         if (req_comp == 2) {
+            if (map[1] < 0) fill[p*4+1] = 255;
+            else shuf[p*4+1] = (stbi_uc) (p*img_n+3);
+         }
+         for (c=0; c < req_comp; ++c)
+            pack[p*req_comp+c] = (stbi_uc) (p*4+c);
+      }
+      m_rg = _mm_loadu_si128((__m128i const *) rg);
+      m_b  = _mm_loadu_si128((__m128i const *) bl);
+      m    = _mm_loadu_si128((__m128i const *) shuf);
+      a    = _mm_loadu_si128((__m128i const *) fill);
+      for (; (n-i)*in_bytes >= 16; i += 4) {
+         __m128i s = _mm_loadu_si128((__m128i const *) (src + i*in_bytes));
+         __m128i y = _mm_add_epi32(_mm_madd_epi16(_mm_shuffle_epi8(s, m_rg), w_rg), _mm_madd_epi16(_mm_shuffle_epi8(s, m_b), w_b));
+         y = _mm_or_si128(_mm_srli_epi32(y, 8), _mm_or_si128(_mm_shuffle_epi8(s, m), a));
+         y = _mm_shuffle_epi8(y, _mm_loadu_si128((__m128i const *) pack));
+         if (req_comp == 1) {
+            stbi__uint32 v = (stbi__uint32) _mm_cvtsi128_si32(y);
+            memcpy(dest + i, &v, 4);
+         } else
+            _mm_storel_epi64((__m128i *) (dest + i*2), y);
+      }
+      return i;
+   }
 
-   STBI_FREE(orig);
-   return reduced;
+   // stores are 16 bytes whatever the step, the next step or the scalar tail overwrites the excess
+   px = 16 / (es * (img_n > req_comp ? img_n : req_comp));
+   for (p=0; p < px; ++p)
+      for (c=0; c < req_comp; ++c)
+         for (b=0; b < es; ++b) {
+            k = (p*req_comp + c)*es + b;
+            if (map[c] < 0) fill[k] = 255;
+            else shuf[k] = (stbi_uc) ((p*img_n + map[c])*es + b);
+         }
+   m = _mm_loadu_si128((__m128i const *) shuf);
+   a = _mm_loadu_si128((__m128i const *) fill);
+   for (; (n-i)*in_bytes >= 16 && (n-i)*out_bytes >= 16; i += px)
+      _mm_storeu_si128((__m128i *) (dest + i*out_bytes), _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i*in_bytes)), m), a));
+   return i;
 }
+#endif
 
-static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int channels)
+#ifdef STBI_NEON
+static uint8x8_t stbi__luma_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
 {
-   int i;
-   int img_len = w * h * channels;
-   stbi__uint16 *enlarged;
-
-   enlarged = (stbi__uint16 *) stbi__malloc(img_len*2);
-   if (enlarged == NULL) return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
+   uint16x8_t s = vmull_u8(r, vdup_n_u8(77));
+   s = vmlal_u8(s, g, vdup_n_u8(150));
+   s = vmlal_u8(s, b, vdup_n_u8(29));
+   return vshrn_n_u16(s, 8);
+}
 
-   for (i = 0; i < img_len; ++i)
-      enlarged[i] = (stbi__uint16)((orig[i] << 8) + orig[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
+// 8 pixels a step, the structure loads and stores do the (de)interleaving
+static int stbi__convert_row_neon(stbi_uc *dest, stbi_uc const *src, int img_n, int req_comp, int n)
+{
+   uint8x8_t opaque = vdup_n_u8(255);
+   uint8x8x2_t s2, o2;
+   uint8x8x3_t s3, o3;
+   uint8x8x4_t s4, o4;
+   int i = 0;
 
-   STBI_FREE(orig);
-   return enlarged;
+   #define STBI__NEON_CASE(a,b)  case (a)*8+(b): for (; i+8 <= n; i += 8, src += 8*(a), dest += 8*(b))
+   switch (img_n*8 + req_comp) {
+      STBI__NEON_CASE(1,2) { o2.val[0]=vld1_u8(src); o2.val[1]=opaque;                                     vst2_u8(dest, o2); } break;
+      STBI__NEON_CASE(1,3) { o3.val[0]=o3.val[1]=o3.val[2]=vld1_u8(src);                                  vst3_u8(dest, o3); } break;
+      STBI__NEON_CASE(1,4) { o4.val[0]=o4.val[1]=o4.val[2]=vld1_u8(src); o4.val[3]=opaque;                 vst4_u8(dest, o4); } break;
+      STBI__NEON_CASE(2,1) { s2=vld2_u8(src);                                                              vst1_u8(dest, s2.val[0]); } break;
+      STBI__NEON_CASE(2,3) { s2=vld2_u8(src); o3.val[0]=o3.val[1]=o3.val[2]=s2.val[0];                     vst3_u8(dest, o3); } break;
+      STBI__NEON_CASE(2,4) { s2=vld2_u8(src); o4.val[0]=o4.val[1]=o4.val[2]=s2.val[0]; o4.val[3]=s2.val[1]; vst4_u8(dest, o4); } break;
+      STBI__NEON_CASE(3,4) { s3=vld3_u8(src); o4.val[0]=s3.val[0]; o4.val[1]=s3.val[1]; o4.val[2]=s3.val[2]; o4.val[3]=opaque; vst4_u8(dest, o4); } break;
+      STBI__NEON_CASE(3,1) { s3=vld3_u8(src); vst1_u8(dest, stbi__luma_neon(s3.val[0],s3.val[1],s3.val[2])); } break;
+      STBI__NEON_CASE(3,2) { s3=vld3_u8(src); o2.val[0]=stbi__luma_neon(s3.val[0],s3.val[1],s3.val[2]); o2.val[1]=opaque;    vst2_u8(dest, o2); } break;
+      STBI__NEON_CASE(4,1) { s4=vld4_u8(src); vst1_u8(dest, stbi__luma_neon(s4.val[0],s4.val[1],s4.val[2])); } break;
+      STBI__NEON_CASE(4,2) { s4=vld4_u8(src); o2.val[0]=stbi__luma_neon(s4.val[0],s4.val[1],s4.val[2]); o2.val[1]=s4.val[3]; vst2_u8(dest, o2); } break;
+      STBI__NEON_CASE(4,3) { s4=vld4_u8(src); o3.val[0]=s4.val[0]; o3.val[1]=s4.val[1]; o3.val[2]=s4.val[2]; vst3_u8(dest, o3); } break;
+      default: break;
+   }
+   #undef STBI__NEON_CASE
+   return i;
 }
+#endif
 
-static void stbi__vertical_flip(void *image, int w, int h, int bytes_per_pixel)
+// n pixels from img_n to req_comp channels, which must differ
+static void stbi__convert_row8(stbi_uc *dest, stbi_uc const *src, int img_n, int req_comp, int n, int simd)
 {
-   int row;
-   size_t bytes_per_row = (size_t)w * bytes_per_pixel;
-   stbi_uc temp[2048];
-   stbi_uc *bytes = (stbi_uc *)image;
+   int i = 0;
+#ifdef STBI_AVX2
+   if (simd == 2) i = stbi__convert_row_avx2(dest, src, img_n, req_comp, 1, n);
+#elif defined(STBI_NEON)
+   if (simd) i = stbi__convert_row_neon(dest, src, img_n, req_comp, n);
+#endif
+   STBI_NOTUSED(simd);
+   src  += i * img_n;
+   dest += i * req_comp;
+   n -= i;
+
+   #define STBI__Y(r,g,b)     ((stbi_uc) (((r)*77 + (g)*150 + (29*(b))) >> 8))
+   #define STBI__CASE(a,b)    case (a)*8+(b): for(i=n-1; i >= 0; --i, src += a, dest += b)
+   // convert source image with img_n components to one with req_comp components;
+   // avoid switch per pixel, so use switch per run and massive macros
+   switch (img_n*8 + req_comp) {
+      STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
+      STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
+      STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
+      STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
+      STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
+      STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
+      STBI__CASE(3,1) { dest[0]=STBI__Y(src[0],src[1],src[2]);                           } break;
+      STBI__CASE(3,2) { dest[0]=STBI__Y(src[0],src[1],src[2]); dest[1] = 255;            } break;
+      STBI__CASE(4,1) { dest[0]=STBI__Y(src[0],src[1],src[2]);                           } break;
+      STBI__CASE(4,2) { dest[0]=STBI__Y(src[0],src[1],src[2]); dest[1] = src[3];         } break;
+      STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
+      default: STBI_ASSERT(0); break;
+   }
+   #undef STBI__CASE
+   #undef STBI__Y
+}
+
+#if !defined(STBI_NO_PNG) || !defined(STBI_NO_PSD)
+// the same at 16 bits, where only the channel reorders have a simd version
+static void stbi__convert_row16(stbi__uint16 *dest, stbi__uint16 const *src, int img_n, int req_comp, int n, int simd)
+{
+   int i = 0;
+#ifdef STBI_AVX2
+   if (simd == 2) i = stbi__convert_row_avx2((stbi_uc *) dest, (stbi_uc const *) src, img_n, req_comp, 2, n);
+#endif
+   STBI_NOTUSED(simd);
+   src  += i * img_n;
+   dest += i * req_comp;
+   n -= i;
+
+   #define STBI__Y(r,g,b)     ((stbi__uint16) (((r)*77 + (g)*150 + (29*(b))) >> 8))
+   #define STBI__CASE(a,b)    case (a)*8+(b): for(i=n-1; i >= 0; --i, src += a, dest += b)
+   switch (img_n*8 + req_comp) {
+      STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=0xffff;                                     } break;
+      STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
+      STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=0xffff;                     } break;
+      STBI__CASE(2,1) { dest[0]=src[0];                                                     } break;
+      STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
+      STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                     } break;
+      STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=0xffff;        } break;
+      STBI__CASE(3,1) { dest[0]=STBI__Y(src[0],src[1],src[2]);                              } break;
+      STBI__CASE(3,2) { dest[0]=STBI__Y(src[0],src[1],src[2]); dest[1] = 0xffff;            } break;
+      STBI__CASE(4,1) { dest[0]=STBI__Y(src[0],src[1],src[2]);                              } break;
+      STBI__CASE(4,2) { dest[0]=STBI__Y(src[0],src[1],src[2]); dest[1] = src[3];            } break;
+      STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                       } break;
+      default: STBI_ASSERT(0); break;
+   }
+   #undef STBI__CASE
+   #undef STBI__Y
+}
+#endif
 
-   for (row = 0; row < (h>>1); row++) {
-      stbi_uc *row0 = bytes + row*bytes_per_row;
-      stbi_uc *row1 = bytes + (h - row - 1)*bytes_per_row;
-      // swap row0 with row1
-      size_t bytes_left = bytes_per_row;
-      while (bytes_left) {
-         size_t bytes_copy = (bytes_left < sizeof(temp)) ? bytes_left : sizeof(temp);
-         memcpy(temp, row0, bytes_copy);
-         memcpy(row0, row1, bytes_copy);
-         memcpy(row1, temp, bytes_copy);
-         row0 += bytes_copy;
-         row1 += bytes_copy;
-         bytes_left -= bytes_copy;
+// n values, keeping the top byte of each: a sufficient approximation of 16->8 bit scaling
+static void stbi__convert_16_to_8_run(stbi_uc *dest, stbi__uint16 const *src, int n, int simd)
+{
+   int i = 0;
+#ifdef STBI_SSE2
+   if (simd)
+      for (; i+16 <= n; i += 16) {
+         __m128i lo = _mm_srli_epi16(_mm_loadu_si128((__m128i const *) (src + i)), 8);
+         __m128i hi = _mm_srli_epi16(_mm_loadu_si128((__m128i const *) (src + i + 8)), 8);
+         _mm_storeu_si128((__m128i *) (dest + i), _mm_packus_epi16(lo, hi));
       }
-   }
+#elif defined(STBI_NEON)
+   if (simd)
+      for (; i+16 <= n; i += 16)
+         vst1q_u8(dest + i, vcombine_u8(vshrn_n_u16(vld1q_u16(src + i), 8), vshrn_n_u16(vld1q_u16(src + i + 8), 8)));
+#endif
+   STBI_NOTUSED(simd);
+   for (; i < n; ++i)
+      dest[i] = (stbi_uc) (src[i] >> 8);
 }
 
-#ifndef STBI_NO_GIF
-static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int bytes_per_pixel)
+// n values, replicated to the high and low byte: maps 0->0, 255->0xffff
+static void stbi__convert_8_to_16_run(stbi__uint16 *dest, stbi_uc const *src, int n, int simd)
 {
-   int slice;
-   int slice_size = w * h * bytes_per_pixel;
+   int i = 0;
+#ifdef STBI_SSE2
+   if (simd)
+      for (; i+16 <= n; i += 16) {
+         __m128i v = _mm_loadu_si128((__m128i const *) (src + i));
+         _mm_storeu_si128((__m128i *) (dest + i), _mm_unpacklo_epi8(v, v));
+         _mm_storeu_si128((__m128i *) (dest + i + 8), _mm_unpackhi_epi8(v, v));
+      }
+#elif defined(STBI_NEON)
+   if (simd)
+      for (; i+8 <= n; i += 8) {
+         uint8x8_t v = vld1_u8(src + i);
+         vst1q_u16(dest + i, vaddw_u8(vshll_n_u8(v, 8), v));
+      }
+#endif
+   STBI_NOTUSED(simd);
+   for (; i < n; ++i)
+      dest[i] = (stbi__uint16) ((src[i] << 8) + src[i]);
+}
 
-   stbi_uc *bytes = (stbi_uc *)image;
-   for (slice = 0; slice < z; ++slice) {
-      stbi__vertical_flip(bytes, w, h, bytes_per_pixel);
-      bytes += slice_size;
-   }
+#ifndef STBI_NO_LINEAR
+// table holds the float for every byte of a colour channel, then for every byte of alpha
+static void stbi__ldr_to_hdr_run(float *dest, stbi_uc const *src, int comp, int n, float const *table)
+{
+   int i, k, alpha = (comp & 1) ? comp : comp-1;
+   for (i=0; i < n; ++i, src += comp, dest += comp)
+      for (k=0; k < comp; ++k)
+         dest[k] = table[(k == alpha ? 256 : 0) + src[k]];
 }
 #endif
 
-static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
-{
-   stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+#ifndef STBI_NO_HDR
+#define stbi__float2int(x)   ((int) (x))
 
-   if (result == NULL)
-      return NULL;
+static int stbi__hdr_to_ldr_value(float v, float scale, float gamma)
+{
+   float z = (float) pow(v*scale, gamma) * 255 + 0.5f;
+   if (z < 0) z = 0;
+   if (z > 255) z = 255;
+   return stbi__float2int(z);
+}
+
+// thresholds[k] is the smallest value that gives k or more, so a binary search over them
+// replaces the pow. returns 0 when they can't be found, then the values go through pow
+static int stbi__hdr_to_ldr_thresholds(float *thresholds, float scale, float gamma)
+{
+   int k, steps;
+   if (!(scale > 0 && scale < 1e30f && gamma > 0 && gamma < 1e30f)) return 0; // the curve has to rise
+   thresholds[0] = 0;
+   for (k=1; k < 256; ++k) {
+      // invert the curve, then step through the float bit patterns to the exact boundary
+      float v = (float) (pow((k - 0.5f) / 255, 1 / gamma) / scale);
+      stbi__uint32 bits;
+      if (!(v >= 0 && v < 1e38f)) return 0;
+      memcpy(&bits, &v, 4);
+      for (steps=0; bits > 0 && stbi__hdr_to_ldr_value(v, scale, gamma) >= k; ++steps) {
+         if (steps == 64) return 0;
+         --bits;
+         memcpy(&v, &bits, 4);
+      }
+      for (steps=0; stbi__hdr_to_ldr_value(v, scale, gamma) < k; ++steps) {
+         if (steps == 64) return 0;
+         ++bits;
+         memcpy(&v, &bits, 4);
+      }
+      if (v < thresholds[k-1]) return 0;
+      thresholds[k] = v;
+   }
+   return 1;
+}
 
-   // it is the responsibility of the loaders to make sure we get either 8 or 16 bit.
-   STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
+static stbi_uc stbi__hdr_to_ldr_lookup(float v, float const *thresholds)
+{
+   int o = 0;
+   if (v >= thresholds[o+128]) o += 128;
+   if (v >= thresholds[o+ 64]) o +=  64;
+   if (v >= thresholds[o+ 32]) o +=  32;
+   if (v >= thresholds[o+ 16]) o +=  16;
+   if (v >= thresholds[o+  8]) o +=   8;
+   if (v >= thresholds[o+  4]) o +=   4;
+   if (v >= thresholds[o+  2]) o +=   2;
+   if (v >= thresholds[o+  1]) o +=   1;
+   return (stbi_uc) o;
+}
 
-   if (ri.bits_per_channel != 8) {
-      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp == 0 ? *comp : req_comp);
-      ri.bits_per_channel = 8;
+static void stbi__hdr_to_ldr_run(stbi_uc *dest, float const *src, int comp, int n, float const *thresholds, float scale, float gamma)
+{
+   int i, k, colour = (comp & 1) ? comp : comp-1;
+   for (i=0; i < n; ++i, src += comp, dest += comp) {
+      for (k=0; k < colour; ++k)
+         // pow can send negative values anywhere, and nan too
+         dest[k] = thresholds && src[k] >= 0 ? stbi__hdr_to_ldr_lookup(src[k], thresholds) : (stbi_uc) stbi__hdr_to_ldr_value(src[k], scale, gamma);
+      if (k < comp) {
+         float z = src[k] * 255 + 0.5f;
+         if (z < 0) z = 0;
+         if (z > 255) z = 255;
+         dest[k] = (stbi_uc) stbi__float2int(z);
+      }
    }
+}
+#endif
 
-   // @TODO: move stbi__convert_format to here
+#ifndef STBI_NO_LINEAR
+// ieee half floats, rounded to nearest even like f16c and the gpu do it
+static stbi__uint16 stbi__float_to_half(float f)
+{
+   stbi__uint32 u, sign;
+   memcpy(&u, &f, 4);
+   sign = (u >> 16) & 0x8000;
+   u &= 0x7fffffff;
+   if (u >= (stbi__uint32) 143 << 23) // past the largest half, inf or nan
+      return (stbi__uint16) (sign | (u > 0x7f800000 ? 0x7e00 : 0x7c00));
+   if (u < (stbi__uint32) 113 << 23) {
+      // a half denormal: adding 0.5 lines the bits up, and the float add rounds
+      memcpy(&f, &u, 4);
+      f += 0.5f;
+      memcpy(&u, &f, 4);
+      return (stbi__uint16) (sign | (u - 0x3f000000));
+   }
+   // rebias the exponent; a carry out of the mantissa rounds up into the next exponent, or inf
+   return (stbi__uint16) (sign | ((u - ((stbi__uint32) 112 << 23) + 0xfff + ((u >> 13) & 1)) >> 13));
+}
 
-   if (stbi__vertically_flip_on_load) {
-      int channels = req_comp ? req_comp : *comp;
-      stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
-   }
+#ifdef STBI_SSE2
+// the same for 4 floats, sign extended so _mm_packs_epi32 keeps them
+static __m128i stbi__float_to_half_sse2(__m128 f)
+{
+   __m128i u = _mm_castps_si128(f);
+   __m128i a = _mm_and_si128(u, _mm_set1_epi32(0x7fffffff));
+   __m128i sign = _mm_srai_epi32(_mm_xor_si128(u, a), 16);
+   __m128i nan = _mm_and_si128(_mm_cmpgt_epi32(a, _mm_set1_epi32(0x7f800000)), _mm_set1_epi32(0x0200));
+   __m128i big = _mm_cmpgt_epi32(a, _mm_set1_epi32((143 << 23) - 1));
+   __m128i small = _mm_cmplt_epi32(a, _mm_set1_epi32(113 << 23));
+   __m128i denorm = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3f000000));
+   __m128i odd = _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(1));
+   __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(a, _mm_set1_epi32(0xfff - (112 << 23))), odd), 13);
+   __m128i h = _mm_or_si128(_mm_and_si128(small, denorm), _mm_andnot_si128(small, normal));
+   h = _mm_or_si128(_mm_and_si128(big, _mm_or_si128(_mm_set1_epi32(0x7c00), nan)), _mm_andnot_si128(big, h));
+   return _mm_or_si128(h, sign);
+}
+#endif
 
-   return (unsigned char *) result;
+#ifdef STBI_NEON
+static uint16x4_t stbi__float_to_half_neon(float32x4_t f)
+{
+   uint32x4_t u = vreinterpretq_u32_f32(f);
+   uint32x4_t a = vandq_u32(u, vdupq_n_u32(0x7fffffff));
+   uint32x4_t sign = vshrq_n_u32(veorq_u32(u, a), 16);
+   uint32x4_t nan = vandq_u32(vcgtq_u32(a, vdupq_n_u32(0x7f800000)), vdupq_n_u32(0x0200));
+   uint32x4_t big = vcgeq_u32(a, vdupq_n_u32((stbi__uint32) 143 << 23));
+   uint32x4_t small = vcltq_u32(a, vdupq_n_u32((stbi__uint32) 113 << 23));
+   uint32x4_t denorm = vsubq_u32(vreinterpretq_u32_f32(vaddq_f32(vreinterpretq_f32_u32(a), vdupq_n_f32(0.5f))), vdupq_n_u32(0x3f000000));
+   uint32x4_t odd = vandq_u32(vshrq_n_u32(a, 13), vdupq_n_u32(1));
+   uint32x4_t normal = vshrq_n_u32(vaddq_u32(vsubq_u32(a, vdupq_n_u32((stbi__uint32) 112 << 23)), vaddq_u32(odd, vdupq_n_u32(0xfff))), 13);
+   uint32x4_t h = vbslq_u32(big, vorrq_u32(vdupq_n_u32(0x7c00), nan), vbslq_u32(small, denorm, normal));
+   return vmovn_u32(vorrq_u32(h, sign));
 }
+#endif
 
-static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+static void stbi__float_to_half_run(stbi__uint16 *dest, float const *src, int n, int simd)
 {
-   stbi__result_info ri;
-   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
+   int i = 0;
+#ifdef STBI_SSE2
+   if (simd)
+      for (; i+8 <= n; i += 8) {
+         __m128i lo = stbi__float_to_half_sse2(_mm_loadu_ps(src + i));
+         __m128i hi = stbi__float_to_half_sse2(_mm_loadu_ps(src + i + 4));
+         _mm_storeu_si128((__m128i *) (dest + i), _mm_packs_epi32(lo, hi));
+      }
+#elif defined(STBI_NEON)
+   if (simd)
+      for (; i+4 <= n; i += 4)
+         vst1_u16(dest + i, stbi__float_to_half_neon(vld1q_f32(src + i)));
+#endif
+   STBI_NOTUSED(simd);
+   for (; i < n; ++i)
+      dest[i] = stbi__float_to_half(src[i]);
+}
+#endif
+
+// whole-image conversions run in bands of rows through the installed parallel-for once they are big enough
+#define STBI__CONVERT_MAX_BANDS        32
+#define STBI__CONVERT_MIN_BAND_PIXELS  (1 << 16)
+
+enum
+{
+   STBI__CONVERT_FORMAT,
+   STBI__CONVERT_FORMAT16,
+   STBI__CONVERT_16_TO_8,
+   STBI__CONVERT_8_TO_16,
+   STBI__CONVERT_LDR_TO_HDR,
+   STBI__CONVERT_HDR_TO_LDR,
+   STBI__CONVERT_FLOAT_TO_HALF
+};
+
+typedef struct
+{
+   int kind, img_n, req_comp, x, y;
+   int simd, bands;
+   void const *src;
+   void *dest;
+   float const *table;   // ldr_to_hdr values, hdr_to_ldr thresholds or NULL
+   float scale, gamma;   // for hdr_to_ldr without thresholds
+} stbi__convert_job;
+
+static void stbi__convert_task(void *task_data, int band)
+{
+   stbi__convert_job *job = (stbi__convert_job *) task_data;
+   int first = job->y * band / job->bands, last = job->y * (band+1) / job->bands;
+   int n = (last - first) * job->x;
+   size_t in  = (size_t) first * job->x * job->img_n;
+   size_t out = (size_t) first * job->x * job->req_comp;
+
+   switch (job->kind) {
+      case STBI__CONVERT_FORMAT:
+         stbi__convert_row8((stbi_uc *) job->dest + out, (stbi_uc const *) job->src + in, job->img_n, job->req_comp, n, job->simd);
+         break;
+#if !defined(STBI_NO_PNG) || !defined(STBI_NO_PSD)
+      case STBI__CONVERT_FORMAT16:
+         stbi__convert_row16((stbi__uint16 *) job->dest + out, (stbi__uint16 const *) job->src + in, job->img_n, job->req_comp, n, job->simd);
+         break;
+#endif
+      case STBI__CONVERT_16_TO_8:
+         stbi__convert_16_to_8_run((stbi_uc *) job->dest + out, (stbi__uint16 const *) job->src + in, n * job->img_n, job->simd);
+         break;
+      case STBI__CONVERT_8_TO_16:
+         stbi__convert_8_to_16_run((stbi__uint16 *) job->dest + out, (stbi_uc const *) job->src + in, n * job->img_n, job->simd);
+         break;
+#ifndef STBI_NO_LINEAR
+      case STBI__CONVERT_LDR_TO_HDR:
+         stbi__ldr_to_hdr_run((float *) job->dest + out, (stbi_uc const *) job->src + in, job->img_n, n, job->table);
+         break;
+      case STBI__CONVERT_FLOAT_TO_HALF:
+         stbi__float_to_half_run((stbi__uint16 *) job->dest + out, (float const *) job->src + in, n * job->img_n, job->simd);
+         break;
+#endif
+#ifndef STBI_NO_HDR
+      case STBI__CONVERT_HDR_TO_LDR:
+         stbi__hdr_to_ldr_run((stbi_uc *) job->dest + out, (float const *) job->src + in, job->img_n, n, job->table, job->scale, job->gamma);
+         break;
+#endif
+      default:
+         STBI_ASSERT(0);
+         break;
+   }
+}
+
+// the caller fills in the table, scale and gamma the kind needs
+static void stbi__convert_run(stbi__convert_job *job, int kind, void const *src, void *dest, int img_n, int req_comp, int x, int y)
+{
+   job->kind = kind;
+   job->src = src;
+   job->dest = dest;
+   job->img_n = img_n;
+   job->req_comp = req_comp;
+   job->x = x;
+   job->y = y;
+   job->simd = stbi__convert_simd();
+   job->bands = 1;
+   if (stbi__parallel_for_func) {
+      job->bands = (int) ((size_t) x * y / STBI__CONVERT_MIN_BAND_PIXELS);
+      if (job->bands > STBI__CONVERT_MAX_BANDS) job->bands = STBI__CONVERT_MAX_BANDS;
+      if (job->bands > y) job->bands = y;
+      if (job->bands < 1) job->bands = 1;
+   }
+   stbi__parallel_run(job->bands, stbi__convert_task, job);
+}
+
+static stbi_uc *stbi__convert_16_to_8(stbi__uint16 *orig, int w, int h, int channels)
+{
+   stbi__convert_job job;
+   stbi_uc *reduced;
+
+   reduced = (stbi_uc *) stbi__malloc(w * h * channels);
+   if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
+
+   stbi__convert_run(&job, STBI__CONVERT_16_TO_8, orig, reduced, channels, channels, w, h);
+
+   stbi__free(orig);
+   return reduced;
+}
+
+static stbi__uint16 *stbi__convert_8_to_16(stbi_uc *orig, int w, int h, int channels)
+{
+   stbi__convert_job job;
+   stbi__uint16 *enlarged;
+
+   enlarged = (stbi__uint16 *) stbi__malloc(w * h * channels * 2);
+   if (enlarged == NULL) return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
+
+   stbi__convert_run(&job, STBI__CONVERT_8_TO_16, orig, enlarged, channels, channels, w, h);
+
+   stbi__free(orig);
+   return enlarged;
+}
+
+static void stbi__vertical_flip(void *image, int w, int h, int bytes_per_pixel)
+{
+   int row;
+   size_t bytes_per_row = (size_t)w * bytes_per_pixel;
+   stbi_uc temp[2048];
+   stbi_uc *bytes = (stbi_uc *)image;
+
+   for (row = 0; row < (h>>1); row++) {
+      stbi_uc *row0 = bytes + row*bytes_per_row;
+      stbi_uc *row1 = bytes + (h - row - 1)*bytes_per_row;
+      // swap row0 with row1
+      size_t bytes_left = bytes_per_row;
+      while (bytes_left) {
+         size_t bytes_copy = (bytes_left < sizeof(temp)) ? bytes_left : sizeof(temp);
+         memcpy(temp, row0, bytes_copy);
+         memcpy(row0, row1, bytes_copy);
+         memcpy(row1, temp, bytes_copy);
+         row0 += bytes_copy;
+         row1 += bytes_copy;
+         bytes_left -= bytes_copy;
+      }
+   }
+}
+
+#ifndef STBI_NO_GIF
+static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int bytes_per_pixel)
+{
+   int slice;
+   int slice_size = w * h * bytes_per_pixel;
+
+   stbi_uc *bytes = (stbi_uc *)image;
+   for (slice = 0; slice < z; ++slice) {
+      stbi__vertical_flip(bytes, w, h, bytes_per_pixel);
+      bytes += slice_size;
+   }
+}
+#endif
+
+// converts one decoded row (img_n channels of 8 or 16 bits) into row 'row' of the caller buffer.
+// gives the same values as stbi__convert_format(16) followed by stbi__convert_16_to_8
+static void stbi__into_row(stbi__into *t, stbi__uint32 row, void *data, int img_n, int bits, stbi__uint32 x)
+{
+   stbi_uc *dest = t->data + (ptrdiff_t) row * t->stride;
+   int i;
+
+   #define STBI__INTO_Y(r,g,b)   (((r)*77 + (g)*150 + (29*(b))) >> 8)
+   #define STBI__INTO_CASE(a,b)  case (a)*8+(b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+   if (bits == 8) {
+      if (img_n == t->channels)
+         memcpy(dest, data, (size_t) x * img_n);
+      else
+         stbi__convert_row8(dest, (stbi_uc const *) data, img_n, t->channels, (int) x, t->simd);
+   } else {
+      stbi__uint16 *src = (stbi__uint16 *) data;
+      // top byte of each value, after converting at 16 bits
+      switch (img_n*8 + t->channels) {
+         STBI__INTO_CASE(1,1) { dest[0]=(stbi_uc) (src[0] >> 8);                                                      } break;
+         STBI__INTO_CASE(1,2) { dest[0]=(stbi_uc) (src[0] >> 8); dest[1]=255;                                         } break;
+         STBI__INTO_CASE(1,3) { dest[0]=dest[1]=dest[2]=(stbi_uc) (src[0] >> 8);                                      } break;
+         STBI__INTO_CASE(1,4) { dest[0]=dest[1]=dest[2]=(stbi_uc) (src[0] >> 8); dest[3]=255;                         } break;
+         STBI__INTO_CASE(2,1) { dest[0]=(stbi_uc) (src[0] >> 8);                                                      } break;
+         STBI__INTO_CASE(2,2) { dest[0]=(stbi_uc) (src[0] >> 8); dest[1]=(stbi_uc) (src[1] >> 8);                     } break;
+         STBI__INTO_CASE(2,3) { dest[0]=dest[1]=dest[2]=(stbi_uc) (src[0] >> 8);                                      } break;
+         STBI__INTO_CASE(2,4) { dest[0]=dest[1]=dest[2]=(stbi_uc) (src[0] >> 8); dest[3]=(stbi_uc) (src[1] >> 8);     } break;
+         STBI__INTO_CASE(3,1) { dest[0]=(stbi_uc) (STBI__INTO_Y(src[0],src[1],src[2]) >> 8);                          } break;
+         STBI__INTO_CASE(3,2) { dest[0]=(stbi_uc) (STBI__INTO_Y(src[0],src[1],src[2]) >> 8); dest[1] = 255;           } break;
+         STBI__INTO_CASE(3,3) { dest[0]=(stbi_uc) (src[0] >> 8); dest[1]=(stbi_uc) (src[1] >> 8); dest[2]=(stbi_uc) (src[2] >> 8); } break;
+         STBI__INTO_CASE(3,4) { dest[0]=(stbi_uc) (src[0] >> 8); dest[1]=(stbi_uc) (src[1] >> 8); dest[2]=(stbi_uc) (src[2] >> 8); dest[3]=255; } break;
+         STBI__INTO_CASE(4,1) { dest[0]=(stbi_uc) (STBI__INTO_Y(src[0],src[1],src[2]) >> 8);                          } break;
+         STBI__INTO_CASE(4,2) { dest[0]=(stbi_uc) (STBI__INTO_Y(src[0],src[1],src[2]) >> 8); dest[1] = (stbi_uc) (src[3] >> 8); } break;
+         STBI__INTO_CASE(4,3) { dest[0]=(stbi_uc) (src[0] >> 8); dest[1]=(stbi_uc) (src[1] >> 8); dest[2]=(stbi_uc) (src[2] >> 8); } break;
+         STBI__INTO_CASE(4,4) { dest[0]=(stbi_uc) (src[0] >> 8); dest[1]=(stbi_uc) (src[1] >> 8); dest[2]=(stbi_uc) (src[2] >> 8); dest[3]=(stbi_uc) (src[3] >> 8); } break;
+         default: STBI_ASSERT(0); break;
+      }
+   }
+   #undef STBI__INTO_CASE
+   #undef STBI__INTO_Y
+}
+
+static int stbi__decode_into(stbi__context *s, stbi__into *t)
+{
+   stbi__result_info ri;
+   int x, y, comp, n, j;
+   size_t row_bytes;
+   void *result;
+
+   s->into = t;
+   result = stbi__load_main(s, &x, &y, &comp, t->channels, &ri, 8);
+   s->into = NULL;
+   if (result == NULL)
+      return 0;
+
+   // loaders that converted channels themselves say so in num_channels
+   n = ri.num_channels ? ri.num_channels : comp;
+   STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
+   if (!t->written) {
+      if (x != t->w || y != t->h) {
+         stbi__free(result);
+         return stbi__err("bad size", "Image size differs from its header");
+      }
+      row_bytes = (size_t) x * n * (ri.bits_per_channel / 8);
+      for (j=0; j < y; ++j)
+         stbi__into_row(t, j, (stbi_uc *) result + row_bytes * j, n, ri.bits_per_channel, x);
+   }
+   stbi__free(result);
+   return 1;
+}
+
+static int stbi__load_into(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *channels_in_file, int desired_channels)
+{
+   stbi__context s;
+   stbi__into t;
+   int w, h, comp;
+   size_t row_bytes;
+
+   if (desired_channels < 1 || desired_channels > 4) return stbi__err("bad req_comp", "Internal error");
+   stbi__start_mem(&s,buffer,len);
+   if (!stbi__info_main(&s, &w, &h, &comp)) return 0;
+   if (x) *x = w;
+   if (y) *y = h;
+   if (channels_in_file) *channels_in_file = comp;
+
+   // an empty image would make the stride 0 below, and a row has to fit the int stride
+   if (w <= 0 || h <= 0) return stbi__err("bad size", "Image has no pixels");
+   row_bytes = (size_t) w * desired_channels;
+   if (row_bytes > INT_MAX) return stbi__err("too large", "Image too large to decode");
+   if (stride == 0) stride = (int) row_bytes;
+   if (stride < 0 || (size_t) stride < row_bytes) return stbi__err("bad stride", "Row stride shorter than a row");
+   if (out == NULL || out_size < 0 || row_bytes > (size_t) out_size || (size_t) (h-1) > ((size_t) out_size - row_bytes) / stride)
+      return stbi__err("buffer too small", "Output buffer too small for the image");
+
+   t.data = flip ? out + (size_t) (h-1) * stride : out;
+   t.stride = flip ? -(ptrdiff_t) stride : (ptrdiff_t) stride;
+   t.w = w;
+   t.h = h;
+   t.channels = desired_channels;
+   t.written = 0;
+   t.simd = stbi__convert_simd();
+   stbi__start_mem(&s,buffer,len);
+   return stbi__decode_into(&s, &t);
+}
+
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *out, int out_size, int stride, int flip, int *x, int *y, int *channels_in_file, int desired_channels)
+{
+#ifdef STBI_THREAD_LOCAL
+   // nothing allocated here outlives the call, so it may all come from the thread's arena
+   stbi_arena *prev = stbi__arena_begin();
+   int ok = stbi__load_into(buffer, len, out, out_size, stride, flip, x, y, channels_in_file, desired_channels);
+   stbi__arena_end(prev);
+   return ok;
+#else
+   return stbi__load_into(buffer, len, out, out_size, stride, flip, x, y, channels_in_file, desired_channels);
+#endif
+}
+
+static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__result_info ri;
+   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+
+   if (result == NULL)
+      return NULL;
+
+   // it is the responsibility of the loaders to make sure we get either 8 or 16 bit.
+   STBI_ASSERT(ri.bits_per_channel == 8 || ri.bits_per_channel == 16);
+
+   if (ri.bits_per_channel != 8) {
+      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp == 0 ? *comp : req_comp);
+      ri.bits_per_channel = 8;
+   }
+
+   // @TODO: move stbi__convert_format to here
+
+   if (stbi__vertically_flip_on_load) {
+      int channels = req_comp ? req_comp : *comp;
+      stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
+   }
+
+   return (unsigned char *) result;
+}
+
+static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__result_info ri;
+   void *result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
 
    if (result == NULL)
       return NULL;
@@ -1432,6 +2442,216 @@ STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, i
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int scale_denom, int *x, int *y, int *channels_in_file, int desired_channels)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   switch (scale_denom) {
+      case 1: s.scale_shift = 0; break;
+      case 2: s.scale_shift = 1; break;
+      case 4: s.scale_shift = 2; break;
+      case 8: s.scale_shift = 3; break;
+      default: return stbi__errpuc("bad scale", "Scale must be 1, 2, 4 or 8");
+   }
+   return stbi__load_and_postprocess_8bit(&s,x,y,channels_in_file,desired_channels);
+}
+
+typedef struct
+{
+   stbi_batch_image *images;
+   int desired_channels;
+   int flip;
+} stbi__batch;
+
+static void stbi__batch_task(void *task_data, int index)
+{
+   stbi__batch *batch = (stbi__batch *) task_data;
+   stbi_batch_image *image = &batch->images[index];
+#ifdef STBI_THREAD_LOCAL
+   // tasks may run on other threads, give them the caller's flip setting for this image only
+   int local = stbi__vertically_flip_on_load_local, set = stbi__vertically_flip_on_load_set;
+   stbi__vertically_flip_on_load_local = batch->flip;
+   stbi__vertically_flip_on_load_set = 1;
+#endif
+   image->data = stbi_load_from_memory(image->buffer, image->len, &image->x, &image->y, &image->channels_in_file, batch->desired_channels);
+   image->failure_reason = image->data ? NULL : stbi__g_failure_reason;
+#ifdef STBI_THREAD_LOCAL
+   stbi__vertically_flip_on_load_local = local;
+   stbi__vertically_flip_on_load_set = set;
+#endif
+}
+
+STBIDEF int stbi_load_from_memory_batch(stbi_batch_image *images, int count, int desired_channels)
+{
+   stbi__batch batch;
+   int i, decoded = 0;
+   batch.images = images;
+   batch.desired_channels = desired_channels;
+   batch.flip = stbi__vertically_flip_on_load;
+   stbi__parallel_run(count, stbi__batch_task, &batch);
+   for (i=0; i < count; ++i)
+      if (images[i].data) ++decoded;
+   return decoded;
+}
+
+#ifndef STBI_NO_STDIO
+
+#if !defined(STBI_NO_MMAP) && (defined(_WIN32) || defined(__unix__) || defined(__APPLE__))
+#define STBI__MMAP
+#endif
+
+#ifdef STBI__MMAP
+#ifdef _WIN32
+#ifdef _WIN64
+typedef unsigned __int64 stbi__win_size;
+#else
+typedef unsigned long stbi__win_size;
+#endif
+struct _SECURITY_ATTRIBUTES;
+#ifdef STBI_WINDOWS_UTF8
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileW(const wchar_t *name, unsigned long access, unsigned long share, struct _SECURITY_ATTRIBUTES *sa, unsigned long disposition, unsigned long flags, void *template_file);
+#else
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileA(const char *name, unsigned long access, unsigned long share, struct _SECURITY_ATTRIBUTES *sa, unsigned long disposition, unsigned long flags, void *template_file);
+#endif
+STBI_EXTERN __declspec(dllimport) unsigned long __stdcall GetFileSize(void *file, unsigned long *size_high);
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileMappingA(void *file, struct _SECURITY_ATTRIBUTES *sa, unsigned long protect, unsigned long size_high, unsigned long size_low, const char *name);
+STBI_EXTERN __declspec(dllimport) void * __stdcall MapViewOfFile(void *mapping, unsigned long access, unsigned long offset_high, unsigned long offset_low, stbi__win_size size);
+STBI_EXTERN __declspec(dllimport) int __stdcall UnmapViewOfFile(const void *base);
+STBI_EXTERN __declspec(dllimport) int __stdcall CloseHandle(void *handle);
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// a whole file mapped read-only
+typedef struct
+{
+   stbi_uc *data;
+   size_t len;
+#ifdef _WIN32
+   void *mapping;
+#endif
+} stbi__mapped_file;
+
+// returns 0 when the file doesn't open, is empty, isn't a regular file or is too big for a memory
+// context. the caller then goes through stdio, which reports what is wrong
+static int stbi__map_file(stbi__mapped_file *m, char const *filename)
+{
+#ifdef _WIN32
+   void *file;
+   unsigned long size, size_high;
+#ifdef STBI_WINDOWS_UTF8
+   wchar_t wFilename[1024];
+   if (0 == MultiByteToWideChar(65001 /* UTF8 */, 0, filename, -1, wFilename, sizeof(wFilename)/sizeof(*wFilename)))
+      return 0;
+   file = CreateFileW(wFilename, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, NULL, 3 /* OPEN_EXISTING */, 0x08000000 /* FILE_FLAG_SEQUENTIAL_SCAN */, NULL);
+#else
+   file = CreateFileA(filename, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, NULL, 3 /* OPEN_EXISTING */, 0x08000000 /* FILE_FLAG_SEQUENTIAL_SCAN */, NULL);
+#endif
+   if (file == (void *) (ptrdiff_t) -1) return 0; // INVALID_HANDLE_VALUE
+   size = GetFileSize(file, &size_high);
+   m->mapping = NULL;
+   if (size_high == 0 && size != 0 && size <= INT_MAX)
+      m->mapping = CreateFileMappingA(file, NULL, 0x02 /* PAGE_READONLY */, 0, 0, NULL);
+   CloseHandle(file); // the mapping keeps it open
+   if (m->mapping == NULL) return 0;
+   m->data = (stbi_uc *) MapViewOfFile(m->mapping, 0x0004 /* FILE_MAP_READ */, 0, 0, 0);
+   if (m->data == NULL) {
+      CloseHandle(m->mapping);
+      return 0;
+   }
+   m->len = size;
+   return 1;
+#else
+   struct stat st;
+   void *p;
+   int fd = open(filename, O_RDONLY);
+   if (fd < 0) return 0;
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX) {
+      close(fd);
+      return 0;
+   }
+   p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd); // the mapping keeps it open
+   if (p == MAP_FAILED) return 0;
+   m->data = (stbi_uc *) p;
+   m->len = (size_t) st.st_size;
+#ifdef MADV_SEQUENTIAL
+   // the decoders read front to back: read ahead further, and drop pages once they are read
+   madvise(p, m->len, MADV_SEQUENTIAL);
+#endif
+   return 1;
+#endif
+}
+
+// starts reading the file into the page cache without waiting for it
+static void stbi__prefetch_mapped(stbi__mapped_file *m)
+{
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+   madvise(m->data, m->len, MADV_WILLNEED);
+#else
+   STBI_NOTUSED(m);
+#endif
+}
+
+static void stbi__unmap_file(stbi__mapped_file *m)
+{
+#ifdef _WIN32
+   UnmapViewOfFile(m->data);
+   CloseHandle(m->mapping);
+#else
+   munmap(m->data, m->len);
+#endif
+}
+#endif // STBI__MMAP
+
+STBIDEF stbi_uc *stbi_load_mapped(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+#ifdef STBI__MMAP
+   stbi__mapped_file m;
+   if (stbi__map_file(&m, filename)) {
+      stbi_uc *result = stbi_load_from_memory(m.data, (int) m.len, x, y, comp, req_comp);
+      stbi__unmap_file(&m);
+      return result;
+   }
+#endif
+   return stbi_load(filename, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_mapped_batch(char const * const *filenames, stbi_batch_image *images, int count, int desired_channels)
+{
+   int i, loaded = 0;
+#ifdef STBI__MMAP
+   stbi__mapped_file cur, next;
+   int cur_mapped, next_mapped = count > 0 && stbi__map_file(&next, filenames[0]);
+#endif
+   for (i=0; i < count; ++i) {
+      stbi_batch_image *image = &images[i];
+#ifdef STBI__MMAP
+      cur = next;
+      cur_mapped = next_mapped;
+      // the kernel reads the next file in while this one decodes
+      next_mapped = i+1 < count && stbi__map_file(&next, filenames[i+1]);
+      if (next_mapped) stbi__prefetch_mapped(&next);
+      if (cur_mapped) {
+         image->data = stbi_load_from_memory(cur.data, (int) cur.len, &image->x, &image->y, &image->channels_in_file, desired_channels);
+         stbi__unmap_file(&cur);
+      } else {
+         image->data = stbi_load(filenames[i], &image->x, &image->y, &image->channels_in_file, desired_channels);
+      }
+#else
+      image->data = stbi_load(filenames[i], &image->x, &image->y, &image->channels_in_file, desired_channels);
+#endif
+      image->failure_reason = image->data ? NULL : stbi__g_failure_reason;
+      if (image->data) ++loaded;
+   }
+   return loaded;
+}
+
+#endif // !STBI_NO_STDIO
+
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
@@ -1447,8 +2667,8 @@ STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int *
    stbi__start_mem(&s,buffer,len);
 
    result = (unsigned char*) stbi__load_gif_main(&s, delays, x, y, z, comp, req_comp);
-   if (stbi__vertically_flip_on_load) {
-      stbi__vertical_flip_slices( result, *x, *y, *z, *comp );
+   if (stbi__vertically_flip_on_load && result) {
+      stbi__vertical_flip_slices( result, *x, *y, *z, req_comp ? req_comp : *comp );
    }
 
    return result;
@@ -1507,31 +2727,88 @@ STBIDEF float *stbi_loadf_from_file(FILE *f, int *x, int *y, int *comp, int req_
 }
 #endif // !STBI_NO_STDIO
 
-#endif // !STBI_NO_LINEAR
-
-// these is-hdr-or-not is defined independent of whether STBI_NO_LINEAR is
-// defined, for API simplicity; if STBI_NO_LINEAR is defined, it always
-// reports false!
-
-STBIDEF int stbi_is_hdr_from_memory(stbi_uc const *buffer, int len)
+static stbi__uint16 *stbi__loadh_main(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
+   stbi__convert_job job;
+   stbi__uint16 *half;
+   float *data;
+   int channels;
    #ifndef STBI_NO_HDR
+   if (stbi__hdr_test(s)) {
+      half = (stbi__uint16 *) stbi__hdr_decode(s,x,y,comp,req_comp,1);
+      if (half && stbi__vertically_flip_on_load)
+         stbi__vertical_flip(half, *x, *y, (req_comp ? req_comp : *comp) * sizeof(stbi__uint16));
+      return half;
+   }
+   #endif
+   data = stbi__loadf_main(s,x,y,comp,req_comp);
+   if (data == NULL) return NULL;
+   channels = req_comp ? req_comp : *comp;
+   half = (stbi__uint16 *) stbi__malloc_mad4(*x, *y, channels, sizeof(stbi__uint16), 0);
+   if (half == NULL) { stbi__free(data); return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory"); }
+   stbi__convert_run(&job, STBI__CONVERT_FLOAT_TO_HALF, data, half, channels, channels, *x, *y);
+   stbi__free(data);
+   return half;
+}
+
+STBIDEF stbi_us *stbi_loadh_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
    stbi__context s;
    stbi__start_mem(&s,buffer,len);
-   return stbi__hdr_test(&s);
-   #else
-   STBI_NOTUSED(buffer);
-   STBI_NOTUSED(len);
-   return 0;
-   #endif
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
 }
 
-#ifndef STBI_NO_STDIO
-STBIDEF int      stbi_is_hdr          (char const *filename)
+STBIDEF stbi_us *stbi_loadh_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
-   FILE *f = stbi__fopen(filename, "rb");
-   int result=0;
-   if (f) {
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_us *stbi_loadh(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   stbi_us *result;
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return (stbi_us *) stbi__errpuc("can't fopen", "Unable to open file");
+   result = stbi_loadh_from_file(f,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF stbi_us *stbi_loadh_from_file(FILE *f, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_file(&s,f);
+   return stbi__loadh_main(&s,x,y,comp,req_comp);
+}
+#endif // !STBI_NO_STDIO
+
+#endif // !STBI_NO_LINEAR
+
+// these is-hdr-or-not is defined independent of whether STBI_NO_LINEAR is
+// defined, for API simplicity; if STBI_NO_LINEAR is defined, it always
+// reports false!
+
+STBIDEF int stbi_is_hdr_from_memory(stbi_uc const *buffer, int len)
+{
+   #ifndef STBI_NO_HDR
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__hdr_test(&s);
+   #else
+   STBI_NOTUSED(buffer);
+   STBI_NOTUSED(len);
+   return 0;
+   #endif
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF int      stbi_is_hdr          (char const *filename)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result=0;
+   if (f) {
       result = stbi_is_hdr_from_file(f);
       fclose(f);
    }
@@ -1590,7 +2867,8 @@ enum
 {
    STBI__SCAN_load=0,
    STBI__SCAN_type,
-   STBI__SCAN_header
+   STBI__SCAN_header,
+   STBI__SCAN_stream   // png: the chunks before the image data, for stbi_stream
 };
 
 static void stbi__refill_buffer(stbi__context *s)
@@ -1728,7 +3006,14 @@ static stbi__uint32 stbi__get32le(stbi__context *s)
 
 #define STBI__BYTECAST(x)  ((stbi_uc) ((x) & 255))  // truncate int to byte without warnings
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#ifndef STBI_NO_JPEG
+static stbi_uc stbi__compute_y(int r, int g, int b)
+{
+   return (stbi_uc) (((r*77) + (g*150) +  (29*b)) >> 8);
+}
+#endif
+
+#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
 // nothing
 #else
 //////////////////////////////////////////////////////////////////////////////
@@ -1740,115 +3025,59 @@ static stbi__uint32 stbi__get32le(stbi__context *s)
 //    interleave an alpha=255 channel, but falls back to this for other cases
 //
 //  assume data buffer is malloced, so malloc a new one and free that one
-//  only failure mode is malloc failing
-
-static stbi_uc stbi__compute_y(int r, int g, int b)
-{
-   return (stbi_uc) (((r*77) + (g*150) +  (29*b)) >> 8);
-}
-#endif
+//  only failure mode is malloc failing. the rows go through stbi__convert_row8/16
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
-// nothing
-#else
 static unsigned char *stbi__convert_format(unsigned char *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   stbi__convert_job job;
    unsigned char *good;
 
    if (req_comp == img_n) return data;
    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
+   if (img_n < 1 || img_n > 4) {
+      STBI_ASSERT(0);
+      stbi__free(data);
+      return stbi__errpuc("unsupported", "Unsupported format conversion");
+   }
 
    good = (unsigned char *) stbi__malloc_mad3(req_comp, x, y, 0);
    if (good == NULL) {
-      STBI_FREE(data);
+      stbi__free(data);
       return stbi__errpuc("outofmem", "Out of memory");
    }
 
-   for (j=0; j < (int) y; ++j) {
-      unsigned char *src  = data + j * x * img_n   ;
-      unsigned char *dest = good + j * x * req_comp;
-
-      #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (STBI__COMBO(img_n, req_comp)) {
-         STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=255;                                     } break;
-         STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=255;                     } break;
-         STBI__CASE(2,1) { dest[0]=src[0];                                                  } break;
-         STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                  } break;
-         STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                  } break;
-         STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=255;        } break;
-         STBI__CASE(3,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(3,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = 255;    } break;
-         STBI__CASE(4,1) { dest[0]=stbi__compute_y(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(4,2) { dest[0]=stbi__compute_y(src[0],src[1],src[2]); dest[1] = src[3]; } break;
-         STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                    } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
-      }
-      #undef STBI__CASE
-   }
+   stbi__convert_run(&job, STBI__CONVERT_FORMAT, data, good, img_n, req_comp, x, y);
 
-   STBI_FREE(data);
+   stbi__free(data);
    return good;
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
-// nothing
-#else
-static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
-{
-   return (stbi__uint16) (((r*77) + (g*150) +  (29*b)) >> 8);
-}
-#endif
-
 #if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
 // nothing
 #else
 static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int req_comp, unsigned int x, unsigned int y)
 {
-   int i,j;
+   stbi__convert_job job;
    stbi__uint16 *good;
 
    if (req_comp == img_n) return data;
    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
+   if (img_n < 1 || img_n > 4) {
+      STBI_ASSERT(0);
+      stbi__free(data);
+      return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
+   }
 
    good = (stbi__uint16 *) stbi__malloc(req_comp * x * y * 2);
    if (good == NULL) {
-      STBI_FREE(data);
+      stbi__free(data);
       return (stbi__uint16 *) stbi__errpuc("outofmem", "Out of memory");
    }
 
-   for (j=0; j < (int) y; ++j) {
-      stbi__uint16 *src  = data + j * x * img_n   ;
-      stbi__uint16 *dest = good + j * x * req_comp;
-
-      #define STBI__COMBO(a,b)  ((a)*8+(b))
-      #define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-      // convert source image with img_n components to one with req_comp components;
-      // avoid switch per pixel, so use switch per scanline and massive macros
-      switch (STBI__COMBO(img_n, req_comp)) {
-         STBI__CASE(1,2) { dest[0]=src[0]; dest[1]=0xffff;                                     } break;
-         STBI__CASE(1,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
-         STBI__CASE(1,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=0xffff;                     } break;
-         STBI__CASE(2,1) { dest[0]=src[0];                                                     } break;
-         STBI__CASE(2,3) { dest[0]=dest[1]=dest[2]=src[0];                                     } break;
-         STBI__CASE(2,4) { dest[0]=dest[1]=dest[2]=src[0]; dest[3]=src[1];                     } break;
-         STBI__CASE(3,4) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];dest[3]=0xffff;        } break;
-         STBI__CASE(3,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(3,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = 0xffff; } break;
-         STBI__CASE(4,1) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]);                   } break;
-         STBI__CASE(4,2) { dest[0]=stbi__compute_y_16(src[0],src[1],src[2]); dest[1] = src[3]; } break;
-         STBI__CASE(4,3) { dest[0]=src[0];dest[1]=src[1];dest[2]=src[2];                       } break;
-         default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return (stbi__uint16*) stbi__errpuc("unsupported", "Unsupported format conversion");
-      }
-      #undef STBI__CASE
-   }
+   stbi__convert_run(&job, STBI__CONVERT_FORMAT16, data, good, img_n, req_comp, x, y);
 
-   STBI_FREE(data);
+   stbi__free(data);
    return good;
 }
 #endif
@@ -1856,54 +3085,42 @@ static stbi__uint16 *stbi__convert_format16(stbi__uint16 *data, int img_n, int r
 #ifndef STBI_NO_LINEAR
 static float   *stbi__ldr_to_hdr(stbi_uc *data, int x, int y, int comp)
 {
-   int i,k,n;
+   stbi__convert_job job;
+   float table[512];
    float *output;
+   int i;
    if (!data) return NULL;
    output = (float *) stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
-   // compute number of non-alpha components
-   if (comp & 1) n = comp; else n = comp-1;
-   for (i=0; i < x*y; ++i) {
-      for (k=0; k < n; ++k) {
-         output[i*comp + k] = (float) (pow(data[i*comp+k]/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
-      }
-   }
-   if (n < comp) {
-      for (i=0; i < x*y; ++i) {
-         output[i*comp + n] = data[i*comp + n]/255.0f;
-      }
-   }
-   STBI_FREE(data);
+   if (output == NULL) { stbi__free(data); return stbi__errpf("outofmem", "Out of memory"); }
+   // a byte has only 256 values, so pow runs once for each of them
+   for (i=0; i < 256; ++i) {
+      table[i] = (float) (pow(i/255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+      table[256+i] = i/255.0f;
+   }
+   job.table = table;
+   stbi__convert_run(&job, STBI__CONVERT_LDR_TO_HDR, data, output, comp, comp, x, y);
+   stbi__free(data);
    return output;
 }
 #endif
 
 #ifndef STBI_NO_HDR
-#define stbi__float2int(x)   ((int) (x))
 static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 {
-   int i,k,n;
+   stbi__convert_job job;
+   float thresholds[256];
    stbi_uc *output;
    if (!data) return NULL;
    output = (stbi_uc *) stbi__malloc_mad3(x, y, comp, 0);
-   if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
-   // compute number of non-alpha components
-   if (comp & 1) n = comp; else n = comp-1;
-   for (i=0; i < x*y; ++i) {
-      for (k=0; k < n; ++k) {
-         float z = (float) pow(data[i*comp+k]*stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
-      }
-      if (k < comp) {
-         float z = data[i*comp+k] * 255 + 0.5f;
-         if (z < 0) z = 0;
-         if (z > 255) z = 255;
-         output[i*comp + k] = (stbi_uc) stbi__float2int(z);
-      }
-   }
-   STBI_FREE(data);
+   if (output == NULL) { stbi__free(data); return stbi__errpuc("outofmem", "Out of memory"); }
+   // finding the thresholds costs about a thousand pow calls, small images are cheaper without
+   job.table = NULL;
+   if ((size_t) x * y * comp >= 4096 && stbi__hdr_to_ldr_thresholds(thresholds, stbi__h2l_scale_i, stbi__h2l_gamma_i))
+      job.table = thresholds;
+   job.scale = stbi__h2l_scale_i;
+   job.gamma = stbi__h2l_gamma_i;
+   stbi__convert_run(&job, STBI__CONVERT_HDR_TO_LDR, data, output, comp, comp, x, y);
+   stbi__free(data);
    return output;
 }
 #endif
@@ -1932,7 +3149,9 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 #ifndef STBI_NO_JPEG
 
 // huffman decoding acceleration
-#define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
+// 10 bits: most ac codes plus their magnitude bits resolve in one lookup. 11 is a little faster on
+// large images, but every table (progressive files rebuild them between scans) costs twice as much to build
+#define FAST_BITS   10  // larger handles more cases; smaller stomps less cache
 
 typedef struct
 {
@@ -1968,6 +3187,8 @@ typedef struct
       int dc_pred;
 
       int x,y,w2,h2;
+      int shift;  // blocks decode to (8>>shift)^2 pixels
+      void (*idct)(stbi_uc *out, int out_stride, short data[64]);
       stbi_uc *data;
       void *raw_data, *raw_coeff;
       stbi_uc *linebuf;
@@ -1992,11 +3213,14 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int scale_shift;
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+   stbi_uc *(*resample_row_h_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+   stbi_uc *(*resample_row_generic_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
 
 static int stbi__build_huffman(stbi__huffman *h, int *count)
@@ -2522,6 +3746,58 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced IDCTs for decoding at 1/2, 1/4 and 1/8 size: the 4, 2 and 1 point IDCTs of the lowest
+// frequencies, scaled so a flat block keeps its level
+#define STBI__IDCT_4(s0,s1,s2,s3) \
+   int e0 = ((s0) + (s2)) * stbi__f2f(0.353553391f);                  \
+   int e1 = ((s0) - (s2)) * stbi__f2f(0.353553391f);                  \
+   int o0 = (s1) * stbi__f2f(0.461939766f) + (s3) * stbi__f2f(0.191341716f); \
+   int o1 = (s1) * stbi__f2f(0.191341716f) - (s3) * stbi__f2f(0.461939766f);
+
+static void stbi__idct_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[16],*v=val;
+   stbi_uc *o;
+   short *d = data;
+
+   // columns, 1<<12 from the constants, keep 2 bits of it
+   for (i=0; i < 4; ++i,++d,++v) {
+      STBI__IDCT_4(d[0],d[8],d[16],d[24])
+      v[ 0] = (e0+o0 + 512) >> 10;
+      v[ 4] = (e1+o1 + 512) >> 10;
+      v[ 8] = (e1-o1 + 512) >> 10;
+      v[12] = (e0-o0 + 512) >> 10;
+   }
+
+   // rows, 1<<14 in total, rounded and moved to 0..255
+   for (i=0, v=val, o=out; i < 4; ++i,v+=4,o+=out_stride) {
+      STBI__IDCT_4(v[0],v[1],v[2],v[3])
+      e0 += (1 << 13) + (128 << 14);
+      e1 += (1 << 13) + (128 << 14);
+      o[0] = stbi__clamp((e0+o0) >> 14);
+      o[1] = stbi__clamp((e1+o1) >> 14);
+      o[2] = stbi__clamp((e1-o1) >> 14);
+      o[3] = stbi__clamp((e0-o0) >> 14);
+   }
+}
+#undef STBI__IDCT_4
+
+static void stbi__idct_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   // every coefficient has weight 1/8
+   int a = data[0] + 4 + (128 << 3), b = data[1], c = data[8], d = data[9];
+   out[0]            = stbi__clamp((a + b + c + d) >> 3);
+   out[1]            = stbi__clamp((a - b + c - d) >> 3);
+   out[out_stride]   = stbi__clamp((a + b - c - d) >> 3);
+   out[out_stride+1] = stbi__clamp((a - b - c + d) >> 3);
+}
+
+static void stbi__idct_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp((data[0] + 4 + (128 << 3)) >> 3);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2703,6 +3979,164 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above, bit-identical as well. the 16-bit rows stay in sse
+// registers, every 32-bit intermediate is a single ymm register where sse2 needs two
+static STBI__AVX2_TARGET void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         /* the pack works per 128-bit lane, put sum and dif back in order */ \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack, then 8bit 8x8 transpose
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -2945,128 +4379,212 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+// number of MCUs in the current scan
+static int stbi__jpeg_scan_mcus(stbi__jpeg *z)
 {
-   stbi__jpeg_reset(z);
-   if (!z->progressive) {
-      if (z->scan_n == 1) {
-         int i,j;
-         STBI_SIMD_ALIGN(short, data[64]);
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
-         }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
-                  }
-               }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+   if (z->scan_n == 1) {
+      // non-interleaved data is one block per MCU, as many as the component has "pixels" for,
+      // independent of interleaved MCU blocking and such
+      int n = z->order[0];
+      return ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   }
+   return z->img_mcu_x * z->img_mcu_y;
+}
+
+// decodes MCUs first .. first+count-1 of the current scan, in scanline order
+static int stbi__parse_mcus(stbi__jpeg *z, int first, int count)
+{
+   int i,j,k,x,y,c;
+   STBI_SIMD_ALIGN(short, data[64]);
+   if (z->scan_n == 1) {
+      // non-interleaved data, we just need to process one block at a time
+      int n = z->order[0];
+      int w = (z->img_comp[n].x+7) >> 3;
+      int bs = 8 >> z->img_comp[n].shift;
+      int ha = z->img_comp[n].ha;
+      i = first % w;
+      j = first / w;
+      for (c=0; c < count; ++c) {
+         if (!z->progressive) {
+            if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            z->img_comp[n].idct(z->img_comp[n].data+z->img_comp[n].w2*j*bs+i*bs, z->img_comp[n].w2, data);
+         } else {
+            short *coeff = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+            if (z->spec_start == 0) {
+               if (!stbi__jpeg_decode_block_prog_dc(z, coeff, &z->huff_dc[z->img_comp[n].hd], n))
+                  return 0;
+            } else {
+               if (!stbi__jpeg_decode_block_prog_ac(z, coeff, &z->huff_ac[ha], z->fast_ac[ha]))
+                  return 0;
             }
          }
-         return 1;
+         if (++i == w) { i = 0; ++j; }
       }
-   } else {
-      if (z->scan_n == 1) {
-         int i,j;
-         int n = z->order[0];
-         // non-interleaved data, we just need to process one block at a time,
-         // in trivial scanline order
-         // number of blocks to do just depends on how many actual "pixels" this
-         // component has, independent of interleaved MCU blocking and such
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               if (z->spec_start == 0) {
-                  if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                     return 0;
-               } else {
-                  int ha = z->img_comp[n].ha;
-                  if (!stbi__jpeg_decode_block_prog_ac(z, data, &z->huff_ac[ha], z->fast_ac[ha]))
-                     return 0;
-               }
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
-            }
-         }
-         return 1;
-      } else { // interleaved
-         int i,j,k,x,y;
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x);
-                        int y2 = (j*z->img_comp[n].v + y);
-                        short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
-                        if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                           return 0;
-                     }
+   } else { // interleaved
+      i = first % z->img_mcu_x;
+      j = first / z->img_mcu_x;
+      for (c=0; c < count; ++c) {
+         // scan an interleaved mcu... process scan_n components in order
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            // scan out an mcu's worth of this component; that's just determined
+            // by the basic H and V specified for the component
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = (i*z->img_comp[n].h + x);
+                  int y2 = (j*z->img_comp[n].v + y);
+                  if (!z->progressive) {
+                     int bs = 8 >> z->img_comp[n].shift;
+                     int ha = z->img_comp[n].ha;
+                     if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                     z->img_comp[n].idct(z->img_comp[n].data+z->img_comp[n].w2*y2*bs+x2*bs, z->img_comp[n].w2, data);
+                  } else {
+                     short *coeff = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
+                     if (!stbi__jpeg_decode_block_prog_dc(z, coeff, &z->huff_dc[z->img_comp[n].hd], n))
+                        return 0;
                   }
                }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
             }
          }
-         return 1;
+         if (++i == z->img_mcu_x) { i = 0; ++j; }
       }
    }
+   return 1;
+}
+
+// decodes MCUs first .. end-1 of the current scan, expecting the RST marker after every
+// full restart interval. returns 0 on error, 2 when a marker is missing, 1 otherwise
+static int stbi__parse_mcu_range(stbi__jpeg *z, int first, int end)
+{
+   int ri = z->restart_interval;
+   while (first < end) {
+      int count = ri ? ri - first % ri : end - first;
+      if (count > end - first) count = end - first;
+      if (!stbi__parse_mcus(z, first, count)) return 0;
+      first += count;
+      if (ri && first % ri == 0) {
+         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+         if (!STBI__RESTART(z->marker)) return 2;
+         stbi__jpeg_reset(z);
+      }
+   }
+   return 1;
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
+{
+   stbi__jpeg_reset(z);
+   // if a restart marker is missing, then just bail, so we get corrupt data
+   // rather than no data
+   return stbi__parse_mcu_range(z, 0, stbi__jpeg_scan_mcus(z)) != 0;
+}
+
+// restart intervals are independent: each starts byte aligned after an RST marker with the
+// dc predictions and eob run reset, and they cover disjoint MCUs. they decode in parallel
+// through the installed parallel-for, each task a run of intervals with its own copy of the
+// decoder state
+#define STBI__JPEG_MAX_TASKS      16
+#define STBI__JPEG_MIN_TASK_MCUS  256   // less than that isn't worth copying the decoder state
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__jpeg *state;       // per task
+   stbi__context *source;   // per task
+   stbi_uc **start;         // first byte of every interval
+   int total, intervals, tasks;
+   int ok[STBI__JPEG_MAX_TASKS];
+   const char *failure_reason[STBI__JPEG_MAX_TASKS];
+} stbi__jpeg_intervals;
+
+static void stbi__jpeg_interval_task(void *task_data, int t)
+{
+   stbi__jpeg_intervals *job = (stbi__jpeg_intervals *) task_data;
+   stbi__jpeg *z = &job->state[t];
+   int ri = job->z->restart_interval;
+   int per = job->intervals / job->tasks, extra = job->intervals % job->tasks;
+   int k = per * t + (t < extra ? t : extra);
+   int end = k + per + (t < extra);
+   *z = *job->z;
+   job->source[t] = *job->z->s;
+   z->s = &job->source[t];
+   job->ok[t] = 1;
+   for (; k < end; ++k) {
+      int first = k * ri;
+      z->s->img_buffer = job->start[k];
+      stbi__jpeg_reset(z);
+      if (!stbi__parse_mcus(z, first, job->total - first < ri ? job->total - first : ri)) {
+         job->ok[t] = 0;
+         job->failure_reason[t] = stbi__g_failure_reason;
+         return;
+      }
+   }
+}
+
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg *z)
+{
+   stbi__context *s = z->s;
+   stbi__jpeg_intervals job;
+   stbi_uc *p, *end = NULL;
+   int found = 1, t, ri = z->restart_interval;
+   int total = stbi__jpeg_scan_mcus(z);
+
+   // only memory sources can be read anywhere
+   if (!stbi__parallel_for_func || !ri || s->read_from_callbacks)
+      return stbi__parse_entropy_coded_data(z);
+   job.intervals = (total + ri-1) / ri;
+   job.tasks = total / STBI__JPEG_MIN_TASK_MCUS;
+   if (job.tasks > job.intervals) job.tasks = job.intervals;
+   if (job.tasks > STBI__JPEG_MAX_TASKS) job.tasks = STBI__JPEG_MAX_TASKS;
+   if (job.tasks < 2)
+      return stbi__parse_entropy_coded_data(z);
+
+   // find the intervals, and the marker after the scan
+   job.start = (stbi_uc **) stbi__malloc(sizeof(stbi_uc *) * job.intervals);
+   if (!job.start) return stbi__err("outofmem", "Out of memory");
+   job.start[0] = p = s->img_buffer;
+   while ((p = (stbi_uc *) memchr(p, 0xff, s->img_buffer_end - p)) != NULL && p+1 < s->img_buffer_end) {
+      if (p[1] == 0x00) p += 2;       // stuffed zero
+      else if (p[1] == 0xff) p += 1;  // fill byte
+      else if (STBI__RESTART(p[1])) {
+         if (found == job.intervals) break;
+         job.start[found++] = p += 2;
+      } else {
+         end = p;
+         break;
+      }
+   }
+   // not one RST per interval: a damaged file, decode it serially as far as it goes
+   if (found != job.intervals || (p && !end)) {
+      stbi__free(job.start);
+      return stbi__parse_entropy_coded_data(z);
+   }
+
+   job.z = z;
+   job.total = total;
+   job.state = (stbi__jpeg *) stbi__malloc_mad2(job.tasks, sizeof(stbi__jpeg), 0);
+   job.source = (stbi__context *) stbi__malloc_mad2(job.tasks, sizeof(stbi__context), 0);
+   if (!job.state || !job.source) {
+      stbi__free(job.start); stbi__free(job.state); stbi__free(job.source);
+      return stbi__err("outofmem", "Out of memory");
+   }
+   stbi__parallel_run(job.tasks, stbi__jpeg_interval_task, &job);
+   stbi__free(job.start);
+   stbi__free(job.state);
+   stbi__free(job.source);
+   // report the first interval that failed, as a serial decode would
+   for (t=0; t < job.tasks; ++t)
+      if (!job.ok[t]) { stbi__g_failure_reason = job.failure_reason[t]; return 0; }
+
+   // continue after the scan like the serial decode, at the marker that ends it
+   stbi__jpeg_reset(z);
+   if (end) {
+      s->img_buffer = end + 2;
+      z->marker = end[1];
+   } else {
+      s->img_buffer = s->img_buffer_end;
+   }
+   return 1;
 }
 
 static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
@@ -3076,22 +4594,41 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+#define STBI__JPEG_FINISH_BANDS  4   // block row bands per component when running in parallel
+
+typedef struct
+{
+   stbi__jpeg *z;
+   int bands;
+} stbi__jpeg_finish_job;
+
+// dequantize and idct one band of block rows of one component
+static void stbi__jpeg_finish_task(void *task_data, int index)
+{
+   stbi__jpeg_finish_job *job = (stbi__jpeg_finish_job *) task_data;
+   stbi__jpeg *z = job->z;
+   int n = index / job->bands, band = index % job->bands;
+   int w = (z->img_comp[n].x+7) >> 3;
+   int h = (z->img_comp[n].y+7) >> 3;
+   int bs = 8 >> z->img_comp[n].shift;
+   int i, j = h * band / job->bands, end = h * (band+1) / job->bands;
+   for (; j < end; ++j) {
+      for (i=0; i < w; ++i) {
+         short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+         stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+         z->img_comp[n].idct(z->img_comp[n].data+z->img_comp[n].w2*j*bs+i*bs, z->img_comp[n].w2, data);
+      }
+   }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
    if (z->progressive) {
-      // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
-         }
-      }
+      // dequantize and idct the data, the components and bands of their block rows are independent
+      stbi__jpeg_finish_job job;
+      job.z = z;
+      job.bands = stbi__parallel_for_func ? STBI__JPEG_FINISH_BANDS : 1;
+      stbi__parallel_run(z->s->img_n * job.bands, stbi__jpeg_finish_task, &job);
    }
 }
 
@@ -3243,17 +4780,17 @@ static int stbi__free_jpeg_components(stbi__jpeg *z, int ncomp, int why)
    int i;
    for (i=0; i < ncomp; ++i) {
       if (z->img_comp[i].raw_data) {
-         STBI_FREE(z->img_comp[i].raw_data);
+         stbi__free(z->img_comp[i].raw_data);
          z->img_comp[i].raw_data = NULL;
          z->img_comp[i].data = NULL;
       }
       if (z->img_comp[i].raw_coeff) {
-         STBI_FREE(z->img_comp[i].raw_coeff);
+         stbi__free(z->img_comp[i].raw_coeff);
          z->img_comp[i].raw_coeff = 0;
          z->img_comp[i].coeff = 0;
       }
       if (z->img_comp[i].linebuf) {
-         STBI_FREE(z->img_comp[i].linebuf);
+         stbi__free(z->img_comp[i].linebuf);
          z->img_comp[i].linebuf = NULL;
       }
    }
@@ -3318,9 +4855,17 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
    for (i=0; i < s->img_n; ++i) {
+      int hs = h_max / z->img_comp[i].h, shift = z->scale_shift;
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
       z->img_comp[i].y = (s->img_y * z->img_comp[i].v + v_max-1) / v_max;
+      // at a reduced size, subsampled planes use a larger IDCT than the full resolution ones
+      // when that lands them at the output size, so they need no upsampling
+      if (hs == v_max / z->img_comp[i].v && (hs == 2 || hs == 4)) {
+         if (shift >= (hs == 2 ? 1 : 2)) shift -= (hs == 2 ? 1 : 2);
+      }
+      z->img_comp[i].shift = shift;
+      z->img_comp[i].idct = shift == 0 ? z->idct_block_kernel : shift == 1 ? stbi__idct_4x4 : shift == 2 ? stbi__idct_2x2 : stbi__idct_1x1;
       // to simplify generation, we'll allocate enough memory to decode
       // the bogus oversized data from using interleaved MCUs and their
       // big blocks (e.g. a 16x16 iMCU on an image of width 33); we won't
@@ -3328,8 +4873,8 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      z->img_comp[i].w2 = (z->img_mcu_x * z->img_comp[i].h * 8) >> shift;
+      z->img_comp[i].h2 = (z->img_mcu_y * z->img_comp[i].v * 8) >> shift;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3339,10 +4884,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // coefficients are kept for every block whatever size they decode to
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3421,7 +4966,11 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
-         if (!stbi__parse_entropy_coded_data(j)) return 0;
+         if (j->progressive && j->spec_start != 0 && j->img_comp[j->order[0]].shift == 3) {
+            // ac scan of a plane decoded from its dc alone, skip to the marker after it. planes that
+            // keep some ac can't skip bands: a later refinement scan may cover them too
+            do j->marker = stbi__skip_jpeg_junk_at_end(j); while (STBI__RESTART(j->marker));
+         } else if (!stbi__parse_entropy_coded_data_parallel(j)) return 0;
          if (j->marker == STBI__MARKER_none ) {
          j->marker = stbi__skip_jpeg_junk_at_end(j);
             // if we reach eof without hitting a marker, stbi__get_marker() below will fail and we'll eventually return 0
@@ -3816,12 +5365,198 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// avx2 versions of the upsamplers and the colour conversion, 16 pixels per step and bit-identical
+// to the scalar ones like the sse2 kernels
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_h_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // need to generate two samples horizontally for every one in input
+   int i;
+   stbi_uc *input = in_near;
+
+   if (w == 1) {
+      out[0] = out[1] = input[0];
+      return out;
+   }
+
+   out[0] = input[0];
+   out[1] = stbi__div4(input[0]*3 + input[1] + 2);
+   // the neighbours are unaligned loads, so the last pixel is left to the scalar loop
+   for (i=1; i+16 < w; i += 16) {
+      __m256i prev = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (input + i - 1)));
+      __m256i curr = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (input + i)));
+      __m256i next = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (input + i + 1)));
+      // 3*cur + 2 is shared by both phases
+      __m256i n    = _mm256_add_epi16(_mm256_add_epi16(curr, _mm256_slli_epi16(curr, 1)), _mm256_set1_epi16(2));
+      __m256i even = _mm256_srli_epi16(_mm256_add_epi16(n, prev), 2);
+      __m256i odd  = _mm256_srli_epi16(_mm256_add_epi16(n, next), 2);
+      // the interleave and the pack both work per 128-bit lane, which puts the pixels back in order
+      __m256i outv = _mm256_packus_epi16(_mm256_unpacklo_epi16(even, odd), _mm256_unpackhi_epi16(even, odd));
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+   }
+   for (; i < w-1; ++i) {
+      int n = 3*input[i]+2;
+      out[i*2+0] = stbi__div4(n+input[i-1]);
+      out[i*2+1] = stbi__div4(n+input[i+1]);
+   }
+   out[i*2+0] = stbi__div4(input[w-2]*3 + input[w-1] + 2);
+   out[i*2+1] = input[w-1];
+
+   STBI_NOTUSED(in_far);
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // need to generate 2x2 samples for every one in input
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   // same as the sse2 version with 16 pixels, the last pixel of the row is left to the scalar loop
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i curr  = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+      // current row shifted by one pixel either way, across the lanes, with the pixels
+      // before and after this group put in
+      __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+      __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, (short) t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, (short) (3*in_near[i+16] + in_far[i+16]), 15);
+
+      // horizontal pass, polyphase:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      __m256i curb = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), _mm256_set1_epi16(8));
+      __m256i even = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+      __m256i odd  = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+      // interleave even and odd pixels, undo scaling, pack. per lane, which keeps the order
+      __m256i de0  = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+      __m256i de1  = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_generic_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // nearest-neighbor. 2x and 4x are byte shuffles of 16 or 8 input pixels into 32 output
+   // pixels, each lane of the shuffle reads its half of the input
+   int i=0,j;
+   if (hs == 2 || hs == 4) {
+      __m256i index = hs == 2
+         ? _mm256_setr_epi8(0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7, 8,8,9,9,10,10,11,11,12,12,13,13,14,14,15,15)
+         : _mm256_setr_epi8(0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3, 4,4,4,4,5,5,5,5,6,6,6,6,7,7,7,7);
+      int step = 32 / hs;
+      for (; i + 16 <= w; i += step) {
+         __m256i in = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *) (in_near + i)));
+         _mm256_storeu_si256((__m256i *) (out + i*hs), _mm256_shuffle_epi8(in, index));
+      }
+   }
+   STBI_NOTUSED(in_far);
+   for (; i < w; ++i)
+      for (j=0; j < hs; ++j)
+         out[i*hs+j] = in_near[i];
+   return out;
+}
+
+static STBI__AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   // same arithmetic as the sse2 version. step 3 is handled too: each 4 pixel group of the rgba
+   // result is shuffled down to 12 bytes and stored with a 16 byte store the next one overwrites,
+   // so the loop stops while the row still has 2 pixels for the last store to spill into
+   if (step == 3 || step == 4) {
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i bias128 = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+      __m128i rgb = _mm_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+      int end = step == 4 ? count - 15 : count - 17;
+
+      for (; i < end; i += 16) {
+         // load and widen, y as (y << 4) + 8 and cr, cb as (c - 128) << 8 like the sse2 unpacks
+         __m256i yw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (y+i)));
+         __m256i crw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcr+i)));
+         __m256i cbw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (pcb+i)));
+         __m256i yws = _mm256_add_epi16(_mm256_slli_epi16(yw, 4), _mm256_set1_epi16(8));
+         __m256i crs = _mm256_slli_epi16(_mm256_sub_epi16(crw, bias128), 8);
+         __m256i cbs = _mm256_slli_epi16(_mm256_sub_epi16(cbw, bias128), 8);
+
+         // color transform
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crs);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbs);
+         __m256i cb1 = _mm256_mulhi_epi16(cbs, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crs, cr_const1);
+         __m256i rw  = _mm256_srai_epi16(_mm256_add_epi16(cr0, yws), 4);
+         __m256i gw  = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(cb0, yws), cr1), 4);
+         __m256i bw  = _mm256_srai_epi16(_mm256_add_epi16(yws, cb1), 4);
+
+         // back to byte and interleave, per lane: pixels 0-7 in the low lanes, 8-15 in the high ones
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1); // pixels 0-3 | 8-11
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1); // pixels 4-7 | 12-15
+
+         if (step == 4) {
+            _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+            _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+            out += 64;
+         } else {
+            _mm_storeu_si128((__m128i *) (out + 0), _mm_shuffle_epi8(_mm256_castsi256_si128(o0), rgb));
+            _mm_storeu_si128((__m128i *) (out + 12), _mm_shuffle_epi8(_mm256_castsi256_si128(o1), rgb));
+            _mm_storeu_si128((__m128i *) (out + 24), _mm_shuffle_epi8(_mm256_extracti128_si256(o0, 1), rgb));
+            _mm_storeu_si128((__m128i *) (out + 36), _mm_shuffle_epi8(_mm256_extracti128_si256(o1, 1), rgb));
+            out += 48;
+         }
+      }
+   }
+
+   stbi__YCbCr_to_RGB_row(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
+   j->resample_row_h_2_kernel = stbi__resample_row_h_2;
+   j->resample_row_generic_kernel = stbi__resample_row_generic;
 
 #ifdef STBI_SSE2
    if (stbi__sse2_available()) {
@@ -3831,6 +5566,16 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    }
 #endif
 
+#ifdef STBI_AVX2
+   if (stbi__avx2_available()) {
+      j->idct_block_kernel = stbi__idct_avx2;
+      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+      j->resample_row_h_2_kernel = stbi__resample_row_h_2_avx2;
+      j->resample_row_generic_kernel = stbi__resample_row_generic_avx2;
+   }
+#endif
+
 #ifdef STBI_NEON
    j->idct_block_kernel = stbi__idct_simd;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
@@ -3861,167 +5606,249 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
-{
-   int n, decode_n, is_rgb;
-   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
-
-   // validate req_comp
-   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
-
-   // load a jpeg image from whichever source, but leave in YCbCr format
-   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
-
-   // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+#define STBI__JPEG_MAX_BANDS      32
+#define STBI__JPEG_MIN_BAND_ROWS  16
 
-   is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample res_comp[4];  // hs, vs, w_lores and the kernel; the rest is per band
+   stbi_uc *output;
+   stbi_uc *tail;               // a row per band, see below
+   int n, decode_n, is_rgb, bands;
+} stbi__jpeg_convert;
 
-   if (z->s->img_n == 3 && n < 3 && !is_rgb)
-      decode_n = 1;
+// sets up the conversion of the decoded planes to n channels, with line buffers for as many bands.
+// returns 0 when there is nothing to convert, or when out of memory
+static int stbi__jpeg_convert_begin(stbi__jpeg_convert *job, stbi__jpeg *z, int n, int bands)
+{
+   int k;
+   job->z = z;
+   job->n = n;
+   job->bands = bands;
+   job->output = NULL;
+   job->tail = NULL;
+   job->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
+   if (z->s->img_n == 3 && n < 3 && !job->is_rgb)
+      job->decode_n = 1;
    else
-      decode_n = z->s->img_n;
+      job->decode_n = z->s->img_n;
 
    // nothing to do if no components requested; check this now to avoid
    // accessing uninitialized coutput[0] later
-   if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
+   if (job->decode_n <= 0) return 0;
 
-   // resample and color-convert
-   {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   for (k=0; k < job->decode_n; ++k) {
+      stbi__resample *r = &job->res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4, one per band
+      z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc_mad2(bands, z->s->img_x + 3, 0);
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+
+      // planes decoded with a larger IDCT than the scale need less expansion, or none
+      r->hs      = (z->img_h_max / z->img_comp[k].h << z->img_comp[k].shift) >> z->scale_shift;
+      r->vs      = (z->img_v_max / z->img_comp[k].v << z->img_comp[k].shift) >> z->scale_shift;
+      r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = z->resample_row_h_2_kernel;
+      else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+      else                               r->resample = z->resample_row_generic_kernel;
+   }
 
-      stbi__resample res_comp[4];
+   if (bands > 1) {
+      job->tail = (stbi_uc *) stbi__malloc_mad3(bands, n, z->s->img_x, bands);
+      if (!job->tail) return stbi__err("outofmem", "Out of memory");
+   }
+   return 1;
+}
 
+// resample and color-convert output rows j .. end-1 with the line buffers of a band, starting
+// the resamplers where the rows before would have left them
+static void stbi__jpeg_convert_rows(stbi__jpeg_convert *job, int band, unsigned int j, unsigned int end)
+{
+   stbi__jpeg *z = job->z;
+   stbi_uc *output = job->output;
+   int n = job->n, decode_n = job->decode_n, is_rgb = job->is_rgb;
+   int k;
+   unsigned int i;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   stbi__resample res_comp[4];
+
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &res_comp[k];
+      int steps = (job->res_comp[k].vs >> 1) + j;
+      int t = steps / job->res_comp[k].vs;
+      int last = z->img_comp[k].y - 1;
+      *r = job->res_comp[k];
+      r->ystep = steps % r->vs;
+      r->ypos  = t;
+      r->line1 = z->img_comp[k].data + z->img_comp[k].w2 * (t < last ? t : last);
+      r->line0 = t == 0 ? r->line1 : z->img_comp[k].data + z->img_comp[k].w2 * (t-1 < last ? t-1 : last);
+   }
+
+   for (; j < end; ++j) {
+      // some conversions write pixels wider than n bytes (3 byte pixels as 4 bytes, the 1 channel
+      // cmyk path as 2), so a row writes the first byte of the next one. the next band's first row
+      // may already be done: the last row of a band goes through its own buffer
+      stbi_uc *row = output + n * z->s->img_x * j;
+      stbi_uc *dest = j+1 == end && job->tail ? job->tail + band * (n * z->s->img_x + 1) : row;
+      stbi_uc *out = dest;
       for (k=0; k < decode_n; ++k) {
          stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
-
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(z->img_comp[k].linebuf + band * (z->s->img_x + 3),
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
          }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
                for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
                   out += n;
                }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
                for (i=0; i < z->s->img_x; ++i) {
                   stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
                   out += n;
                }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
                for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
                   out += n;
                }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
             }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
          }
       }
-      stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
-      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      if (dest != row)
+         memcpy(row, dest, n * z->s->img_x);
+   }
+}
+
+static void stbi__jpeg_convert_band(void *task_data, int band)
+{
+   stbi__jpeg_convert *job = (stbi__jpeg_convert *) task_data;
+   stbi__uint32 h = job->z->s->img_y;
+   stbi__jpeg_convert_rows(job, band, h * band / job->bands, h * (band+1) / job->bands);
+}
+
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   int n, bands;
+   stbi_uc *output;
+   stbi__jpeg_convert job;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+   // validate req_comp
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+
+   // load a jpeg image from whichever source, but leave in YCbCr format
+   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+
+   // from here on the image and its planes have their reduced sizes
+   if (z->scale_shift) {
+      int k, round = (1 << z->scale_shift) - 1;
+      z->s->img_x = (z->s->img_x + round) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + round) >> z->scale_shift;
+      for (k=0; k < z->s->img_n; ++k) {
+         int cround = (1 << z->img_comp[k].shift) - 1;
+         z->img_comp[k].x = (z->img_comp[k].x + cround) >> z->img_comp[k].shift;
+         z->img_comp[k].y = (z->img_comp[k].y + cround) >> z->img_comp[k].shift;
+      }
    }
+
+   // determine actual number of components to generate
+   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+
+   // resample and color-convert, in bands of rows when there are threads to run them
+   bands = 1;
+   if (stbi__parallel_for_func) {
+      bands = z->s->img_y / STBI__JPEG_MIN_BAND_ROWS;
+      if (bands > STBI__JPEG_MAX_BANDS) bands = STBI__JPEG_MAX_BANDS;
+      if (bands < 1) bands = 1;
+   }
+   if (!stbi__jpeg_convert_begin(&job, z, n, bands)) { stbi__free(job.tail); stbi__cleanup_jpeg(z); return NULL; }
+
+   // can't error after this so, this is safe
+   output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+   if (!output) { stbi__free(job.tail); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+   job.output = output;
+
+   stbi__parallel_run(job.bands, stbi__jpeg_convert_band, &job);
+   stbi__free(job.tail);
+   stbi__cleanup_jpeg(z);
+   *out_x = z->s->img_x;
+   *out_y = z->s->img_y;
+   if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+   return output;
 }
 
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
@@ -4032,9 +5859,10 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    memset(j, 0, sizeof(stbi__jpeg));
    STBI_NOTUSED(ri);
    j->s = s;
+   j->scale_shift = s->scale_shift;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
-   STBI_FREE(j);
+   stbi__free(j);
    return result;
 }
 
@@ -4048,7 +5876,7 @@ static int stbi__jpeg_test(stbi__context *s)
    stbi__setup_jpeg(j);
    r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
    stbi__rewind(s);
-   STBI_FREE(j);
+   stbi__free(j);
    return r;
 }
 
@@ -4072,7 +5900,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
    memset(j, 0, sizeof(stbi__jpeg));
    j->s = s;
    result = stbi__jpeg_info_raw(j, x, y, comp);
-   STBI_FREE(j);
+   stbi__free(j);
    return result;
 }
 #endif
@@ -4091,6 +5919,26 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// tables for the fast inner loop, see stbi__zbuild_fast. a literal/length entry
+// decodes up to two literals, or a length, from the next STBI__ZLIT_BITS bits
+#define STBI__ZLIT_BITS   11
+#define STBI__ZDIST_BITS  10
+#define STBI__ZLIT_MASK   ((1 << STBI__ZLIT_BITS) - 1)
+#define STBI__ZDIST_MASK  ((1 << STBI__ZDIST_BITS) - 1)
+// the fast loop runs while this much input and output is left: one refill per
+// symbol reads a machine word, one match writes up to 258 bytes plus 8 of slop
+#define STBI__ZFAST_IN    16
+#define STBI__ZFAST_OUT   (258 + 8)
+// #define STBI_NO_ZFAST to leave the fast loop out and decode every symbol a bit
+// at a time through stbi__zhuffman_decode, as tests/zlib_inflate_bench.cpp does
+// for its reference decoder
+
+// word sized refills only where a loaded word is little-endian
+#if defined(_MSC_VER) || defined(STBI__X86_TARGET) || defined(STBI__X64_TARGET) || \
+    (defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define STBI__ZWORD_REFILL
+#endif
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4173,6 +6021,11 @@ static int stbi__zbuild_huffman(stbi__zhuffman *z, const stbi_uc *sizelist, int
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
 
+// called after every deflate block with all the output so far, so PNG can
+// unfilter the rows that are complete while they are still in cache.
+// start moves when the output buffer grows. return 0 to stop with an error
+typedef int stbi__zprogress(void *user, stbi_uc *start, stbi_uc *end);
+
 typedef struct
 {
    stbi_uc *zbuffer, *zbuffer_end;
@@ -4186,6 +6039,17 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+#ifndef STBI_NO_ZFAST
+   stbi__uint32 zfast_length[1 << STBI__ZLIT_BITS];
+   stbi__uint32 zfast_distance[1 << STBI__ZDIST_BITS];
+#endif
+
+   stbi__zprogress *progress;
+   void *progress_user;
+
+   // where stbi__zinflate is in the stream, so it can stop and go on when more input arrives
+   int state, final, stored_left;
+   int partial; // the input is only the start of the stream
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4220,13 +6084,15 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// decodes the symbol at the bottom of the next 16 bits of the stream, its size goes in *size.
+// codes shorter than min_size are not looked for
+static int stbi__zhuffman_decode_code(stbi__zhuffman *z, int code, int min_size, int *size)
 {
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
-   for (s=STBI__ZFAST_BITS+1; ; ++s)
+   k = stbi__bit_reverse(code, 16);
+   for (s=min_size; ; ++s)
       if (k < z->maxcode[s])
          break;
    if (s >= 16) return -1; // invalid code!
@@ -4234,9 +6100,17 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
    if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
    if (z->size[b] != s) return -1;  // was originally an assert, but report failure instead.
+   *size = s;
+   return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int s, v = stbi__zhuffman_decode_code(z, (int) (a->code_buffer & 0xffff), STBI__ZFAST_BITS+1, &s);
+   if (v < 0) return -1;
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -4282,7 +6156,7 @@ static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room
       if(limit > UINT_MAX / 2) return stbi__err("outofmem", "Out of memory");
       limit *= 2;
    }
-   q = (char *) STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+   q = (char *) stbi__realloc_sized(z->zout_start, old_limit, limit);
    STBI_NOTUSED(old_limit);
    if (q == NULL) return stbi__err("outofmem", "Out of memory");
    z->zout_start = q;
@@ -4305,30 +6179,268 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
-static int stbi__parse_huffman_block(stbi__zbuf *a)
+#ifndef STBI_NO_ZFAST
+// fills table with an entry for every value of the next bits of the stream whose
+// code is at most that long: bits 0-7 code size, 16-31 symbol.
+// the other entries stay 0, the code is longer or invalid
+static void stbi__zbuild_fast_codes(stbi__uint32 *table, int bits, const stbi_uc *sizelist, int num)
 {
-   char *zout = a->zout;
-   for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
-      if (z < 256) {
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
-         if (zout >= a->zout_end) {
-            if (!stbi__zexpand(a, zout, 1)) return 0;
-            zout = a->zout;
+   int i, code = 0, next_code[16], sizes[16];
+   memset(sizes, 0, sizeof(sizes));
+   memset(table, 0, sizeof(*table) << bits);
+   for (i=0; i < num; ++i)
+      ++sizes[sizelist[i]];
+   sizes[0] = 0;
+   for (i=1; i < 16; ++i) {
+      next_code[i] = code;
+      code = (code + sizes[i]) << 1;
+   }
+   for (i=0; i < num; ++i) {
+      int s = sizelist[i];
+      if (s) {
+         if (s <= bits) {
+            int j = stbi__bit_reverse(next_code[s], s);
+            for (; j < (1 << bits); j += (1 << s))
+               table[j] = (stbi__uint32) s | ((stbi__uint32) i << 16);
          }
-         *zout++ = (char) z;
-      } else {
-         stbi_uc *p;
-         int len,dist;
-         if (z == 256) {
-            a->zout = zout;
-            if (a->hit_zeof_once && a->num_bits < 16) {
-               // The first time we hit zeof, we inserted 16 extra zero bits into our bit
-               // buffer so the decoder can just do its speculative decoding. But if we
-               // actually consumed any of those bits (which is the case when num_bits < 16),
-               // the stream actually read past the end so it is malformed.
-               return stbi__err("unexpected end","Corrupt PNG");
-            }
+         ++next_code[s];
+      }
+   }
+}
+
+// kinds of literal/length entries. the literal kinds are the number of bytes they write.
+// END also covers the invalid symbols 286 and 287
+enum
+{
+   STBI__ZFAST_END      = 0,
+   STBI__ZFAST_LITERAL  = 1,
+   STBI__ZFAST_LITERAL2 = 2,
+   STBI__ZFAST_LENGTH   = 4
+};
+
+// called once the huffman tables are valid. literal/length entries become, with the kind in bits 8-11
+//    1 literal:   size | LITERAL << 8 | literal << 16
+//    2 literals:  size of both | LITERAL2 << 8 | first << 16 | second << 24
+//    length:      size | LENGTH << 8 | extra bits << 12 | base length << 16
+//    256-287:     size | END << 8 | symbol << 16
+// and distance entries size | extra bits << 8 | base distance << 16
+static void stbi__zbuild_fast(stbi__zbuf *a, const stbi_uc *length_sizes, int nlength, const stbi_uc *distance_sizes, int ndistance)
+{
+   stbi__uint32 *t = a->zfast_length;
+   int i;
+   stbi__zbuild_fast_codes(t, STBI__ZLIT_BITS, length_sizes, nlength);
+   for (i=0; i < (1 << STBI__ZLIT_BITS); ++i) {
+      int sym = t[i] >> 16;
+      if (!t[i]) continue;
+      if (sym < 256)
+         t[i] |= STBI__ZFAST_LITERAL << 8;
+      else if (sym > 256 && sym < 286)
+         t[i] = (t[i] & 255) | (STBI__ZFAST_LENGTH << 8) | ((stbi__uint32) stbi__zlength_extra[sym-257] << 12) | ((stbi__uint32) stbi__zlength_base[sym-257] << 16);
+   }
+   // pair literals whose codes fit together. going down, t[i >> size] is not paired yet
+   for (i=(1 << STBI__ZLIT_BITS)-1; i >= 0; --i) {
+      stbi__uint32 e = t[i], e2;
+      int size = e & 255;
+      if (((e >> 8) & 15) != STBI__ZFAST_LITERAL) continue;
+      e2 = t[i >> size];
+      if (((e2 >> 8) & 15) == STBI__ZFAST_LITERAL && size + (int) (e2 & 255) <= STBI__ZLIT_BITS)
+         t[i] = (size + (e2 & 255)) | (STBI__ZFAST_LITERAL2 << 8) | (e & 0xff0000) | ((e2 & 0xff0000) << 8);
+   }
+
+   t = a->zfast_distance;
+   stbi__zbuild_fast_codes(t, STBI__ZDIST_BITS, distance_sizes, ndistance);
+   for (i=0; i < (1 << STBI__ZDIST_BITS); ++i) {
+      int sym = t[i] >> 16;
+      // 30 and 31 are left to the slow path, which reports them
+      if (sym < 30)
+         t[i] = t[i] ? (t[i] & 255) | ((stbi__uint32) stbi__zdist_extra[sym] << 8) | ((stbi__uint32) stbi__zdist_base[sym] << 16) : 0;
+      else
+         t[i] = 0;
+   }
+}
+
+// copies a match of len bytes from dist back, in 8 byte moves that may write up to 7 bytes past the end
+stbi_inline static void stbi__zcopy_match(stbi_uc *out, int len, int dist)
+{
+   stbi_uc *end = out + len, *p = out - dist;
+   if (dist == 1) { // run of one byte; common in images.
+      memset(out, *p, len);
+      return;
+   }
+   if (dist < 8) {
+      // a short repeating pattern. after writing the bytes up to the first multiple
+      // of dist that is at least 8, the pattern can also be copied from that far back
+      int step = dist * ((8 + dist - 1) / dist);
+      stbi_uc *stop = out + (step - dist);
+      while (out < stop && out < end)
+         *out++ = *p++;
+      p = out - step;
+   }
+   while (out < end) {
+      memcpy(out, p, 8);
+      out += 8;
+      p += 8;
+   }
+}
+
+// the inner loop of stbi__parse_huffman_block, for when the input and output are
+// far from their ends: no end checks per byte, a size_t bit buffer refilled a word
+// at a time, two literals per table lookup, matches copied 8 bytes at a time.
+// returns 0 on error, 1 at the end of the block, 2 when the caller has to go on
+// one symbol at a time because it got near the end of the input or output
+static int stbi__zfast_huffman_block(stbi__zbuf *a, char **pzout)
+{
+   stbi_uc *in = a->zbuffer, *in_end = a->zbuffer_end;
+   stbi_uc *out = (stbi_uc *) *pzout, *out_start = (stbi_uc *) a->zout_start, *out_end = (stbi_uc *) a->zout_end;
+   size_t buf = a->code_buffer;
+   int bits = a->num_bits;
+   int result = 2;
+
+   // tops up buf to at least sizeof(size_t)*8 - 8 bits
+#ifdef STBI__ZWORD_REFILL
+   #define STBI__ZFAST_REFILL() \
+      do { size_t w_; memcpy(&w_, in, sizeof(w_)); buf |= w_ << bits; \
+           in += ((int) sizeof(size_t)*8 - 1 - bits) >> 3; bits |= (int) sizeof(size_t)*8 - 8; } while (0)
+#else
+   #define STBI__ZFAST_REFILL() \
+      do { while (bits <= (int) sizeof(size_t)*8 - 8) { buf |= (size_t) *in++ << bits; bits += 8; } } while (0)
+#endif
+   #define STBI__ZFAST_CONSUME(n) do { buf >>= (n); bits -= (n); } while (0)
+
+   while (in_end - in >= STBI__ZFAST_IN && out_end - out >= STBI__ZFAST_OUT) {
+      stbi__uint32 e;
+      int len, dist, sym, size;
+      STBI__ZFAST_REFILL();
+      e = a->zfast_length[buf & STBI__ZLIT_MASK];
+      if (e & ((STBI__ZFAST_LITERAL | STBI__ZFAST_LITERAL2) << 8)) {
+         // a refill holds two entries even in 32 bits
+         STBI__ZFAST_CONSUME(e & 255);
+         out[0] = (stbi_uc) (e >> 16);
+         out[1] = (stbi_uc) (e >> 24);
+         out += (e >> 8) & 3;
+         e = a->zfast_length[buf & STBI__ZLIT_MASK];
+         if (e & ((STBI__ZFAST_LITERAL | STBI__ZFAST_LITERAL2) << 8)) {
+            STBI__ZFAST_CONSUME(e & 255);
+            out[0] = (stbi_uc) (e >> 16);
+            out[1] = (stbi_uc) (e >> 24);
+            out += (e >> 8) & 3;
+            continue;
+         }
+         if (sizeof(size_t) < 8) {
+            STBI__ZFAST_REFILL();
+            e = a->zfast_length[buf & STBI__ZLIT_MASK];
+         }
+      }
+      if (e & (STBI__ZFAST_LENGTH << 8)) {
+         STBI__ZFAST_CONSUME(e & 255);
+         len = (e >> 16) + (int) (buf & ((1 << ((e >> 12) & 15)) - 1));
+         STBI__ZFAST_CONSUME((e >> 12) & 15);
+      } else {
+         if (e) {
+            sym = e >> 16;
+            size = e & 255;
+         } else {
+            // longer than the table, or invalid
+            sym = stbi__zhuffman_decode_code(&a->z_length, (int) (buf & 0xffff), STBI__ZLIT_BITS+1, &size);
+            if (sym < 0) return stbi__err("bad huffman code","Corrupt PNG");
+         }
+         STBI__ZFAST_CONSUME(size);
+         if (sym < 256) {
+            *out++ = (stbi_uc) sym;
+            continue;
+         }
+         if (sym == 256) {
+            result = 1;
+            goto done;
+         }
+         if (sym >= 286) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, length codes 286 and 287 must not appear in compressed data
+         sym -= 257;
+         len = stbi__zlength_base[sym] + (int) (buf & ((1 << stbi__zlength_extra[sym]) - 1));
+         STBI__ZFAST_CONSUME(stbi__zlength_extra[sym]);
+      }
+
+      // 32 bit buffers hold one code and its extra bits at a time. on 64 bit a literal
+      // before the length (11 bits), the length (15+5) and the distance (15+13) are
+      // 59 bits, more than the 56 a refill guarantees
+      if (sizeof(size_t) < 8 || bits < 28) STBI__ZFAST_REFILL();
+      e = a->zfast_distance[buf & STBI__ZDIST_MASK];
+      if (e) {
+         size = e & 255;
+         STBI__ZFAST_CONSUME(size);
+         if (sizeof(size_t) < 8) STBI__ZFAST_REFILL();
+         dist = (e >> 16) + (int) (buf & ((1 << ((e >> 8) & 255)) - 1));
+         STBI__ZFAST_CONSUME((e >> 8) & 255);
+      } else {
+         // longer than the table, invalid, or the invalid symbols 30 and 31
+         sym = stbi__zhuffman_decode_code(&a->z_distance, (int) (buf & 0xffff), 1, &size);
+         if (sym < 0 || sym >= 30) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, distance codes 30 and 31 must not appear in compressed data
+         STBI__ZFAST_CONSUME(size);
+         if (sizeof(size_t) < 8) STBI__ZFAST_REFILL();
+         dist = stbi__zdist_base[sym] + (int) (buf & ((1 << stbi__zdist_extra[sym]) - 1));
+         STBI__ZFAST_CONSUME(stbi__zdist_extra[sym]);
+      }
+      if (out - out_start < dist) return stbi__err("bad dist","Corrupt PNG");
+      stbi__zcopy_match(out, len, dist);
+      out += len;
+   }
+
+done:
+   // give back the whole bytes still in the buffer, so the byte at a time code
+   // sees the stream exactly as if it had read it all itself
+   in -= bits >> 3;
+   bits &= 7;
+   a->zbuffer = in;
+   a->code_buffer = (stbi__uint32) (buf & ((1 << bits) - 1));
+   a->num_bits = bits;
+   *pzout = (char *) out;
+   return result;
+
+   #undef STBI__ZFAST_REFILL
+   #undef STBI__ZFAST_CONSUME
+}
+#endif // STBI_NO_ZFAST
+
+// returns 0 on error, 1 at the end of the block, 2 when a partial input runs low: a symbol
+// might need more of it, so the block goes on from here once more has been appended
+static int stbi__parse_huffman_block(stbi__zbuf *a)
+{
+   char *zout = a->zout;
+   for(;;) {
+      int z;
+#ifndef STBI_NO_ZFAST
+      if (a->zbuffer_end - a->zbuffer >= STBI__ZFAST_IN && a->zout_end - zout >= STBI__ZFAST_OUT) {
+         int r = stbi__zfast_huffman_block(a, &zout);
+         if (r != 2) {
+            a->zout = zout;
+            return r;
+         }
+      }
+#endif
+      // a length, distance and their extra bits are 48 bits at most, well short of STBI__ZFAST_IN bytes
+      if (a->partial && a->zbuffer_end - a->zbuffer < STBI__ZFAST_IN) {
+         a->zout = zout;
+         return 2;
+      }
+      z = stbi__zhuffman_decode(a, &a->z_length);
+      if (z < 256) {
+         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
+         if (zout >= a->zout_end) {
+            if (!stbi__zexpand(a, zout, 1)) return 0;
+            zout = a->zout;
+         }
+         *zout++ = (char) z;
+      } else {
+         stbi_uc *p;
+         int len,dist;
+         if (z == 256) {
+            a->zout = zout;
+            if (a->hit_zeof_once && a->num_bits < 16) {
+               // The first time we hit zeof, we inserted 16 extra zero bits into our bit
+               // buffer so the decoder can just do its speculative decoding. But if we
+               // actually consumed any of those bits (which is the case when num_bits < 16),
+               // the stream actually read past the end so it is malformed.
+               return stbi__err("unexpected end","Corrupt PNG");
+            }
             return 1;
          }
          if (z >= 286) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, length codes 286 and 287 must not appear in compressed data
@@ -4402,10 +6514,14 @@ static int stbi__compute_huffman_codes(stbi__zbuf *a)
    if (n != ntot) return stbi__err("bad codelengths","Corrupt PNG");
    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
    if (!stbi__zbuild_huffman(&a->z_distance, lencodes+hlit, hdist)) return 0;
+#ifndef STBI_NO_ZFAST
+   stbi__zbuild_fast(a, lencodes, hlit, lencodes+hlit, hdist);
+#endif
    return 1;
 }
 
-static int stbi__parse_uncompressed_block(stbi__zbuf *a)
+// reads the length of a stored block, its bytes are copied by stbi__zinflate
+static int stbi__parse_uncompressed_header(stbi__zbuf *a)
 {
    stbi_uc header[4];
    int len,nlen,k;
@@ -4425,12 +6541,7 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
-   if (a->zout + len > a->zout_end)
-      if (!stbi__zexpand(a, a->zout, len)) return 0;
-   memcpy(a->zout, a->zbuffer, len);
-   a->zbuffer += len;
-   a->zout += len;
+   a->stored_left = len;
    return 1;
 }
 
@@ -4477,45 +6588,123 @@ Init algorithm:
 }
 */
 
-static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
+enum
+{
+   STBI__ZSTATE_header,  // the zlib header
+   STBI__ZSTATE_block,   // the header of the next block, or the end after the final one
+   STBI__ZSTATE_stored,  // in the bytes of a stored block
+   STBI__ZSTATE_codes    // in the codes of a huffman block
+};
+
+// a dynamic block header is 17 bits, 19 code length codes of 3 bits and at most
+// 286+30 code lengths of up to 7+7 bits: it always fits in this many bytes
+#define STBI__ZHEADER_MAX  600
+
+static void stbi__zinit(stbi__zbuf *a, int parse_header)
 {
-   int final, type;
-   if (parse_header)
-      if (!stbi__parse_zlib_header(a)) return 0;
    a->num_bits = 0;
    a->code_buffer = 0;
    a->hit_zeof_once = 0;
-   do {
-      final = stbi__zreceive(a,1);
-      type = stbi__zreceive(a,2);
-      if (type == 0) {
-         if (!stbi__parse_uncompressed_block(a)) return 0;
-      } else if (type == 3) {
-         return 0;
-      } else {
-         if (type == 1) {
-            // use fixed code lengths
-            if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
-            if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
-         } else {
-            if (!stbi__compute_huffman_codes(a)) return 0;
+   a->state = parse_header ? STBI__ZSTATE_header : STBI__ZSTATE_block;
+   a->final = 0;
+   a->stored_left = 0;
+   a->partial = 0;
+}
+
+// inflates as far as the input goes. returns 0 on error, 1 at the end of the stream. with
+// a->partial set the input is only the start of the stream: it returns 2 where going on could
+// read past it, and is called again once more input has been appended after zbuffer_end
+static int stbi__zinflate(stbi__zbuf *a)
+{
+   for (;;) {
+      switch (a->state) {
+         case STBI__ZSTATE_header:
+            // the header is 2 bytes, and stbi__parse_zlib_header wants one after it
+            if (a->partial && a->zbuffer_end - a->zbuffer < 3) return 2;
+            if (!stbi__parse_zlib_header(a)) return 0;
+            a->state = STBI__ZSTATE_block;
+            break;
+
+         case STBI__ZSTATE_block: {
+            int type;
+            if (a->final) return 1;
+            if (a->partial && a->zbuffer_end - a->zbuffer < STBI__ZHEADER_MAX) return 2;
+            a->final = stbi__zreceive(a,1);
+            type = stbi__zreceive(a,2);
+            if (type == 0) {
+               if (!stbi__parse_uncompressed_header(a)) return 0;
+               a->state = STBI__ZSTATE_stored;
+            } else if (type == 3) {
+               return 0;
+            } else {
+               if (type == 1) {
+                  // use fixed code lengths
+                  if (!stbi__zbuild_huffman(&a->z_length  , stbi__zdefault_length  , STBI__ZNSYMS)) return 0;
+                  if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance,  32)) return 0;
+#ifndef STBI_NO_ZFAST
+                  stbi__zbuild_fast(a, stbi__zdefault_length, STBI__ZNSYMS, stbi__zdefault_distance, 32);
+#endif
+               } else {
+                  if (!stbi__compute_huffman_codes(a)) return 0;
+               }
+               a->state = STBI__ZSTATE_codes;
+            }
+            break;
+         }
+
+         case STBI__ZSTATE_stored: {
+            int len = a->stored_left;
+            if (len > a->zbuffer_end - a->zbuffer) {
+               if (!a->partial) return stbi__err("read past buffer","Corrupt PNG");
+               len = (int) (a->zbuffer_end - a->zbuffer);
+            }
+            if (a->zout + len > a->zout_end)
+               if (!stbi__zexpand(a, a->zout, len)) return 0;
+            memcpy(a->zout, a->zbuffer, len);
+            a->zbuffer += len;
+            a->zout += len;
+            a->stored_left -= len;
+            if (a->progress && !a->progress(a->progress_user, (stbi_uc *) a->zout_start, (stbi_uc *) a->zout)) return 0;
+            if (a->stored_left) return 2;
+            a->state = STBI__ZSTATE_block;
+            break;
+         }
+
+         case STBI__ZSTATE_codes: {
+            int r = stbi__parse_huffman_block(a);
+            if (!r) return 0;
+            if (a->progress && !a->progress(a->progress_user, (stbi_uc *) a->zout_start, (stbi_uc *) a->zout)) return 0;
+            if (r == 2) return 2;
+            a->state = STBI__ZSTATE_block;
+            break;
          }
-         if (!stbi__parse_huffman_block(a)) return 0;
       }
-   } while (!final);
-   return 1;
+   }
 }
 
-static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse_header)
+static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
+{
+   stbi__zinit(a, parse_header);
+   return stbi__zinflate(a);
+}
+
+static int stbi__do_zlib_progress(stbi__zbuf *a, char *obuf, int olen, int exp, int parse_header, stbi__zprogress *progress, void *user)
 {
    a->zout_start = obuf;
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+   a->progress = progress;
+   a->progress_user = user;
 
    return stbi__parse_zlib(a, parse_header);
 }
 
+static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse_header)
+{
+   return stbi__do_zlib_progress(a, obuf, olen, exp, parse_header, NULL, NULL);
+}
+
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen)
 {
    stbi__zbuf a;
@@ -4527,7 +6716,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -4548,7 +6737,7 @@ STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, i
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -4575,7 +6764,7 @@ STBIDEF char *stbi_zlib_decode_noheader_malloc(char const *buffer, int len, int
       if (outlen) *outlen = (int) (a.zout - a.zout_start);
       return a.zout_start;
    } else {
-      STBI_FREE(a.zout_start);
+      stbi__free(a.zout_start);
       return NULL;
    }
 }
@@ -4626,11 +6815,21 @@ static int stbi__check_png_header(stbi__context *s)
    return 1;
 }
 
+// what the chunks before the image data said, kept by STBI__SCAN_stream
+typedef struct
+{
+   stbi_uc palette[1024], pal_img_n, has_trans, tc[3];
+   stbi__uint16 tc16[3];
+   stbi__uint32 pal_len, idat_len;
+   int interlace, color, is_iphone;
+} stbi__png_header;
+
 typedef struct
 {
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi__png_header *header; // STBI__SCAN_stream only
 } stbi__png;
 
 
@@ -4666,6 +6865,216 @@ static int stbi__paeth(int a, int b, int c)
    return t1;
 }
 
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+// SIMD unfiltering. Up has no dependency between bytes and goes 16 at a time.
+// Sub, Avg and Paeth depend on the pixel to the left, so they go one pixel at a
+// time with all of its bytes in one register. that only beats the scalar loops
+// from 3 bytes per pixel up: RGB and RGBA, 8 and 16 bit.
+// 3 and 6 byte pixels are moved as 4 and 8 bytes, except the last one of the row:
+// the extra byte read is in the row, the extra byte written is the next pixel's
+#ifdef STBI_SSE2
+static stbi_inline __m128i stbi__png_load_px(stbi_uc const *p, int n)
+{
+   stbi__uint32 lo;
+   if (n == 8) return _mm_loadl_epi64((__m128i const *) p);
+   if (n == 3) return _mm_cvtsi32_si128(p[0] | (p[1] << 8) | (p[2] << 16));
+   memcpy(&lo, p, 4);
+   if (n == 4) return _mm_cvtsi32_si128((int) lo);
+   return _mm_insert_epi16(_mm_cvtsi32_si128((int) lo), p[4] | (p[5] << 8), 2);
+}
+
+static stbi_inline void stbi__png_store_px(stbi_uc *p, __m128i v, int n)
+{
+   stbi__uint32 lo;
+   if (n == 8) {
+      _mm_storel_epi64((__m128i *) p, v);
+      return;
+   }
+   lo = (stbi__uint32) _mm_cvtsi128_si32(v);
+   if (n == 3) {
+      p[0] = STBI__BYTECAST(lo);
+      p[1] = STBI__BYTECAST(lo >> 8);
+      p[2] = STBI__BYTECAST(lo >> 16);
+      return;
+   }
+   memcpy(p, &lo, 4);
+   if (n == 6) {
+      int hi = _mm_extract_epi16(v, 2);
+      p[4] = STBI__BYTECAST(hi);
+      p[5] = STBI__BYTECAST(hi >> 8);
+   }
+}
+
+// bytes k..end of the row, moving n bytes per pixel of bpp bytes
+static stbi_inline void stbi__png_unfilter_px(int filter, stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int k, int end, int bpp, int n)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i one = _mm_set1_epi8(1);
+   __m128i lo_byte = _mm_set1_epi16(0xff);
+   __m128i a = zero, b, c = zero;
+   if (k > 0) {
+      a = stbi__png_load_px(cur+k-bpp, bpp);
+      c = stbi__png_load_px(prior+k-bpp, bpp);
+   }
+   switch (filter) {
+   case STBI__F_sub:
+      for (; k < end; k += bpp) {
+         a = _mm_add_epi8(a, stbi__png_load_px(raw+k, n));
+         stbi__png_store_px(cur+k, a, n);
+      }
+      break;
+   case STBI__F_avg:
+      for (; k < end; k += bpp) {
+         // (a+b)>>1 is the rounded up average minus the rounding
+         b = stbi__png_load_px(prior+k, n);
+         b = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+         a = _mm_add_epi8(stbi__png_load_px(raw+k, n), b);
+         stbi__png_store_px(cur+k, a, n);
+      }
+      break;
+   case STBI__F_paeth:
+      // stbi__paeth in 16 bit lanes, 3c-(a+b) does not fit in a byte. keeping a
+      // unpacked keeps the pack and unpack off the chain from pixel to pixel
+      a = _mm_unpacklo_epi8(a, zero);
+      c = _mm_unpacklo_epi8(c, zero);
+      for (; k < end; k += bpp) {
+         __m128i thresh, lo, hi, m, t;
+         b = _mm_unpacklo_epi8(stbi__png_load_px(prior+k, n), zero);
+         thresh = _mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), _mm_add_epi16(a, b));
+         lo = _mm_min_epi16(a, b);
+         hi = _mm_max_epi16(a, b);
+         m = _mm_cmpgt_epi16(hi, thresh);
+         t = _mm_or_si128(_mm_and_si128(m, c), _mm_andnot_si128(m, lo));
+         m = _mm_cmpgt_epi16(thresh, lo);
+         t = _mm_or_si128(_mm_and_si128(m, t), _mm_andnot_si128(m, hi));
+         a = _mm_and_si128(_mm_add_epi16(t, _mm_unpacklo_epi8(stbi__png_load_px(raw+k, n), zero)), lo_byte);
+         stbi__png_store_px(cur+k, _mm_packus_epi16(a, a), n);
+         c = b;
+      }
+      break;
+   }
+}
+
+static void stbi__png_unfilter_up(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int nk)
+{
+   int k = 0;
+   for (; k+16 <= nk; k += 16)
+      _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(_mm_loadu_si128((__m128i const *) (raw+k)), _mm_loadu_si128((__m128i const *) (prior+k))));
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+#endif // STBI_SSE2
+
+#ifdef STBI_NEON
+static stbi_inline uint8x8_t stbi__png_load_px(stbi_uc const *p, int n)
+{
+   stbi__uint32 lo;
+   stbi_uc px[8] = { 0 };
+   if (n == 8) return vld1_u8(p);
+   if (n == 4) {
+      memcpy(&lo, p, 4);
+      return vreinterpret_u8_u32(vset_lane_u32(lo, vdup_n_u32(0), 0));
+   }
+   memcpy(px, p, n);
+   return vld1_u8(px);
+}
+
+static stbi_inline void stbi__png_store_px(stbi_uc *p, uint8x8_t v, int n)
+{
+   stbi__uint32 lo;
+   stbi_uc px[8];
+   if (n == 8) {
+      vst1_u8(p, v);
+   } else if (n == 4) {
+      lo = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+      memcpy(p, &lo, 4);
+   } else {
+      vst1_u8(px, v);
+      memcpy(p, px, n);
+   }
+}
+
+// bytes k..end of the row, moving n bytes per pixel of bpp bytes
+static stbi_inline void stbi__png_unfilter_px(int filter, stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int k, int end, int bpp, int n)
+{
+   uint8x8_t a = vdup_n_u8(0), b, c = vdup_n_u8(0);
+   if (k > 0) {
+      a = stbi__png_load_px(cur+k-bpp, bpp);
+      c = stbi__png_load_px(prior+k-bpp, bpp);
+   }
+   switch (filter) {
+   case STBI__F_sub:
+      for (; k < end; k += bpp) {
+         a = vadd_u8(a, stbi__png_load_px(raw+k, n));
+         stbi__png_store_px(cur+k, a, n);
+      }
+      break;
+   case STBI__F_avg:
+      for (; k < end; k += bpp) {
+         b = stbi__png_load_px(prior+k, n);
+         a = vadd_u8(stbi__png_load_px(raw+k, n), vhadd_u8(a, b));
+         stbi__png_store_px(cur+k, a, n);
+      }
+      break;
+   case STBI__F_paeth:
+      for (; k < end; k += bpp) {
+         uint16x8_t pa, pb, pc, not_a;
+         uint8x8_t bc;
+         b = stbi__png_load_px(prior+k, n);
+         pa = vabdl_u8(b, c);
+         pb = vabdl_u8(a, c);
+         pc = vabdq_u16(vaddl_u8(a, b), vshll_n_u8(c, 1));
+         // a if pa <= pb and pa <= pc, else b if pb <= pc, else c
+         not_a = vorrq_u16(vcgtq_u16(pa, pb), vcgtq_u16(pa, pc));
+         bc = vbsl_u8(vmovn_u16(vcgtq_u16(pb, pc)), c, b);
+         a = vadd_u8(vbsl_u8(vmovn_u16(not_a), bc, a), stbi__png_load_px(raw+k, n));
+         stbi__png_store_px(cur+k, a, n);
+         c = b;
+      }
+      break;
+   }
+}
+
+static void stbi__png_unfilter_up(stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int nk)
+{
+   int k = 0;
+   for (; k+16 <= nk; k += 16)
+      vst1q_u8(cur+k, vaddq_u8(vld1q_u8(raw+k), vld1q_u8(prior+k)));
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+#endif // STBI_NEON
+
+// returns 0 to leave the row to the scalar loops
+static int stbi__png_unfilter_simd(int filter, stbi_uc *cur, stbi_uc const *prior, stbi_uc const *raw, int nk, int filter_bytes)
+{
+   if (filter == STBI__F_up) {
+      stbi__png_unfilter_up(cur, prior, raw, nk);
+      return 1;
+   }
+   if (filter != STBI__F_sub && filter != STBI__F_avg && filter != STBI__F_paeth)
+      return 0;
+   // constant sizes, so the loads and stores compile to plain moves
+   switch (filter_bytes) {
+      case 3:
+         stbi__png_unfilter_px(filter, cur, prior, raw, 0, nk-3, 3, 4);
+         stbi__png_unfilter_px(filter, cur, prior, raw, nk-3, nk, 3, 3);
+         return 1;
+      case 4:
+         stbi__png_unfilter_px(filter, cur, prior, raw, 0, nk, 4, 4);
+         return 1;
+      case 6:
+         stbi__png_unfilter_px(filter, cur, prior, raw, 0, nk-6, 6, 8);
+         stbi__png_unfilter_px(filter, cur, prior, raw, nk-6, nk, 6, 6);
+         return 1;
+      case 8:
+         stbi__png_unfilter_px(filter, cur, prior, raw, 0, nk, 8, 8);
+         return 1;
+   }
+   return 0;
+}
+#endif // STBI_SSE2 || STBI_NEON
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // adds an extra all-255 alpha channel
@@ -4691,69 +7100,186 @@ static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__ui
    }
 }
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+static int stbi__compute_transparency(stbi_uc *p, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
 {
-   int bytes = (depth == 16 ? 2 : 1);
-   stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
-   stbi__uint32 img_len, img_width_bytes;
-   stbi_uc *filter_buf;
-   int all_ok = 1;
-   int k;
-   int img_n = s->img_n; // copy it into a local for later
-
-   int output_bytes = out_n*bytes;
-   int filter_bytes = img_n*bytes;
-   int width = x;
+   stbi__uint32 i;
 
-   STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
+   // compute color-based transparency, assuming we've
+   // already got 255 as the alpha value in the output
+   STBI_ASSERT(out_n == 2 || out_n == 4);
 
-   // note: error exits here don't need to clean up a->out individually,
-   // stbi__do_png always does on error.
-   if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
-   img_width_bytes = (((img_n * x * depth) + 7) >> 3);
-   if (!stbi__mad2sizes_valid(img_width_bytes, y, img_width_bytes)) return stbi__err("too large", "Corrupt PNG");
-   img_len = (img_width_bytes + 1) * y;
+   if (out_n == 2) {
+      for (i=0; i < pixel_count; ++i) {
+         p[1] = (p[0] == tc[0] ? 0 : 255);
+         p += 2;
+      }
+   } else {
+      for (i=0; i < pixel_count; ++i) {
+         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
+            p[3] = 0;
+         p += 4;
+      }
+   }
+   return 1;
+}
 
-   // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
-   // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
-   // so just check for raw_len < img_len always.
-   if (raw_len < img_len) return stbi__err("not enough pixels","Corrupt PNG");
+static int stbi__compute_transparency16(stbi__uint16 *p, stbi__uint32 pixel_count, stbi__uint16 tc[3], int out_n)
+{
+   stbi__uint32 i;
 
-   // Allocate two scan lines worth of filter workspace buffer.
-   filter_buf = (stbi_uc *) stbi__malloc_mad2(img_width_bytes, 2, 0);
-   if (!filter_buf) return stbi__err("outofmem", "Out of memory");
+   // compute color-based transparency, assuming we've
+   // already got 65535 as the alpha value in the output
+   STBI_ASSERT(out_n == 2 || out_n == 4);
 
-   // Filtering for low-bit-depth images
-   if (depth < 8) {
-      filter_bytes = 1;
-      width = img_width_bytes;
+   if (out_n == 2) {
+      for (i = 0; i < pixel_count; ++i) {
+         p[1] = (p[0] == tc[0] ? 0 : 65535);
+         p += 2;
+      }
+   } else {
+      for (i = 0; i < pixel_count; ++i) {
+         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
+            p[3] = 0;
+         p += 4;
+      }
    }
+   return 1;
+}
 
-   for (j=0; j < y; ++j) {
-      // cur/prior filter buffers alternate
-      stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
-      stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
-      stbi_uc *dest = a->out + stride*j;
-      int nk = width * filter_bytes;
-      int filter = *raw++;
-
-      // check filter type
-      if (filter > 4) {
-         all_ok = stbi__err("invalid filter","Corrupt PNG");
-         break;
+static void stbi__png_palette_lookup(stbi_uc *p, stbi_uc const *orig, stbi__uint32 pixel_count, stbi_uc const *palette, int pal_img_n)
+{
+   stbi__uint32 i;
+   if (pal_img_n == 3) {
+      for (i=0; i < pixel_count; ++i) {
+         int n = orig[i]*4;
+         p[0] = palette[n  ];
+         p[1] = palette[n+1];
+         p[2] = palette[n+2];
+         p += 3;
+      }
+   } else {
+      for (i=0; i < pixel_count; ++i) {
+         int n = orig[i]*4;
+         p[0] = palette[n  ];
+         p[1] = palette[n+1];
+         p[2] = palette[n+2];
+         p[3] = palette[n+3];
+         p += 4;
       }
+   }
+}
 
-      // if first row, use special filter that doesn't sample previous row
-      if (j == 0) filter = first_row_filter[filter];
+// unfiltering one row at a time, so PNG can run it while the image is still
+// being inflated, on rows that were just written and are still in cache
+typedef struct
+{
+   stbi__context *s;
+   stbi_uc *out, *filter_buf;
+   stbi__uint32 x, y, row, img_width_bytes, img_len;
+   int out_n, depth, color;
+   int bad_filter;
+   int simd;
+   stbi__into *into; // rows are converted into it and out only holds one row
+   // with into: the tRNS key applied to each row, and the palette it is looked up in
+   int has_trans;
+   stbi_uc tc[3];
+   stbi__uint16 tc16[3];
+   stbi_uc *palette, *pal_row;
+   int pal_img_n;
+} stbi__png_rows;
 
-      // perform actual filtering
-      switch (filter) {
-      case STBI__F_none:
-         memcpy(cur, raw, nk);
+static int stbi__png_rows_begin(stbi__png_rows *r, stbi__context *s, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, stbi__into *into)
+{
+   int bytes = (depth == 16 ? 2 : 1);
+   int img_n = s->img_n;
+   int output_bytes = out_n*bytes;
+
+   r->s = s;
+   r->out = NULL;
+   r->filter_buf = NULL;
+   r->x = x;
+   r->y = y;
+   r->row = 0;
+   r->out_n = out_n;
+   r->depth = depth;
+   r->color = color;
+   r->bad_filter = 0;
+   r->into = into;
+   r->has_trans = 0;
+   r->palette = NULL;
+#ifdef STBI_SSE2
+   r->simd = stbi__sse2_available();
+#elif defined(STBI_NEON)
+   r->simd = 1;
+#else
+   r->simd = 0;
+#endif
+
+   STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
+   r->out = (stbi_uc *) stbi__malloc_mad3(x, into ? 1 : y, output_bytes, 0); // extra bytes to write off the end into
+   if (!r->out) return stbi__err("outofmem", "Out of memory");
+
+   // note: error exits here don't need to clean up r->out,
+   // the caller always does on error.
+   if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
+   r->img_width_bytes = (((img_n * x * depth) + 7) >> 3);
+   if (!stbi__mad2sizes_valid(r->img_width_bytes, y, r->img_width_bytes)) return stbi__err("too large", "Corrupt PNG");
+   r->img_len = (r->img_width_bytes + 1) * y;
+
+   // Allocate two scan lines worth of filter workspace buffer.
+   r->filter_buf = (stbi_uc *) stbi__malloc_mad2(r->img_width_bytes, 2, 0);
+   if (!r->filter_buf) return stbi__err("outofmem", "Out of memory");
+   return 1;
+}
+
+// unfilters the rows that are complete in the first avail bytes of raw and not done yet
+static void stbi__png_rows_run(stbi__png_rows *r, stbi_uc *raw_start, stbi__uint32 avail)
+{
+   int bytes = (r->depth == 16 ? 2 : 1);
+   stbi__uint32 i,j,x = r->x,y = r->y,stride = x*r->out_n*bytes;
+   stbi__uint32 img_width_bytes = r->img_width_bytes;
+   stbi_uc *filter_buf = r->filter_buf;
+   int k;
+   int img_n = r->s->img_n; // copy it into a local for later
+   int out_n = r->out_n, depth = r->depth, color = r->color;
+
+   int filter_bytes = img_n*bytes;
+   int width = x;
+
+   if (r->bad_filter) return;
+   if (avail > r->img_len) avail = r->img_len;
+
+   // Filtering for low-bit-depth images
+   if (depth < 8) {
+      filter_bytes = 1;
+      width = img_width_bytes;
+   }
+
+   for (j=r->row; j < y && img_width_bytes+1 <= avail - j*(img_width_bytes+1); ++j) {
+      // cur/prior filter buffers alternate
+      stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
+      stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
+      stbi_uc *dest = r->into ? r->out : r->out + stride*j;
+      stbi_uc *raw = raw_start + j*(img_width_bytes+1);
+      int nk = width * filter_bytes;
+      int filter = *raw++;
+
+      // check filter type. reported by stbi__png_rows_end, after the length check
+      if (filter > 4) {
+         r->bad_filter = 1;
+         break;
+      }
+
+      // if first row, use special filter that doesn't sample previous row
+      if (j == 0) filter = first_row_filter[filter];
+
+      // perform actual filtering, with SIMD when there are kernels for this filter and pixel size
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+      if (!r->simd || !stbi__png_unfilter_simd(filter, cur, prior, raw, nk, filter_bytes))
+#endif
+      switch (filter) {
+      case STBI__F_none:
+         memcpy(cur, raw, nk);
          break;
       case STBI__F_sub:
          memcpy(cur, raw, filter_bytes);
@@ -4783,8 +7309,6 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          break;
       }
 
-      raw += nk;
-
       // expand decoded bits in cur to dest, also adding an extra alpha channel if desired
       if (depth < 8) {
          stbi_uc scale = (color == 0) ? stbi__depth_scale_table[depth] : 1; // scale grayscale values to 0..255 range
@@ -4819,7 +7343,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
          if (img_n != out_n)
             stbi__create_png_alpha_expand8(dest, dest, x, img_n);
       } else if (depth == 8) {
-         if (img_n == out_n)
+         if (r->into && img_n == out_n)
+            dest = cur; // converted straight from the filter buffer below
+         else if (img_n == out_n)
             memcpy(dest, cur, x*img_n);
          else
             stbi__create_png_alpha_expand8(dest, cur, x, img_n);
@@ -4849,139 +7375,204 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
             }
          }
       }
+
+      if (r->into) {
+         if (r->has_trans) {
+            if (depth == 16)
+               stbi__compute_transparency16((stbi__uint16 *) dest, x, r->tc16, out_n);
+            else
+               stbi__compute_transparency(dest, x, r->tc, out_n);
+         }
+         if (r->palette) {
+            stbi__png_palette_lookup(r->pal_row, dest, x, r->palette, r->pal_img_n);
+            stbi__into_row(r->into, j, r->pal_row, r->pal_img_n, 8, x);
+         } else {
+            stbi__into_row(r->into, j, dest, out_n, depth == 16 ? 16 : 8, x);
+         }
+      }
    }
 
-   STBI_FREE(filter_buf);
-   if (!all_ok) return 0;
+   r->row = j;
+}
 
+// stbi_zlib progress callback, start is the inflated stream so far
+static int stbi__png_rows_progress(void *user, stbi_uc *start, stbi_uc *end)
+{
+   stbi__png_rows_run((stbi__png_rows *) user, start, (stbi__uint32) (end - start));
    return 1;
 }
 
-static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
+// unfilters the remaining rows of the complete raw data and frees the workspace
+static int stbi__png_rows_end(stbi__png_rows *r, stbi_uc *raw, stbi__uint32 raw_len)
 {
-   int bytes = (depth == 16 ? 2 : 1);
-   int out_bytes = out_n * bytes;
-   stbi_uc *final;
-   int p;
-   if (!interlaced)
-      return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+   int all_ok = 1;
+   // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
+   // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
+   // so just check for raw_len < img_len always.
+   if (raw_len < r->img_len) {
+      all_ok = stbi__err("not enough pixels","Corrupt PNG");
+   } else {
+      stbi__png_rows_run(r, raw, raw_len);
+      if (r->bad_filter) all_ok = stbi__err("invalid filter","Corrupt PNG");
+   }
+   stbi__free(r->filter_buf);
+   r->filter_buf = NULL;
+   return all_ok;
+}
 
-   // de-interlacing
-   final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
-   if (!final) return stbi__err("outofmem", "Out of memory");
-   for (p=0; p < 7; ++p) {
-      int xorig[] = { 0,4,0,2,0,1,0 };
-      int yorig[] = { 0,0,4,0,2,0,1 };
-      int xspc[]  = { 8,8,4,4,2,2,1 };
-      int yspc[]  = { 8,8,8,4,4,2,2 };
-      int i,j,x,y;
-      // pass1_x[4] = 0, pass1_x[5] = 1, pass1_x[12] = 1
-      x = (a->s->img_x - xorig[p] + xspc[p]-1) / xspc[p];
-      y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
-      if (x && y) {
-         stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-         if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-            STBI_FREE(final);
-            return 0;
-         }
+// create the png data from post-deflated data
+static int stbi__create_png_image_raw(stbi__context *s, stbi_uc **out, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+{
+   stbi__png_rows r;
+   int ok = stbi__png_rows_begin(&r, s, out_n, x, y, depth, color, NULL);
+   *out = r.out;
+   if (!ok) {
+      stbi__free(r.filter_buf);
+      return 0;
+   }
+   return stbi__png_rows_end(&r, raw, raw_len);
+}
+
+// the seven Adam7 passes are independent once the whole stream is inflated
+typedef struct
+{
+   stbi__context *s;
+   stbi_uc *image_data, *final;
+   stbi__uint32 image_data_len;
+   stbi__uint32 offset[7];
+   int out_n, depth, color;
+   int ok[7];
+   const char *failure_reason[7];
+} stbi__png_adam7;
+
+static const int stbi__adam7_xorig[] = { 0,4,0,2,0,1,0 };
+static const int stbi__adam7_yorig[] = { 0,0,4,0,2,0,1 };
+static const int stbi__adam7_xspc[]  = { 8,8,4,4,2,2,1 };
+static const int stbi__adam7_yspc[]  = { 8,8,8,4,4,2,2 };
+
+static void stbi__png_adam7_pass(void *task_data, int p)
+{
+   stbi__png_adam7 *job = (stbi__png_adam7 *) task_data;
+   stbi__context *s = job->s;
+   int out_bytes = job->out_n * (job->depth == 16 ? 2 : 1);
+   int i,j,x,y;
+   stbi_uc *out;
+   // pass1_x[4] = 0, pass1_x[5] = 1, pass1_x[12] = 1
+   x = (s->img_x - stbi__adam7_xorig[p] + stbi__adam7_xspc[p]-1) / stbi__adam7_xspc[p];
+   y = (s->img_y - stbi__adam7_yorig[p] + stbi__adam7_yspc[p]-1) / stbi__adam7_yspc[p];
+   job->ok[p] = 1;
+   job->failure_reason[p] = NULL;
+   if (!x || !y) return;
+   if (job->offset[p] > job->image_data_len) {
+      // an earlier pass already ran out of data
+      job->ok[p] = stbi__err("not enough pixels","Corrupt PNG");
+   } else {
+      job->ok[p] = stbi__create_png_image_raw(s, &out, job->image_data + job->offset[p], job->image_data_len - job->offset[p],
+                                              job->out_n, x, y, job->depth, job->color);
+      if (job->ok[p]) {
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
-               int out_y = j*yspc[p]+yorig[p];
-               int out_x = i*xspc[p]+xorig[p];
-               memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
-                      a->out + (j*x+i)*out_bytes, out_bytes);
+               int out_y = j*stbi__adam7_yspc[p]+stbi__adam7_yorig[p];
+               int out_x = i*stbi__adam7_xspc[p]+stbi__adam7_xorig[p];
+               memcpy(job->final + out_y*s->img_x*out_bytes + out_x*out_bytes,
+                      out + (j*x+i)*out_bytes, out_bytes);
             }
          }
-         STBI_FREE(a->out);
-         image_data += img_len;
-         image_data_len -= img_len;
       }
+      stbi__free(out);
    }
-   a->out = final;
-
-   return 1;
+   if (!job->ok[p]) job->failure_reason[p] = stbi__g_failure_reason;
 }
 
-static int stbi__compute_transparency(stbi__png *z, stbi_uc tc[3], int out_n)
+static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi_uc *p = z->out;
-
-   // compute color-based transparency, assuming we've
-   // already got 255 as the alpha value in the output
-   STBI_ASSERT(out_n == 2 || out_n == 4);
+   stbi__png_adam7 job;
+   int bytes = (depth == 16 ? 2 : 1);
+   int out_bytes = out_n * bytes;
+   stbi__uint32 offset = 0;
+   int p;
+   if (!interlaced)
+      return stbi__create_png_image_raw(a->s, &a->out, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
 
-   if (out_n == 2) {
-      for (i=0; i < pixel_count; ++i) {
-         p[1] = (p[0] == tc[0] ? 0 : 255);
-         p += 2;
+   // de-interlacing
+   job.final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
+   if (!job.final) return stbi__err("outofmem", "Out of memory");
+   job.s = a->s;
+   job.image_data = image_data;
+   job.image_data_len = image_data_len;
+   job.out_n = out_n;
+   job.depth = depth;
+   job.color = color;
+   for (p=0; p < 7; ++p) {
+      stbi__uint32 x = (a->s->img_x - stbi__adam7_xorig[p] + stbi__adam7_xspc[p]-1) / stbi__adam7_xspc[p];
+      stbi__uint32 y = (a->s->img_y - stbi__adam7_yorig[p] + stbi__adam7_yspc[p]-1) / stbi__adam7_yspc[p];
+      job.offset[p] = offset;
+      if (x && y) {
+         // invalid sizes are reported by the pass itself, stop counting so nothing wraps around
+         if (!stbi__mad3sizes_valid(a->s->img_n, x, depth, 7)) offset = image_data_len + 1;
+         else if (offset <= image_data_len) offset += ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
       }
-   } else {
-      for (i=0; i < pixel_count; ++i) {
-         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
-            p[3] = 0;
-         p += 4;
+   }
+   stbi__parallel_run(7, stbi__png_adam7_pass, &job);
+   // report the first pass that failed, as a serial decode would
+   for (p=0; p < 7; ++p) {
+      if (!job.ok[p]) {
+         stbi__g_failure_reason = job.failure_reason[p];
+         stbi__free(job.final);
+         return 0;
       }
    }
+   a->out = job.final;
+
    return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png *z, stbi__uint16 tc[3], int out_n)
+// inflates the IDAT data. non-interlaced images are unfiltered while they inflate, into 'into' when it is set
+static int stbi__png_inflate(stbi__png *z, stbi__uint32 ioff, stbi__uint32 raw_len, int out_n, int depth, int color, int interlace, int parse_header, stbi__into *into)
 {
-   stbi__context *s = z->s;
-   stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-   stbi__uint16 *p = (stbi__uint16*) z->out;
-
-   // compute color-based transparency, assuming we've
-   // already got 65535 as the alpha value in the output
-   STBI_ASSERT(out_n == 2 || out_n == 4);
-
-   if (out_n == 2) {
-      for (i = 0; i < pixel_count; ++i) {
-         p[1] = (p[0] == tc[0] ? 0 : 65535);
-         p += 2;
-      }
-   } else {
-      for (i = 0; i < pixel_count; ++i) {
-         if (p[0] == tc[0] && p[1] == tc[1] && p[2] == tc[2])
-            p[3] = 0;
-         p += 4;
+   stbi__png_rows r;
+   stbi__zbuf za;
+   char *zout;
+   int ok;
+   if (interlace) {
+      z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, parse_header);
+      if (z->expanded == NULL) return 0; // zlib should set error
+      stbi__free(z->idata); z->idata = NULL;
+      return stbi__create_png_image(z, z->expanded, raw_len, out_n, depth, color, interlace);
+   }
+
+   ok = stbi__png_rows_begin(&r, z->s, out_n, z->s->img_x, z->s->img_y, depth, color, into);
+   z->out = r.out; // freed by stbi__do_png, like expanded
+   if (ok) {
+      zout = (char *) stbi__malloc(raw_len);
+      if (zout == NULL) {
+         ok = stbi__err("outofmem", "Out of memory");
+      } else {
+         za.zbuffer = z->idata;
+         za.zbuffer_end = z->idata + ioff;
+         ok = stbi__do_zlib_progress(&za, zout, raw_len, 1, parse_header, stbi__png_rows_progress, &r);
+         z->expanded = (stbi_uc *) za.zout_start;
+         if (ok) {
+            stbi__free(z->idata); z->idata = NULL;
+            if (!stbi__png_rows_end(&r, z->expanded, (stbi__uint32) (za.zout - za.zout_start))) return 0;
+            if (into) into->written = 1;
+            return 1;
+         }
       }
    }
-   return 1;
+   stbi__free(r.filter_buf);
+   return 0;
 }
 
 static int stbi__expand_png_palette(stbi__png *a, stbi_uc *palette, int len, int pal_img_n)
 {
-   stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-   stbi_uc *p, *temp_out, *orig = a->out;
-
-   p = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
-   if (p == NULL) return stbi__err("outofmem", "Out of memory");
+   stbi__uint32 pixel_count = a->s->img_x * a->s->img_y;
+   stbi_uc *temp_out;
 
-   // between here and free(out) below, exitting would leak
-   temp_out = p;
-
-   if (pal_img_n == 3) {
-      for (i=0; i < pixel_count; ++i) {
-         int n = orig[i]*4;
-         p[0] = palette[n  ];
-         p[1] = palette[n+1];
-         p[2] = palette[n+2];
-         p += 3;
-      }
-   } else {
-      for (i=0; i < pixel_count; ++i) {
-         int n = orig[i]*4;
-         p[0] = palette[n  ];
-         p[1] = palette[n+1];
-         p[2] = palette[n+2];
-         p[3] = palette[n+3];
-         p += 4;
-      }
-   }
-   STBI_FREE(a->out);
+   temp_out = (stbi_uc *) stbi__malloc_mad2(pixel_count, pal_img_n, 0);
+   if (temp_out == NULL) return stbi__err("outofmem", "Out of memory");
+   stbi__png_palette_lookup(temp_out, a->out, pixel_count, palette, pal_img_n);
+   stbi__free(a->out);
    a->out = temp_out;
 
    STBI_NOTUSED(len);
@@ -5176,6 +7767,21 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                   s->img_n = pal_img_n;
                return 1;
             }
+            if (scan == STBI__SCAN_stream) {
+               // the stream decoder reads the image data itself, as it arrives
+               stbi__png_header *h = z->header;
+               memcpy(h->palette, palette, sizeof(palette));
+               memcpy(h->tc, tc, sizeof(tc));
+               memcpy(h->tc16, tc16, sizeof(tc16));
+               h->pal_img_n = pal_img_n;
+               h->has_trans = has_trans;
+               h->pal_len = pal_len;
+               h->idat_len = c.length;
+               h->interlace = interlace;
+               h->color = color;
+               h->is_iphone = is_iphone;
+               return 1;
+            }
             if (c.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
             if ((int)(ioff + c.length) < (int)ioff) return 0;
             if (ioff + c.length > idata_limit) {
@@ -5185,7 +7791,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                while (ioff + c.length > idata_limit)
                   idata_limit *= 2;
                STBI_NOTUSED(idata_limit_old);
-               p = (stbi_uc *) STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+               p = (stbi_uc *) stbi__realloc_sized(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
                z->idata = p;
             }
             if (!stbi__getn(s, z->idata+ioff,c.length)) return stbi__err("outofdata","Corrupt PNG");
@@ -5195,25 +7801,27 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 
          case STBI__PNG_TYPE('I','E','N','D'): {
             stbi__uint32 raw_len, bpl;
+            stbi__into *into = NULL;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
             raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
-            if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
-            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            // rows go straight into a caller buffer unless a pass over the whole image follows
+            if (s->into && !interlace && !has_trans && !is_iphone && !pal_img_n && s->img_out_n == s->img_n &&
+                s->img_x == (stbi__uint32) s->into->w && s->img_y == (stbi__uint32) s->into->h)
+               into = s->into;
+            if (!stbi__png_inflate(z, ioff, raw_len, s->img_out_n, z->depth, color, interlace, !is_iphone, into)) return 0;
             if (has_trans) {
                if (z->depth == 16) {
-                  if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency16((stbi__uint16 *) z->out, s->img_x * s->img_y, tc16, s->img_out_n)) return 0;
                } else {
-                  if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+                  if (!stbi__compute_transparency(z->out, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
                }
             }
             if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
@@ -5229,7 +7837,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
                // non-paletted image with tRNS -> source image has (constant) alpha
                ++s->img_n;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            stbi__free(z->expanded); z->expanded = NULL;
             // end of PNG chunk, read and skip CRC
             stbi__get32be(s);
             return 1;
@@ -5282,9 +7890,9 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
       *y = p->s->img_y;
       if (n) *n = p->s->img_n;
    }
-   STBI_FREE(p->out);      p->out      = NULL;
-   STBI_FREE(p->expanded); p->expanded = NULL;
-   STBI_FREE(p->idata);    p->idata    = NULL;
+   stbi__free(p->out);      p->out      = NULL;
+   stbi__free(p->expanded); p->expanded = NULL;
+   stbi__free(p->idata);    p->idata    = NULL;
 
    return result;
 }
@@ -5595,7 +8203,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    if (info.bpp < 16) {
       int z=0;
-      if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+      if (psize == 0 || psize > 256) { stbi__free(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
       for (i=0; i < psize; ++i) {
          pal[i][2] = stbi__get8(s);
          pal[i][1] = stbi__get8(s);
@@ -5607,7 +8215,7 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
       if (info.bpp == 1) width = (s->img_x + 7) >> 3;
       else if (info.bpp == 4) width = (s->img_x + 1) >> 1;
       else if (info.bpp == 8) width = s->img_x;
-      else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+      else { stbi__free(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
       pad = (-width)&3;
       if (info.bpp == 1) {
          for (j=0; j < (int) s->img_y; ++j) {
@@ -5664,13 +8272,13 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
             easy = 2;
       }
       if (!easy) {
-         if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (!mr || !mg || !mb) { stbi__free(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
          // right shift amt to put high bit in position #7
          rshift = stbi__high_bit(mr)-7; rcount = stbi__bitcount(mr);
          gshift = stbi__high_bit(mg)-7; gcount = stbi__bitcount(mg);
          bshift = stbi__high_bit(mb)-7; bcount = stbi__bitcount(mb);
          ashift = stbi__high_bit(ma)-7; acount = stbi__bitcount(ma);
-         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { stbi__free(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
       }
       for (j=0; j < (int) s->img_y; ++j) {
          if (easy) {
@@ -5938,7 +8546,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
       if ( tga_indexed)
       {
          if (tga_palette_len == 0) {  /* you have to have at least one entry! */
-            STBI_FREE(tga_data);
+            stbi__free(tga_data);
             return stbi__errpuc("bad palette", "Corrupt TGA");
          }
 
@@ -5947,7 +8555,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
          //   load the palette
          tga_palette = (unsigned char*)stbi__malloc_mad2(tga_palette_len, tga_comp, 0);
          if (!tga_palette) {
-            STBI_FREE(tga_data);
+            stbi__free(tga_data);
             return stbi__errpuc("outofmem", "Out of memory");
          }
          if (tga_rgb16) {
@@ -5958,8 +8566,8 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
                pal_entry += tga_comp;
             }
          } else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-               STBI_FREE(tga_data);
-               STBI_FREE(tga_palette);
+               stbi__free(tga_data);
+               stbi__free(tga_palette);
                return stbi__errpuc("bad palette", "Corrupt TGA");
          }
       }
@@ -6040,7 +8648,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
       //   clear my palette, if I had one
       if ( tga_palette != NULL )
       {
-         STBI_FREE( tga_palette );
+         stbi__free( tga_palette );
       }
    }
 
@@ -6232,7 +8840,7 @@ static void *stbi__psd_load(stbi__context *s, int *x, int *y, int *comp, int req
          } else {
             // Read the RLE data.
             if (!stbi__psd_decode_rle(s, p, pixelCount)) {
-               STBI_FREE(out);
+               stbi__free(out);
                return stbi__errpuc("corrupt", "bad RLE data");
             }
          }
@@ -6524,7 +9132,7 @@ static void *stbi__pic_load(stbi__context *s,int *px,int *py,int *comp,int req_c
    memset(result, 0xff, x*y*4);
 
    if (!stbi__pic_load_core(s,x,y,comp, result)) {
-      STBI_FREE(result);
+      stbi__free(result);
       result=0;
    }
    *px = x;
@@ -6572,6 +9180,7 @@ typedef struct
    int cur_x, cur_y;
    int line_size;
    int delay;
+   int lzw_cs;                   // lzw code size of the last frame, its colour indices are below 1 << lzw_cs
 } stbi__gif;
 
 static int stbi__gif_test_raw(stbi__context *s)
@@ -6638,13 +9247,13 @@ static int stbi__gif_info_raw(stbi__context *s, int *x, int *y, int *comp)
    stbi__gif* g = (stbi__gif*) stbi__malloc(sizeof(stbi__gif));
    if (!g) return stbi__err("outofmem", "Out of memory");
    if (!stbi__gif_header(s, g, comp, 1)) {
-      STBI_FREE(g);
+      stbi__free(g);
       stbi__rewind( s );
       return 0;
    }
    if (x) *x = g->w;
    if (y) *y = g->h;
-   STBI_FREE(g);
+   stbi__free(g);
    return 1;
 }
 
@@ -6695,6 +9304,7 @@ static stbi_uc *stbi__process_gif_raster(stbi__context *s, stbi__gif *g)
 
    lzw_cs = stbi__get8(s);
    if (lzw_cs > 12) return NULL;
+   g->lzw_cs = lzw_cs;
    clear = 1 << lzw_cs;
    first = 1;
    codesize = lzw_cs + 1;
@@ -6877,7 +9487,10 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
             }
 
             if (g->lflags & 0x80) {
-               stbi__gif_parse_colortable(s,g->lpal, 2 << (g->lflags & 7), g->eflags & 0x01 ? g->transparent : -1);
+               int entries = 2 << (g->lflags & 7);
+               stbi__gif_parse_colortable(s,g->lpal, entries, g->eflags & 0x01 ? g->transparent : -1);
+               // indices past the table are transparent, not whatever an earlier frame's table had there
+               memset(g->lpal + entries, 0, (256 - entries) * 4);
                g->color_table = (stbi_uc *) g->lpal;
             } else if (g->flags & 0x80) {
                g->color_table = (stbi_uc *) g->pal;
@@ -6948,12 +9561,12 @@ static stbi_uc *stbi__gif_load_next(stbi__context *s, stbi__gif *g, int *comp, i
 
 static void *stbi__load_gif_main_outofmem(stbi__gif *g, stbi_uc *out, int **delays)
 {
-   STBI_FREE(g->out);
-   STBI_FREE(g->history);
-   STBI_FREE(g->background);
+   stbi__free(g->out);
+   stbi__free(g->history);
+   stbi__free(g->background);
 
-   if (out) STBI_FREE(out);
-   if (delays && *delays) STBI_FREE(*delays);
+   if (out) stbi__free(out);
+   if (delays && *delays) stbi__free(*delays);
    return stbi__errpuc("outofmem", "Out of memory");
 }
 
@@ -6988,7 +9601,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
             stride = g.w * g.h * 4;
 
             if (out) {
-               void *tmp = (stbi_uc*) STBI_REALLOC_SIZED( out, out_size, layers * stride );
+               void *tmp = (stbi_uc*) stbi__realloc_sized( out, out_size, layers * stride );
                if (!tmp)
                   return stbi__load_gif_main_outofmem(&g, out, delays);
                else {
@@ -6997,7 +9610,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
                }
 
                if (delays) {
-                  int *new_delays = (int*) STBI_REALLOC_SIZED( *delays, delays_size, sizeof(int) * layers );
+                  int *new_delays = (int*) stbi__realloc_sized( *delays, delays_size, sizeof(int) * layers );
                   if (!new_delays)
                      return stbi__load_gif_main_outofmem(&g, out, delays);
                   *delays = new_delays;
@@ -7017,7 +9630,7 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
             }
             memcpy( out + ((layers - 1) * stride), u, stride );
             if (layers >= 2) {
-               two_back = out - 2 * stride;
+               two_back = out + (layers - 2) * stride;
             }
 
             if (delays) {
@@ -7027,9 +9640,9 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
       } while (u != 0);
 
       // free temp buffer;
-      STBI_FREE(g.out);
-      STBI_FREE(g.history);
-      STBI_FREE(g.background);
+      stbi__free(g.out);
+      stbi__free(g.history);
+      stbi__free(g.background);
 
       // do the final conversion after loading everything;
       if (req_comp && req_comp != 4)
@@ -7061,12 +9674,12 @@ static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req
          u = stbi__convert_format(u, 4, req_comp, g.w, g.h);
    } else if (g.out) {
       // if there was an error and we allocated an image buffer, free it!
-      STBI_FREE(g.out);
+      stbi__free(g.out);
    }
 
    // free buffers needed for multiple frame loading;
-   STBI_FREE(g.history);
-   STBI_FREE(g.background);
+   stbi__free(g.history);
+   stbi__free(g.background);
 
    return u;
 }
@@ -7075,6 +9688,245 @@ static int stbi__gif_info(stbi__context *s, int *x, int *y, int *comp)
 {
    return stbi__gif_info_raw(s,x,y,comp);
 }
+
+// a frame a seek can start from: it draws an opaque pixel everywhere, so it looks the same whatever
+// came before, and isn't disposed of to the background or to the frame before it, so the frames
+// after it don't look back past it either. starting there needs the palette alpha and the graphic
+// control in effect before its blocks
+typedef struct
+{
+   int frame;
+   int offset;                   // where its blocks start in the buffer
+   int eflags, delay, transparent;
+   stbi_uc opaque[32];           // palette entries with alpha 255, a bit each
+} stbi__gif_keyframe;
+
+struct stbi__gif_frames
+{
+   stbi__context s;
+   stbi__gif g;
+   int w, h, req_comp, simd;
+   int next;                     // the frame stbi_gif_next decodes
+   int indexed;                  // frames checked for being keyframes
+   int count;                    // -1 until the end is found
+   int failed;
+   const char *failure_reason;
+   int out_valid;                // g.out holds frame next-1
+   int has_prev;                 // prev holds frame next-2, for disposal 3
+   stbi_uc *prev, *spare;
+   stbi_uc *frame;               // what the caller gets
+   int delay;
+   stbi__gif_keyframe *keys;     // in frame order
+   int keys_n, keys_cap;
+};
+
+static stbi_uc *stbi__gif_frames_fail(stbi_gif_frames *f)
+{
+   f->failed = 1;
+   f->failure_reason = stbi__g_failure_reason;
+   return NULL;
+}
+
+static int stbi__gif_frames_add_key(stbi_gif_frames *f, stbi__gif_keyframe *key)
+{
+   if (f->keys_n == f->keys_cap) {
+      int cap = f->keys_cap ? 2 * f->keys_cap : 16;
+      stbi__gif_keyframe *keys = (stbi__gif_keyframe *) stbi__realloc_sized(f->keys, f->keys_cap * sizeof(*key), cap * sizeof(*key));
+      if (!keys) return stbi__err("outofmem", "Out of memory");
+      f->keys = keys;
+      f->keys_cap = cap;
+   }
+   f->keys[f->keys_n++] = *key;
+   return 1;
+}
+
+// converts the canvas into the caller's frame
+static stbi_uc *stbi__gif_frames_output(stbi_gif_frames *f, int *delay)
+{
+   int pcount = f->w * f->h;
+   if (f->req_comp == 4)
+      memcpy(f->frame, f->g.out, 4 * pcount);
+   else
+      stbi__convert_row8(f->frame, f->g.out, 4, f->req_comp, pcount, f->simd);
+   if (stbi__vertically_flip_on_load)
+      stbi__vertical_flip(f->frame, f->w, f->h, f->req_comp);
+   if (delay) *delay = f->delay;
+   return f->frame;
+}
+
+// goes back to a keyframe, or to the start without one
+static int stbi__gif_frames_restart(stbi_gif_frames *f, stbi__gif_keyframe *key)
+{
+   stbi__gif *g = &f->g;
+   stbi_uc *out = g->out, *background = g->background, *history = g->history;
+   int comp, k, pcount = f->w * f->h;
+
+   memset(g, 0, sizeof(*g));
+   stbi__rewind(&f->s);
+   f->next = 0;
+   f->out_valid = f->has_prev = 0;
+   if (key == NULL) {
+      // the first frame allocates and clears them again
+      stbi__free(out);
+      stbi__free(background);
+      stbi__free(history);
+      return 1;
+   }
+
+   if (!out) out = (stbi_uc *) stbi__malloc(4 * pcount);
+   if (!background) background = (stbi_uc *) stbi__malloc(4 * pcount);
+   if (!history) history = (stbi_uc *) stbi__malloc(pcount);
+   g->out = out;
+   g->background = background;
+   g->history = history;
+   if (!out || !background || !history) return stbi__err("outofmem", "Out of memory");
+   if (!stbi__gif_header(&f->s, g, &comp, 0)) return 0;
+   for (k=0; k < 256; ++k)
+      g->pal[k][3] = (key->opaque[k >> 3] >> (k & 7)) & 1 ? 255 : 0;
+   g->eflags = key->eflags;
+   g->delay = key->delay;
+   g->transparent = key->transparent;
+   // with no history, the frame before isn't disposed of; the keyframe draws over all of it anyway
+   memset(g->out, 0, 4 * pcount);
+   memset(g->history, 0, pcount);
+   f->s.img_buffer = f->s.img_buffer_original + key->offset;
+   f->next = key->frame;
+   return 1;
+}
+
+STBIDEF stbi_gif_frames *stbi_gif_begin(stbi_uc const *buffer, int len, int *x, int *y, int desired_channels)
+{
+   stbi_gif_frames *f;
+   int w, h, comp;
+   if (desired_channels < 0 || desired_channels > 4) return (stbi_gif_frames *) stbi__errpuc("bad req_comp", "Internal error");
+   f = (stbi_gif_frames *) STBI_MALLOC(sizeof(stbi_gif_frames));
+   if (f == NULL) return (stbi_gif_frames *) stbi__errpuc("outofmem", "Out of memory");
+   memset(f, 0, sizeof(stbi_gif_frames));
+   stbi__start_mem(&f->s, buffer, len);
+   if (!stbi__gif_test(&f->s)) {
+      STBI_FREE(f);
+      return (stbi_gif_frames *) stbi__errpuc("not GIF", "Image was not as a gif type.");
+   }
+   if (!stbi__gif_info_raw(&f->s, &w, &h, &comp)) {
+      STBI_FREE(f);
+      return NULL;
+   }
+   stbi__rewind(&f->s);
+   f->w = w;
+   f->h = h;
+   f->req_comp = desired_channels ? desired_channels : 4;
+   f->simd = stbi__convert_simd();
+   f->count = -1;
+   f->prev  = (stbi_uc *) stbi__malloc_mad3(4, w, h, 0);
+   f->spare = (stbi_uc *) stbi__malloc_mad3(4, w, h, 0);
+   f->frame = (stbi_uc *) stbi__malloc_mad3(f->req_comp, w, h, 0);
+   if (!f->prev || !f->spare || !f->frame) {
+      stbi_gif_end(f);
+      return (stbi_gif_frames *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   if (x) *x = w;
+   if (y) *y = h;
+   return f;
+}
+
+STBIDEF stbi_uc *stbi_gif_next(stbi_gif_frames *f, int *delay)
+{
+   stbi__gif *g = &f->g;
+   stbi__gif_keyframe key;
+   stbi_uc *u, *t;
+   int comp, k, entries, pcount = f->w * f->h;
+
+   if (f->failed) {
+      stbi__g_failure_reason = f->failure_reason;
+      return NULL;
+   }
+   if (f->count >= 0 && f->next >= f->count) return NULL;
+
+   // the state this frame starts from, in case it is a keyframe
+   key.frame = f->next;
+   key.offset = (int) (f->s.img_buffer - f->s.img_buffer_original);
+   key.eflags = g->eflags;
+   key.delay = g->delay;
+   key.transparent = g->transparent;
+   memset(key.opaque, 0, sizeof(key.opaque));
+   for (k=0; k < 256; ++k)
+      if (g->pal[k][3] == 255)
+         key.opaque[k >> 3] |= (stbi_uc) (1 << (k & 7));
+
+   // keep the frame that is about to be drawn over, it is next-2 for the one after
+   if (f->out_valid) memcpy(f->spare, g->out, 4 * pcount);
+   u = stbi__gif_load_next(&f->s, g, &comp, 4, f->has_prev ? f->prev : NULL);
+   if (u == (stbi_uc *) &f->s) { // end of animated gif marker, the last frame has been disposed of
+      f->count = f->next;
+      f->out_valid = 0;
+      return NULL;
+   }
+   if (!u) return stbi__gif_frames_fail(f);
+   f->has_prev = f->out_valid;
+   if (f->out_valid) {
+      t = f->prev;
+      f->prev = f->spare;
+      f->spare = t;
+   }
+   f->out_valid = 1;
+
+   if (f->next == f->indexed) {
+      // the whole canvas, no transparent index, every index inside the table, every pixel reached, and
+      // no disposal to the background or the frame before
+      entries = 2 << ((g->color_table == (stbi_uc *) g->lpal ? g->lflags : g->flags) & 7);
+      if (f->next > 0 && g->start_x == 0 && g->start_y == 0 && g->max_x == g->line_size && g->max_y == f->h * g->line_size &&
+          !(g->eflags & 0x01) && (g->eflags & 0x1C) != 0x08 && (g->eflags & 0x1C) != 0x0C && (1 << g->lzw_cs) <= entries &&
+          memchr(g->history, 0, pcount) == NULL)
+         if (!stbi__gif_frames_add_key(f, &key))
+            return stbi__gif_frames_fail(f);
+      ++f->indexed;
+   }
+
+   ++f->next;
+   f->delay = g->delay;
+   return stbi__gif_frames_output(f, delay);
+}
+
+STBIDEF stbi_uc *stbi_gif_frame(stbi_gif_frames *f, int index, int *delay)
+{
+   int k, start;
+   if (f->failed) {
+      stbi__g_failure_reason = f->failure_reason;
+      return NULL;
+   }
+   if (index < 0 || (f->count >= 0 && index >= f->count)) return stbi__errpuc("bad frame", "Frame index out of range");
+   if (f->out_valid && index == f->next - 1) return stbi__gif_frames_output(f, delay);
+
+   // decode on from here if that doesn't mean decoding more than from the last keyframe
+   for (k = f->keys_n - 1; k >= 0 && f->keys[k].frame > index; --k)
+      ;
+   start = k >= 0 ? f->keys[k].frame : 0;
+   if (index < f->next || f->next <= start)
+      if (!stbi__gif_frames_restart(f, k >= 0 ? &f->keys[k] : NULL))
+         return stbi__gif_frames_fail(f);
+
+   while (f->next <= index)
+      if (!stbi_gif_next(f, delay))
+         return f->failed ? NULL : stbi__errpuc("bad frame", "Frame index out of range");
+   return f->frame;
+}
+
+STBIDEF int stbi_gif_frame_count(stbi_gif_frames *f)
+{
+   return f->count;
+}
+
+STBIDEF void stbi_gif_end(stbi_gif_frames *f)
+{
+   stbi__free(f->g.out);
+   stbi__free(f->g.background);
+   stbi__free(f->g.history);
+   stbi__free(f->prev);
+   stbi__free(f->spare);
+   stbi__free(f->frame);
+   stbi__free(f->keys);
+   STBI_FREE(f);
+}
 #endif
 
 // *************************************************************************************************
@@ -7129,8 +9981,9 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
 {
    if ( input[3] != 0 ) {
       float f1;
-      // Exponent
-      f1 = (float) ldexp(1.0f, input[3] - (int)(128 + 8));
+      // Exponent: 2^(e-136) has the float exponent field e-9, or is the denormal bit e+13
+      stbi__uint32 bits = input[3] >= 10 ? (stbi__uint32) (input[3] - 9) << 23 : (stbi__uint32) 1 << (input[3] + 13);
+      memcpy(&f1, &bits, 4);
       if (req_comp <= 2)
          output[0] = (input[0] + input[1] + input[2]) * f1 / 3;
       else {
@@ -7152,37 +10005,258 @@ static void stbi__hdr_convert(float *output, stbi_uc *input, int req_comp)
    }
 }
 
-static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+// pixel i of a scanline held as r, g, b and e planes of width bytes
+static void stbi__hdr_convert_planar(float *output, stbi_uc const *planes, int width, int i, int req_comp)
 {
-   char buffer[STBI__HDR_BUFLEN];
-   char *token;
-   int valid = 0;
-   int width, height;
-   stbi_uc *scanline;
-   float *hdr_data;
-   int len;
-   unsigned char count, value;
-   int i, j, k, c1,c2, z;
-   const char *headerToken;
-   STBI_NOTUSED(ri);
-
-   // Check identifier
-   headerToken = stbi__hdr_gettoken(s,buffer);
-   if (strcmp(headerToken, "#?RADIANCE") != 0 && strcmp(headerToken, "#?RGBE") != 0)
-      return stbi__errpf("not HDR", "Corrupt HDR image");
+   stbi_uc rgbe[4];
+   rgbe[0] = planes[i];
+   rgbe[1] = planes[width + i];
+   rgbe[2] = planes[2*width + i];
+   rgbe[3] = planes[3*width + i];
+   stbi__hdr_convert(output, rgbe, req_comp);
+}
 
-   // Parse header
-   for(;;) {
-      token = stbi__hdr_gettoken(s,buffer);
-      if (token[0] == 0) break;
-      if (strcmp(token, "FORMAT=32-bit_rle_rgbe") == 0) valid = 1;
+#ifdef STBI_SSE2
+// 4 bytes of a plane, one to each 32-bit lane
+static __m128i stbi__hdr_widen_sse2(stbi_uc const *p)
+{
+   int v;
+   memcpy(&v, p, 4);
+   return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), _mm_setzero_si128()), _mm_setzero_si128());
+}
+
+// 4 pixels at a time; returns how many pixels it converted
+static int stbi__hdr_convert_sse2(float *output, stbi_uc const *planes, int width, int req_comp)
+{
+   __m128i zero = _mm_setzero_si128(), ten = _mm_set1_epi32(10), nine = _mm_set1_epi32(9);
+   __m128 one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f);
+   int i, k;
+   for (i=0; i+4 <= width; i += 4, output += 4*req_comp) {
+      __m128i r = stbi__hdr_widen_sse2(planes + i);
+      __m128i g = stbi__hdr_widen_sse2(planes + width + i);
+      __m128i b = stbi__hdr_widen_sse2(planes + 2*width + i);
+      __m128i e = stbi__hdr_widen_sse2(planes + 3*width + i);
+      __m128 scale, p0, p1, p2, p3;
+      // exponents 1-9 scale into float denormals, which take the scalar path
+      if (_mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi32(e, zero), _mm_cmplt_epi32(e, ten)))) {
+         for (k=0; k < 4; ++k)
+            stbi__hdr_convert_planar(output + k*req_comp, planes, width, i+k, req_comp);
+         continue;
+      }
+      // the exponent field goes straight into the scale, e 0 is black
+      scale = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(e, nine), 23)), _mm_castsi128_ps(_mm_cmpgt_epi32(e, zero)));
+      if (req_comp <= 2) {
+         __m128 y = _mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(r, g), b)), scale), three);
+         if (req_comp == 1)
+            _mm_storeu_ps(output, y);
+         else {
+            _mm_storeu_ps(output,     _mm_unpacklo_ps(y, one));
+            _mm_storeu_ps(output + 4, _mm_unpackhi_ps(y, one));
+         }
+         continue;
+      }
+      p0 = _mm_mul_ps(_mm_cvtepi32_ps(r), scale);
+      p1 = _mm_mul_ps(_mm_cvtepi32_ps(g), scale);
+      p2 = _mm_mul_ps(_mm_cvtepi32_ps(b), scale);
+      p3 = one;
+      _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+      if (req_comp == 4) {
+         _mm_storeu_ps(output,      p0);
+         _mm_storeu_ps(output + 4,  p1);
+         _mm_storeu_ps(output + 8,  p2);
+         _mm_storeu_ps(output + 12, p3);
+      } else {
+         // rgb rgb rgb rgb out of four rgb1
+         _mm_storeu_ps(output,     _mm_shuffle_ps(p0, _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(0,0,2,2)), _MM_SHUFFLE(2,0,1,0)));
+         _mm_storeu_ps(output + 4, _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(1,0,2,1)));
+         _mm_storeu_ps(output + 8, _mm_shuffle_ps(_mm_shuffle_ps(p2, p3, _MM_SHUFFLE(0,0,2,2)), p3, _MM_SHUFFLE(2,1,2,0)));
+      }
    }
+   return i;
+}
+#endif
 
-   if (!valid)    return stbi__errpf("unsupported format", "Unsupported HDR format");
+#ifdef STBI_NEON
+// 8 pixels at a time, rgb and rgba only: 32-bit arm has no vector divide for the luma's /3, and
+// flushes denormals, so exponents 1-9 take the scalar path
+static int stbi__hdr_convert_neon(float *output, stbi_uc const *planes, int width, int req_comp)
+{
+   int i, h, k;
+   if (req_comp < 3) return 0;
+   for (i=0; i+8 <= width; i += 8, output += 8*req_comp) {
+      uint16x8_t r = vmovl_u8(vld1_u8(planes + i));
+      uint16x8_t g = vmovl_u8(vld1_u8(planes + width + i));
+      uint16x8_t b = vmovl_u8(vld1_u8(planes + 2*width + i));
+      uint16x8_t e = vmovl_u8(vld1_u8(planes + 3*width + i));
+      uint16x8_t tiny = vcltq_u16(vsubq_u16(e, vdupq_n_u16(1)), vdupq_n_u16(9));
+      if (vget_lane_u64(vreinterpret_u64_u16(vorr_u16(vget_low_u16(tiny), vget_high_u16(tiny))), 0)) {
+         for (k=0; k < 8; ++k)
+            stbi__hdr_convert_planar(output + k*req_comp, planes, width, i+k, req_comp);
+         continue;
+      }
+      for (h=0; h < 2; ++h) {
+         uint32x4_t e32 = vmovl_u16(h ? vget_high_u16(e) : vget_low_u16(e));
+         float32x4_t scale = vreinterpretq_f32_u32(vandq_u32(vshlq_n_u32(vsubq_u32(e32, vdupq_n_u32(9)), 23), vtstq_u32(e32, e32)));
+         float32x4_t fr = vmulq_f32(vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(r) : vget_low_u16(r))), scale);
+         float32x4_t fg = vmulq_f32(vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(g) : vget_low_u16(g))), scale);
+         float32x4_t fb = vmulq_f32(vcvtq_f32_u32(vmovl_u16(h ? vget_high_u16(b) : vget_low_u16(b))), scale);
+         if (req_comp == 4) {
+            float32x4x4_t o;
+            o.val[0] = fr; o.val[1] = fg; o.val[2] = fb; o.val[3] = vdupq_n_f32(1.0f);
+            vst4q_f32(output + h*16, o);
+         } else {
+            float32x4x3_t o;
+            o.val[0] = fr; o.val[1] = fg; o.val[2] = fb;
+            vst3q_f32(output + h*12, o);
+         }
+      }
+   }
+   return i;
+}
+#endif
 
-   // Parse width and height
-   // can't use sscanf() if we're not using stdio!
-   token = stbi__hdr_gettoken(s,buffer);
+static void stbi__hdr_convert_row(float *output, stbi_uc const *planes, int width, int req_comp, int simd)
+{
+   int i = 0;
+#ifdef STBI_SSE2
+   if (simd) i = stbi__hdr_convert_sse2(output, planes, width, req_comp);
+#elif defined(STBI_NEON)
+   if (simd) i = stbi__hdr_convert_neon(output, planes, width, req_comp);
+#endif
+   STBI_NOTUSED(simd);
+   for (; i < width; ++i)
+      stbi__hdr_convert_planar(output + i*req_comp, planes, width, i, req_comp);
+}
+
+// one new-style scanline, every channel run length encoded on its own, into planes of width bytes.
+// most runs and dumps are short, and are written as 16 bytes when there is room; the packets after
+// them overwrite the excess. returns 0 on bad run lengths
+static int stbi__hdr_rle_scanline(stbi__context *s, stbi_uc *planes, int width)
+{
+   int i, k, z, count;
+   for (k = 0; k < 4; ++k) {
+      stbi_uc *plane = planes + k*width;
+      for (i = 0; i < width; i += count) {
+         count = stbi__get8(s);
+         if (count > 128) {
+            // Run
+            count -= 128;
+            if (count > width - i) return 0;
+            memset(plane + i, stbi__get8(s), count <= 16 && width - i >= 16 ? 16 : count);
+         } else {
+            // Dump
+            if ((count == 0) || (count > width - i)) return 0;
+            if (count <= 16 && width - i >= 16 && s->img_buffer_end - s->img_buffer >= 16) {
+               memcpy(plane + i, s->img_buffer, 16);
+               s->img_buffer += count;
+            } else if (s->img_buffer + count <= s->img_buffer_end) {
+               memcpy(plane + i, s->img_buffer, count);
+               s->img_buffer += count;
+            } else
+               for (z = 0; z < count; ++z)
+                  plane[i + z] = stbi__get8(s);
+         }
+      }
+   }
+   return 1;
+}
+
+// where each scanline starts, so they can be decoded in parallel. returns 0 when one isn't
+// new-style or runs past the end; the sequential decode deals with those
+static int stbi__hdr_find_scanlines(stbi_uc const *p, stbi_uc const *end, int width, int height, stbi_uc const **rows)
+{
+   int i, j, k, count;
+   for (j = 0; j < height; ++j) {
+      rows[j] = p;
+      if (end - p < 4 || p[0] != 2 || p[1] != 2 || ((p[2] << 8) | p[3]) != width) return 0;
+      p += 4;
+      for (k = 0; k < 4; ++k)
+         for (i = 0; i < width; i += count) {
+            if (p == end) return 0;
+            count = *p++;
+            if (count > 128) {
+               count -= 128;
+               if (count > width - i || p == end) return 0;
+               ++p;
+            } else {
+               if (count == 0 || count > width - i || end - p < count) return 0;
+               p += count;
+            }
+         }
+   }
+   rows[height] = p;
+   return 1;
+}
+
+typedef struct
+{
+   void *output;                 // floats, or halfs
+   int width, height, req_comp, half, simd;
+   int bands;
+   stbi_uc const **rows;         // where each scanline starts, when decoding bands in parallel
+   stbi_uc *scratch;             // planes, then a float scanline when converting to halfs, for each band
+   size_t scratch_size;
+} stbi__hdr_job;
+
+static void stbi__hdr_output(stbi__hdr_job *job, int row, stbi_uc const *planes, float *rowf)
+{
+   size_t at = (size_t) row * job->width * job->req_comp;
+#ifndef STBI_NO_LINEAR
+   if (job->half) {
+      stbi__hdr_convert_row(rowf, planes, job->width, job->req_comp, job->simd);
+      stbi__float_to_half_run((stbi__uint16 *) job->output + at, rowf, job->width * job->req_comp, job->simd);
+      return;
+   }
+#endif
+   STBI_NOTUSED(rowf);
+   stbi__hdr_convert_row((float *) job->output + at, planes, job->width, job->req_comp, job->simd);
+}
+
+static void stbi__hdr_task(void *task_data, int band)
+{
+   stbi__hdr_job *job = (stbi__hdr_job *) task_data;
+   int first = job->height * band / job->bands, last = job->height * (band+1) / job->bands, j;
+   stbi_uc *planes = job->scratch + band * job->scratch_size;
+   stbi__context s;
+
+   stbi__start_mem(&s, job->rows[first], (int) (job->rows[last] - job->rows[first]));
+   for (j = first; j < last; ++j) {
+      s.img_buffer += 4; // the scanline header, already checked
+      stbi__hdr_rle_scanline(&s, planes, job->width);
+      stbi__hdr_output(job, j, planes, (float *) (planes + 4 * job->width));
+   }
+}
+
+static void *stbi__hdr_decode(stbi__context *s, int *x, int *y, int *comp, int req_comp, int half)
+{
+   char buffer[STBI__HDR_BUFLEN];
+   char *token;
+   int valid = 0;
+   int width, height, size;
+   stbi_uc *planes;
+   float *rowf;
+   stbi__hdr_job job;
+   int len;
+   int i, j, c1,c2, flat;
+   const char *headerToken;
+
+   // Check identifier
+   headerToken = stbi__hdr_gettoken(s,buffer);
+   if (strcmp(headerToken, "#?RADIANCE") != 0 && strcmp(headerToken, "#?RGBE") != 0)
+      return stbi__errpf("not HDR", "Corrupt HDR image");
+
+   // Parse header
+   for(;;) {
+      token = stbi__hdr_gettoken(s,buffer);
+      if (token[0] == 0) break;
+      if (strcmp(token, "FORMAT=32-bit_rle_rgbe") == 0) valid = 1;
+   }
+
+   if (!valid)    return stbi__errpf("unsupported format", "Unsupported HDR format");
+
+   // Parse width and height
+   // can't use sscanf() if we're not using stdio!
+   token = stbi__hdr_gettoken(s,buffer);
    if (strncmp(token, "-Y ", 3))  return stbi__errpf("unsupported data layout", "Unsupported HDR format");
    token += 3;
    height = (int) strtol(token, &token, 10);
@@ -7200,87 +10274,107 @@ static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int re
    if (comp) *comp = 3;
    if (req_comp == 0) req_comp = 3;
 
-   if (!stbi__mad4sizes_valid(width, height, req_comp, sizeof(float), 0))
+   size = half ? sizeof(stbi__uint16) : sizeof(float);
+   if (!stbi__mad4sizes_valid(width, height, req_comp, size, 0))
       return stbi__errpf("too large", "HDR image is too large");
 
    // Read data
-   hdr_data = (float *) stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
-   if (!hdr_data)
+   job.output = stbi__malloc_mad4(width, height, req_comp, size, 0);
+   if (!job.output)
       return stbi__errpf("outofmem", "Out of memory");
+   job.width = width;
+   job.height = height;
+   job.req_comp = req_comp;
+   job.half = half;
+   job.simd = stbi__convert_simd();
+   job.bands = 1;
+   job.rows = NULL;
 
    // Load image data
    // image data is stored as some number of sca
-   if ( width < 8 || width >= 32768) {
-      // Read flat data
-      for (j=0; j < height; ++j) {
-         for (i=0; i < width; ++i) {
-            stbi_uc rgbe[4];
-           main_decode_loop:
-            stbi__getn(s, rgbe, 4);
-            stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
-         }
+   flat = width < 8 || width >= 32768;
+
+   // scanlines in memory can all be found up front, then decoded in bands on other threads
+   if (!flat && stbi__parallel_for_func && !s->read_from_callbacks && (size_t) width * height >= 2 * STBI__CONVERT_MIN_BAND_PIXELS) {
+      job.rows = (stbi_uc const **) stbi__malloc_mad2(height + 1, sizeof(*job.rows), 0);
+      if (job.rows && stbi__hdr_find_scanlines(s->img_buffer, s->img_buffer_end, width, height, job.rows)) {
+         job.bands = (int) ((size_t) width * height / STBI__CONVERT_MIN_BAND_PIXELS);
+         if (job.bands > STBI__CONVERT_MAX_BANDS) job.bands = STBI__CONVERT_MAX_BANDS;
+         if (job.bands > height) job.bands = height;
+      } else {
+         stbi__free(job.rows);
+         job.rows = NULL;
       }
-   } else {
-      // Read RLE-encoded data
-      scanline = NULL;
+   }
 
-      for (j = 0; j < height; ++j) {
+   // the planes, then a float scanline when converting to halfs
+   job.scratch_size = (size_t) width * (half ? 4 + 4 * req_comp : 4);
+   job.scratch = (stbi_uc *) stbi__malloc(job.bands * job.scratch_size);
+   if (!job.scratch) {
+      stbi__free(job.output);
+      stbi__free(job.rows);
+      return stbi__errpf("outofmem", "Out of memory");
+   }
+
+   if (job.bands > 1) {
+      stbi__parallel_run(job.bands, stbi__hdr_task, &job);
+      s->img_buffer = (stbi_uc *) job.rows[height];
+      stbi__free(job.rows);
+      stbi__free(job.scratch);
+      return job.output;
+   }
+
+   planes = job.scratch;
+   rowf = (float *) (job.scratch + 4 * width);
+   i = 0;
+   for (j = 0; j < height; ++j) {
+      if (!flat) {
+         // Read RLE-encoded data
          c1 = stbi__get8(s);
          c2 = stbi__get8(s);
          len = stbi__get8(s);
          if (c1 != 2 || c2 != 2 || (len & 0x80)) {
             // not run-length encoded, so we have to actually use THIS data as a decoded
-            // pixel (note this can't be a valid pixel--one of RGB must be >= 128)
-            stbi_uc rgbe[4];
-            rgbe[0] = (stbi_uc) c1;
-            rgbe[1] = (stbi_uc) c2;
-            rgbe[2] = (stbi_uc) len;
-            rgbe[3] = (stbi_uc) stbi__get8(s);
-            stbi__hdr_convert(hdr_data, rgbe, req_comp);
+            // pixel (note this can't be a valid pixel--one of RGB must be >= 128). the rest is
+            // read flat from pixel 1 of the first scanline (yes, this makes no sense)
+            planes[0]       = (stbi_uc) c1;
+            planes[width]   = (stbi_uc) c2;
+            planes[2*width] = (stbi_uc) len;
+            planes[3*width] = (stbi_uc) stbi__get8(s);
+            flat = 1;
             i = 1;
             j = 0;
-            STBI_FREE(scanline);
-            goto main_decode_loop; // yes, this makes no sense
-         }
-         len <<= 8;
-         len |= stbi__get8(s);
-         if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
-         if (scanline == NULL) {
-            scanline = (stbi_uc *) stbi__malloc_mad2(width, 4, 0);
-            if (!scanline) {
-               STBI_FREE(hdr_data);
-               return stbi__errpf("outofmem", "Out of memory");
-            }
+         } else {
+            len <<= 8;
+            len |= stbi__get8(s);
+            if (len != width) { stbi__free(job.output); stbi__free(job.scratch); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
+            if (!stbi__hdr_rle_scanline(s, planes, width)) { stbi__free(job.output); stbi__free(job.scratch); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
          }
-
-         for (k = 0; k < 4; ++k) {
-            int nleft;
-            i = 0;
-            while ((nleft = width - i) > 0) {
-               count = stbi__get8(s);
-               if (count > 128) {
-                  // Run
-                  value = stbi__get8(s);
-                  count -= 128;
-                  if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = value;
-               } else {
-                  // Dump
-                  if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                  for (z = 0; z < count; ++z)
-                     scanline[i++ * 4 + k] = stbi__get8(s);
-               }
-            }
+      }
+      if (flat) {
+         // Read flat data
+         for (; i < width; ++i) {
+            stbi_uc rgbe[4];
+            if (!stbi__getn(s, rgbe, 4))
+               rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+            planes[i]         = rgbe[0];
+            planes[width+i]   = rgbe[1];
+            planes[2*width+i] = rgbe[2];
+            planes[3*width+i] = rgbe[3];
          }
-         for (i=0; i < width; ++i)
-            stbi__hdr_convert(hdr_data+(j*width + i)*req_comp, scanline + i*4, req_comp);
+         i = 0;
       }
-      if (scanline)
-         STBI_FREE(scanline);
+      stbi__hdr_output(&job, j, planes, rowf);
    }
 
-   return hdr_data;
+   stbi__free(job.scratch);
+   return job.output;
+}
+
+static float *stbi__hdr_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+{
+   STBI_NOTUSED(ri);
+   return (float *) stbi__hdr_decode(s, x, y, comp, req_comp, 0);
 }
 
 static int stbi__hdr_info(stbi__context *s, int *x, int *y, int *comp)
@@ -7522,7 +10616,7 @@ static void *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int req
    out = (stbi_uc *) stbi__malloc_mad4(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0);
    if (!out) return stbi__errpuc("outofmem", "Out of memory");
    if (!stbi__getn(s, out, s->img_n * s->img_x * s->img_y * (ri->bits_per_channel / 8))) {
-      STBI_FREE(out);
+      stbi__free(out);
       return stbi__errpuc("bad PNM", "PNM file truncated");
    }
 
@@ -7756,6 +10850,1062 @@ STBIDEF int stbi_is_16_bit_from_callbacks(stbi_io_callbacks const *c, void *user
    return stbi__is_16_main(&s);
 }
 
+// the format the first bytes of the file say it is in, STBI__PROBE_any when they don't say
+enum
+{
+   STBI__PROBE_any,
+   STBI__PROBE_jpeg,
+   STBI__PROBE_png,
+   STBI__PROBE_gif,
+   STBI__PROBE_bmp,
+   STBI__PROBE_psd,
+   STBI__PROBE_pic,
+   STBI__PROBE_pnm,
+   STBI__PROBE_hdr
+};
+
+static int stbi__probe_format(stbi_uc const *p, size_t n)
+{
+   static const stbi_uc png_sig[8] = { 137,80,78,71,13,10,26,10 };
+   static const stbi_uc pic_sig[4] = { 0x53,0x80,0xf6,0x34 };
+   if (n >= 2 && p[0] == 0xff && p[1] == 0xd8)               return STBI__PROBE_jpeg;
+   if (n >= 8 && memcmp(p, png_sig, 8) == 0)                 return STBI__PROBE_png;
+   if (n >= 6 && (memcmp(p, "GIF87a", 6) == 0 || memcmp(p, "GIF89a", 6) == 0))
+                                                             return STBI__PROBE_gif;
+   if (n >= 2 && p[0] == 'B' && p[1] == 'M')                 return STBI__PROBE_bmp;
+   if (n >= 4 && memcmp(p, "8BPS", 4) == 0)                  return STBI__PROBE_psd;
+   if (n >= 4 && memcmp(p, pic_sig, 4) == 0)                 return STBI__PROBE_pic;
+   if (n >= 2 && p[0] == 'P' && (p[1] == '5' || p[1] == '6')) return STBI__PROBE_pnm;
+   if ((n >= 11 && memcmp(p, "#?RADIANCE\n", 11) == 0) || (n >= 7 && memcmp(p, "#?RGBE\n", 7) == 0))
+                                                             return STBI__PROBE_hdr;
+   return STBI__PROBE_any;
+}
+
+// the first buffer of a context holds the signature: a whole memory context, and at least the
+// first 128 bytes of a file or callbacks
+static int stbi__probe_main(stbi__context *s, stbi_image_info *info)
+{
+   int *x = &info->x, *y = &info->y, *comp = &info->channels_in_file;
+   int r;
+   info->is_16_bit = 0;
+   info->is_hdr = 0;
+   switch (stbi__probe_format(s->img_buffer, (size_t) (s->img_buffer_end - s->img_buffer))) {
+      #ifndef STBI_NO_JPEG
+      case STBI__PROBE_jpeg: r = stbi__jpeg_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_PNG
+      case STBI__PROBE_png: {
+         stbi__png p;
+         p.s = s;
+         r = stbi__png_info_raw(&p, x, y, comp);
+         info->is_16_bit = r && p.depth == 16;
+         break;
+      }
+      #endif
+      #ifndef STBI_NO_GIF
+      case STBI__PROBE_gif: r = stbi__gif_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_BMP
+      case STBI__PROBE_bmp: r = stbi__bmp_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_PSD
+      case STBI__PROBE_psd:
+         // the header is 26 bytes, well inside the first buffer
+         r = stbi__psd_info(s, x, y, comp);
+         if (r) {
+            stbi__rewind(s);
+            info->is_16_bit = stbi__psd_is16(s);
+         }
+         break;
+      #endif
+      #ifndef STBI_NO_PIC
+      case STBI__PROBE_pic: r = stbi__pic_info(s, x, y, comp); break;
+      #endif
+      #ifndef STBI_NO_PNM
+      case STBI__PROBE_pnm:
+         r = stbi__pnm_info(s, x, y, comp);
+         info->is_16_bit = r == 16;
+         break;
+      #endif
+      #ifndef STBI_NO_HDR
+      case STBI__PROBE_hdr:
+         r = stbi__hdr_info(s, x, y, comp);
+         info->is_hdr = r != 0;
+         break;
+      #endif
+      default:
+         return stbi__info_main(s, x, y, comp);
+   }
+   if (!r) return stbi__err("bad header", "Corrupt header, or unsupported variant of the format");
+   return 1;
+}
+
+STBIDEF int stbi_probe_from_memory(stbi_uc const *buffer, int len, stbi_image_info *info)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__probe_main(&s, info);
+}
+
+#ifndef STBI_NO_STDIO
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+// strict ISO modes leave pread out
+#if (defined(_XOPEN_VERSION) && _XOPEN_VERSION >= 500) || (defined(_POSIX_VERSION) && _POSIX_VERSION >= 200809L)
+#define STBI__PREAD
+#endif
+#endif
+
+#ifdef STBI__PREAD
+// a file read a block at a time with pread, for callbacks. a probe reads one block for most
+// files, and skips over the rest without reading it
+typedef struct
+{
+   int fd;
+   off_t offset;     // of the byte after the block
+   int len, pos;     // bytes in the block, and the next one to read
+   int eof;
+   stbi_uc block[4096];
+} stbi__pread_file;
+
+static int stbi__pread_read(void *user, char *data, int size)
+{
+   stbi__pread_file *f = (stbi__pread_file *) user;
+   int n = 0;
+   while (n < size) {
+      int k;
+      if (f->pos == f->len) {
+         ssize_t r = f->eof ? 0 : pread(f->fd, f->block, sizeof(f->block), f->offset);
+         if (r <= 0) {
+            f->eof = 1;
+            break;
+         }
+         f->offset += r;
+         f->len = (int) r;
+         f->pos = 0;
+      }
+      k = f->len - f->pos;
+      if (k > size - n) k = size - n;
+      memcpy(data + n, f->block + f->pos, k);
+      f->pos += k;
+      n += k;
+   }
+   return n;
+}
+
+static void stbi__pread_skip(void *user, int n)
+{
+   stbi__pread_file *f = (stbi__pread_file *) user;
+   off_t at = f->offset - (f->len - f->pos) + n;
+   if (at >= f->offset - f->len && at <= f->offset) {
+      f->pos = (int) (at - (f->offset - f->len));
+   } else {
+      f->offset = at;
+      f->len = f->pos = 0;
+      f->eof = 0;
+   }
+}
+
+static int stbi__pread_eof(void *user)
+{
+   stbi__pread_file *f = (stbi__pread_file *) user;
+   return f->eof && f->pos == f->len;
+}
+#endif
+
+STBIDEF int stbi_probe(char const *filename, stbi_image_info *info)
+{
+   stbi__context s;
+   int result;
+#ifdef STBI__PREAD
+   static stbi_io_callbacks const io = { stbi__pread_read, stbi__pread_skip, stbi__pread_eof };
+   stbi__pread_file f;
+   f.fd = open(filename, O_RDONLY);
+   if (f.fd < 0) return stbi__err("can't fopen", "Unable to open file");
+   f.offset = 0;
+   f.len = f.pos = 0;
+   f.eof = 0;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) &io, &f);
+   result = stbi__probe_main(&s, info);
+   close(f.fd);
+#else
+   FILE *f = stbi__fopen(filename, "rb");
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   stbi__start_file(&s, f);
+   result = stbi__probe_main(&s, info);
+   fclose(f);
+#endif
+   return result;
+}
+
+#ifdef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef STBI_WINDOWS_UTF8
+STBI_EXTERN __declspec(dllimport) int __stdcall MoveFileExW(const wchar_t *from, const wchar_t *to, unsigned long flags);
+#else
+STBI_EXTERN __declspec(dllimport) int __stdcall MoveFileExA(const char *from, const char *to, unsigned long flags);
+#endif
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#define STBI__INFO_CACHE_VERSION  1
+#define STBI__INFO_CACHE_RECORD   36  // bytes in an entry before its path
+
+enum
+{
+   STBI__INFO_probed = 1,    // 0 in an entry that has just been added
+   STBI__INFO_ok     = 2,
+   STBI__INFO_16_bit = 4,
+   STBI__INFO_hdr    = 8
+};
+
+typedef struct
+{
+   size_t name;              // offset of the path in names
+   stbi__uint32 name_len;
+   stbi__uint32 hash;
+   stbi__uint32 stamp[4];    // size, then modification time, low word first
+   int x, y, comp;
+   stbi__uint32 flags;
+} stbi__info_entry;
+
+struct stbi__info_cache
+{
+   char *index_filename;
+   stbi__info_entry *entries;
+   int count, capacity;
+   int *slots;               // open addressing on the path hash: entry index + 1, 0 when empty
+   int slot_count;           // a power of two, at least twice count
+   char *names;              // the paths one after another, each 0-terminated
+   size_t names_len, names_capacity;
+   int dirty;
+};
+
+// the size and modification time of a regular file, which a cached entry has to match
+static int stbi__file_stamp(char const *filename, stbi__uint32 stamp[4])
+{
+#ifdef _WIN32
+   struct _stat64 st;
+#ifdef STBI_WINDOWS_UTF8
+   wchar_t wFilename[1024];
+   if (0 == MultiByteToWideChar(65001 /* UTF8 */, 0, filename, -1, wFilename, sizeof(wFilename)/sizeof(*wFilename)))
+      return 0;
+   if (_wstat64(wFilename, &st) != 0) return 0;
+#else
+   if (_stat64(filename, &st) != 0) return 0;
+#endif
+   if ((st.st_mode & _S_IFMT) != _S_IFREG) return 0;
+#else
+   struct stat st;
+   if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+#endif
+   // shifted in two steps so that a 32-bit off_t or time_t isn't shifted by its whole width
+   stamp[0] = (stbi__uint32) st.st_size;
+   stamp[1] = (stbi__uint32) ((st.st_size >> 16) >> 16);
+   stamp[2] = (stbi__uint32) st.st_mtime;
+   stamp[3] = (stbi__uint32) ((st.st_mtime >> 16) >> 16);
+   return 1;
+}
+
+// FNV-1a
+static stbi__uint32 stbi__info_cache_hash(char const *name, stbi__uint32 len)
+{
+   stbi__uint32 h = 2166136261u, i;
+   for (i=0; i < len; ++i)
+      h = (h ^ (stbi_uc) name[i]) * 16777619u;
+   return h;
+}
+
+// the slot holding the entry for name, or the empty slot where it would go
+static int stbi__info_cache_slot(stbi_info_cache *c, char const *name, stbi__uint32 len, stbi__uint32 hash)
+{
+   int mask = c->slot_count - 1;
+   int i = (int) (hash & (stbi__uint32) mask);
+   for (;;) {
+      int e = c->slots[i];
+      if (e == 0) return i;
+      if (c->entries[e-1].hash == hash && c->entries[e-1].name_len == len &&
+          memcmp(c->names + c->entries[e-1].name, name, len) == 0)
+         return i;
+      i = (i + 1) & mask;
+   }
+}
+
+// makes room for one more entry and its path
+static int stbi__info_cache_reserve(stbi_info_cache *c, stbi__uint32 name_len)
+{
+   if (c->count == c->capacity) {
+      int capacity = c->capacity ? c->capacity * 2 : 64;
+      stbi__info_entry *entries;
+      if (capacity > (INT_MAX >> 2) / (int) sizeof(*entries)) return stbi__err("outofmem", "Out of memory");
+      entries = (stbi__info_entry *) STBI_REALLOC_SIZED(c->entries, c->capacity * sizeof(*entries), capacity * sizeof(*entries));
+      if (!entries) return stbi__err("outofmem", "Out of memory");
+      c->entries = entries;
+      c->capacity = capacity;
+   }
+   if ((c->count + 1) * 2 > c->slot_count) {
+      int slot_count = c->slot_count ? c->slot_count * 2 : 128, i;
+      int *slots;
+      // freed with STBI_FREE and kept across calls, so not from the arena stbi__malloc may be using
+      if (slot_count > (INT_MAX >> 2) / (int) sizeof(int)) return stbi__err("outofmem", "Out of memory");
+      slots = (int *) STBI_MALLOC(slot_count * sizeof(int));
+      if (!slots) return stbi__err("outofmem", "Out of memory");
+      memset(slots, 0, slot_count * sizeof(int));
+      STBI_FREE(c->slots);
+      c->slots = slots;
+      c->slot_count = slot_count;
+      for (i=0; i < c->count; ++i) {
+         stbi__info_entry *e = &c->entries[i];
+         c->slots[stbi__info_cache_slot(c, c->names + e->name, e->name_len, e->hash)] = i+1;
+      }
+   }
+   if (c->names_capacity - c->names_len < (size_t) name_len + 1) {
+      size_t capacity = c->names_capacity ? c->names_capacity : 4096;
+      char *names;
+      while (capacity - c->names_len < (size_t) name_len + 1) capacity *= 2;
+      names = (char *) STBI_REALLOC_SIZED(c->names, c->names_capacity, capacity);
+      if (!names) return stbi__err("outofmem", "Out of memory");
+      c->names = names;
+      c->names_capacity = capacity;
+   }
+   return 1;
+}
+
+// the entry for name, added with the given stamp if there is none. NULL when out of memory
+static stbi__info_entry *stbi__info_cache_entry(stbi_info_cache *c, char const *name, stbi__uint32 len, stbi__uint32 const stamp[4])
+{
+   stbi__uint32 hash = stbi__info_cache_hash(name, len);
+   stbi__info_entry *e;
+   int slot;
+   if (c->slot_count) {
+      slot = stbi__info_cache_slot(c, name, len, hash);
+      if (c->slots[slot]) return &c->entries[c->slots[slot]-1];
+   }
+   if (!stbi__info_cache_reserve(c, len)) return NULL;
+   slot = stbi__info_cache_slot(c, name, len, hash);
+   e = &c->entries[c->count];
+   e->name = c->names_len;
+   e->name_len = len;
+   e->hash = hash;
+   memcpy(e->stamp, stamp, sizeof(e->stamp));
+   e->x = e->y = e->comp = 0;
+   e->flags = 0;
+   memcpy(c->names + c->names_len, name, len);
+   c->names[c->names_len + len] = 0;
+   c->names_len += len + 1;
+   c->slots[slot] = ++c->count;
+   return e;
+}
+
+static stbi__uint32 stbi__info_get32le(stbi_uc const *p)
+{
+   return p[0] | (p[1] << 8) | (p[2] << 16) | ((stbi__uint32) p[3] << 24);
+}
+
+static void stbi__info_put32le(stbi_uc *p, stbi__uint32 v)
+{
+   p[0] = (stbi_uc) v;
+   p[1] = (stbi_uc) (v >> 8);
+   p[2] = (stbi_uc) (v >> 16);
+   p[3] = (stbi_uc) (v >> 24);
+}
+
+// reads the index file, if there is one. on anything unexpected the cache stays empty
+static void stbi__info_cache_load(stbi_info_cache *c)
+{
+   FILE *f = stbi__fopen(c->index_filename, "rb");
+   stbi_uc *data = NULL, *p, *end;
+   long len;
+   stbi__uint32 n, i;
+   if (!f) return;
+   if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 16 && len <= INT_MAX && fseek(f, 0, SEEK_SET) == 0) {
+      data = (stbi_uc *) stbi__malloc((size_t) len);
+      if (data && fread(data, 1, (size_t) len, f) != (size_t) len) {
+         STBI_FREE(data);
+         data = NULL;
+      }
+   }
+   fclose(f);
+   if (!data) return;
+
+   end = data + len;
+   n = stbi__info_get32le(data + 12);
+   if (memcmp(data, "stbiinfo", 8) != 0 || stbi__info_get32le(data + 8) != STBI__INFO_CACHE_VERSION)
+      n = 0;
+   for (i=0, p = data + 16; i < n; ++i) {
+      stbi__info_entry *e;
+      stbi__uint32 stamp[4], name_len;
+      if (end - p < STBI__INFO_CACHE_RECORD) break;
+      name_len = stbi__info_get32le(p);
+      if (name_len == 0 || name_len > (stbi__uint32) (end - p - STBI__INFO_CACHE_RECORD)) break;
+      stamp[0] = stbi__info_get32le(p + 4);
+      stamp[1] = stbi__info_get32le(p + 8);
+      stamp[2] = stbi__info_get32le(p + 12);
+      stamp[3] = stbi__info_get32le(p + 16);
+      e = stbi__info_cache_entry(c, (char const *) p + STBI__INFO_CACHE_RECORD, name_len, stamp);
+      if (!e) break;
+      e->x     = (int) stbi__info_get32le(p + 20);
+      e->y     = (int) stbi__info_get32le(p + 24);
+      e->comp  = (int) stbi__info_get32le(p + 28);
+      e->flags = stbi__info_get32le(p + 32);
+      p += STBI__INFO_CACHE_RECORD + name_len;
+   }
+   if (i != n || p != end) {
+      c->count = 0;
+      c->names_len = 0;
+      if (c->slots) memset(c->slots, 0, c->slot_count * sizeof(int));
+   }
+   STBI_FREE(data);
+}
+
+STBIDEF stbi_info_cache *stbi_info_cache_open(char const *index_filename)
+{
+   size_t len = strlen(index_filename);
+   stbi_info_cache *c = (stbi_info_cache *) stbi__malloc(sizeof(*c));
+   if (!c) return (stbi_info_cache *) stbi__errpuc("outofmem", "Out of memory");
+   memset(c, 0, sizeof(*c));
+   c->index_filename = (char *) stbi__malloc(len + 1);
+   if (!c->index_filename) {
+      STBI_FREE(c);
+      return (stbi_info_cache *) stbi__errpuc("outofmem", "Out of memory");
+   }
+   memcpy(c->index_filename, index_filename, len + 1);
+   stbi__info_cache_load(c);
+   return c;
+}
+
+STBIDEF int stbi_info_cache_probe(stbi_info_cache *c, char const *filename, stbi_image_info *info)
+{
+   stbi__uint32 stamp[4];
+   stbi__info_entry *e;
+   size_t len = strlen(filename);
+   int r;
+   if (len == 0 || len > 0xffffff || !stbi__file_stamp(filename, stamp))
+      return stbi__err("can't fopen", "Unable to open file");
+   e = stbi__info_cache_entry(c, filename, (stbi__uint32) len, stamp);
+   if (e && (e->flags & STBI__INFO_probed) && memcmp(e->stamp, stamp, sizeof(stamp)) == 0) {
+      if (!(e->flags & STBI__INFO_ok))
+         return stbi__err("bad header", "Corrupt header, or unknown format, when last probed");
+      info->x = e->x;
+      info->y = e->y;
+      info->channels_in_file = e->comp;
+      info->is_16_bit = (e->flags & STBI__INFO_16_bit) != 0;
+      info->is_hdr = (e->flags & STBI__INFO_hdr) != 0;
+      return 1;
+   }
+
+   r = stbi_probe(filename, info);
+   if (e) {
+      memcpy(e->stamp, stamp, sizeof(stamp));
+      e->x = r ? info->x : 0;
+      e->y = r ? info->y : 0;
+      e->comp = r ? info->channels_in_file : 0;
+      e->flags = STBI__INFO_probed;
+      if (r) {
+         e->flags |= STBI__INFO_ok;
+         if (info->is_16_bit) e->flags |= STBI__INFO_16_bit;
+         if (info->is_hdr)    e->flags |= STBI__INFO_hdr;
+      }
+      c->dirty = 1;
+   }
+   return r;
+}
+
+STBIDEF int stbi_info_cache_save(stbi_info_cache *c)
+{
+   size_t len = strlen(c->index_filename);
+   stbi_uc record[STBI__INFO_CACHE_RECORD];
+   stbi__uint32 n = 0;
+   char *temp;
+   FILE *f;
+   int i, ok;
+   if (!c->dirty) return 1;
+   temp = (char *) stbi__malloc(len + 5);
+   if (!temp) return stbi__err("outofmem", "Out of memory");
+   memcpy(temp, c->index_filename, len);
+   memcpy(temp + len, ".tmp", 5);
+
+   f = stbi__fopen(temp, "wb");
+   if (!f) {
+      STBI_FREE(temp);
+      return stbi__err("can't fopen", "Unable to open file");
+   }
+   for (i=0; i < c->count; ++i)
+      if (c->entries[i].flags & STBI__INFO_probed) ++n;
+   memcpy(record, "stbiinfo", 8);
+   stbi__info_put32le(record + 8, STBI__INFO_CACHE_VERSION);
+   stbi__info_put32le(record + 12, n);
+   ok = fwrite(record, 1, 16, f) == 16;
+   for (i=0; ok && i < c->count; ++i) {
+      stbi__info_entry *e = &c->entries[i];
+      if (!(e->flags & STBI__INFO_probed)) continue;
+      stbi__info_put32le(record, e->name_len);
+      stbi__info_put32le(record + 4, e->stamp[0]);
+      stbi__info_put32le(record + 8, e->stamp[1]);
+      stbi__info_put32le(record + 12, e->stamp[2]);
+      stbi__info_put32le(record + 16, e->stamp[3]);
+      stbi__info_put32le(record + 20, (stbi__uint32) e->x);
+      stbi__info_put32le(record + 24, (stbi__uint32) e->y);
+      stbi__info_put32le(record + 28, (stbi__uint32) e->comp);
+      stbi__info_put32le(record + 32, e->flags);
+      ok = fwrite(record, 1, sizeof(record), f) == sizeof(record) &&
+           fwrite(c->names + e->name, 1, e->name_len, f) == e->name_len;
+   }
+   if (fclose(f) != 0) ok = 0;
+   if (ok) {
+#ifdef _WIN32
+#ifdef STBI_WINDOWS_UTF8
+      wchar_t wFrom[1024], wTo[1024];
+      ok = 0 != MultiByteToWideChar(65001 /* UTF8 */, 0, temp, -1, wFrom, sizeof(wFrom)/sizeof(*wFrom)) &&
+           0 != MultiByteToWideChar(65001 /* UTF8 */, 0, c->index_filename, -1, wTo, sizeof(wTo)/sizeof(*wTo)) &&
+           MoveFileExW(wFrom, wTo, 1 /* MOVEFILE_REPLACE_EXISTING */);
+#else
+      ok = MoveFileExA(temp, c->index_filename, 1 /* MOVEFILE_REPLACE_EXISTING */);
+#endif
+#else
+      ok = rename(temp, c->index_filename) == 0;
+#endif
+   }
+   if (!ok) remove(temp);
+   STBI_FREE(temp);
+   if (!ok) return stbi__err("can't write", "Unable to write the index");
+   c->dirty = 0;
+   return 1;
+}
+
+STBIDEF void stbi_info_cache_close(stbi_info_cache *c)
+{
+   if (!c) return;
+   stbi_info_cache_save(c);
+   STBI_FREE(c->entries);
+   STBI_FREE(c->slots);
+   STBI_FREE(c->names);
+   STBI_FREE(c->index_filename);
+   STBI_FREE(c);
+}
+#endif // !STBI_NO_STDIO
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  incremental decoding
+//
+// the input accumulates in one buffer, and the decoders run on memory contexts over what has
+// arrived so far. a context can't wait for more bytes in the middle of a read, so PNG inflates
+// with stbi__zinflate, which stops short of the end of a partial input and goes on later, and
+// JPEG decodes a row of MCUs at a time and starts the row over from a checkpoint when it ran
+// into the end of the input
+
+enum
+{
+   STBI__STREAM_sniff,        // too few bytes yet to tell the format
+   STBI__STREAM_buffer,       // anything else, kept whole and decoded by stbi_stream_end
+   STBI__STREAM_png_header,   // walking the chunks up to the first IDAT
+   STBI__STREAM_png_data,     // inflating the IDAT payloads as they arrive
+   STBI__STREAM_jpeg_header,  // walking the marker segments up to the first SOS
+   STBI__STREAM_jpeg_data,    // decoding rows of MCUs as they arrive
+   STBI__STREAM_done          // every row reported, the rest of the input is ignored
+};
+
+struct stbi__stream
+{
+   int state;
+   int failed;
+   const char *failure_reason; // why it failed, for stbi_stream_end to report
+   stbi_stream_rows *callback;
+   void *user;
+   int desired, n;             // channels asked for, and in the image
+   int x, y, comp;             // 0 until known
+   stbi_uc *image;
+   int rows;                   // reported so far
+
+   stbi_uc *in;                // input not consumed yet, from in+pos
+   int in_len, in_cap, pos;
+   stbi__context ctx;
+
+#ifndef STBI_NO_PNG
+   stbi__png_header png_header;
+   stbi__png_rows png_rows;
+   stbi__into into;
+   stbi__zbuf zbuf;
+   stbi_uc *zin;               // the IDAT payloads so far, zbuf reads from it
+   int zin_len, zin_cap;
+   stbi__uint32 chunk_left;    // bytes of IDAT payload to go
+   stbi__uint32 skip_left;     // bytes of CRCs and other chunks to skip
+#endif
+
+#ifndef STBI_NO_JPEG
+   stbi__jpeg *jpeg;
+   stbi__jpeg_convert convert;
+   int mcu_row, mcu_rows, mcu_w;
+   int retry_len;              // don't try the row again with less input than this
+#endif
+};
+
+// appends n bytes to a buffer that grows by doubling
+static int stbi__stream_append(stbi_uc **buf, int *len, int *cap, stbi_uc const *data, int n)
+{
+   if (n > *cap - *len) {
+      int c = *cap ? *cap : 4096;
+      stbi_uc *p;
+      if (n > (1 << 30) - *len) return stbi__err("too large", "Image file too large");
+      while (c - *len < n) c *= 2;
+      p = (stbi_uc *) stbi__realloc_sized(*buf, *cap, c);
+      if (p == NULL) return stbi__err("outofmem", "Out of memory");
+      *buf = p;
+      *cap = c;
+   }
+   if (n) memcpy(*buf + *len, data, n);
+   *len += n;
+   return 1;
+}
+
+static int stbi__stream_alloc_image(stbi_stream *st)
+{
+   st->n = st->desired ? st->desired : st->comp;
+   st->image = (stbi_uc *) stbi__malloc_mad3(st->x, st->y, st->n, 1); // the jpeg conversions write a byte past the last row
+   if (st->image == NULL) return stbi__err("outofmem", "Out of memory");
+   return 1;
+}
+
+static void stbi__stream_report(stbi_stream *st, int rows)
+{
+   if (rows > st->rows) {
+      if (st->callback)
+         st->callback(st->user, st->image + (size_t) st->rows * st->x * st->n, st->rows, rows);
+      st->rows = rows;
+   }
+   if (st->rows == st->y) st->state = STBI__STREAM_done;
+}
+
+// decodes the whole input in one go, for files that aren't streamed
+static int stbi__stream_decode_all(stbi_stream *st)
+{
+   size_t size;
+   stbi__start_mem(&st->ctx, st->in, st->in_len);
+   if (!stbi__info_main(&st->ctx, &st->x, &st->y, &st->comp)) return 0;
+   if (!stbi__stream_alloc_image(st)) return 0;
+   size = (size_t) st->x * st->y * st->n;
+   if (size > INT_MAX) return stbi__err("too large", "Image too large to decode");
+   if (!stbi__load_into(st->in, st->in_len, st->image, (int) size, 0, 0, &st->x, &st->y, &st->comp, st->n)) return 0;
+   stbi__stream_report(st, st->y);
+   return 1;
+}
+
+#ifndef STBI_NO_PNG
+// the rest of the chunks are only read once the header up to the first IDAT is all there.
+// returns 0 on error, 1 when it went on to another state, 2 when it needs more input
+static int stbi__stream_png_header(stbi_stream *st)
+{
+   stbi__png png;
+   stbi__png_header *h = &st->png_header;
+   stbi__png_rows *r = &st->png_rows;
+   stbi__uint32 len, type;
+
+   for (;;) {
+      stbi_uc *c = st->in + st->pos;
+      if (st->in_len - st->pos < 8) return 2;
+      len  = (c[0] << 24) + (c[1] << 16) + (c[2] << 8) + c[3];
+      type = (c[4] << 24) + (c[5] << 16) + (c[6] << 8) + c[7];
+      if (type == STBI__PNG_TYPE('I','D','A','T')) break;
+      if (type == STBI__PNG_TYPE('I','E','N','D')) return stbi__err("no IDAT","Corrupt PNG");
+      if (len > (1u << 30)) return stbi__err("bad chunk len","Corrupt PNG");
+      if ((stbi__uint32) (st->in_len - st->pos) < len + 12) return 2;
+      st->pos += len + 12;
+   }
+
+   stbi__start_mem(&st->ctx, st->in, st->pos + 8);
+   png.s = &st->ctx;
+   png.header = h;
+   if (!stbi__parse_png_file(&png, STBI__SCAN_stream, 0)) return 0;
+   st->x = st->ctx.img_x;
+   st->y = st->ctx.img_y;
+   st->comp = h->pal_img_n ? h->pal_img_n : st->ctx.img_n + h->has_trans;
+
+   // the Adam7 passes and the iphone channel swap want the whole image
+   if (h->interlace || h->is_iphone) {
+      st->state = STBI__STREAM_buffer;
+      return 1;
+   }
+
+   if (!stbi__stream_alloc_image(st)) return 0;
+   st->into.data = st->image;
+   st->into.stride = (ptrdiff_t) st->x * st->n;
+   st->into.w = st->x;
+   st->into.h = st->y;
+   st->into.channels = st->n;
+   st->into.written = 0;
+   st->into.simd = stbi__convert_simd();
+   if (!stbi__png_rows_begin(r, &st->ctx, st->ctx.img_n + h->has_trans, st->x, st->y, png.depth, h->color, &st->into)) return 0;
+   r->has_trans = h->has_trans;
+   memcpy(r->tc, h->tc, sizeof(r->tc));
+   memcpy(r->tc16, h->tc16, sizeof(r->tc16));
+   if (h->pal_img_n) {
+      r->pal_row = (stbi_uc *) stbi__malloc_mad2(st->x, 4, 0);
+      if (r->pal_row == NULL) return stbi__err("outofmem", "Out of memory");
+      r->palette = h->palette;
+      r->pal_img_n = h->pal_img_n;
+   }
+
+   st->zbuf.zout_start = (char *) stbi__malloc(r->img_len);
+   if (st->zbuf.zout_start == NULL) return stbi__err("outofmem", "Out of memory");
+   st->zbuf.zout = st->zbuf.zout_start;
+   st->zbuf.zout_end = st->zbuf.zout_start + r->img_len;
+   st->zbuf.z_expandable = 1;
+   st->zbuf.progress = stbi__png_rows_progress;
+   st->zbuf.progress_user = r;
+   st->zbuf.zbuffer = st->zbuf.zbuffer_end = st->zin;
+   stbi__zinit(&st->zbuf, 1);
+   st->zbuf.partial = 1;
+
+   st->pos += 8;
+   st->chunk_left = h->idat_len;
+   st->skip_left = 0;
+   st->state = STBI__STREAM_png_data;
+   return 1;
+}
+
+// moves the IDAT payloads that arrived over to the inflater, and inflates what it can
+static int stbi__stream_png_data(stbi_stream *st, int final)
+{
+   stbi__zbuf *a = &st->zbuf;
+   stbi__png_rows *r = &st->png_rows;
+   int ended = 0, z;
+
+   for (;;) {
+      int avail = st->in_len - st->pos;
+      if (st->chunk_left) {
+         int n = (stbi__uint32) avail < st->chunk_left ? avail : (int) st->chunk_left;
+         int used = (int) (a->zbuffer - st->zin), drop = used - 8;
+         if (n == 0) break;
+         // drop the input the inflater is done with, once that is most of it. the bytes just
+         // before zbuffer stay: stbi__zfast_huffman_block gives back the ones left in its bit buffer
+         if (drop > 0 && drop >= st->zin_len - drop) {
+            memmove(st->zin, st->zin + drop, st->zin_len - drop);
+            st->zin_len -= drop;
+            used -= drop;
+         }
+         if (!stbi__stream_append(&st->zin, &st->zin_len, &st->zin_cap, st->in + st->pos, n)) return 0;
+         a->zbuffer = st->zin + used;
+         a->zbuffer_end = st->zin + st->zin_len;
+         st->pos += n;
+         st->chunk_left -= n;
+         if (!st->chunk_left) st->skip_left = 4; // its CRC
+      } else if (st->skip_left) {
+         int n = (stbi__uint32) avail < st->skip_left ? avail : (int) st->skip_left;
+         if (n == 0) break;
+         st->pos += n;
+         st->skip_left -= n;
+      } else {
+         stbi_uc *c = st->in + st->pos;
+         stbi__uint32 len, type;
+         if (avail < 8) break;
+         len  = (c[0] << 24) + (c[1] << 16) + (c[2] << 8) + c[3];
+         type = (c[4] << 24) + (c[5] << 16) + (c[6] << 8) + c[7];
+         if (len > (1u << 30)) return stbi__err("bad chunk len","Corrupt PNG");
+         st->pos += 8;
+         if (type == STBI__PNG_TYPE('I','D','A','T')) {
+            st->chunk_left = len;
+            if (!len) st->skip_left = 4;
+         } else if (type == STBI__PNG_TYPE('I','E','N','D')) {
+            ended = 1;
+            break;
+         } else {
+            if ((type & (1 << 29)) == 0) return stbi__err("unknown chunk after IDAT", "PNG not supported: unknown PNG chunk type");
+            st->skip_left = len + 4;
+         }
+      }
+   }
+
+   if (ended || final) {
+      if (!ended) return stbi__err("outofdata","Corrupt PNG");
+      a->partial = 0;
+   }
+   z = stbi__zinflate(a);
+   if (!z) return 0;
+   if (a->partial) {
+      stbi__stream_report(st, r->row);
+      return 1;
+   }
+   if (!stbi__png_rows_end(r, (stbi_uc *) a->zout_start, (stbi__uint32) (a->zout - a->zout_start))) return 0;
+   stbi__stream_report(st, r->row);
+   return 1;
+}
+#endif // STBI_NO_PNG
+
+#ifndef STBI_NO_JPEG
+// the frame and scan headers are only read once everything up to the end of the first SOS
+// segment is there. returns 0 on error, 1 when it went on to another state, 2 when it needs
+// more input
+static int stbi__stream_jpeg_header(stbi_stream *st)
+{
+   stbi__jpeg *j;
+   int m, k;
+
+   for (;;) {
+      stbi_uc *c = st->in + st->pos;
+      int avail = st->in_len - st->pos, len;
+      if (avail < 2) return 2;
+      if (c[0] != 0xff || c[1] == 0xff) { ++st->pos; continue; } // padding, fill bytes
+      m = c[1];
+      if (m == 0xd9) return stbi__err("no SOS", "Corrupt JPEG");
+      if (STBI__RESTART(m) || m == 0x01 || m == 0xd8) { st->pos += 2; continue; } // no length
+      if (avail < 4) return 2;
+      len = (c[2] << 8) + c[3];
+      if (avail < 2 + len) return 2;
+      st->pos += 2 + len;
+      if (m == 0xda) break;
+   }
+
+   j = st->jpeg = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (j == NULL) return stbi__err("outofmem", "Out of memory");
+   memset(j, 0, sizeof(stbi__jpeg));
+   stbi__start_mem(&st->ctx, st->in, st->pos);
+   j->s = &st->ctx;
+   stbi__setup_jpeg(j);
+   for (k=0; k < 4; ++k) {
+      j->img_comp[k].raw_data = NULL;
+      j->img_comp[k].raw_coeff = NULL;
+   }
+   j->restart_interval = 0;
+   if (!stbi__decode_jpeg_header(j, STBI__SCAN_load)) return 0;
+   st->x = st->ctx.img_x;
+   st->y = st->ctx.img_y;
+   st->comp = st->ctx.img_n >= 3 ? 3 : 1;
+   m = stbi__get_marker(j);
+   while (!stbi__SOS(m)) {
+      if (!stbi__process_marker(j, m)) return 0;
+      m = stbi__get_marker(j);
+   }
+   if (!stbi__process_scan_header(j)) return 0;
+
+   // progressive scans refine the whole image, and a scan per component leaves the others
+   // to come later: there are no finished rows until the end
+   if (j->progressive || j->scan_n != st->ctx.img_n) {
+      stbi__cleanup_jpeg(j);
+      stbi__free(j);
+      st->jpeg = NULL;
+      st->state = STBI__STREAM_buffer;
+      return 1;
+   }
+
+   if (!stbi__stream_alloc_image(st)) return 0;
+   if (!stbi__jpeg_convert_begin(&st->convert, j, st->n, 1)) return 0;
+   st->convert.output = st->image;
+   if (j->scan_n == 1) {
+      st->mcu_w = (j->img_comp[j->order[0]].x+7) >> 3;
+      st->mcu_rows = (j->img_comp[j->order[0]].y+7) >> 3;
+   } else {
+      st->mcu_w = j->img_mcu_x;
+      st->mcu_rows = j->img_mcu_y;
+   }
+   st->mcu_row = 0;
+   st->retry_len = 0;
+   stbi__jpeg_reset(j);
+   st->state = STBI__STREAM_jpeg_data;
+   return 1;
+}
+
+// decodes the rows of MCUs that arrived, and converts the rows of the image they finish
+static int stbi__stream_jpeg_data(stbi_stream *st, int final)
+{
+   stbi__jpeg *j = st->jpeg;
+   int total = st->mcu_w * st->mcu_rows;
+
+   while (st->mcu_row < st->mcu_rows) {
+      int avail = st->in_len - st->pos;
+      int first = st->mcu_row * st->mcu_w, end = first + st->mcu_w, r, k, rows;
+      stbi__uint32 code_buffer = j->code_buffer;
+      int code_bits = j->code_bits, nomore = j->nomore, eob_run = j->eob_run, todo = j->todo;
+      int dc_pred[4];
+      stbi_uc marker = j->marker;
+
+      if (!final && avail < st->retry_len) return 1;
+      for (k=0; k < 4; ++k) dc_pred[k] = j->img_comp[k].dc_pred;
+      if (end > total) end = total;
+      stbi__start_mem(&st->ctx, st->in + st->pos, avail);
+      r = stbi__parse_mcu_range(j, first, end);
+      if (!final && st->ctx.img_buffer == st->ctx.img_buffer_end) {
+         // it may have read past the input as if it ended here. start the row over once there is
+         // half as much again, which keeps the retries linear in the input
+         j->code_buffer = code_buffer;
+         j->code_bits = code_bits;
+         j->nomore = nomore;
+         j->eob_run = eob_run;
+         j->todo = todo;
+         j->marker = marker;
+         for (k=0; k < 4; ++k) j->img_comp[k].dc_pred = dc_pred[k];
+         st->retry_len = avail + (avail >> 1) + 1;
+         return 1;
+      }
+      if (!r) return 0;
+      st->pos += (int) (st->ctx.img_buffer - (st->in + st->pos));
+      st->retry_len = 0;
+      // a missing restart marker ends the scan, leaving the rest of the image as it is, like
+      // stbi__parse_entropy_coded_data does
+      st->mcu_row = r == 2 ? st->mcu_rows : st->mcu_row + 1;
+
+      // an image row is done once the plane rows it is resampled from are
+      rows = st->y;
+      for (k=0; k < st->convert.decode_n; ++k) {
+         int vs = st->convert.res_comp[k].vs;
+         int done = st->mcu_row * (j->scan_n == 1 ? 8 : j->img_comp[k].v * 8);
+         if (done < j->img_comp[k].y && vs * done - (vs >> 1) < rows)
+            rows = vs * done - (vs >> 1);
+      }
+      if (rows > st->rows) {
+         stbi__jpeg_convert_rows(&st->convert, 0, st->rows, rows);
+         stbi__stream_report(st, rows);
+      }
+   }
+   return 1;
+}
+#endif // STBI_NO_JPEG
+
+// goes as far as the input allows. at the end of the input, final decodes the rest
+static int stbi__stream_run(stbi_stream *st, int final)
+{
+   for (;;) {
+      int r = 1;
+      switch (st->state) {
+         case STBI__STREAM_sniff: {
+            static const stbi_uc png_sig[8] = { 137,80,78,71,13,10,26,10 };
+            if (st->in_len >= 2 && st->in[0] == 0xff && st->in[1] == 0xd8) {
+               st->state = STBI__STREAM_jpeg_header;
+               st->pos = 2;
+            } else if (st->in_len >= 8 && memcmp(st->in, png_sig, 8) == 0) {
+               st->state = STBI__STREAM_png_header;
+               st->pos = 8;
+            } else if (st->in_len >= 8 || final) {
+               st->state = STBI__STREAM_buffer;
+            } else {
+               return 1;
+            }
+            #ifdef STBI_NO_JPEG
+            if (st->state == STBI__STREAM_jpeg_header) st->state = STBI__STREAM_buffer;
+            #endif
+            #ifdef STBI_NO_PNG
+            if (st->state == STBI__STREAM_png_header) st->state = STBI__STREAM_buffer;
+            #endif
+            break;
+         }
+
+         case STBI__STREAM_buffer:
+            return final ? stbi__stream_decode_all(st) : 1;
+
+#ifndef STBI_NO_PNG
+         case STBI__STREAM_png_header:
+            r = stbi__stream_png_header(st);
+            break;
+         case STBI__STREAM_png_data:
+            return stbi__stream_png_data(st, final);
+#endif
+
+#ifndef STBI_NO_JPEG
+         case STBI__STREAM_jpeg_header:
+            r = stbi__stream_jpeg_header(st);
+            break;
+         case STBI__STREAM_jpeg_data:
+            return stbi__stream_jpeg_data(st, final);
+#endif
+
+         default:
+            return 1;
+      }
+      if (r == 0) return 0;
+      if (r == 2) {
+         // the file ends inside its headers, the full decoder says what is wrong with it
+         if (!final) return 1;
+         st->state = STBI__STREAM_buffer;
+      }
+   }
+}
+
+static int stbi__stream_fail(stbi_stream *st)
+{
+   st->failed = 1;
+   st->failure_reason = stbi__g_failure_reason;
+   return 0;
+}
+
+STBIDEF stbi_stream *stbi_stream_begin(int desired_channels, stbi_stream_rows *callback, void *user)
+{
+   stbi_stream *st;
+   if (desired_channels < 0 || desired_channels > 4) return (stbi_stream *) stbi__errpuc("bad req_comp", "Internal error");
+   st = (stbi_stream *) STBI_MALLOC(sizeof(stbi_stream));
+   if (st == NULL) return (stbi_stream *) stbi__errpuc("outofmem", "Out of memory");
+   memset(st, 0, sizeof(stbi_stream));
+   st->state = STBI__STREAM_sniff;
+   st->desired = desired_channels;
+   st->callback = callback;
+   st->user = user;
+   return st;
+}
+
+STBIDEF int stbi_stream_feed(stbi_stream *st, stbi_uc const *data, int len)
+{
+   int ok;
+   if (st->failed) return 0;
+   if (st->state == STBI__STREAM_done) return 1;
+
+   // once the headers are read, the input before pos is done with
+   if ((st->state == STBI__STREAM_png_data || st->state == STBI__STREAM_jpeg_data) &&
+       st->pos && st->pos >= st->in_len - st->pos) {
+      memmove(st->in, st->in + st->pos, st->in_len - st->pos);
+      st->in_len -= st->pos;
+      st->pos = 0;
+   }
+   if (len < 0)
+      ok = stbi__err("bad len", "Negative length");
+   else
+      ok = stbi__stream_append(&st->in, &st->in_len, &st->in_cap, data, len) && stbi__stream_run(st, 0);
+   return ok ? 1 : stbi__stream_fail(st);
+}
+
+STBIDEF int stbi_stream_info(stbi_stream *st, int *x, int *y, int *channels_in_file)
+{
+   if (!st->x) return 0;
+   if (x) *x = st->x;
+   if (y) *y = st->y;
+   if (channels_in_file) *channels_in_file = st->comp;
+   return 1;
+}
+
+STBIDEF stbi_uc *stbi_stream_end(stbi_stream *st, int *x, int *y, int *channels_in_file)
+{
+   stbi_uc *result = NULL;
+   if (!st->failed && !stbi__stream_run(st, 1))
+      stbi__stream_fail(st);
+   if (st->failed) {
+      stbi__g_failure_reason = st->failure_reason;
+      stbi__free(st->image);
+   } else {
+      result = st->image;
+      if (x) *x = st->x;
+      if (y) *y = st->y;
+      if (channels_in_file) *channels_in_file = st->comp;
+   }
+#ifndef STBI_NO_PNG
+   stbi__free(st->png_rows.out);
+   stbi__free(st->png_rows.filter_buf);
+   stbi__free(st->png_rows.pal_row);
+   stbi__free(st->zbuf.zout_start);
+   stbi__free(st->zin);
+#endif
+#ifndef STBI_NO_JPEG
+   if (st->jpeg) {
+      stbi__cleanup_jpeg(st->jpeg);
+      stbi__free(st->jpeg);
+   }
+#endif
+   stbi__free(st->in);
+   STBI_FREE(st);
+   return result;
+}
+
 #endif // STB_IMAGE_IMPLEMENTATION
 
 /*
@@ -0,0 +1,130 @@
+// TextureAtlas::build on sets of 10k random images: reports the pages used, the occupancy and the time of a
+// build on one thread and split across a pool, and checks the packing: every region has the size of its
+// image and lies inside its page with its border, and no two regions of a page overlap, borders included
+// no context needed, build() does not touch GL
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I../../../OpenGL/include -I.. atlas_pack_bench.cpp ../texture_atlas.cpp ../thread_pool.cpp
+//		../../../OpenGL/src/glad.c -pthread -o atlas_pack_bench && ./atlas_pack_bench
+// exits with 1 when a set does not build or a region is out of its page or overlaps another
+
+#include "texture_atlas.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace {
+	struct Set {
+		const char* name;
+		int count;
+		int minSize;
+		int maxSize;
+		int pageSize;
+	};
+
+	int failures = 0;
+
+	// covers the region of every image of one page, with its border, in a map of the page: a pixel covered
+	// twice is an overlap
+	void checkPage(const TextureAtlas& atlas, const Set& set, int layer, const std::vector<int>& widths,
+		const std::vector<int>& heights, int padding) {
+		int size = atlas.pageWidth(), height = atlas.pageHeight();
+		std::vector<unsigned char> covered((size_t)size * height, 0);
+		for (int i = 0; i < atlas.images(); i++) {
+			const TextureAtlas::Region& region = atlas.region(i);
+			if (region.layer != layer)
+				continue;
+			if (region.width != widths[i] || region.height != heights[i]) {
+				std::printf("FAIL %s: image %d is %dx%d in the atlas, %dx%d added\n", set.name, i, region.width,
+					region.height, widths[i], heights[i]);
+				failures++;
+				return;
+			}
+			int left = region.x - padding, top = region.y - padding;
+			int right = region.x + region.width + padding, bottom = region.y + region.height + padding;
+			if (left < 0 || top < 0 || right > size || bottom > height) {
+				std::printf("FAIL %s: image %d at (%d, %d) %dx%d is out of page %d\n", set.name, i, region.x, region.y,
+					region.width, region.height, layer);
+				failures++;
+				return;
+			}
+			for (int y = top; y < bottom; y++) {
+				unsigned char* row = &covered[(size_t)y * size];
+				if (std::any_of(row + left, row + right, [](unsigned char pixel) { return pixel != 0; })) {
+					std::printf("FAIL %s: image %d at (%d, %d) on page %d overlaps another\n", set.name, i, region.x,
+						region.y, layer);
+					failures++;
+					return;
+				}
+				std::fill(row + left, row + right, (unsigned char)1);
+			}
+		}
+	}
+
+	void run(const Set& set, ThreadPool& pool) {
+		const int padding = 1;
+		TextureAtlas single(set.pageSize, padding), pooled(set.pageSize, padding);
+		std::vector<int> widths, heights;
+		std::vector<unsigned char> pixels((size_t)set.maxSize * set.maxSize * 4);
+		std::uint32_t state = 1;
+		for (unsigned char& pixel : pixels) {
+			state = state * 1664525u + 1013904223u;
+			pixel = (unsigned char)(state >> 24);
+		}
+		for (int i = 0; i < set.count; i++) {
+			state = state * 1664525u + 1013904223u;
+			int width = set.minSize + (int)(state >> 8) % (set.maxSize - set.minSize + 1);
+			state = state * 1664525u + 1013904223u;
+			int height = set.minSize + (int)(state >> 8) % (set.maxSize - set.minSize + 1);
+			int channels = 1 + (int)(state >> 4) % 4;
+			single.add(pixels.data(), width, height, channels);
+			pooled.add(pixels.data(), width, height, channels);
+			widths.push_back(width);
+			heights.push_back(height);
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool built = single.build();
+		double singleMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		start = std::chrono::steady_clock::now();
+		built = pooled.build(&pool) && built;
+		double pooledMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (!built) {
+			std::printf("FAIL %s: does not build\n", set.name);
+			failures++;
+			return;
+		}
+
+		std::printf("  %-20s %3d x %4dx%-4d %8.1f %% %9.1f %9.1f\n", set.name, single.pages(), single.pageWidth(),
+			single.pageHeight(), single.occupancy() * 100.0, singleMs, pooledMs);
+		for (int layer = 0; layer < single.pages(); layer++)
+			checkPage(single, set, layer, widths, heights, padding);
+		// the pool only copies, the packing is the same
+		size_t bytes = (size_t)single.pageWidth() * single.pageHeight() * 4 * single.pages();
+		if (pooled.pages() != single.pages() || !std::equal(single.pixels(), single.pixels() + bytes, pooled.pixels())) {
+			std::printf("FAIL %s: the pooled build differs from the single thread one\n", set.name);
+			failures++;
+		}
+	}
+}
+
+int main() {
+	const Set sets[] = {
+		{ "10k, 8-64 px", 10000, 8, 64, 2048 },
+		{ "10k, 16-128 px", 10000, 16, 128, 2048 },
+		{ "10k, 32 px icons", 10000, 32, 32, 2048 },
+		{ "100, 8-64 px", 100, 8, 64, 2048 },
+	};
+	ThreadPool pool;
+
+	std::printf("padding 1, random images of 1 to 4 channels, pool of %u workers\n", pool.size());
+	std::printf("  %-20s %15s %10s %9s %9s\n", "", "pages", "occupancy", "ms", "pool ms");
+	for (const Set& set : sets)
+		run(set, pool);
+
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+// GLStateCache against a recording mock loader: glad is loaded from mock functions that log every call that
+// reaches the "driver", then the calls of the render loop of mainWindow.cpp are made twice through the cache
+// no context needed
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I../../../OpenGL/include -I.. gl_state_cache.cpp ../gl_state.cpp ../../../OpenGL/src/glad.c
+//		-o gl_state_cache && ./gl_state_cache
+// exits with 1 when a call reaches the driver that should not, or one that should does not
+
+#include "gl_state.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+	std::vector<std::string> driver;
+
+	void record(const char* call, long long a = 0, long long b = 0) {
+		driver.push_back(std::string(call) + " " + std::to_string(a) + " " + std::to_string(b));
+	}
+
+	const GLubyte* APIENTRY mockGetString(GLenum name) {
+		return (const GLubyte*)(name == GL_VERSION ? "3.3.0 mock" : "mock");
+	}
+	const GLubyte* APIENTRY mockGetStringi(GLenum, GLuint) { return (const GLubyte*)"GL_MOCK_extension"; }
+	void APIENTRY mockGetIntegerv(GLenum pname, GLint* value) { *value = pname == GL_NUM_EXTENSIONS ? 1 : 0; }
+
+	void APIENTRY mockUseProgram(GLuint program) { record("glUseProgram", program); }
+	void APIENTRY mockDeleteProgram(GLuint program) { record("glDeleteProgram", program); }
+	void APIENTRY mockBindVertexArray(GLuint array) { record("glBindVertexArray", array); }
+	void APIENTRY mockDeleteVertexArrays(GLsizei, const GLuint* arrays) { record("glDeleteVertexArrays", arrays[0]); }
+	void APIENTRY mockBindBuffer(GLenum target, GLuint buffer) { record("glBindBuffer", target, buffer); }
+	void APIENTRY mockBindBufferBase(GLenum target, GLuint, GLuint buffer) { record("glBindBufferBase", target, buffer); }
+	void APIENTRY mockBindBufferRange(GLenum target, GLuint, GLuint buffer, GLintptr, GLsizeiptr) { record("glBindBufferRange", target, buffer); }
+	void APIENTRY mockDeleteBuffers(GLsizei, const GLuint* buffers) { record("glDeleteBuffers", buffers[0]); }
+	void APIENTRY mockActiveTexture(GLenum texture) { record("glActiveTexture", texture - GL_TEXTURE0); }
+	void APIENTRY mockBindTexture(GLenum target, GLuint texture) { record("glBindTexture", target, texture); }
+	void APIENTRY mockDeleteTextures(GLsizei, const GLuint* textures) { record("glDeleteTextures", textures[0]); }
+	void APIENTRY mockClearColor(GLfloat red, GLfloat, GLfloat, GLfloat) { record("glClearColor", (long long)(red * 10)); }
+	void APIENTRY mockViewport(GLint, GLint, GLsizei width, GLsizei height) { record("glViewport", width, height); }
+	void APIENTRY mockEnable(GLenum cap) { record("glEnable", cap); }
+
+	struct MockFunction {
+		const char* name;
+		void* function;
+	};
+	const MockFunction functions[] = {
+		{ "glGetString", (void*)mockGetString },
+		{ "glGetStringi", (void*)mockGetStringi },
+		{ "glGetIntegerv", (void*)mockGetIntegerv },
+		{ "glUseProgram", (void*)mockUseProgram },
+		{ "glDeleteProgram", (void*)mockDeleteProgram },
+		{ "glBindVertexArray", (void*)mockBindVertexArray },
+		{ "glDeleteVertexArrays", (void*)mockDeleteVertexArrays },
+		{ "glBindBuffer", (void*)mockBindBuffer },
+		{ "glBindBufferBase", (void*)mockBindBufferBase },
+		{ "glBindBufferRange", (void*)mockBindBufferRange },
+		{ "glDeleteBuffers", (void*)mockDeleteBuffers },
+		{ "glActiveTexture", (void*)mockActiveTexture },
+		{ "glBindTexture", (void*)mockBindTexture },
+		{ "glDeleteTextures", (void*)mockDeleteTextures },
+		{ "glClearColor", (void*)mockClearColor },
+		{ "glViewport", (void*)mockViewport },
+		{ "glEnable", (void*)mockEnable },
+	};
+
+	// what glfwGetProcAddress is to gladLoadGLLoader, everything else stays null
+	void* mockLoader(const char* name) {
+		for (const MockFunction& function : functions) {
+			if (std::strcmp(function.name, name) == 0)
+				return function.function;
+		}
+		return nullptr;
+	}
+
+	int failures = 0;
+
+	// the driver calls since the last check, in order
+	void expectCalls(const char* what, const std::vector<std::string>& expected) {
+		if (driver != expected) {
+			std::printf("FAIL %s:\n  driver got:", what);
+			for (const std::string& call : driver)
+				std::printf(" [%s]", call.c_str());
+			std::printf("\n  expected:  ");
+			for (const std::string& call : expected)
+				std::printf(" [%s]", call.c_str());
+			std::printf("\n");
+			failures++;
+		}
+		driver.clear();
+	}
+
+	void expectCounters(const char* what, const GLStateCache& cache, unsigned long long issued, unsigned long long elided) {
+		if (cache.counters().issued != issued || cache.counters().elided != elided) {
+			std::printf("FAIL %s: %llu issued, %llu elided, expected %llu and %llu\n", what,
+				cache.counters().issued, cache.counters().elided, issued, elided);
+			failures++;
+		}
+	}
+
+	// the state calls of one frame of mainWindow.cpp's render loop
+	void frame() {
+		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, 1);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, 2);
+		glUseProgram(3);
+		glBindVertexArray(4);
+		glBindVertexArray(0);
+	}
+}
+
+int main() {
+	if (!gladLoadGLLoader((GLADloadproc)mockLoader)) {
+		std::printf("FAIL gladLoadGLLoader on the mock\n");
+		return 1;
+	}
+
+	GLStateCache cache;
+	if (!cache.install()) {
+		std::printf("FAIL install\n");
+		return 1;
+	}
+
+	// the first frame finds every shadow unknown
+	frame();
+	expectCalls("first frame", { "glClearColor 2 0", "glActiveTexture 0 0", "glBindTexture 3553 1",
+		"glActiveTexture 1 0", "glBindTexture 3553 2", "glUseProgram 3 0", "glBindVertexArray 4 0",
+		"glBindVertexArray 0 0" });
+	expectCounters("first frame", cache, 8, 0);
+
+	// the same frame again: clear colour, both textures and the program are dropped. the unit switches
+	// and the vertex array bind and unbind change state, they still reach the driver
+	cache.resetCounters();
+	frame();
+	expectCalls("second frame", { "glActiveTexture 0 0", "glActiveTexture 1 0", "glBindVertexArray 4 0",
+		"glBindVertexArray 0 0" });
+	expectCounters("second frame", cache, 4, 4);
+
+	// redundant binds of the same kind back to back
+	cache.resetCounters();
+	glUseProgram(5);
+	glUseProgram(5);
+	glBindBuffer(GL_ARRAY_BUFFER, 6);
+	glBindBuffer(GL_ARRAY_BUFFER, 6);
+	glBindBuffer(GL_UNIFORM_BUFFER, 6);
+	glViewport(0, 0, 800, 600);
+	glViewport(0, 0, 800, 600);
+	expectCalls("redundant binds", { "glUseProgram 5 0", "glBindBuffer 34962 6", "glBindBuffer 35345 6",
+		"glViewport 800 600" });
+	expectCounters("redundant binds", cache, 4, 3);
+
+	// glEnable is not shadowed: every call reaches the driver and none is counted
+	cache.resetCounters();
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_DEPTH_TEST);
+	expectCalls("glEnable", { "glEnable 2929 0", "glEnable 2929 0" });
+	expectCounters("glEnable", cache, 0, 0);
+
+	// the element array buffer is vertex array state, a vertex array change forgets it
+	cache.resetCounters();
+	glBindVertexArray(7);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 8);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 8);
+	glBindVertexArray(9);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 8);
+	expectCalls("element array buffer", { "glBindVertexArray 7 0", "glBindBuffer 34963 8", "glBindVertexArray 9 0",
+		"glBindBuffer 34963 8" });
+	expectCounters("element array buffer", cache, 4, 1);
+
+	// glBindBufferRange binds the generic target too, the bind after it is redundant
+	cache.resetCounters();
+	glBindBufferRange(GL_UNIFORM_BUFFER, 0, 10, 0, 256);
+	glBindBuffer(GL_UNIFORM_BUFFER, 10);
+	expectCalls("glBindBufferRange", { "glBindBufferRange 35345 10" });
+	expectCounters("glBindBufferRange", cache, 1, 1);
+
+	// deleting bound objects resets the shadows: texture 2 was bound on unit 1, program 5 in use
+	cache.resetCounters();
+	GLuint texture = 2, program = 5;
+	glDeleteTextures(1, &texture);
+	glDeleteProgram(program);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_2D, 2);
+	glUseProgram(5);
+	expectCalls("delete", { "glDeleteTextures 2 0", "glDeleteProgram 5 0", "glBindTexture 3553 2",
+		"glUseProgram 5 0" });
+	// the unit and the 0 bind are elided: unit 1 is still active and deleting bound the texture to 0
+	expectCounters("delete", cache, 2, 2);
+
+	// after invalidate() nothing is known, the same calls are issued again
+	cache.resetCounters();
+	cache.invalidate();
+	glUseProgram(5);
+	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+	expectCalls("invalidate", { "glUseProgram 5 0", "glClearColor 2 0" });
+	expectCounters("invalidate", cache, 2, 0);
+
+	// uninstall puts the mock's own functions back
+	cache.resetCounters();
+	cache.uninstall();
+	glUseProgram(5);
+	glUseProgram(5);
+	expectCalls("uninstall", { "glUseProgram 5 0", "glUseProgram 5 0" });
+	expectCounters("uninstall", cache, 0, 0);
+	if (glad_glUseProgram != mockUseProgram || glad_glBindTexture != mockBindTexture) {
+		std::printf("FAIL uninstall: the glad pointers are not the loader's\n");
+		failures++;
+	}
+
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
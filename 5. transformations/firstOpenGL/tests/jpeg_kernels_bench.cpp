@@ -0,0 +1,304 @@
+// stb_image's JPEG kernels, scalar against SSE2 against AVX2: the IDCT, the YCbCr to RGB(A) conversion and the
+// h2v1, h2v2 and generic upsamplers. checks that every tier gives the same bytes on random blocks and rows of
+// many widths, then times each kernel per tier and whole decodes of a baseline and a progressive JPEG with the
+// kernels of each tier, whose pixels must come out the same as well
+// the static functions of stb_image are visible here because the implementation is compiled into this file
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I.. jpeg_kernels_bench.cpp -o jpeg_kernels_bench && ./jpeg_kernels_bench [more.jpg ...]
+// exits with 1 when a tier differs from the scalar kernels
+// the SIMD tiers the CPU cannot run are left out, AVX2 is only compiled in where stb_image has STBI_AVX2
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_JPEG
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef STBI_SSE2
+int main() {
+	std::printf("stb_image has no SSE2 or AVX2 JPEG kernels for this target\n");
+	return 0;
+}
+#else
+namespace {
+	typedef void (*IdctKernel)(stbi_uc* out, int out_stride, short data[64]);
+	typedef void (*ColourKernel)(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb, const stbi_uc* pcr, int count, int step);
+
+	// the kernels stbi__setup_jpeg picks for each tier
+	struct Tier {
+		const char* name;
+		IdctKernel idct;
+		ColourKernel colour;
+		resample_row_func hv2;
+		resample_row_func h2;
+		resample_row_func generic;
+	};
+
+	const Tier scalarTier = { "scalar", stbi__idct_block, stbi__YCbCr_to_RGB_row, stbi__resample_row_hv_2,
+		stbi__resample_row_h_2, stbi__resample_row_generic };
+	const Tier sse2Tier = { "sse2", stbi__idct_simd, stbi__YCbCr_to_RGB_simd, stbi__resample_row_hv_2_simd,
+		stbi__resample_row_h_2, stbi__resample_row_generic };
+#ifdef STBI_AVX2
+	const Tier avx2Tier = { "avx2", stbi__idct_avx2, stbi__YCbCr_to_RGB_avx2, stbi__resample_row_hv_2_avx2,
+		stbi__resample_row_h_2_avx2, stbi__resample_row_generic_avx2 };
+#endif
+
+	const int runs = 5;
+	std::uint32_t state = 1;
+	int failures = 0;
+
+	std::uint32_t random() {
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	void randomBytes(std::vector<stbi_uc>& bytes) {
+		for (stbi_uc& byte : bytes)
+			byte = (stbi_uc)random();
+	}
+
+	// dequantized coefficients the way a decode leaves them: a DC term, AC terms that get smaller and sparser
+	// along the zigzag order, and some blocks with nothing but DC for the shortcut of the scalar IDCT
+	void randomBlock(short data[64]) {
+		bool dcOnly = random() % 4 == 0;
+		for (int k = 0; k < 64; k++) {
+			int range = k == 0 ? 2048 : 1024 >> (k / 12);
+			bool zero = k > 0 && (dcOnly || (int)(random() % 64) < k);
+			data[stbi__jpeg_dezigzag[k]] = zero ? 0 : (short)((int)(random() % (2 * range)) - range);
+		}
+	}
+
+	void expect(const char* what, const Tier& tier, int width, bool same) {
+		if (!same) {
+			std::printf("FAIL %s, %s: width %d differs from scalar\n", what, tier.name, width);
+			failures++;
+		}
+	}
+
+	// every kernel of the tier against the scalar one
+	void compare(const Tier& tier) {
+		for (int block = 0; block < 20000; block++) {
+			short data[64], copy[64];
+			randomBlock(data);
+			std::copy(data, data + 64, copy);
+			// a stride wider than the block, with guard bytes around it
+			std::vector<stbi_uc> scalar(8 * 24, 0xA5), simd(8 * 24, 0xA5);
+			scalarTier.idct(scalar.data() + 8, 24, data);
+			tier.idct(simd.data() + 8, 24, copy);
+			if (scalar != simd) {
+				expect("idct", tier, 8, false);
+				break;
+			}
+		}
+
+		for (int width = 1; width <= 300; width = width < 70 ? width + 1 : width * 2 + 1) {
+			std::vector<stbi_uc> y(width), cb(width), cr(width), near(width), far(width);
+			randomBytes(y);
+			randomBytes(cb);
+			randomBytes(cr);
+			randomBytes(near);
+			randomBytes(far);
+			for (int step = 3; step <= 4; step++) {
+				std::vector<stbi_uc> scalar(width * step + 16, 0xA5), simd(width * step + 16, 0xA5);
+				scalarTier.colour(scalar.data(), y.data(), cb.data(), cr.data(), width, step);
+				tier.colour(simd.data(), y.data(), cb.data(), cr.data(), width, step);
+				// step 4 leaves alpha to the kernel, step 3 must not write past the row
+				expect(step == 3 ? "YCbCr to RGB" : "YCbCr to RGBA", tier, width, scalar == simd);
+			}
+
+			struct Upsampler {
+				const char* name;
+				resample_row_func Tier::*kernel;
+				int hs;
+			};
+			const Upsampler upsamplers[] = {
+				{ "h2v2", &Tier::hv2, 2 },
+				{ "h2v1", &Tier::h2, 2 },
+				{ "generic 2x", &Tier::generic, 2 },
+				{ "generic 3x", &Tier::generic, 3 },
+				{ "generic 4x", &Tier::generic, 4 },
+			};
+			for (const Upsampler& upsampler : upsamplers) {
+				std::vector<stbi_uc> scalar(width * upsampler.hs + 16, 0xA5), simd(width * upsampler.hs + 16, 0xA5);
+				// the kernels may return their input instead of writing out, compare what they return
+				stbi_uc* a = (scalarTier.*upsampler.kernel)(scalar.data(), near.data(), far.data(), width, upsampler.hs);
+				stbi_uc* b = (tier.*upsampler.kernel)(simd.data(), near.data(), far.data(), width, upsampler.hs);
+				bool same = std::equal(a, a + width * upsampler.hs, b) &&
+					std::equal(scalar.begin() + width * upsampler.hs, scalar.end(), simd.begin() + width * upsampler.hs);
+				expect(upsampler.name, tier, width, same);
+			}
+		}
+	}
+
+	double elapsedNs(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	template <typename Run>
+	double best(Run run) {
+		double fastest = 1e30;
+		for (int i = 0; i < runs; i++) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			run();
+			fastest = std::min(fastest, elapsedNs(start));
+		}
+		return fastest;
+	}
+
+	// ns per block for the IDCT, per 1000 output pixels for the others
+	struct KernelTimes {
+		double idct, rgb, rgba, hv2, h2, generic;
+	};
+
+	KernelTimes time(const Tier& tier) {
+		const int blocks = 4096, width = 1024, rows = 256;
+		std::vector<short> coefficients(blocks * 64);
+		for (int block = 0; block < blocks; block++)
+			randomBlock(&coefficients[block * 64]);
+		std::vector<stbi_uc> pixels(blocks * 64), y(width), cb(width), cr(width), out(width * 4);
+		randomBytes(y);
+		randomBytes(cb);
+		randomBytes(cr);
+
+		KernelTimes times;
+		times.idct = best([&] {
+			for (int block = 0; block < blocks; block++)
+				tier.idct(&pixels[block * 64], 8, &coefficients[block * 64]);
+		}) / blocks;
+		times.rgb = best([&] {
+			for (int row = 0; row < rows; row++)
+				tier.colour(out.data(), y.data(), cb.data(), cr.data(), width, 3);
+		}) / rows / (width / 1000.0);
+		times.rgba = best([&] {
+			for (int row = 0; row < rows; row++)
+				tier.colour(out.data(), y.data(), cb.data(), cr.data(), width, 4);
+		}) / rows / (width / 1000.0);
+		// the upsamplers take half a row in and write the whole row
+		times.hv2 = best([&] {
+			for (int row = 0; row < rows; row++)
+				tier.hv2(out.data(), y.data(), cb.data(), width / 2, 2);
+		}) / rows / (width / 1000.0);
+		times.h2 = best([&] {
+			for (int row = 0; row < rows; row++)
+				tier.h2(out.data(), y.data(), cb.data(), width / 2, 2);
+		}) / rows / (width / 1000.0);
+		times.generic = best([&] {
+			for (int row = 0; row < rows; row++)
+				tier.generic(out.data(), y.data(), cb.data(), width / 2, 2);
+		}) / rows / (width / 1000.0);
+		volatile stbi_uc sink = out[0] ^ pixels[0];
+		(void)sink;
+		return times;
+	}
+
+	// what stbi__jpeg_load does, with the tier's kernels in place of the ones stbi__setup_jpeg picks
+	stbi_uc* decode(const std::vector<stbi_uc>& file, const Tier& tier, int channels, int* width, int* height) {
+		stbi__context context;
+		stbi__start_mem(&context, file.data(), (int)file.size());
+		std::vector<unsigned char> memory(sizeof(stbi__jpeg));
+		stbi__jpeg* j = (stbi__jpeg*)memory.data();
+		j->s = &context;
+		j->scale_shift = 0;
+		stbi__setup_jpeg(j);
+		j->idct_block_kernel = tier.idct;
+		j->YCbCr_to_RGB_kernel = tier.colour;
+		j->resample_row_hv_2_kernel = tier.hv2;
+		j->resample_row_h_2_kernel = tier.h2;
+		j->resample_row_generic_kernel = tier.generic;
+		int components;
+		return load_jpeg_image(j, width, height, &components, channels);
+	}
+
+	bool readFile(const std::string& path, std::vector<stbi_uc>& bytes) {
+		std::ifstream file(path, std::ios::binary);
+		bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return !bytes.empty();
+	}
+
+	bool progressive(const std::vector<stbi_uc>& file) {
+		for (size_t at = 2; at + 4 <= file.size() && file[at] == 0xFF;) {
+			if (file[at + 1] == 0xC2)
+				return true;
+			if (file[at + 1] == 0xC0 || file[at + 1] == 0xC1)
+				return false;
+			at += 2 + (file[at + 2] << 8 | file[at + 3]);
+		}
+		return false;
+	}
+}
+
+int main(int argc, char** argv) {
+	if (!stbi__sse2_available()) {
+		std::printf("no SSE2 on this CPU\n");
+		return 0;
+	}
+	std::vector<Tier> tiers = { scalarTier, sse2Tier };
+#ifdef STBI_AVX2
+	if (stbi__avx2_available())
+		tiers.push_back(avx2Tier);
+	else
+		std::printf("no AVX2 on this CPU, timing scalar and SSE2 only\n");
+#endif
+
+	for (size_t i = 1; i < tiers.size(); i++)
+		compare(tiers[i]);
+
+	// the kernels on their own: h2v1 and generic have no SSE2 kernel, the sse2 tier runs the scalar ones there
+	std::printf("kernels, best of %d: ns per block for the IDCT, ns per 1000 output pixels for the rest\n", runs);
+	std::printf("  %-8s %9s %9s %9s %9s %9s %9s\n", "", "idct", "rgb", "rgba", "h2v2", "h2v1", "generic");
+	for (const Tier& tier : tiers) {
+		KernelTimes times = time(tier);
+		std::printf("  %-8s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", tier.name, times.idct, times.rgb, times.rgba,
+			times.hv2, times.h2, times.generic);
+	}
+
+	// whole decodes, where the Huffman decoding the kernels do not touch takes its share
+	std::vector<std::string> paths(argv + 1, argv + argc);
+	if (paths.empty())
+		paths = { "../../../glm-master/doc/manual/references-outerra1.jpg", "../../../glm-master/doc/manual/noise-perlin1.jpg" };
+	std::printf("whole decodes, best of %d (ms)\n", runs);
+	for (const std::string& path : paths) {
+		std::vector<stbi_uc> file;
+		if (!readFile(path, file)) {
+			std::printf("FAIL %s: cannot read\n", path.c_str());
+			failures++;
+			continue;
+		}
+		for (int channels = 3; channels <= 4; channels++) {
+			int width = 0, height = 0;
+			stbi_uc* reference = decode(file, scalarTier, channels, &width, &height);
+			if (!reference) {
+				std::printf("FAIL %s: %s\n", path.c_str(), stbi_failure_reason());
+				failures++;
+				break;
+			}
+			size_t bytes = (size_t)width * height * channels;
+			std::printf("  %s, %dx%d %s, %s:", path.c_str(), width, height, progressive(file) ? "progressive" : "baseline",
+				channels == 3 ? "RGB" : "RGBA");
+			for (const Tier& tier : tiers) {
+				int w, h;
+				stbi_uc* pixels = decode(file, tier, channels, &w, &h);
+				if (!pixels || w != width || h != height || !std::equal(pixels, pixels + bytes, reference)) {
+					std::printf("\nFAIL %s, %s: the decode differs from scalar\n", path.c_str(), tier.name);
+					failures++;
+				}
+				stbi_image_free(pixels);
+				double ms = best([&] { stbi_image_free(decode(file, tier, channels, &w, &h)); }) / 1e6;
+				std::printf("  %s %.3f", tier.name, ms);
+			}
+			std::printf("\n");
+			stbi_image_free(reference);
+		}
+	}
+
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
+#endif
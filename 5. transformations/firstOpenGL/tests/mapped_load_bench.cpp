@@ -0,0 +1,207 @@
+// stbi_load_mapped and stbi_load_mapped_batch against stbi_load: checks that the mapped loads give the same
+// pixels as the stdio ones, then times passes over a set of files with each and counts the read system calls
+// and page faults of a pass. the files are read once first, so every pass finds them in the page cache
+// read calls come from /proc/self/io on Linux and GetProcessIoCounters on Windows, faults from getrusage
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I.. mapped_load_bench.cpp -o mapped_load_bench && ./mapped_load_bench [more files ...]
+// exits with 1 when a mapped load differs from stbi_load, or a mapped pass reads through read calls
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+// the IO_COUNTERS of windows.h, which this file does not include next to stb_image's own declarations
+struct ProcessIoCounters {
+	unsigned long long readOperations, writeOperations, otherOperations;
+	unsigned long long readBytes, writeBytes, otherBytes;
+};
+extern "C" __declspec(dllimport) void* __stdcall GetCurrentProcess(void);
+extern "C" __declspec(dllimport) int __stdcall GetProcessIoCounters(void* process, ProcessIoCounters* counters);
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const int runs = 5;
+
+	struct Counters {
+		long long reads;	// -1 when the platform does not say
+		long long faults;
+	};
+
+	long long readCalls() {
+#ifdef _WIN32
+		ProcessIoCounters counters;
+		return GetProcessIoCounters(GetCurrentProcess(), &counters) ? (long long)counters.readOperations : -1;
+#else
+		// syscr of /proc/self/io, read with one open and one read so that the cost of asking is the same each time
+		char text[512];
+		int fd = open("/proc/self/io", O_RDONLY);
+		if (fd < 0)
+			return -1;
+		ssize_t length = read(fd, text, sizeof(text) - 1);
+		close(fd);
+		if (length <= 0)
+			return -1;
+		text[length] = 0;
+		const char* syscr = std::strstr(text, "syscr:");
+		return syscr ? std::atoll(syscr + 6) : -1;
+#endif
+	}
+
+	long long pageFaults() {
+#ifdef _WIN32
+		return -1;
+#else
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		return usage.ru_minflt + usage.ru_majflt;
+#endif
+	}
+
+	Counters counters() {
+		Counters now;
+		now.faults = pageFaults();
+		now.reads = readCalls();
+		return now;
+	}
+
+	// the read calls counters() itself makes between two samples
+	long long sampleCost() {
+		Counters a = counters(), b = counters();
+		return a.reads < 0 ? 0 : b.reads - a.reads;
+	}
+
+	typedef std::vector<stbi_uc*> (*Loader)(const std::vector<std::string>& paths);
+
+	std::vector<stbi_uc*> loadEach(const std::vector<std::string>& paths) {
+		std::vector<stbi_uc*> images;
+		int x, y, n;
+		for (const std::string& path : paths)
+			images.push_back(stbi_load(path.c_str(), &x, &y, &n, 0));
+		return images;
+	}
+
+	std::vector<stbi_uc*> loadMapped(const std::vector<std::string>& paths) {
+		std::vector<stbi_uc*> images;
+		int x, y, n;
+		for (const std::string& path : paths)
+			images.push_back(stbi_load_mapped(path.c_str(), &x, &y, &n, 0));
+		return images;
+	}
+
+	std::vector<stbi_uc*> loadMappedBatch(const std::vector<std::string>& paths) {
+		std::vector<const char*> names;
+		for (const std::string& path : paths)
+			names.push_back(path.c_str());
+		std::vector<stbi_batch_image> batch(paths.size());
+		stbi_load_mapped_batch(names.data(), batch.data(), (int)batch.size(), 0);
+		std::vector<stbi_uc*> images;
+		for (const stbi_batch_image& image : batch)
+			images.push_back(image.data);
+		return images;
+	}
+
+	void freeAll(const std::vector<stbi_uc*>& images) {
+		for (stbi_uc* image : images)
+			stbi_image_free(image);
+	}
+
+	struct Pass {
+		double ms;
+		Counters counts;
+	};
+
+	// best of runs for the time, the counters of the last pass
+	Pass time(Loader load, const std::vector<std::string>& paths) {
+		Pass pass = { 1e30, { 0, 0 } };
+		long long cost = sampleCost();
+		for (int run = 0; run < runs; run++) {
+			Counters before = counters();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			std::vector<stbi_uc*> images = load(paths);
+			pass.ms = std::min(pass.ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			Counters after = counters();
+			freeAll(images);
+			pass.counts.reads = before.reads < 0 ? -1 : after.reads - before.reads - cost;
+			pass.counts.faults = before.faults < 0 ? -1 : after.faults - before.faults;
+		}
+		return pass;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> paths(argv + 1, argv + argc);
+	if (paths.empty()) {
+		paths = { "../pic1.png", "../pic2.png" };
+		const char* jpegs[] = { "noise-perlin1.jpg", "noise-perlin2.jpg", "noise-perlin3.jpg", "noise-simplex1.jpg",
+			"noise-simplex2.jpg", "noise-simplex3.jpg", "references-glsl4book.jpg", "references-leosfortune.jpeg",
+			"references-leosfortune2.jpg", "references-outerra1.jpg", "references-outerra2.jpg",
+			"references-outerra3.jpg", "references-outerra4.jpg" };
+		for (const char* jpeg : jpegs)
+			paths.push_back(std::string("../../../glm-master/doc/manual/") + jpeg);
+	}
+	int failures = 0;
+
+	// the same pixels from each loader, and the files in the page cache from here on
+	std::vector<stbi_uc*> stdio = loadEach(paths), mapped = loadMapped(paths), batch = loadMappedBatch(paths);
+	for (size_t i = 0; i < paths.size(); i++) {
+		int x = 0, y = 0, n = 0;
+		if (!stdio[i] || !stbi_info(paths[i].c_str(), &x, &y, &n)) {
+			std::printf("FAIL %s: %s\n", paths[i].c_str(), stbi_failure_reason());
+			failures++;
+			continue;
+		}
+		size_t bytes = (size_t)x * y * n;
+		if (!mapped[i] || !std::equal(stdio[i], stdio[i] + bytes, mapped[i])) {
+			std::printf("FAIL %s: stbi_load_mapped differs from stbi_load\n", paths[i].c_str());
+			failures++;
+		}
+		if (!batch[i] || !std::equal(stdio[i], stdio[i] + bytes, batch[i])) {
+			std::printf("FAIL %s: stbi_load_mapped_batch differs from stbi_load\n", paths[i].c_str());
+			failures++;
+		}
+	}
+	freeAll(stdio);
+	freeAll(mapped);
+	freeAll(batch);
+
+	struct Row {
+		const char* name;
+		Loader load;
+		bool mapped;
+	};
+	const Row rows[] = {
+		{ "stbi_load", loadEach, false },
+		{ "stbi_load_mapped", loadMapped, true },
+		{ "stbi_load_mapped_batch", loadMappedBatch, true },
+	};
+	std::printf("%d files, one pass each, best of %d\n", (int)paths.size(), runs);
+	std::printf("  %-24s %9s %11s %9s\n", "", "ms", "read calls", "faults");
+	for (const Row& row : rows) {
+		Pass pass = time(row.load, paths);
+		std::printf("  %-24s %9.2f %11lld %9lld\n", row.name, pass.ms, pass.counts.reads, pass.counts.faults);
+#ifdef STBI__MMAP
+		// the mapped loaders open and map, the decoders read straight from the mapping
+		if (row.mapped && pass.counts.reads > 0) {
+			std::printf("FAIL %s: %lld read calls\n", row.name, pass.counts.reads);
+			failures++;
+		}
+#endif
+	}
+	if (readCalls() < 0 || pageFaults() < 0)
+		std::printf("(-1: this platform does not count them)\n");
+
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
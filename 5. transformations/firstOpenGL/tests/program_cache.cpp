@@ -0,0 +1,249 @@
+// ProgramCache against a stubbed GL loader: the mock driver has one binary format, hands out binaries of the
+// programs it "linked" and accepts them back only in that format. counts the hits and misses of the cache over
+// a miss and store, a hit, and cached files with a wrong magic, format, key or length
+// no context needed, writes to program_cache_test/ in the working directory
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I../../../OpenGL/include -I.. program_cache.cpp ../program_cache.cpp ../../../OpenGL/src/glad.c
+//		-o program_cache && ./program_cache
+// exits with 1 when a check fails
+
+#include "program_cache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+	const GLenum mockFormat = 0x4D4F;
+	const char* const directory = "program_cache_test";
+
+	// the offsets of BinaryHeader in program_cache.cpp: magic, format, length, reserved, key
+	const int formatOffset = 4;
+	const int lengthOffset = 8;
+	const int keyOffset = 16;
+
+	struct MockProgram {
+		bool linked;
+		std::string binary;
+	};
+	std::map<GLuint, MockProgram> programs;
+	GLuint nextProgram = 1;
+	int binaryFormats = 1;
+	const char* renderer = "mock renderer";
+
+	int getProgramBinaryCalls = 0;
+	int programBinaryCalls = 0;
+	int retrievableHints = 0;
+
+	const GLubyte* APIENTRY mockGetString(GLenum name) {
+		switch (name) {
+		case GL_VENDOR: return (const GLubyte*)"mock vendor";
+		case GL_RENDERER: return (const GLubyte*)renderer;
+		case GL_VERSION: return (const GLubyte*)"4.1 mock";
+		}
+		return nullptr;
+	}
+
+	void APIENTRY mockGetIntegerv(GLenum pname, GLint* value) {
+		if (pname == GL_NUM_PROGRAM_BINARY_FORMATS)
+			*value = binaryFormats;
+		else if (pname == GL_PROGRAM_BINARY_FORMATS)
+			*value = (GLint)mockFormat;
+		else
+			*value = 0;
+	}
+
+	GLuint APIENTRY mockCreateProgram() {
+		programs[nextProgram] = MockProgram{ false, "" };
+		return nextProgram++;
+	}
+
+	void APIENTRY mockDeleteProgram(GLuint program) { programs.erase(program); }
+
+	void APIENTRY mockGetProgramiv(GLuint program, GLenum pname, GLint* value) {
+		const MockProgram& mock = programs[program];
+		if (pname == GL_LINK_STATUS)
+			*value = mock.linked ? GL_TRUE : GL_FALSE;
+		else if (pname == GL_PROGRAM_BINARY_LENGTH)
+			*value = (GLint)mock.binary.size();
+		else
+			*value = 0;
+	}
+
+	void APIENTRY mockGetProgramBinary(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary) {
+		getProgramBinaryCalls++;
+		const std::string& bytes = programs[program].binary;
+		*length = (GLsizei)std::min<size_t>(bytes.size(), (size_t)bufSize);
+		*binaryFormat = mockFormat;
+		std::memcpy(binary, bytes.data(), *length);
+	}
+
+	// like a driver: a binary in another format, or not one it wrote, leaves the program unlinked
+	void APIENTRY mockProgramBinary(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length) {
+		programBinaryCalls++;
+		std::string bytes((const char*)binary, length);
+		MockProgram& mock = programs[program];
+		mock.linked = binaryFormat == mockFormat && bytes.compare(0, 8, "MOCKBIN ") == 0;
+		mock.binary = mock.linked ? bytes : "";
+	}
+
+	void APIENTRY mockProgramParameteri(GLuint, GLenum pname, GLint value) {
+		if (pname == GL_PROGRAM_BINARY_RETRIEVABLE_HINT && value == GL_TRUE)
+			retrievableHints++;
+	}
+
+	void* mockLoader(const char* name) {
+		if (std::strcmp(name, "glGetProgramBinary") == 0)
+			return (void*)mockGetProgramBinary;
+		if (std::strcmp(name, "glProgramBinary") == 0)
+			return (void*)mockProgramBinary;
+		if (std::strcmp(name, "glProgramParameteri") == 0)
+			return (void*)mockProgramParameteri;
+		return nullptr;
+	}
+
+	// what glCompileShader + glLinkProgram would leave behind
+	GLuint linkProgram(const std::string& name) {
+		GLuint program = mockCreateProgram();
+		programs[program] = MockProgram{ true, "MOCKBIN " + name };
+		return program;
+	}
+
+	std::string pathFor(std::uint64_t key) {
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+		return std::string(directory) + "/" + name;
+	}
+
+	std::vector<char> readFile(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	void writeFile(const std::string& path, const std::vector<char>& bytes) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(bytes.data(), bytes.size());
+	}
+
+	template <typename T>
+	void patch(std::vector<char>& bytes, int offset, T value) {
+		std::memcpy(bytes.data() + offset, &value, sizeof(value));
+	}
+
+	int failures = 0;
+
+	void expect(const char* what, bool ok) {
+		if (!ok) {
+			std::printf("FAIL %s\n", what);
+			failures++;
+		}
+	}
+
+	void expectStats(const char* what, const ProgramCache& cache, unsigned int hits, unsigned int misses,
+		unsigned int rejected, unsigned int stored) {
+		const ProgramCache::Stats& stats = cache.stats();
+		if (stats.hits != hits || stats.misses != misses || stats.rejected != rejected || stats.stored != stored) {
+			std::printf("FAIL %s: %u hits, %u misses, %u rejected, %u stored, expected %u, %u, %u, %u\n", what,
+				stats.hits, stats.misses, stats.rejected, stats.stored, hits, misses, rejected, stored);
+			failures++;
+		}
+	}
+}
+
+int main() {
+	glad_glGetString = mockGetString;
+	glad_glGetIntegerv = mockGetIntegerv;
+	glad_glCreateProgram = mockCreateProgram;
+	glad_glDeleteProgram = mockDeleteProgram;
+	glad_glGetProgramiv = mockGetProgramiv;
+
+	// a driver with the entry points but no formats leaves the cache off
+	binaryFormats = 0;
+	ProgramCache disabled(directory);
+	expect("load without binary formats returns false", !disabled.load(mockLoader) && !disabled.available());
+	binaryFormats = 1;
+
+	ProgramCache cache(directory);
+	expect("load", cache.load(mockLoader) && cache.available());
+	std::uint64_t key = cache.key("vertex source", "fragment source");
+	std::remove(pathFor(key).c_str());
+
+	// miss, then the linked program is stored
+	expect("first load misses", cache.loadProgram(key) == 0);
+	expect("a miss does not reach glProgramBinary", programBinaryCalls == 0);
+	expectStats("miss", cache, 0, 1, 0, 0);
+	GLuint linked = linkProgram("vertex source + fragment source");
+	cache.prepareProgram(linked);
+	expect("prepareProgram sets the retrievable hint", retrievableHints == 1);
+	cache.storeProgram(key, linked);
+	expect("store reads the binary", getProgramBinaryCalls == 1);
+	expectStats("store", cache, 0, 1, 0, 1);
+	std::vector<char> stored = readFile(pathFor(key));
+	expect("the stored file is the header and the binary", stored.size() == 24 + programs[linked].binary.size());
+
+	// hit: a new program with the same binary, linked without compiling
+	GLuint loaded = cache.loadProgram(key);
+	expect("second load hits", loaded != 0 && loaded != linked);
+	expect("the hit is linked with the stored binary", programs[loaded].linked &&
+		programs[loaded].binary == programs[linked].binary);
+	expectStats("hit", cache, 1, 1, 0, 1);
+
+	// another source or another driver is another key
+	expect("changed source misses", cache.loadProgram(cache.key("vertex source", "edited fragment source")) == 0);
+	expectStats("changed source", cache, 1, 2, 0, 1);
+	renderer = "updated mock renderer";
+	ProgramCache updated(directory);
+	updated.load(mockLoader);
+	expect("a driver update changes the key", updated.key("vertex source", "fragment source") != key);
+	renderer = "mock renderer";
+
+	// a file that is not a cached binary: refused before the driver sees it
+	int calls = programBinaryCalls;
+	std::vector<char> bytes = stored;
+	bytes[0] = 'X';
+	writeFile(pathFor(key), bytes);
+	expect("wrong magic misses", cache.loadProgram(key) == 0);
+	expectStats("wrong magic", cache, 1, 3, 0, 1);
+
+	// a binary stored for another key under this key's name
+	bytes = stored;
+	patch<std::uint64_t>(bytes, keyOffset, key ^ 1);
+	writeFile(pathFor(key), bytes);
+	expect("wrong key misses", cache.loadProgram(key) == 0);
+	expectStats("wrong key", cache, 1, 4, 0, 1);
+
+	// a length past the end of the file
+	bytes = stored;
+	patch<std::uint32_t>(bytes, lengthOffset, 0x7fffffffu);
+	writeFile(pathFor(key), bytes);
+	expect("oversized length misses", cache.loadProgram(key) == 0);
+	writeFile(pathFor(key), std::vector<char>(stored.begin(), stored.end() - 1));
+	expect("truncated binary misses", cache.loadProgram(key) == 0);
+	expectStats("bad length", cache, 1, 6, 0, 1);
+	expect("bad files do not reach glProgramBinary", programBinaryCalls == calls);
+
+	// a format the driver does not take: glProgramBinary fails, the file is removed and counted as rejected
+	bytes = stored;
+	patch<std::uint32_t>(bytes, formatOffset, mockFormat + 1);
+	writeFile(pathFor(key), bytes);
+	size_t programCount = programs.size();
+	expect("wrong format misses", cache.loadProgram(key) == 0);
+	expect("the rejected program is deleted", programs.size() == programCount);
+	expect("the rejected file is removed", !std::ifstream(pathFor(key)));
+	expectStats("wrong format", cache, 1, 7, 1, 1);
+
+	// stored again after the rejection, and hit
+	cache.storeProgram(key, linked);
+	expect("hit after storing again", cache.loadProgram(key) != 0);
+	expectStats("stored again", cache, 2, 7, 1, 2);
+	expect("no temporary file left", !std::ifstream(pathFor(key) + ".tmp"));
+
+	std::remove(pathFor(key).c_str());
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
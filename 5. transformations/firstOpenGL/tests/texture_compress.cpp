@@ -0,0 +1,304 @@
+// CompressedChain on the CPU: gradient and noise images are encoded to BC1, BC3 and BC7, decoded again with the
+// decoder below (written from the format specifications, not from texture_compress.cpp) and held to a PSNR
+// floor per format. also checks that the SSE2 and scalar kernels and the pool and single thread encodes write the
+// same bytes, and that a chain comes back unchanged from a KTX2 cache file
+// no context needed, writes texture_compress_test.ktx2 in the working directory
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I../../../OpenGL/include -I.. texture_compress.cpp ../texture_compress.cpp ../mipmap.cpp
+//		../thread_pool.cpp ../../../OpenGL/src/glad.c -pthread -o texture_compress && ./texture_compress
+// exits with 1 when a check fails
+
+#include "texture_compress.h"
+#include "mipmap.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+	const int size = 256;
+	const char* const cachePath = "texture_compress_test.ktx2";
+
+	// ---------------------------------------------------------------------------------------------
+	// reference decoder
+	// ---------------------------------------------------------------------------------------------
+
+	void expand565(unsigned color, int* rgb) {
+		int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		rgb[0] = r << 3 | r >> 2;
+		rgb[1] = g << 2 | g >> 4;
+		rgb[2] = b << 3 | b >> 2;
+	}
+
+	// BC1: two RGB565 colours and 2 bit indices. c0 > c1: 4 colours, else 3 and transparent black
+	// in BC3 the colour block always has 4 colours
+	void referenceColor(const std::uint8_t* block, bool bc3, std::uint8_t* out) {
+		unsigned c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+		int colors[4][4];
+		expand565(c0, colors[0]);
+		expand565(c1, colors[1]);
+		for (int c = 0; c < 3; c++) {
+			if (bc3 || c0 > c1) {
+				colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+				colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+			}
+			else {
+				colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+				colors[3][c] = 0;
+			}
+		}
+		colors[0][3] = colors[1][3] = colors[2][3] = 255;
+		colors[3][3] = bc3 || c0 > c1 ? 255 : 0;
+		for (int i = 0; i < 16; i++) {
+			int index = (block[4 + i / 4] >> (i % 4 * 2)) & 3;
+			for (int c = 0; c < 4; c++)
+				out[i * 4 + c] = (std::uint8_t)colors[index][c];
+		}
+	}
+
+	// BC3 alpha: two 8 bit endpoints, 3 bit indices. a0 > a1: 6 steps between them, else 4 and 0 and 255
+	void referenceAlpha(const std::uint8_t* block, std::uint8_t* out) {
+		int a0 = block[0], a1 = block[1], alphas[8] = { a0, a1 };
+		if (a0 > a1) {
+			for (int k = 1; k <= 6; k++)
+				alphas[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+		}
+		else {
+			for (int k = 1; k <= 4; k++)
+				alphas[k + 1] = ((5 - k) * a0 + k * a1) / 5;
+			alphas[6] = 0;
+			alphas[7] = 255;
+		}
+		std::uint64_t bits = 0;
+		for (int i = 0; i < 6; i++)
+			bits |= (std::uint64_t)block[2 + i] << (8 * i);
+		for (int i = 0; i < 16; i++)
+			out[i * 4 + 3] = (std::uint8_t)alphas[(bits >> (3 * i)) & 7];
+	}
+
+	// bits [first, first + count) of a 128 bit little endian block
+	unsigned field(const std::uint8_t* block, int first, int count) {
+		unsigned value = 0;
+		for (int i = 0; i < count; i++)
+			value |= ((block[(first + i) / 8] >> ((first + i) % 8)) & 1u) << i;
+		return value;
+	}
+
+	// BC7: the mode is the position of the lowest set bit. only mode 6 (one subset, RGBA 7.7.7.7 endpoints with a
+	// p-bit each, 4 bit indices) is decoded, false for any other
+	bool referenceBc7(const std::uint8_t* block, std::uint8_t* out) {
+		int mode = 0;
+		while (mode < 8 && !field(block, mode, 1))
+			mode++;
+		if (mode != 6)
+			return false;
+		static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		int endpoints[2][4];
+		unsigned p0 = field(block, 63, 1), p1 = field(block, 64, 1);
+		for (int c = 0; c < 4; c++) {
+			endpoints[0][c] = (int)(field(block, 7 + c * 14, 7) << 1 | p0);
+			endpoints[1][c] = (int)(field(block, 7 + c * 14 + 7, 7) << 1 | p1);
+		}
+		// the anchor index (pixel 0) drops its top bit
+		for (int i = 0, at = 65; i < 16; i++) {
+			int bits = i == 0 ? 3 : 4;
+			int w = weights[field(block, at, bits)];
+			at += bits;
+			for (int c = 0; c < 4; c++)
+				out[i * 4 + c] = (std::uint8_t)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+		}
+		return true;
+	}
+
+	// level 0 of a chain as RGBA, false when a block is not one the reference decodes
+	bool referenceDecode(const CompressedChain& chain, std::vector<std::uint8_t>& rgba) {
+		const CompressedChain::Level& level = chain.level(0);
+		const std::uint8_t* in = chain.data(0);
+		int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+		size_t blockBytes = chain.format() == BLOCK_BC1 ? 8 : 16;
+		rgba.assign((size_t)level.width * level.height * 4, 0);
+		for (int by = 0; by < blocksY; by++) {
+			for (int bx = 0; bx < blocksX; bx++, in += blockBytes) {
+				std::uint8_t pixels[64];
+				switch (chain.format()) {
+				case BLOCK_BC1:
+					referenceColor(in, false, pixels);
+					break;
+				case BLOCK_BC3:
+					referenceColor(in + 8, true, pixels);
+					referenceAlpha(in, pixels);
+					break;
+				case BLOCK_BC7:
+					if (!referenceBc7(in, pixels))
+						return false;
+					break;
+				}
+				for (int y = 0; y < 4 && by * 4 + y < level.height; y++)
+					std::memcpy(&rgba[((size_t)(by * 4 + y) * level.width + bx * 4) * 4], pixels + y * 16,
+						std::min(4, level.width - bx * 4) * 4);
+			}
+		}
+		return true;
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// test images
+	// ---------------------------------------------------------------------------------------------
+
+	std::vector<std::uint8_t> gradient() {
+		std::vector<std::uint8_t> pixels((size_t)size * size * 4);
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				std::uint8_t* p = &pixels[((size_t)y * size + x) * 4];
+				p[0] = (std::uint8_t)x;
+				p[1] = (std::uint8_t)y;
+				p[2] = (std::uint8_t)((x + y) / 2);
+				p[3] = (std::uint8_t)(255 - x);
+			}
+		}
+		return pixels;
+	}
+
+	std::vector<std::uint8_t> noise() {
+		std::vector<std::uint8_t> pixels((size_t)size * size * 4);
+		std::uint32_t state = 12345;
+		for (std::uint8_t& value : pixels) {
+			state = state * 1664525u + 1013904223u;
+			value = (std::uint8_t)(state >> 24);
+		}
+		return pixels;
+	}
+
+	// the channels a format stores: RGB for BC1, RGBA for BC3 and BC7
+	std::vector<std::uint8_t> channels(const std::vector<std::uint8_t>& rgba, int count) {
+		std::vector<std::uint8_t> out;
+		out.reserve(rgba.size() / 4 * count);
+		for (size_t i = 0; i < rgba.size(); i += 4)
+			out.insert(out.end(), rgba.begin() + i, rgba.begin() + i + count);
+		return out;
+	}
+
+	int failures = 0;
+
+	void expect(const std::string& what, bool ok) {
+		if (!ok) {
+			std::printf("FAIL %s\n", what.c_str());
+			failures++;
+		}
+	}
+
+	bool sameLevels(const CompressedChain& a, const CompressedChain& b) {
+		if (a.levels() != b.levels() || a.format() != b.format())
+			return false;
+		for (int i = 0; i < a.levels(); i++) {
+			if (a.level(i).width != b.level(i).width || a.level(i).height != b.level(i).height ||
+				a.level(i).size != b.level(i).size || std::memcmp(a.data(i), b.data(i), a.level(i).size) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	const char* formatName(BlockFormat format) {
+		return format == BLOCK_BC1 ? "BC1" : format == BLOCK_BC3 ? "BC3" : "BC7";
+	}
+}
+
+int main() {
+	struct Image {
+		const char* name;
+		std::vector<std::uint8_t> pixels;
+		// PSNR floors in dB for BC1, BC3, BC7
+		double floor[3];
+	};
+	Image images[] = {
+		{ "gradient", gradient(), { 43.0, 44.0, 48.0 } },
+		{ "noise", noise(), { 12.5, 13.5, 12.5 } },
+	};
+	const BlockFormat formats[] = { BLOCK_BC1, BLOCK_BC3, BLOCK_BC7 };
+	ThreadPool pool(3);
+
+	for (Image& image : images) {
+		MipChain mips;
+		mips.build(image.pixels.data(), size, size, 4, MIP_UNSIGNED_BYTE);
+		for (BlockFormat format : formats) {
+			std::string what = std::string(formatName(format)) + " " + image.name;
+			int stored = format == BLOCK_BC1 ? 3 : 4;
+
+			CompressedChain chain;
+			expect(what + " build", chain.build(mips, 4, format));
+			std::vector<std::uint8_t> decoded;
+			if (!referenceDecode(chain, decoded)) {
+				expect(what + ": a block the reference decoder does not know", false);
+				continue;
+			}
+			double quality = psnr(channels(image.pixels, stored).data(), channels(decoded, stored).data(),
+				(size_t)size * size * stored);
+			std::printf("%-13s %6.2f dB\n", what.c_str(), quality);
+			expect(what + " PSNR under the floor", quality >= image.floor[format]);
+
+			// the encoder's own decoder agrees with the reference to within the rounding of the steps between endpoints
+			std::vector<std::uint8_t> own((size_t)size * size * 4);
+			chain.decode(0, own.data());
+			int difference = 0;
+			for (size_t i = 0; i < own.size(); i++)
+				difference = std::max(difference, std::abs((int)own[i] - decoded[i]));
+			expect(what + " decode() differs from the reference by more than 1", difference <= 1);
+
+			// the scalar kernels and the pool write the same blocks
+			CompressedChain::useSimd(false);
+			CompressedChain scalar;
+			scalar.build(mips, 4, format);
+			CompressedChain::useSimd(true);
+			expect(what + " scalar and SIMD encodes differ", sameLevels(chain, scalar));
+			CompressedChain pooled;
+			pooled.build(mips, 4, format, &pool);
+			expect(what + " pool and single thread encodes differ", sameLevels(chain, pooled));
+
+			// KTX2 round trip
+			std::remove(cachePath);
+			expect(what + " save", chain.save(cachePath, 0x1234));
+			CompressedChain loaded;
+			expect(what + " load", loaded.load(cachePath, 0x1234));
+			expect(what + " loaded levels differ", sameLevels(chain, loaded));
+			CompressedChain otherKey;
+			expect(what + " load with another key", !otherKey.load(cachePath, 0x1235) && otherKey.levels() == 0);
+		}
+	}
+
+	// the file save() writes: KTX2 identifier, vkFormat of BC7, a truncated copy is refused
+	MipChain mips;
+	std::vector<std::uint8_t> pixels = gradient();
+	mips.build(pixels.data(), size, size, 4, MIP_UNSIGNED_BYTE);
+	CompressedChain chain;
+	chain.build(mips, 4, BLOCK_BC7);
+	chain.save(cachePath, 1);
+	std::vector<char> file;
+	{
+		std::ifstream in(cachePath, std::ios::binary);
+		file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	std::uint32_t vkFormat = 0;
+	if (file.size() >= 16)
+		std::memcpy(&vkFormat, file.data() + 12, 4);
+	expect("KTX2 identifier", file.size() >= 16 && std::memcmp(file.data(), "\xABKTX 20\xBB\r\n\x1A\n", 12) == 0);
+	expect("vkFormat VK_FORMAT_BC7_UNORM_BLOCK", vkFormat == 145);
+	{
+		std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+		out.write(file.data(), file.size() - 1);
+	}
+	CompressedChain truncated;
+	expect("truncated file refused", !truncated.load(cachePath, 1));
+	std::remove(cachePath);
+	CompressedChain missing;
+	expect("missing file refused", !missing.load(cachePath, 1));
+
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
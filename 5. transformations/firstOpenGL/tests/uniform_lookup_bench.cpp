@@ -0,0 +1,169 @@
+// uniform lookups of Shader against a mock GL: counts the driver calls a frame makes and times the lookups
+// no context needed, the glad function pointers are pointed at the mock before any Shader is made
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I../../../OpenGL/include -I.. uniform_lookup_bench.cpp ../shader_s.cpp ../program_cache.cpp
+//		../shader_source.cpp ../../../OpenGL/src/glad.c -o uniform_lookup_bench && ./uniform_lookup_bench
+// exits with 1 when a lookup returns the wrong location
+
+#include "shader_s.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+	// the active uniforms of the mock program. u31992 and u605430 have the same FNV-1a hash,
+	// lights is an array of 4
+	struct MockUniform {
+		const char* name;
+		GLenum type;
+		int size;
+	};
+	const MockUniform active[] = {
+		{ "transform", GL_FLOAT_MAT4, 1 },
+		{ "lerpVal", GL_FLOAT, 1 },
+		{ "texture1", GL_SAMPLER_2D, 1 },
+		{ "texture2", GL_SAMPLER_2D, 1 },
+		{ "tint", GL_FLOAT_VEC4, 1 },
+		{ "lights[0]", GL_FLOAT_VEC4, 4 },
+		{ "u31992", GL_FLOAT, 1 },
+	};
+	const int activeCount = sizeof(active) / sizeof(active[0]);
+
+	long long locationCalls = 0;
+	long long uniformCalls = 0;
+	int lastLocation = -2;
+
+	// locations: the index of the uniform times 10, plus the element for arrays
+	GLint APIENTRY mockGetUniformLocation(GLuint, const GLchar* name) {
+		locationCalls++;
+		for (int i = 0; i < activeCount; i++) {
+			std::string base(active[i].name);
+			if (base.size() > 3 && base.compare(base.size() - 3, 3, "[0]") == 0)
+				base.resize(base.size() - 3);
+			if (base == name || active[i].name == std::string(name))
+				return i * 10;
+			for (int element = 1; element < active[i].size; element++) {
+				if (base + "[" + std::to_string(element) + "]" == name)
+					return i * 10 + element;
+			}
+		}
+		return -1;
+	}
+
+	void APIENTRY mockGetProgramiv(GLuint, GLenum pname, GLint* value) {
+		if (pname == GL_ACTIVE_UNIFORMS)
+			*value = activeCount;
+		else if (pname == GL_ACTIVE_UNIFORM_MAX_LENGTH)
+			*value = 32;
+		else
+			*value = 0;
+	}
+
+	void APIENTRY mockGetActiveUniform(GLuint, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name) {
+		std::snprintf(name, bufSize, "%s", active[index].name);
+		*length = (GLsizei)std::strlen(name);
+		*size = active[index].size;
+		*type = active[index].type;
+	}
+
+	void APIENTRY mockUniform1i(GLint location, GLint) { uniformCalls++; lastLocation = location; }
+	void APIENTRY mockUniform1f(GLint location, GLfloat) { uniformCalls++; lastLocation = location; }
+	void APIENTRY mockUniform4f(GLint location, GLfloat, GLfloat, GLfloat, GLfloat) { uniformCalls++; lastLocation = location; }
+	void APIENTRY mockUniformMatrix4fv(GLint location, GLsizei, GLboolean, const GLfloat*) { uniformCalls++; lastLocation = location; }
+
+	int failures = 0;
+
+	void expect(const char* what, int location, int expected) {
+		if (location != expected) {
+			std::printf("FAIL %s: location %d, expected %d\n", what, location, expected);
+			failures++;
+		}
+	}
+
+	double elapsedMs(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main() {
+	glad_glGetUniformLocation = mockGetUniformLocation;
+	glad_glGetProgramiv = mockGetProgramiv;
+	glad_glGetActiveUniform = mockGetActiveUniform;
+	glad_glUniform1i = mockUniform1i;
+	glad_glUniform1f = mockUniform1f;
+	glad_glUniform4f = mockUniform4f;
+	glad_glUniformMatrix4fv = mockUniformMatrix4fv;
+
+	Shader shader(1u);
+	long long buildCalls = locationCalls;
+
+	// lookups
+	expect("transform", shader.uniformLocation("transform"), 0);
+	expect("lights", shader.uniformLocation("lights"), 50);
+	expect("lights[0]", shader.uniformLocation("lights[0]"), 50);
+	expect("lights[2]", shader.uniformLocation("lights[2]"), 52);
+	expect("u31992", shader.uniformLocation("u31992"), 60);
+	// not active, same hash as u31992
+	expect("u605430", shader.uniformLocation("u605430"), -1);
+	expect("missing", shader.uniformLocation("missing"), -1);
+	expect("uniform<float> lerpVal", shader.uniform<float>("lerpVal").location, 10);
+	expect("uniform<int> texture2", shader.uniform<int>("texture2").location, 30);
+	expect("uniform<glm::vec4> lights[3]", shader.uniform<glm::vec4>("lights[3]").location, 53);
+	expect("uniform<float> lights[3]", shader.uniform<float>("lights[3]").location, -1);
+	expect("uniform<float> u605430", shader.uniform<float>("u605430").location, -1);
+	shader.setInt("lights[1]", 0);
+	expect("setInt lights[1]", lastLocation, 51);
+	lastLocation = -2;
+	shader.setFloat("u605430", 1.0f);
+	expect("setFloat u605430", lastLocation, -1);
+
+	// what the render loop of mainWindow.cpp sets every frame
+	const int frames = 1000000;
+	glm::mat4 transform(1.0f);
+
+	locationCalls = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		glUniform1f(glGetUniformLocation(shader.ID, "lerpVal"), 0.5f);
+		glUniformMatrix4fv(glGetUniformLocation(shader.ID, "transform"), 1, GL_FALSE, &transform[0][0]);
+		glUniform1i(glGetUniformLocation(shader.ID, "texture1"), 0);
+		glUniform1i(glGetUniformLocation(shader.ID, "texture2"), 1);
+	}
+	double driverMs = elapsedMs(start);
+	long long driverCalls = locationCalls;
+
+	locationCalls = 0;
+	start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		shader.setFloat("lerpVal", 0.5f);
+		glUniformMatrix4fv(shader.uniformLocation("transform"), 1, GL_FALSE, &transform[0][0]);
+		shader.setInt("texture1", 0);
+		shader.setInt("texture2", 1);
+	}
+	double tableMs = elapsedMs(start);
+	long long tableCalls = locationCalls;
+
+	Uniform<float> lerpVal = shader.uniform<float>("lerpVal");
+	Uniform<glm::mat4> transformHandle = shader.uniform<glm::mat4>("transform");
+	Uniform<int> texture1 = shader.uniform<int>("texture1"), texture2 = shader.uniform<int>("texture2");
+	locationCalls = 0;
+	start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		shader.set(lerpVal, 0.5f);
+		shader.set(transformHandle, transform);
+		shader.set(texture1, 0);
+		shader.set(texture2, 1);
+	}
+	double handleMs = elapsedMs(start);
+	long long handleCalls = locationCalls;
+
+	std::printf("table built with %lld glGetUniformLocation calls\n", buildCalls);
+	std::printf("%d frames, 4 uniforms a frame:\n", frames);
+	std::printf("  glGetUniformLocation every set  %9lld location calls  %8.1f ms\n", driverCalls, driverMs);
+	std::printf("  string setters, table           %9lld location calls  %8.1f ms\n", tableCalls, tableMs);
+	std::printf("  typed handles                   %9lld location calls  %8.1f ms\n", handleCalls, handleMs);
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
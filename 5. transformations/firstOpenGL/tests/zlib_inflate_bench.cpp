@@ -0,0 +1,129 @@
+// stb_image's inflate with the fast loop (stbi__zfast_huffman_block) against the same decoder built with
+// STBI_NO_ZFAST, which decodes a bit at a time through stbi__zhuffman_decode as before: takes the zlib
+// stream of every PNG given (pic1.png and pic2.png by default), checks that both decoders give the same
+// bytes and measures the MB/s of inflated output of each
+// this file is compiled twice, once with ZLIB_BENCH_REFERENCE for the decoder without the fast loop
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I.. -DZLIB_BENCH_REFERENCE -c zlib_inflate_bench.cpp -o zlib_reference.o
+//	g++ -std=c++14 -O2 -I.. zlib_inflate_bench.cpp zlib_reference.o -o zlib_inflate_bench && ./zlib_inflate_bench
+// exits with 1 when a stream cannot be read or the two decoders disagree
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#ifdef ZLIB_BENCH_REFERENCE
+// static, so the two builds of stb_image can be linked together
+#define STB_IMAGE_STATIC
+#define STBI_NO_ZFAST
+#endif
+#include "stb_image.h"
+
+// stbi_zlib_decode_buffer of the build without the fast loop
+int referenceInflate(char* out, int outLength, const char* in, int inLength);
+
+#ifdef ZLIB_BENCH_REFERENCE
+int referenceInflate(char* out, int outLength, const char* in, int inLength) {
+	return stbi_zlib_decode_buffer(out, outLength, in, inLength);
+}
+#else
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+	const int runs = 5;
+
+	std::uint32_t bigEndian(const unsigned char* bytes) {
+		return (std::uint32_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+	}
+
+	// the IDAT chunks of a PNG joined together: one zlib stream with its header
+	bool zlibStream(const std::string& path, std::vector<char>& stream) {
+		std::ifstream file(path, std::ios::binary);
+		std::vector<unsigned char> png((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (png.size() < 8)
+			return false;
+		for (size_t at = 8; at + 12 <= png.size();) {
+			std::uint32_t length = bigEndian(&png[at]);
+			if (length > png.size() - at - 12)
+				return false;
+			if (std::equal(&png[at + 4], &png[at + 8], "IDAT"))
+				stream.insert(stream.end(), &png[at + 8], &png[at + 8] + length);
+			at += 12 + length;
+		}
+		return !stream.empty();
+	}
+
+	typedef int (*Inflate)(char*, int, const char*, int);
+
+	int fastInflate(char* out, int outLength, const char* in, int inLength) {
+		return stbi_zlib_decode_buffer(out, outLength, in, inLength);
+	}
+
+	// best of runs, in ms
+	double time(Inflate inflate, std::vector<char>& out, const std::vector<char>& stream) {
+		double best = 1e30;
+		for (int run = 0; run < runs; run++) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			inflate(out.data(), (int)out.size(), stream.data(), (int)stream.size());
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> paths(argv + 1, argv + argc);
+	if (paths.empty())
+		paths = { "../pic1.png", "../pic2.png" };
+	int failures = 0;
+
+	std::printf("inflated MB/s, best of %d\n", runs);
+	std::printf("  %-24s %9s %9s %9s %9s %8s\n", "", "in KB", "out KB", "old", "new", "speedup");
+	for (const std::string& path : paths) {
+		std::vector<char> stream;
+		if (!zlibStream(path, stream)) {
+			std::printf("FAIL %s: no zlib stream\n", path.c_str());
+			failures++;
+			continue;
+		}
+		int length = 0;
+		char* inflated = stbi_zlib_decode_malloc(stream.data(), (int)stream.size(), &length);
+		if (!inflated) {
+			std::printf("FAIL %s: %s\n", path.c_str(), stbi_failure_reason());
+			failures++;
+			continue;
+		}
+		STBI_FREE(inflated);
+
+		// one byte of slack: both must stop at the end of the stream, not the end of the buffer
+		std::vector<char> reference(length + 1, 0), fast(length + 1, 0);
+		int referenceLength = referenceInflate(reference.data(), (int)reference.size(), stream.data(), (int)stream.size());
+		int fastLength = fastInflate(fast.data(), (int)fast.size(), stream.data(), (int)stream.size());
+		if (referenceLength != length || fastLength != length || reference != fast) {
+			std::printf("FAIL %s: %d and %d bytes, expected %d%s\n", path.c_str(), referenceLength, fastLength, length,
+				reference != fast ? ", the bytes differ" : "");
+			failures++;
+			continue;
+		}
+
+		// alternate so that neither decoder always runs on a warmer cache
+		double referenceMs = 1e30, fastMs = 1e30;
+		for (int round = 0; round < 3; round++) {
+			referenceMs = std::min(referenceMs, time(referenceInflate, reference, stream));
+			fastMs = std::min(fastMs, time(fastInflate, fast, stream));
+		}
+		double megabytes = (double)length / (1 << 20);
+		std::printf("  %-24s %9.0f %9.0f %9.0f %9.0f %7.2fx\n", path.c_str(), stream.size() / 1024.0, length / 1024.0,
+			megabytes / (referenceMs / 1000.0), megabytes / (fastMs / 1000.0), referenceMs / fastMs);
+	}
+
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
+#endif
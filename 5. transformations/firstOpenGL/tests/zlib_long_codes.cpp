@@ -0,0 +1,175 @@
+// stb_image's inflate against a dynamic Huffman stream whose length and distance codes are 15 bits long
+// a literal of 11 bits, a 15 bit length code with 5 extra bits and a 15 bit distance code with 13 extra bits
+// are 59 bits, more than one refill of the fast loop holds on 64 bit. the stream is built here, next to
+// the bytes it has to decode to
+//
+// build and run from this directory:
+//	g++ -std=c++14 -O2 -I.. zlib_long_codes.cpp -o zlib_long_codes && ./zlib_long_codes
+// exits with 1 when the decoded bytes differ
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#include "stb_image.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+	// deflate writes values from the lowest bit up, Huffman codes from their highest bit
+	struct BitWriter {
+		std::vector<unsigned char> bytes;
+		int used = 0;
+
+		void put(std::uint32_t value, int count) {
+			for (int i = 0; i < count; i++) {
+				if (used == 0)
+					bytes.push_back(0);
+				bytes.back() |= (unsigned char)(((value >> i) & 1) << used);
+				used = (used + 1) & 7;
+			}
+		}
+	};
+
+	// canonical Huffman code of a set of code lengths, as in RFC 1951 3.2.2
+	struct Code {
+		std::vector<int> lengths;
+		std::vector<std::uint32_t> codes;
+
+		explicit Code(const std::vector<int>& codeLengths) : lengths(codeLengths), codes(codeLengths.size()) {
+			int count[16] = {}, next[16] = {};
+			for (int length : lengths)
+				count[length]++;
+			count[0] = 0;
+			for (int bits = 1, code = 0; bits < 16; bits++) {
+				code = (code + count[bits - 1]) << 1;
+				next[bits] = code;
+			}
+			for (size_t symbol = 0; symbol < lengths.size(); symbol++)
+				if (lengths[symbol])
+					codes[symbol] = (std::uint32_t)next[lengths[symbol]]++;
+		}
+
+		void put(BitWriter& out, int symbol) const {
+			for (int i = lengths[symbol] - 1; i >= 0; i--)
+				out.put((codes[symbol] >> i) & 1, 1);
+		}
+	};
+
+	const int literals[] = { 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J' };
+
+	std::uint32_t random(std::uint32_t& state) {
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+}
+
+int main() {
+	// both codes are complete: lengths 1 to 14 once, 15 twice
+	std::vector<int> literalLengths(286, 0), distanceLengths(30, 0);
+	for (int i = 0; i < 10; i++)
+		literalLengths[literals[i]] = i + 1;
+	literalLengths['X'] = 11;
+	literalLengths[256] = 12;
+	literalLengths[257] = 13;
+	literalLengths[258] = 14;
+	// lengths 227 + 0..30 and 258
+	literalLengths[284] = 15;
+	literalLengths[285] = 15;
+	for (int i = 0; i < 14; i++)
+		distanceLengths[i] = i + 1;
+	// distances 16385 + 0..8191 and 24577 + 0..8191
+	distanceLengths[28] = 15;
+	distanceLengths[29] = 15;
+	Code literalCode(literalLengths), distanceCode(distanceLengths);
+
+	// code length code: 13 symbols of 4 bits, 6 of 5 bits, sent in the RFC's order
+	const int order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	std::vector<int> lengthLengths(19);
+	for (int symbol = 0; symbol < 19; symbol++)
+		lengthLengths[symbol] = symbol < 13 ? 4 : 5;
+	Code lengthCode(lengthLengths);
+
+	BitWriter out;
+	// zlib header, 32K window
+	out.put(0x78, 8);
+	out.put(0x01, 8);
+	out.put(1, 1);
+	out.put(2, 2);
+	out.put(286 - 257, 5);
+	out.put(30 - 1, 5);
+	out.put(19 - 4, 4);
+	for (int i = 0; i < 19; i++)
+		out.put((std::uint32_t)lengthLengths[order[i]], 3);
+	for (int length : literalLengths)
+		lengthCode.put(out, length);
+	for (int length : distanceLengths)
+		lengthCode.put(out, length);
+
+	std::vector<unsigned char> expected;
+	std::uint32_t state = 1;
+	auto literal = [&](int symbol) {
+		literalCode.put(out, symbol);
+		expected.push_back((unsigned char)symbol);
+	};
+	auto copy = [&](int length, int distance) {
+		size_t from = expected.size() - distance;
+		for (int i = 0; i < length; i++) {
+			unsigned char c = expected[from + i];
+			expected.push_back(c);
+		}
+	};
+
+	// varied bytes to copy from, more than the farthest short distance (128)
+	for (int i = 0; i < 256; i++)
+		literal(literals[random(state) % 10]);
+	// grow the output past the largest distance with 258 byte matches over short distances (codes 0 to 13)
+	while (expected.size() < 32768) {
+		literal(literals[random(state) % 10]);
+		int symbol = (int)(random(state) % 14);
+		int extraBits = symbol < 4 ? 0 : symbol / 2 - 1;
+		int base = symbol < 4 ? symbol + 1 : ((2 + (symbol & 1)) << extraBits) + 1;
+		int extra = (int)(random(state) & ((1u << extraBits) - 1));
+		literalCode.put(out, 285);
+		distanceCode.put(out, symbol);
+		out.put((std::uint32_t)extra, extraBits);
+		copy(258, base + extra);
+	}
+	// the long sequence: 11 bit literal, then a 15 + 5 bit length and a 15 + 13 bit distance
+	while (expected.size() < 80000) {
+		literal('X');
+		int lengthExtra = (int)(random(state) % 31);
+		int distanceExtra = (int)(random(state) & 8191);
+		literalCode.put(out, 284);
+		out.put((std::uint32_t)lengthExtra, 5);
+		distanceCode.put(out, 29);
+		out.put((std::uint32_t)distanceExtra, 13);
+		copy(227 + lengthExtra, 24577 + distanceExtra);
+	}
+	literalCode.put(out, 256);
+	out.used = 0;
+
+	// Adler-32, big endian
+	std::uint32_t a = 1, b = 0;
+	for (unsigned char c : expected) {
+		a = (a + c) % 65521;
+		b = (b + a) % 65521;
+	}
+	std::uint32_t adler = b << 16 | a;
+	for (int i = 3; i >= 0; i--)
+		out.bytes.push_back((unsigned char)(adler >> (i * 8)));
+
+	int length = 0;
+	char* decoded = stbi_zlib_decode_malloc((const char*)out.bytes.data(), (int)out.bytes.size(), &length);
+	bool same = decoded && length == (int)expected.size() && std::memcmp(decoded, expected.data(), expected.size()) == 0;
+	std::printf("%d byte stream, %d bytes expected, %d decoded: %s\n", (int)out.bytes.size(), (int)expected.size(),
+		decoded ? length : -1, same ? "ok" : "FAIL");
+	if (decoded && !same) {
+		int first = 0;
+		while (first < length && first < (int)expected.size() && decoded[first] == (char)expected[first])
+			first++;
+		std::printf("first difference at byte %d\n", first);
+	}
+	STBI_FREE(decoded);
+	return same ? 0 : 1;
+}
@@ -0,0 +1,272 @@
+#include "texture_atlas.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	// the top edge of the packed area of a page, as runs of the same height from left to right
+	// the runs always cover the whole page width
+	struct Skyline {
+		struct Node {
+			int x;
+			int y;
+			int width;
+		};
+		std::vector<Node> nodes;
+
+		explicit Skyline(int width) : nodes{ Node{ 0, 0, width } } {}
+
+		// y of a width x height rectangle whose left edge is on node i, -1 when it does not fit there
+		int fit(int i, int width, int height, int pageSize) const {
+			if (nodes[i].x + width > pageSize)
+				return -1;
+			int y = 0;
+			for (int left = width; left > 0; left -= nodes[i++].width) {
+				y = std::max(y, nodes[i].y);
+				if (y + height > pageSize)
+					return -1;
+			}
+			return y;
+		}
+
+		// bottom-left: the lowest top edge, then the narrowest node so wide gaps stay open for wide images
+		bool find(int width, int height, int pageSize, int& node, int& y) const {
+			int bestTop = INT_MAX, bestWidth = INT_MAX;
+			node = -1;
+			for (int i = 0; i < (int)nodes.size(); i++) {
+				int at = fit(i, width, height, pageSize);
+				if (at < 0)
+					continue;
+				if (at + height < bestTop || (at + height == bestTop && nodes[i].width < bestWidth)) {
+					bestTop = at + height;
+					bestWidth = nodes[i].width;
+					node = i;
+					y = at;
+				}
+			}
+			return node >= 0;
+		}
+
+		// raise the skyline under a rectangle placed on node i
+		void place(int i, int width, int top) {
+			int x = nodes[i].x;
+			nodes.insert(nodes.begin() + i, Node{ x, top, width });
+			// cut away what the rectangle covers of the nodes to its right
+			for (size_t j = i + 1; j < nodes.size();) {
+				int covered = x + width - nodes[j].x;
+				if (covered <= 0)
+					break;
+				if (covered < nodes[j].width) {
+					nodes[j].x += covered;
+					nodes[j].width -= covered;
+					break;
+				}
+				nodes.erase(nodes.begin() + j);
+			}
+			// merge runs of the same height
+			for (size_t j = 0; j + 1 < nodes.size();) {
+				if (nodes[j].y == nodes[j + 1].y) {
+					nodes[j].width += nodes[j + 1].width;
+					nodes.erase(nodes.begin() + j + 1);
+				}
+				else {
+					j++;
+				}
+			}
+		}
+
+		int top() const {
+			int y = 0;
+			for (const Node& node : nodes)
+				y = std::max(y, node.y);
+			return y;
+		}
+	};
+
+	// images copied per task, so 10k tiny images are not 10k tasks
+	const int imagesPerTask = 64;
+}
+
+TextureAtlas::TextureAtlas(int pageSize, int padding, int maxPages) : size(pageSize), padding(padding), maxPages(maxPages) {
+}
+
+TextureAtlas::~TextureAtlas() {
+	if (atlasTexture)
+		glDeleteTextures(1, &atlasTexture);
+	if (remapTextureName)
+		glDeleteTextures(1, &remapTextureName);
+	if (remapBuffer)
+		glDeleteBuffers(1, &remapBuffer);
+}
+
+int TextureAtlas::add(const unsigned char* pixels, int width, int height, int channels) {
+	if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+		std::cout << "ERROR::TEXTURE_ATLAS::INVALID_IMAGE" << std::endl;
+		return -1;
+	}
+	if (width + 2 * padding > size || height + 2 * padding > size) {
+		std::cout << "ERROR::TEXTURE_ATLAS::IMAGE_LARGER_THAN_PAGE" << std::endl;
+		return -1;
+	}
+	size_t bytes = (size_t)width * height * channels;
+	sources.push_back(Image{ width, height, channels, sourcePixels.size() });
+	sourcePixels.insert(sourcePixels.end(), pixels, pixels + bytes);
+	return (int)sources.size() - 1;
+}
+
+bool TextureAtlas::build(ThreadPool* pool) {
+	regions.assign(sources.size(), Region{ 0, 0, 0, 0, 0 });
+	remap.clear();
+	atlas.clear();
+	pageCount = 0;
+	height = 0;
+	if (sources.empty())
+		return true;
+
+	// tallest first, then widest, keeps the skyline flat
+	std::vector<int> order(sources.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = (int)i;
+	std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+		if (sources[a].height != sources[b].height)
+			return sources[a].height > sources[b].height;
+		return sources[a].width > sources[b].width;
+	});
+
+	// every image goes on the first page it fits, a new page when none has room
+	std::vector<Skyline> skylines;
+	for (int i : order) {
+		int width = sources[i].width + 2 * padding, imageHeight = sources[i].height + 2 * padding;
+		int node = -1, y = 0;
+		size_t page = 0;
+		for (; page < skylines.size(); page++)
+			if (skylines[page].find(width, imageHeight, size, node, y))
+				break;
+		if (page == skylines.size()) {
+			if ((int)page == maxPages) {
+				std::cout << "ERROR::TEXTURE_ATLAS::OUT_OF_PAGES" << std::endl;
+				regions.clear();
+				return false;
+			}
+			skylines.push_back(Skyline(size));
+			skylines.back().find(width, imageHeight, size, node, y);
+		}
+		Skyline& skyline = skylines[page];
+		regions[i] = Region{ (int)page, skyline.nodes[node].x + padding, y + padding, sources[i].width, sources[i].height };
+		skyline.place(node, width, y + imageHeight);
+	}
+
+	// a single page only needs the rows in use, a multiple of 4 like a compressed texture would
+	pageCount = (int)skylines.size();
+	height = pageCount == 1 ? std::min((skylines[0].top() + 3) / 4 * 4, size) : size;
+
+	atlas.assign((size_t)size * height * 4 * pageCount, 0);
+	int tasks = ((int)sources.size() + imagesPerTask - 1) / imagesPerTask;
+	auto copy = [this](int task) {
+		int end = std::min((task + 1) * imagesPerTask, (int)sources.size());
+		for (int i = task * imagesPerTask; i < end; i++)
+			blit(i);
+	};
+	if (pool && tasks > 1)
+		pool->parallelFor(tasks, copy);
+	else
+		for (int task = 0; task < tasks; task++)
+			copy(task);
+
+	remap.reserve(regions.size() * 2);
+	for (const Region& region : regions) {
+		remap.push_back(glm::vec4((float)region.x / size, (float)region.y / height,
+			(float)region.width / size, (float)region.height / height));
+		remap.push_back(glm::vec4((float)region.layer, 0.0f, 0.0f, 0.0f));
+	}
+	return true;
+}
+
+void TextureAtlas::blit(int i) {
+	const Image& image = sources[i];
+	const Region& region = regions[i];
+	const unsigned char* src = sourcePixels.data() + image.offset;
+	unsigned char* page = atlas.data() + (size_t)region.layer * size * height * 4;
+	// the border repeats the edge rows and columns, clamped like GL_CLAMP_TO_EDGE
+	for (int y = -padding; y < image.height + padding; y++) {
+		int sy = std::min(std::max(y, 0), image.height - 1);
+		const unsigned char* row = src + (size_t)sy * image.width * image.channels;
+		unsigned char* dst = page + ((size_t)(region.y + y) * size + region.x - padding) * 4;
+		for (int x = -padding; x < image.width + padding; x++, dst += 4) {
+			const unsigned char* p = row + (size_t)std::min(std::max(x, 0), image.width - 1) * image.channels;
+			switch (image.channels) {
+			case 4:
+				std::memcpy(dst, p, 4);
+				break;
+			case 3:
+				dst[0] = p[0];
+				dst[1] = p[1];
+				dst[2] = p[2];
+				dst[3] = 255;
+				break;
+			default:
+				dst[0] = p[0];
+				dst[1] = image.channels == 2 ? p[1] : 0;
+				dst[2] = 0;
+				dst[3] = 255;
+				break;
+			}
+		}
+	}
+}
+
+bool TextureAtlas::upload() {
+	if (pageCount == 0)
+		return false;
+	GLint maxSize = 0, maxLayers = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	if (size > maxSize || (pageCount > 1 && pageCount > maxLayers)) {
+		std::cout << "ERROR::TEXTURE_ATLAS::TOO_LARGE_FOR_DRIVER" << std::endl;
+		return false;
+	}
+
+	GLenum atlasTarget = target();
+	if (!atlasTexture)
+		glGenTextures(1, &atlasTexture);
+	glBindTexture(atlasTarget, atlasTexture);
+	// storage first, then every page in one call
+	if (atlasTarget == GL_TEXTURE_2D) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, height, GL_RGBA, GL_UNSIGNED_BYTE, atlas.data());
+	}
+	else {
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, height, pageCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, size, height, pageCount, GL_RGBA, GL_UNSIGNED_BYTE, atlas.data());
+	}
+	// no mip levels, the texture is complete with level 0 alone
+	glTexParameteri(atlasTarget, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(atlasTarget, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(atlasTarget, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(atlasTarget, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(atlasTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// a uniform block holds a few thousand entries at most, a texture buffer any number
+	if (!remapBuffer)
+		glGenBuffers(1, &remapBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, remapBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, remap.size() * sizeof(glm::vec4), remap.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if (!remapTextureName)
+		glGenTextures(1, &remapTextureName);
+	glBindTexture(GL_TEXTURE_BUFFER, remapTextureName);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, remapBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	return true;
+}
+
+double TextureAtlas::occupancy() const {
+	if (pageCount == 0)
+		return 0.0;
+	double used = 0;
+	for (const Region& region : regions)
+		used += (double)region.width * region.height;
+	return used / ((double)size * height * pageCount);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+#include "glm/glm.hpp"
+
+class ThreadPool;
+
+// many small 8 bit images (what stbi_load returns) packed into the pages of one texture, so a scene of sprites
+// draws with a single bind. images are packed with a skyline packer, tallest first, into square pages:
+// one page is a GL_TEXTURE_2D trimmed to the height in use, more pages are the layers of a GL_TEXTURE_2D_ARRAY
+// every image keeps a border of its edge pixels, linear filtering does not pick up its neighbours
+// the atlas has no mip levels, the borders would have to grow with every level
+class TextureAtlas {
+public:
+	// where an image ended up, in pixels of its page
+	struct Region {
+		int layer;
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	// pageSize: width and height of a page, at most GL_MAX_TEXTURE_SIZE. padding: border pixels around every image
+	explicit TextureAtlas(int pageSize = 2048, int padding = 1, int maxPages = 64);
+	// deletes the textures, on the render thread
+	~TextureAtlas();
+
+	TextureAtlas(const TextureAtlas&) = delete;
+	TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+	// copies the pixels, 1 to 4 channels stored as RGBA the way GL samples GL_RED, GL_RG and GL_RGB (0 for
+	// green and blue, 255 for alpha). returns the index of the image, -1 when it does not fit in a page
+	int add(const unsigned char* pixels, int width, int height, int channels);
+
+	// packs every image added so far and copies them into the pages, the copies split across the pool's workers
+	// false when they do not fit in maxPages, the atlas is empty then
+	bool build(ThreadPool* pool = nullptr);
+
+	// render thread: the pages in one glTexSubImage2D or glTexSubImage3D, and the remap table in a texture buffer
+	bool upload();
+
+	int images() const { return (int)regions.size(); }
+	int pages() const { return pageCount; }
+	int pageWidth() const { return size; }
+	int pageHeight() const { return height; }
+	const Region& region(int i) const { return regions[i]; }
+	// the pages one after another, RGBA, valid after build()
+	const unsigned char* pixels() const { return atlas.data(); }
+
+	// two texels per image, the texture coordinates of a quad in [0, 1] become uv * scale + offset on layer:
+	//	texel 2i: (offset.u, offset.v, scale.u, scale.v), texel 2i + 1: (layer, 0, 0, 0)
+	// in GLSL, with the image index of the sprite:
+	//	uniform samplerBuffer remap;
+	//	vec4 r = texelFetch(remap, 2 * image);
+	//	vec3 atlasUv = vec3(uv * r.zw + r.xy, texelFetch(remap, 2 * image + 1).x);
+	const std::vector<glm::vec4>& remapTable() const { return remap; }
+
+	// area of the images (without borders) over the area of the pages
+	double occupancy() const;
+
+	// GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	GLenum target() const { return pageCount > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D; }
+	unsigned int texture() const { return atlasTexture; }
+	// GL_TEXTURE_BUFFER, GL_RGBA32F
+	unsigned int remapTexture() const { return remapTextureName; }
+
+private:
+	struct Image {
+		int width;
+		int height;
+		int channels;
+		size_t offset;
+	};
+
+	int size;
+	int padding;
+	int maxPages;
+	int pageCount = 0;
+	int height = 0;
+	std::vector<Image> sources;
+	std::vector<unsigned char> sourcePixels;
+	std::vector<Region> regions;
+	std::vector<unsigned char> atlas;
+	std::vector<glm::vec4> remap;
+	unsigned int atlasTexture = 0;
+	unsigned int remapBuffer = 0;
+	unsigned int remapTextureName = 0;
+
+	void blit(int i);
+};
+
+#endif
@@ -0,0 +1,977 @@
+#include "texture_compress.h"
+#include "mipmap.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <limits>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TEXCOMPRESS_X86
+#include <emmintrin.h>
+#endif
+
+namespace {
+	typedef uint8_t Pixel[4];
+
+	// ---------------------------------------------------------------------------------------------
+	// closest palette entry of each of the 16 pixels of a block, by squared RGBA distance
+	// returns the summed distance, ties go to the lower index
+	// ---------------------------------------------------------------------------------------------
+
+	uint32_t nearestScalar(const Pixel* pixels, const Pixel* palette, int entries, uint8_t* indices) {
+		uint32_t total = 0;
+		for (int i = 0; i < 16; i++) {
+			int best = INT_MAX;
+			for (int k = 0; k < entries; k++) {
+				int distance = 0;
+				for (int c = 0; c < 4; c++) {
+					int d = pixels[i][c] - palette[k][c];
+					distance += d * d;
+				}
+				if (distance < best) {
+					best = distance;
+					indices[i] = (uint8_t)k;
+				}
+			}
+			total += (uint32_t)best;
+		}
+		return total;
+	}
+
+#ifdef TEXCOMPRESS_X86
+	__m128i select(__m128i mask, __m128i a, __m128i b) {
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	// 4 pixels a vector as 16 bit (r, g) and (b, a) pairs, _mm_madd_epi16 squares and adds a pair in one step
+	uint32_t nearestSse2(const Pixel* pixels, const Pixel* palette, int entries, uint8_t* indices) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i rg[4], ba[4], best[4], bestIndex[4];
+		for (int i = 0; i < 4; i++) {
+			__m128i p = _mm_loadu_si128((const __m128i*)pixels[i * 4]);
+			// rg0 ba0 rg1 ba1 -> rg0 rg1 ba0 ba1
+			__m128i low = _mm_shuffle_epi32(_mm_unpacklo_epi8(p, zero), _MM_SHUFFLE(3, 1, 2, 0));
+			__m128i high = _mm_shuffle_epi32(_mm_unpackhi_epi8(p, zero), _MM_SHUFFLE(3, 1, 2, 0));
+			rg[i] = _mm_unpacklo_epi64(low, high);
+			ba[i] = _mm_unpackhi_epi64(low, high);
+			best[i] = _mm_set1_epi32(INT_MAX);
+			bestIndex[i] = zero;
+		}
+		for (int k = 0; k < entries; k++) {
+			__m128i entryRg = _mm_set1_epi32(palette[k][0] | palette[k][1] << 16);
+			__m128i entryBa = _mm_set1_epi32(palette[k][2] | palette[k][3] << 16);
+			__m128i index = _mm_set1_epi32(k);
+			for (int i = 0; i < 4; i++) {
+				__m128i dRg = _mm_sub_epi16(rg[i], entryRg);
+				__m128i dBa = _mm_sub_epi16(ba[i], entryBa);
+				__m128i distance = _mm_add_epi32(_mm_madd_epi16(dRg, dRg), _mm_madd_epi16(dBa, dBa));
+				__m128i closer = _mm_cmplt_epi32(distance, best[i]);
+				best[i] = select(closer, distance, best[i]);
+				bestIndex[i] = select(closer, index, bestIndex[i]);
+			}
+		}
+		__m128i sum = zero;
+		for (int i = 0; i < 4; i++) {
+			sum = _mm_add_epi32(sum, best[i]);
+			// indices are below 16, pack the 4 lanes into 4 bytes
+			__m128i packed = _mm_packus_epi16(_mm_packs_epi32(bestIndex[i], zero), zero);
+			uint32_t four = (uint32_t)_mm_cvtsi128_si32(packed);
+			std::memcpy(indices + i * 4, &four, 4);
+		}
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+		return (uint32_t)_mm_cvtsi128_si32(sum);
+	}
+#endif
+
+	std::atomic<bool> simdEnabled(true);
+
+	uint32_t nearest(const Pixel* pixels, const Pixel* palette, int entries, uint8_t* indices) {
+#ifdef TEXCOMPRESS_X86
+		if (simdEnabled.load(std::memory_order_relaxed))
+			return nearestSse2(pixels, palette, entries, indices);
+#endif
+		return nearestScalar(pixels, palette, entries, indices);
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// endpoint fitting, shared by the BC1 colour and BC7 blocks
+	// ---------------------------------------------------------------------------------------------
+
+	// the pixels with the lowest and highest projection on the principal axis of the first `channels` channels
+	void principalEndpoints(const Pixel* pixels, int channels, float* low, float* high) {
+		float mean[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < channels; c++)
+				mean[c] += pixels[i][c];
+		for (int c = 0; c < channels; c++)
+			mean[c] /= 16.0f;
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++) {
+			float d[4];
+			for (int c = 0; c < channels; c++)
+				d[c] = pixels[i][c] - mean[c];
+			for (int a = 0; a < channels; a++)
+				for (int b = a; b < channels; b++)
+					covariance[a][b] += d[a] * d[b];
+		}
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < a; b++)
+				covariance[a][b] = covariance[b][a];
+
+		// power iteration, starting from the channel that varies most
+		float axis[4] = { 0, 0, 0, 0 };
+		int widest = 0;
+		for (int c = 1; c < channels; c++)
+			if (covariance[c][c] > covariance[widest][widest])
+				widest = c;
+		axis[widest] = 1.0f;
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float next[4] = { 0, 0, 0, 0 };
+			float length = 0;
+			for (int a = 0; a < channels; a++) {
+				for (int b = 0; b < channels; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::fabs(next[a]));
+			}
+			if (length < 1e-6f)
+				break;
+			for (int c = 0; c < channels; c++)
+				axis[c] = next[c] / length;
+		}
+
+		int lowest = 0, highest = 0;
+		float lowestDot = std::numeric_limits<float>::max(), highestDot = -lowestDot;
+		for (int i = 0; i < 16; i++) {
+			float dot = 0;
+			for (int c = 0; c < channels; c++)
+				dot += (pixels[i][c] - mean[c]) * axis[c];
+			if (dot < lowestDot) {
+				lowestDot = dot;
+				lowest = i;
+			}
+			if (dot > highestDot) {
+				highestDot = dot;
+				highest = i;
+			}
+		}
+		for (int c = 0; c < 4; c++) {
+			low[c] = pixels[lowest][c];
+			high[c] = pixels[highest][c];
+		}
+	}
+
+	// endpoints e0, e1 minimising the squared error of pixel i against (1 - w[i]) * e0 + w[i] * e1
+	// false when the weights do not determine them (every pixel on the same step)
+	bool leastSquares(const Pixel* pixels, const float* weights, int channels, float* e0, float* e1) {
+		float aa = 0, ab = 0, bb = 0, ax[4] = {}, bx[4] = {};
+		for (int i = 0; i < 16; i++) {
+			float b = weights[i], a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int c = 0; c < channels; c++) {
+				ax[c] += a * pixels[i][c];
+				bx[c] += b * pixels[i][c];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		float inverse = 1.0f / determinant;
+		for (int c = 0; c < channels; c++) {
+			e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) * inverse, 0.0f), 255.0f);
+			e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) * inverse, 0.0f), 255.0f);
+		}
+		return true;
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// BC1 colour block, also the second half of BC3
+	// ---------------------------------------------------------------------------------------------
+
+	uint16_t pack565(const float* rgb) {
+		int r = (int)(rgb[0] * 31.0f / 255.0f + 0.5f);
+		int g = (int)(rgb[1] * 63.0f / 255.0f + 0.5f);
+		int b = (int)(rgb[2] * 31.0f / 255.0f + 0.5f);
+		return (uint16_t)(r << 11 | g << 5 | b);
+	}
+
+	void unpack565(uint16_t color, uint8_t* rgba) {
+		int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+		rgba[0] = (uint8_t)(r << 3 | r >> 2);
+		rgba[1] = (uint8_t)(g << 2 | g >> 4);
+		rgba[2] = (uint8_t)(b << 3 | b >> 2);
+		rgba[3] = 255;
+	}
+
+	// BC1 uses the 3 colour palette (and transparent black) when c0 <= c1, the colour block of BC3 never does
+	void colorPalette(uint16_t c0, uint16_t c1, bool alwaysFour, Pixel* palette) {
+		unpack565(c0, palette[0]);
+		unpack565(c1, palette[1]);
+		bool four = alwaysFour || c0 > c1;
+		for (int c = 0; c < 3; c++) {
+			if (four) {
+				palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+				palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+			}
+			else {
+				palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+				palette[3][c] = 0;
+			}
+		}
+		palette[2][3] = 255;
+		palette[3][3] = four ? 255 : 0;
+	}
+
+	void writeColorBlock(uint16_t c0, uint16_t c1, const uint8_t* indices, uint8_t* out) {
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= (uint32_t)indices[i] << (i * 2);
+		out[0] = (uint8_t)c0;
+		out[1] = (uint8_t)(c0 >> 8);
+		out[2] = (uint8_t)c1;
+		out[3] = (uint8_t)(c1 >> 8);
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = (uint8_t)(bits >> (i * 8));
+	}
+
+	// pixels with alpha 255, the 4 colour palette only so the block decodes the same as part of BC1 and of BC3
+	void encodeColorBlock(const Pixel* pixels, uint8_t* out) {
+		static const float stepWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		float low[4], high[4];
+		principalEndpoints(pixels, 3, low, high);
+
+		uint32_t bestError = UINT_MAX;
+		uint16_t best0 = 0, best1 = 0;
+		uint8_t bestIndices[16] = {};
+		for (int iteration = 0; iteration < 3; iteration++) {
+			uint16_t c0 = pack565(high), c1 = pack565(low);
+			// c0 > c1 selects the 4 colour palette
+			if (c0 < c1)
+				std::swap(c0, c1);
+			Pixel palette[4];
+			colorPalette(c0, c1, false, palette);
+			uint8_t indices[16];
+			// c0 == c1 is the 3 colour palette, only its first entry is used
+			uint32_t error = nearest(pixels, palette, c0 == c1 ? 1 : 4, indices);
+			if (error < bestError) {
+				bestError = error;
+				best0 = c0;
+				best1 = c1;
+				std::memcpy(bestIndices, indices, 16);
+			}
+			if (error == 0 || c0 == c1)
+				break;
+			float weights[16];
+			for (int i = 0; i < 16; i++)
+				weights[i] = stepWeights[indices[i]];
+			float e0[4], e1[4];
+			if (!leastSquares(pixels, weights, 3, e0, e1))
+				break;
+			std::memcpy(high, e0, sizeof(e0));
+			std::memcpy(low, e1, sizeof(e1));
+		}
+		writeColorBlock(best0, best1, bestIndices, out);
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// BC3 alpha block
+	// ---------------------------------------------------------------------------------------------
+
+	// 8 steps when a0 > a1, otherwise 6 and the values 0 and 255
+	void alphaPalette(int a0, int a1, int* palette) {
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1) {
+			for (int k = 2; k < 8; k++)
+				palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		}
+		else {
+			for (int k = 2; k < 6; k++)
+				palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	void encodeAlphaBlock(const Pixel* pixels, uint8_t* out) {
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++) {
+			a0 = std::max(a0, (int)pixels[i][3]);
+			a1 = std::min(a1, (int)pixels[i][3]);
+		}
+		int palette[8];
+		alphaPalette(a0, a1, palette);
+		uint64_t bits = 0;
+		for (int i = 0; i < 16 && a0 != a1; i++) {
+			int best = INT_MAX, index = 0;
+			for (int k = 0; k < 8; k++) {
+				int d = std::abs(pixels[i][3] - palette[k]);
+				if (d < best) {
+					best = d;
+					index = k;
+				}
+			}
+			bits |= (uint64_t)index << (i * 3);
+		}
+		out[0] = (uint8_t)a0;
+		out[1] = (uint8_t)a1;
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = (uint8_t)(bits >> (i * 8));
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// BC7 mode 6: 7 bit RGBA endpoints with one extra low bit each (the p-bit), 4 bit indices
+	// ---------------------------------------------------------------------------------------------
+
+	const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct Bc7Endpoint {
+		uint8_t value[4];  // 7 bits
+		uint8_t pbit;
+	};
+
+	// the p-bit that lands closer to e over all 4 channels
+	Bc7Endpoint quantizeBc7(const float* e) {
+		Bc7Endpoint best = {};
+		float bestError = std::numeric_limits<float>::max();
+		for (int p = 0; p < 2; p++) {
+			Bc7Endpoint candidate;
+			candidate.pbit = (uint8_t)p;
+			float error = 0;
+			for (int c = 0; c < 4; c++) {
+				int q = std::min(std::max((int)std::floor((e[c] - p) / 2.0f + 0.5f), 0), 127);
+				candidate.value[c] = (uint8_t)q;
+				float d = (q * 2 + p) - e[c];
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	void bc7Palette(const Bc7Endpoint& e0, const Bc7Endpoint& e1, Pixel* palette) {
+		for (int c = 0; c < 4; c++) {
+			int v0 = e0.value[c] << 1 | e0.pbit, v1 = e1.value[c] << 1 | e1.pbit;
+			for (int k = 0; k < 16; k++)
+				palette[k][c] = (uint8_t)(((64 - bc7Weights[k]) * v0 + bc7Weights[k] * v1 + 32) >> 6);
+		}
+	}
+
+	struct BitWriter {
+		uint8_t* out;
+		int position;
+
+		void put(uint32_t value, int bits) {
+			for (int i = 0; i < bits; i++, position++)
+				if ((value >> i) & 1)
+					out[position >> 3] |= (uint8_t)(1 << (position & 7));
+		}
+	};
+
+	struct BitReader {
+		const uint8_t* in;
+		int position;
+
+		uint32_t get(int bits) {
+			uint32_t value = 0;
+			for (int i = 0; i < bits; i++, position++)
+				value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+			return value;
+		}
+	};
+
+	void encodeBc7Block(const Pixel* pixels, uint8_t* out) {
+		float low[4], high[4];
+		principalEndpoints(pixels, 4, low, high);
+
+		uint32_t bestError = UINT_MAX;
+		Bc7Endpoint best0 = {}, best1 = {};
+		uint8_t bestIndices[16] = {};
+		for (int iteration = 0; iteration < 3; iteration++) {
+			Bc7Endpoint e0 = quantizeBc7(low), e1 = quantizeBc7(high);
+			Pixel palette[16];
+			bc7Palette(e0, e1, palette);
+			uint8_t indices[16];
+			uint32_t error = nearest(pixels, palette, 16, indices);
+			if (error < bestError) {
+				bestError = error;
+				best0 = e0;
+				best1 = e1;
+				std::memcpy(bestIndices, indices, 16);
+			}
+			if (error == 0)
+				break;
+			float weights[16];
+			for (int i = 0; i < 16; i++)
+				weights[i] = bc7Weights[indices[i]] / 64.0f;
+			if (!leastSquares(pixels, weights, 4, low, high))
+				break;
+		}
+
+		// the index of the first pixel is stored without its top bit, which must be 0
+		if (bestIndices[0] & 8) {
+			std::swap(best0, best1);
+			for (int i = 0; i < 16; i++)
+				bestIndices[i] = (uint8_t)(15 - bestIndices[i]);
+		}
+		std::memset(out, 0, 16);
+		BitWriter bits = { out, 0 };
+		bits.put(1 << 6, 7);
+		for (int c = 0; c < 4; c++) {
+			bits.put(best0.value[c], 7);
+			bits.put(best1.value[c], 7);
+		}
+		bits.put(best0.pbit, 1);
+		bits.put(best1.pbit, 1);
+		bits.put(bestIndices[0], 3);
+		for (int i = 1; i < 16; i++)
+			bits.put(bestIndices[i], 4);
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// decoding, the inverse of the encoders above
+	// ---------------------------------------------------------------------------------------------
+
+	void decodeColorBlock(const uint8_t* in, bool alwaysFour, Pixel* pixels) {
+		uint16_t c0 = (uint16_t)(in[0] | in[1] << 8), c1 = (uint16_t)(in[2] | in[3] << 8);
+		uint32_t bits = (uint32_t)in[4] | (uint32_t)in[5] << 8 | (uint32_t)in[6] << 16 | (uint32_t)in[7] << 24;
+		Pixel palette[4];
+		colorPalette(c0, c1, alwaysFour, palette);
+		for (int i = 0; i < 16; i++)
+			std::memcpy(pixels[i], palette[(bits >> (i * 2)) & 3], 4);
+	}
+
+	void decodeAlphaBlock(const uint8_t* in, Pixel* pixels) {
+		int palette[8];
+		alphaPalette(in[0], in[1], palette);
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; i++)
+			bits |= (uint64_t)in[2 + i] << (i * 8);
+		for (int i = 0; i < 16; i++)
+			pixels[i][3] = (uint8_t)palette[(bits >> (i * 3)) & 7];
+	}
+
+	// blocks in the other modes, which this encoder never writes, decode to transparent black
+	void decodeBc7Block(const uint8_t* in, Pixel* pixels) {
+		if ((in[0] & 0x7f) != 0x40) {
+			std::memset(pixels, 0, 16 * 4);
+			return;
+		}
+		BitReader bits = { in, 7 };
+		Bc7Endpoint e0, e1;
+		for (int c = 0; c < 4; c++) {
+			e0.value[c] = (uint8_t)bits.get(7);
+			e1.value[c] = (uint8_t)bits.get(7);
+		}
+		e0.pbit = (uint8_t)bits.get(1);
+		e1.pbit = (uint8_t)bits.get(1);
+		Pixel palette[16];
+		bc7Palette(e0, e1, palette);
+		for (int i = 0; i < 16; i++)
+			std::memcpy(pixels[i], palette[bits.get(i == 0 ? 3 : 4)], 4);
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// levels
+	// ---------------------------------------------------------------------------------------------
+
+	size_t blockSize(BlockFormat format) {
+		return format == BLOCK_BC1 ? 8 : 16;
+	}
+
+	size_t levelSize(BlockFormat format, int width, int height) {
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+	}
+
+	struct EncodeJob {
+		const uint8_t* src;
+		int width;
+		int height;
+		int channels;
+		BlockFormat format;
+		uint8_t* dst;
+	};
+
+	// the 4x4 block at (bx, by) as RGBA, edge pixels repeated past the right and bottom of the level
+	void gatherBlock(const EncodeJob& job, int bx, int by, bool opaque, Pixel* pixels) {
+		for (int y = 0; y < 4; y++) {
+			int sy = std::min(by * 4 + y, job.height - 1);
+			for (int x = 0; x < 4; x++) {
+				int sx = std::min(bx * 4 + x, job.width - 1);
+				const uint8_t* p = job.src + ((size_t)sy * job.width + sx) * job.channels;
+				uint8_t* d = pixels[y * 4 + x];
+				d[0] = p[0];
+				d[1] = job.channels > 1 ? p[1] : 0;
+				d[2] = job.channels > 2 ? p[2] : 0;
+				d[3] = job.channels > 3 && !opaque ? p[3] : 255;
+			}
+		}
+	}
+
+	void encodeRows(const EncodeJob& job, int rowBegin, int rowEnd) {
+		int blocksX = (job.width + 3) / 4;
+		size_t size = blockSize(job.format);
+		for (int by = rowBegin; by < rowEnd; by++) {
+			for (int bx = 0; bx < blocksX; bx++) {
+				uint8_t* out = job.dst + ((size_t)by * blocksX + bx) * size;
+				Pixel pixels[16];
+				switch (job.format) {
+				case BLOCK_BC1:
+					gatherBlock(job, bx, by, true, pixels);
+					encodeColorBlock(pixels, out);
+					break;
+				case BLOCK_BC3:
+					gatherBlock(job, bx, by, false, pixels);
+					encodeAlphaBlock(pixels, out);
+					for (Pixel& pixel : pixels)
+						pixel[3] = 255;
+					encodeColorBlock(pixels, out + 8);
+					break;
+				case BLOCK_BC7:
+					gatherBlock(job, bx, by, false, pixels);
+					encodeBc7Block(pixels, out);
+					break;
+				}
+			}
+		}
+	}
+
+	// below this many blocks a level is not worth splitting across threads
+	const int parallelThreshold = 4096;
+
+	void runLevel(const EncodeJob& job, ThreadPool* pool) {
+		int blockRows = (job.height + 3) / 4;
+		int blocks = blockRows * ((job.width + 3) / 4);
+		if (!pool || blocks < parallelThreshold || blockRows < 2) {
+			encodeRows(job, 0, blockRows);
+			return;
+		}
+		// one band per worker plus one for this thread
+		int bands = std::min((int)pool->size() + 1, blockRows);
+		std::vector<std::future<void>> running;
+		for (int band = 1; band < bands; band++) {
+			int begin = blockRows * band / bands, end = blockRows * (band + 1) / bands;
+			running.push_back(pool->submit([&job, begin, end]() { encodeRows(job, begin, end); }));
+		}
+		encodeRows(job, 0, blockRows / bands);
+		for (std::future<void>& band : running)
+			band.get();
+	}
+
+	// ---------------------------------------------------------------------------------------------
+	// KTX2 container
+	// ---------------------------------------------------------------------------------------------
+
+	struct Ktx2Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	struct Ktx2Level {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	const uint8_t ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	const char keyName[] = "texture_cache.key";
+
+	// VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK
+	uint32_t vkFormatOf(BlockFormat format) {
+		return format == BLOCK_BC1 ? 131 : format == BLOCK_BC3 ? 137 : 145;
+	}
+
+	bool blockFormatOf(uint32_t vkFormat, BlockFormat& format) {
+		switch (vkFormat) {
+		case 131: format = BLOCK_BC1; return true;
+		case 137: format = BLOCK_BC3; return true;
+		case 145: format = BLOCK_BC7; return true;
+		}
+		return false;
+	}
+
+	// basic data format descriptor block: colour model, linear BT.709, 4x4 texels, one sample per block half
+	std::vector<uint32_t> dataFormatDescriptor(BlockFormat format) {
+		// KHR_DF_MODEL_BC1A, KHR_DF_MODEL_BC3, KHR_DF_MODEL_BC7
+		uint32_t model = format == BLOCK_BC1 ? 128 : format == BLOCK_BC3 ? 130 : 134;
+		std::vector<uint32_t> samples;
+		if (format == BLOCK_BC3) {
+			// alpha (channel 15) in bits 0-63, colour (channel 0) in bits 64-127
+			samples.insert(samples.end(), { 0u | 63u << 16 | 15u << 24, 0, 0, 0xFFFFFFFFu });
+			samples.insert(samples.end(), { 64u | 63u << 16, 0, 0, 0xFFFFFFFFu });
+		}
+		else {
+			uint32_t bits = (uint32_t)blockSize(format) * 8 - 1;
+			samples.insert(samples.end(), { bits << 16, 0, 0, 0xFFFFFFFFu });
+		}
+		uint32_t blockLength = 24 + (uint32_t)samples.size() * 4;
+		std::vector<uint32_t> words = {
+			4 + blockLength,
+			0,                                   // vendor 0 (Khronos), descriptor type 0 (basic)
+			2 | blockLength << 16,               // version 1.3
+			model | 1 << 8 | 1 << 16,            // BT.709 primaries, linear transfer, straight alpha
+			3 | 3 << 8,                          // texel block 4x4x1x1
+			(uint32_t)blockSize(format),         // bytes in plane 0
+			0
+		};
+		words.insert(words.end(), samples.begin(), samples.end());
+		return words;
+	}
+
+	size_t align(size_t offset, size_t alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+}
+
+// ---------------------------------------------------------------------------------------------
+// a read-only mapping of a whole file
+// ---------------------------------------------------------------------------------------------
+
+struct CompressedChain::Mapping {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE handle = nullptr;
+#endif
+
+	bool open(const std::string& path) {
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER length;
+		if (GetFileSizeEx(file, &length) && length.QuadPart > 0 && (unsigned long long)length.QuadPart <= SIZE_MAX)
+			handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		// the mapping keeps the file open
+		CloseHandle(file);
+		if (!handle)
+			return false;
+		data = (const unsigned char*)MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+		if (!data) {
+			CloseHandle(handle);
+			handle = nullptr;
+			return false;
+		}
+		size = (size_t)length.QuadPart;
+		return true;
+#else
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		void* view = MAP_FAILED;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+			view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		// the mapping keeps the file open
+		close(file);
+		if (view == MAP_FAILED)
+			return false;
+		data = (const unsigned char*)view;
+		size = (size_t)info.st_size;
+		return true;
+#endif
+	}
+
+	~Mapping() {
+		if (!data)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(handle);
+#else
+		munmap((void*)data, size);
+#endif
+	}
+};
+
+CompressedChain::CompressedChain() {
+}
+
+CompressedChain::~CompressedChain() {
+}
+
+void CompressedChain::useSimd(bool enabled) {
+	simdEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool CompressedChain::build(const MipChain& mips, int channels, BlockFormat format, ThreadPool* pool) {
+	mapping.reset();
+	chain.clear();
+	storage.clear();
+	base = nullptr;
+	blockFormat = format;
+	if (mips.levels() == 0 || channels < 1 || channels > 4) {
+		std::cout << "ERROR::TEXTURE_COMPRESS::INVALID_IMAGE" << std::endl;
+		return false;
+	}
+
+	size_t total = 0;
+	for (int i = 0; i < mips.levels(); i++) {
+		const MipChain::Level& level = mips.level(i);
+		size_t size = levelSize(format, level.width, level.height);
+		chain.push_back(Level{ level.width, level.height, total, size });
+		total += size;
+	}
+	storage.resize(total);
+	base = storage.data();
+
+	for (int i = 0; i < levels(); i++) {
+		EncodeJob job;
+		job.src = (const uint8_t*)mips.data(i);
+		job.width = chain[i].width;
+		job.height = chain[i].height;
+		job.channels = channels;
+		job.format = format;
+		job.dst = storage.data() + chain[i].offset;
+		runLevel(job, pool);
+	}
+	return true;
+}
+
+bool CompressedChain::save(const std::string& path, std::uint64_t key) const {
+	if (chain.empty())
+		return false;
+
+	std::vector<uint32_t> dfd = dataFormatDescriptor(blockFormat);
+	char value[17];
+	std::snprintf(value, sizeof(value), "%016llx", (unsigned long long)key);
+	// key and value, both 0 terminated, after their combined length
+	uint32_t keyValueLength = (uint32_t)(sizeof(keyName) + sizeof(value));
+
+	Ktx2Header header;
+	std::memcpy(header.identifier, ktx2Identifier, sizeof(ktx2Identifier));
+	header.vkFormat = vkFormatOf(blockFormat);
+	header.typeSize = 1;
+	header.pixelWidth = (uint32_t)chain[0].width;
+	header.pixelHeight = (uint32_t)chain[0].height;
+	header.pixelDepth = 0;
+	header.layerCount = 0;
+	header.faceCount = 1;
+	header.levelCount = (uint32_t)chain.size();
+	header.supercompressionScheme = 0;
+	header.dfdByteOffset = (uint32_t)(sizeof(Ktx2Header) + chain.size() * sizeof(Ktx2Level));
+	header.dfdByteLength = (uint32_t)(dfd.size() * 4);
+	header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+	header.kvdByteLength = (uint32_t)align(4 + keyValueLength, 4);
+	header.sgdByteOffset = 0;
+	header.sgdByteLength = 0;
+
+	// level data starts block aligned, the smallest level first
+	std::vector<Ktx2Level> index(chain.size());
+	size_t offset = align(header.kvdByteOffset + header.kvdByteLength, blockSize(blockFormat));
+	for (int i = levels() - 1; i >= 0; i--) {
+		index[i].byteOffset = offset;
+		index[i].byteLength = chain[i].size;
+		index[i].uncompressedByteLength = chain[i].size;
+		offset += chain[i].size;
+	}
+
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cout << "ERROR::TEXTURE_CACHE::FILE_NOT_SUCCESFULLY_WRITTEN" << std::endl;
+			return false;
+		}
+		std::vector<char> keyValue(header.kvdByteLength, 0);
+		std::memcpy(keyValue.data(), &keyValueLength, 4);
+		std::memcpy(keyValue.data() + 4, keyName, sizeof(keyName));
+		std::memcpy(keyValue.data() + 4 + sizeof(keyName), value, sizeof(value));
+		std::vector<char> padding((size_t)index.back().byteOffset - (header.kvdByteOffset + header.kvdByteLength), 0);
+
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)index.data(), index.size() * sizeof(Ktx2Level));
+		file.write((const char*)dfd.data(), dfd.size() * 4);
+		file.write(keyValue.data(), keyValue.size());
+		file.write(padding.data(), padding.size());
+		for (int i = levels() - 1; i >= 0; i--)
+			file.write((const char*)data(i), chain[i].size);
+		if (!file) {
+			std::cout << "ERROR::TEXTURE_CACHE::FILE_NOT_SUCCESFULLY_WRITTEN" << std::endl;
+			file.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+	// rename does not replace an existing file on Windows
+	std::remove(path.c_str());
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool CompressedChain::load(const std::string& path, std::uint64_t key) {
+	chain.clear();
+	storage.clear();
+	base = nullptr;
+	mapping.reset(new Mapping());
+	if (!mapping->open(path)) {
+		mapping.reset();
+		return false;
+	}
+	const unsigned char* file = mapping->data;
+	size_t fileSize = mapping->size;
+
+	Ktx2Header header;
+	BlockFormat format;
+	bool valid = fileSize >= sizeof(header);
+	if (valid) {
+		std::memcpy(&header, file, sizeof(header));
+		valid = std::memcmp(header.identifier, ktx2Identifier, sizeof(ktx2Identifier)) == 0 &&
+			blockFormatOf(header.vkFormat, format) && header.typeSize == 1 &&
+			header.pixelWidth > 0 && header.pixelHeight > 0 && header.pixelWidth <= 65536 && header.pixelHeight <= 65536 &&
+			header.pixelDepth == 0 && header.layerCount == 0 && header.faceCount == 1 && header.supercompressionScheme == 0 &&
+			header.levelCount > 0 && header.levelCount <= 17 &&
+			sizeof(header) + header.levelCount * sizeof(Ktx2Level) <= fileSize &&
+			(uint64_t)header.kvdByteOffset + header.kvdByteLength <= fileSize;
+	}
+
+	// the key value pair written by save()
+	if (valid) {
+		char value[17];
+		std::snprintf(value, sizeof(value), "%016llx", (unsigned long long)key);
+		bool found = false;
+		size_t at = header.kvdByteOffset, end = at + header.kvdByteLength;
+		while (!found && at + 4 <= end) {
+			uint32_t length;
+			std::memcpy(&length, file + at, 4);
+			if (length > end - at - 4)
+				break;
+			const char* pair = (const char*)file + at + 4;
+			found = length == sizeof(keyName) + sizeof(value) &&
+				std::memcmp(pair, keyName, sizeof(keyName)) == 0 && std::memcmp(pair + sizeof(keyName), value, sizeof(value)) == 0;
+			at += align(4 + length, 4);
+		}
+		valid = found;
+	}
+
+	// every level the size a full chain has, inside the file
+	int width = (int)header.pixelWidth, height = (int)header.pixelHeight;
+	for (uint32_t i = 0; valid && i < header.levelCount; i++) {
+		Ktx2Level level;
+		std::memcpy(&level, file + sizeof(header) + i * sizeof(Ktx2Level), sizeof(level));
+		size_t size = levelSize(format, width, height);
+		valid = level.byteLength == size && level.byteOffset <= fileSize && size <= fileSize - level.byteOffset;
+		chain.push_back(Level{ width, height, (size_t)level.byteOffset, size });
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	valid = valid && chain.back().width == 1 && chain.back().height == 1;
+	if (!valid) {
+		chain.clear();
+		mapping.reset();
+		return false;
+	}
+
+	// touch every page now, so the upload on the render thread does not wait for the disk
+	unsigned int sum = 0;
+	for (size_t i = 0; i < fileSize; i += 4096)
+		sum += file[i];
+	volatile unsigned int sink = sum;
+	(void)sink;
+
+	blockFormat = format;
+	base = file;
+	return true;
+}
+
+GLenum CompressedChain::internalFormat(BlockFormat format) {
+	switch (format) {
+	case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BLOCK_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+bool CompressedChain::supported(BlockFormat format) {
+	int count = 0;
+	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+	if (count <= 0)
+		return false;
+	std::vector<GLint> formats(count);
+	glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+	return std::find(formats.begin(), formats.end(), (GLint)internalFormat(format)) != formats.end();
+}
+
+void CompressedChain::upload(GLenum target) const {
+	GLenum format = internalFormat(blockFormat);
+	for (int i = 0; i < levels(); i++)
+		glCompressedTexImage2D(target, i, format, chain[i].width, chain[i].height, 0, (GLsizei)chain[i].size, data(i));
+}
+
+void CompressedChain::decode(int i, unsigned char* rgba) const {
+	const Level& level = chain[i];
+	const uint8_t* in = data(i);
+	int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++, in += blockSize(blockFormat)) {
+			Pixel pixels[16];
+			switch (blockFormat) {
+			case BLOCK_BC1:
+				decodeColorBlock(in, false, pixels);
+				break;
+			case BLOCK_BC3:
+				decodeColorBlock(in + 8, true, pixels);
+				decodeAlphaBlock(in, pixels);
+				break;
+			case BLOCK_BC7:
+				decodeBc7Block(in, pixels);
+				break;
+			}
+			// blocks past the right and bottom edge keep their outside pixels to themselves
+			for (int y = 0; y < 4 && by * 4 + y < level.height; y++)
+				for (int x = 0; x < 4 && bx * 4 + x < level.width; x++)
+					std::memcpy(rgba + ((size_t)(by * 4 + y) * level.width + bx * 4 + x) * 4, pixels[y * 4 + x], 4);
+		}
+	}
+}
+
+double psnr(const unsigned char* a, const unsigned char* b, size_t count) {
+	double sum = 0;
+	for (size_t i = 0; i < count; i++) {
+		double d = (double)a[i] - b[i];
+		sum += d * d;
+	}
+	if (sum == 0 || count == 0)
+		return std::numeric_limits<double>::infinity();
+	return 10.0 * std::log10(255.0 * 255.0 / (sum / count));
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MipChain;
+class ThreadPool;
+
+// glad is generated for GL 4.0 core, S3TC is EXT_texture_compression_s3tc and BPTC is GL 4.2 / ARB_texture_compression_bptc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// 4x4 pixel blocks the GPU samples directly
+// BC1: RGB in 8 bytes (4 bits a pixel), BC3: RGBA, a BC1 colour block after an 8 byte alpha block, BC7: RGBA in 16 bytes,
+// written in mode 6 only (one pair of 8 bit RGBA endpoints, 16 steps between them)
+enum BlockFormat { BLOCK_BC1, BLOCK_BC3, BLOCK_BC7 };
+
+// a mip chain encoded into blocks, in memory after build() or in a mapped cache file after load()
+// encoding fits the endpoints of each block along its principal axis and refines them by least squares,
+// the search for the closest palette entry of every pixel runs on SSE2
+class CompressedChain {
+public:
+	struct Level {
+		int width;
+		int height;
+		size_t offset;
+		size_t size;
+	};
+
+	CompressedChain();
+	~CompressedChain();
+
+	CompressedChain(const CompressedChain&) = delete;
+	CompressedChain& operator=(const CompressedChain&) = delete;
+
+	// encodes every level of an 8 bit chain with 1 to 4 channels. the channels a texture uploaded as GL_RED, GL_RG or
+	// GL_RGB does not have are encoded as GL samples them: 0 for green and blue, 255 for alpha
+	// with a pool the block rows of each large level are split across the workers, never pass the pool this call is running on
+	bool build(const MipChain& mips, int channels, BlockFormat format, ThreadPool* pool = nullptr);
+
+	// cache file: a KTX2 container (level index, data format descriptor, levels smallest first) with key stored under
+	// "texture_cache.key", so a cache written for another source file or other settings is not used
+	// written to a temporary file first and renamed, a reader never sees half a file
+	bool save(const std::string& path, std::uint64_t key) const;
+	// maps the file and reads it in on the calling thread, the levels point into the mapping until the chain is
+	// built, loaded or destroyed again. false when the file is missing, not one save() wrote or has another key
+	bool load(const std::string& path, std::uint64_t key);
+
+	BlockFormat format() const { return blockFormat; }
+	int levels() const { return (int)chain.size(); }
+	const Level& level(int i) const { return chain[i]; }
+	const unsigned char* data(int i) const { return base + chain[i].offset; }
+
+	// glCompressedTexImage2D for every level of the texture bound to target
+	void upload(GLenum target) const;
+	// level i decoded back to 8 bit RGBA, width * height * 4 bytes, to measure an encoder against its source (see psnr)
+	void decode(int i, unsigned char* rgba) const;
+
+	static GLenum internalFormat(BlockFormat format);
+	// render thread: the driver lists the format in GL_COMPRESSED_TEXTURE_FORMATS
+	static bool supported(BlockFormat format);
+	// false forces the scalar kernels, to compare against the SIMD ones
+	static void useSimd(bool enabled);
+
+private:
+	struct Mapping;
+
+	std::unique_ptr<Mapping> mapping;
+	const unsigned char* base = nullptr;
+	std::vector<Level> chain;
+	std::vector<unsigned char> storage;
+	BlockFormat blockFormat = BLOCK_BC1;
+};
+
+// peak signal to noise ratio of b against a in dB, over count bytes of 8 bit values. infinite when they are equal
+double psnr(const unsigned char* a, const unsigned char* b, size_t count);
+
+#endif
@@ -0,0 +1,261 @@
+#include "texture_loader.h"
+#include "thread_pool.h"
+#include "stb_image.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace {
+	GLenum formatOf(int channels) {
+		switch (channels) {
+		case 1: return GL_RED;
+		case 2: return GL_RG;
+		case 3: return GL_RGB;
+		}
+		return GL_RGBA;
+	}
+
+	bool readFile(const std::string& path, std::vector<unsigned char>& bytes) {
+		FILE* file = std::fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+		bool ok = std::fseek(file, 0, SEEK_END) == 0;
+		long length = ok ? std::ftell(file) : -1;
+		ok = length > 0 && std::fseek(file, 0, SEEK_SET) == 0;
+		if (ok) {
+			bytes.resize((size_t)length);
+			ok = std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+		}
+		std::fclose(file);
+		return ok;
+	}
+
+	// bumped when the encoders change, so caches written by an older build are encoded again
+	const std::uint64_t encoderVersion = 1;
+
+	std::uint64_t hashBytes(const void* data, size_t size, std::uint64_t hash) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	// stb_image parallel-for on the pool: Adam7 passes of interlaced PNGs, JPEG restart intervals and row bands,
+	// stbi_load_from_memory_batch
+	void stbParallelFor(void* user, int count, void (*task)(void* taskData, int index), void* taskData) {
+		static_cast<ThreadPool*>(user)->parallelFor(count, [task, taskData](int index) { task(taskData, index); });
+	}
+
+	// stb_image scratch memory of the calling worker. it grows to the peak of the largest decode so far,
+	// after that decodes of images no larger do not allocate at all
+	stbi_arena* workerArena() {
+		thread_local std::vector<unsigned char> memory;
+		thread_local stbi_arena arena = {};
+		if (arena.peak + 15 > memory.size()) {
+			memory.resize(arena.peak + 15);
+			arena.memory = memory.data();
+			arena.size = memory.size();
+		}
+		return &arena;
+	}
+}
+
+std::vector<unsigned char> StagingPool::acquire() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (buffers.empty())
+		return std::vector<unsigned char>();
+	std::vector<unsigned char> buffer = std::move(buffers.back());
+	buffers.pop_back();
+	buffer.clear();
+	return buffer;
+}
+
+void StagingPool::release(std::vector<unsigned char>&& buffer) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (buffers.size() < maxBuffers)
+		buffers.push_back(std::move(buffer));
+}
+
+TextureLoader::TextureLoader(ThreadPool& pool) : pool(pool), completed(nullptr) {
+	stbi_set_parallel_for(stbParallelFor, &pool);
+}
+
+TextureLoader::~TextureLoader() {
+	for (std::future<void>& decode : decodes)
+		decode.wait();
+	// images that never got uploaded
+	Decoded* decoded = completed.exchange(nullptr);
+	while (decoded) {
+		Decoded* next = decoded->next;
+		ready.push_back(decoded);
+		decoded = next;
+	}
+	for (Decoded* image : ready)
+		delete image;
+	stbi_set_parallel_for(nullptr, nullptr);
+}
+
+bool TextureLoader::enableCompression(const std::string& directory, bool useBc7) {
+	BlockFormat formats[2] = { useBc7 ? BLOCK_BC7 : BLOCK_BC1, useBc7 ? BLOCK_BC7 : BLOCK_BC3 };
+	if (!CompressedChain::supported(formats[0]) || !CompressedChain::supported(formats[1]))
+		return false;
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	cacheDirectory = directory;
+	bc7 = useBc7;
+	compress = true;
+	return true;
+}
+
+unsigned int TextureLoader::request(const std::string& path, bool flipVertically) {
+	auto found = entries.find(path);
+	if (found != entries.end())
+		return found->second.texture;
+
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	entries[path] = Entry{ texture, PENDING };
+	inFlight++;
+
+	decodes.push_back(pool.submit([this, texture, path, flipVertically]() { decode(texture, path, flipVertically); }));
+	return texture;
+}
+
+void TextureLoader::decode(unsigned int texture, const std::string& path, bool flipVertically) {
+	Decoded* decoded = new Decoded();
+	decoded->texture = texture;
+	decoded->path = path;
+
+	// the file name depends on the request only, the key also on the file and the settings it was encoded with
+	std::string cachePath;
+	std::uint64_t key = 0;
+	struct stat info;
+	if (compress && stat(path.c_str(), &info) == 0) {
+		std::uint64_t name = hashBytes(path.data(), path.size(), 14695981039346656037ull);
+		name = hashBytes(&flipVertically, sizeof(flipVertically), name);
+		char file[32];
+		std::snprintf(file, sizeof(file), "%016llx.ktx2", (unsigned long long)name);
+		cachePath = cacheDirectory + "/" + file;
+
+		std::uint64_t size = (std::uint64_t)info.st_size, modified = (std::uint64_t)info.st_mtime;
+		key = hashBytes(&bc7, sizeof(bc7), name);
+		key = hashBytes(&size, sizeof(size), key);
+		key = hashBytes(&modified, sizeof(modified), key);
+		key = hashBytes(&encoderVersion, sizeof(encoderVersion), key);
+		if (decoded->compressed.load(cachePath, key)) {
+			push(decoded);
+			return;
+		}
+	}
+
+	std::vector<unsigned char> bytes = staging.acquire();
+	int width, height, channels;
+	if (readFile(path, bytes) && stbi_info_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &channels)) {
+		// decoded into the pooled buffer, flipped while the rows are written
+		stbi_set_scratch_arena_thread(workerArena());
+		std::vector<unsigned char> pixels = pixelPool.acquire();
+		pixels.resize((size_t)width * height * channels);
+		if (stbi_load_from_memory_into(bytes.data(), (int)bytes.size(), pixels.data(), (int)pixels.size(), 0, flipVertically,
+			&decoded->width, &decoded->height, &decoded->channels, channels)) {
+			decoded->pixels = std::move(pixels);
+			// the chain is built on this worker alone, the other workers are busy with other images
+			decoded->mips.build(decoded->pixels.data(), decoded->width, decoded->height, decoded->channels, MIP_UNSIGNED_BYTE);
+			if (!cachePath.empty())
+				compressToCache(*decoded, cachePath, key);
+		}
+		else {
+			pixelPool.release(std::move(pixels));
+		}
+	}
+	staging.release(std::move(bytes));
+	push(decoded);
+}
+
+void TextureLoader::compressToCache(Decoded& decoded, const std::string& cachePath, std::uint64_t key) {
+	BlockFormat format = bc7 ? BLOCK_BC7 : decoded.channels == 4 ? BLOCK_BC3 : BLOCK_BC1;
+	if (!decoded.compressed.build(decoded.mips, decoded.channels, format))
+		return;
+	// a failed write only costs the next run another encode
+	decoded.compressed.save(cachePath, key);
+	// the blocks are all the upload needs
+	decoded.mips = MipChain();
+	pixelPool.release(std::move(decoded.pixels));
+	decoded.pixels.clear();
+}
+
+void TextureLoader::push(Decoded* decoded) {
+	// lock-free stack, update() restores the order
+	Decoded* head = completed.load(std::memory_order_relaxed);
+	do {
+		decoded->next = head;
+	} while (!completed.compare_exchange_weak(head, decoded, std::memory_order_release, std::memory_order_relaxed));
+}
+
+unsigned int TextureLoader::update(double budgetMs) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// take everything the workers finished, oldest first
+	Decoded* taken = completed.exchange(nullptr, std::memory_order_acquire);
+	std::deque<Decoded*> newest;
+	for (; taken; taken = taken->next)
+		newest.push_front(taken);
+	ready.insert(ready.end(), newest.begin(), newest.end());
+
+	unsigned int uploaded = 0;
+	while (!ready.empty()) {
+		if (uploaded > 0 &&
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs)
+			break;
+		Decoded* decoded = ready.front();
+		ready.pop_front();
+		Entry& entry = entries[decoded->path];
+		if (!decoded->pixels.empty() || decoded->compressed.levels() > 0) {
+			upload(*decoded);
+			entry.state = READY;
+		}
+		else {
+			std::cout << "FAILED TO LOAD TEXTURE " << decoded->path << std::endl;
+			entry.state = FAILED;
+		}
+		pixelPool.release(std::move(decoded->pixels));
+		delete decoded;
+		inFlight--;
+		uploaded++;
+	}
+
+	// forget the finished decodes
+	for (size_t i = 0; i < decodes.size();) {
+		if (decodes[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			decodes[i] = std::move(decodes.back());
+			decodes.pop_back();
+		}
+		else {
+			i++;
+		}
+	}
+	return uploaded;
+}
+
+void TextureLoader::upload(const Decoded& decoded) {
+	glBindTexture(GL_TEXTURE_2D, decoded.texture);
+	// every level at once, no glGenerateMipmap on the render thread
+	if (decoded.compressed.levels() > 0)
+		decoded.compressed.upload(GL_TEXTURE_2D);
+	else
+		decoded.mips.upload(GL_TEXTURE_2D, formatOf(decoded.channels));
+}
+
+TextureLoader::State TextureLoader::state(const std::string& path) const {
+	auto found = entries.find(path);
+	return found == entries.end() ? FAILED : found->second.state;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include "mipmap.h"
+#include "texture_compress.h"
+#include <atomic>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// recycled byte buffers, so streaming many files does not allocate a new buffer per file
+// any thread may acquire and release
+class StagingPool {
+public:
+	explicit StagingPool(size_t maxBuffers = 8) : maxBuffers(maxBuffers) {}
+
+	// an empty buffer, with the capacity of an earlier one when there is one
+	std::vector<unsigned char> acquire();
+	// keeps the capacity for the next acquire, unless the pool is full
+	void release(std::vector<unsigned char>&& buffer);
+
+private:
+	std::mutex mutex;
+	std::vector<std::vector<unsigned char>> buffers;
+	size_t maxBuffers;
+};
+
+// loads textures without stalling the render thread
+// files are read and decoded with stb_image and their mip chains built on the thread pool, the decoded images wait in a lock-free
+// queue until update() uploads them on the render thread, as many per frame as the time budget allows
+// file bytes and decoded pixels both live in pooled buffers, stb_image decodes straight into the pixel buffer
+// with compression enabled the chains are encoded to BC1/BC3/BC7 and kept in a cache directory, later runs map the cached
+// blocks instead of decoding the file
+class TextureLoader {
+public:
+	enum State { PENDING, READY, FAILED };
+
+	explicit TextureLoader(ThreadPool& pool);
+	// waits for decodes still running on the pool
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// render thread. the texture name is valid right away and shows a 1x1 white texel until the image
+	// is uploaded. asking for the same path again returns the same texture without loading it twice
+	// the texture is mipmap complete from the start (the texel, then the image's whole chain), a mipmap
+	// GL_TEXTURE_MIN_FILTER can be set right away
+	unsigned int request(const std::string& path, bool flipVertically = true);
+	// render thread, before the first request. false when the driver cannot sample the format, textures stay uncompressed
+	// BC3 for images with alpha, BC1 for the others, or BC7 for all of them when bc7 is set
+	bool enableCompression(const std::string& directory, bool bc7 = false);
+	// render thread, once per frame: upload decoded images until budgetMs is used up (at least one)
+	// returns the number of textures uploaded
+	unsigned int update(double budgetMs);
+
+	// FAILED for a path that was never requested
+	State state(const std::string& path) const;
+	// requests not uploaded yet
+	unsigned int pending() const { return inFlight; }
+
+private:
+	// a decoded image travelling from a worker to the render thread
+	struct Decoded {
+		unsigned int texture;
+		std::string path;
+		// empty when the decode failed, goes back to the pixel pool after the upload
+		std::vector<unsigned char> pixels;
+		int width;
+		int height;
+		int channels;
+		Decoded* next;
+		// computed on the worker too, the render thread only uploads
+		MipChain mips;
+		// levels when compression is enabled, pixels and mips are released then
+		CompressedChain compressed;
+	};
+	struct Entry {
+		unsigned int texture;
+		State state;
+	};
+
+	ThreadPool& pool;
+	StagingPool staging;
+	StagingPool pixelPool;
+	std::map<std::string, Entry> entries;
+	// workers push, the render thread takes the whole list at once
+	std::atomic<Decoded*> completed;
+	// taken from completed but not uploaded yet because the budget ran out, render thread only
+	std::deque<Decoded*> ready;
+	std::vector<std::future<void>> decodes;
+	unsigned int inFlight = 0;
+	// set before the first request, read by the workers
+	bool compress = false;
+	bool bc7 = false;
+	std::string cacheDirectory;
+
+	void decode(unsigned int texture, const std::string& path, bool flipVertically);
+	void compressToCache(Decoded& decoded, const std::string& cachePath, std::uint64_t key);
+	void push(Decoded* decoded);
+	void upload(const Decoded& decoded);
+};
+
+#endif
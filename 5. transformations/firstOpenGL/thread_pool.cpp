@@ -0,0 +1,80 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+	if (threadCount == 0) {
+		unsigned int hardware = std::thread::hardware_concurrency();
+		threadCount = hardware > 1 ? hardware - 1 : 1;
+	}
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	// queued tasks still run before the workers exit
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::run() {
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+			task = std::move(tasks.front());
+			tasks.pop();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& task) {
+	struct Shared {
+		std::atomic<int> next{ 0 };
+		int done = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	if (count <= 0)
+		return;
+	std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+	const std::function<void(int)>* body = &task;
+	// takes indices until none are left. a helper that starts after the last index was taken does nothing,
+	// so it never touches task once this call has returned
+	auto work = [shared, body, count]() {
+		int taken = 0;
+		for (int i = shared->next++; i < count; i = shared->next++) {
+			(*body)(i);
+			taken++;
+		}
+		if (taken == 0)
+			return;
+		std::lock_guard<std::mutex> lock(shared->mutex);
+		shared->done += taken;
+		if (shared->done == count)
+			shared->finished.notify_all();
+	};
+
+	int helpers = std::min(count - 1, (int)workers.size());
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int i = 0; i < helpers; i++)
+			tasks.push(work);
+	}
+	for (int i = 0; i < helpers; i++)
+		wake.notify_one();
+
+	// no waiting on workers that are busy elsewhere, or on this thread itself when nested
+	work();
+	std::unique_lock<std::mutex> lock(shared->mutex);
+	shared->finished.wait(lock, [&shared, count]() { return shared->done == count; });
+}
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <vector>
+
+// fixed set of worker threads for work that must stay off the render thread (file reads, image decodes)
+// never call OpenGL from a task: the context is only current on the render thread
+class ThreadPool {
+public:
+	// 0 picks one thread per hardware thread, minus the render thread
+	explicit ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int size() const { return (unsigned int)workers.size(); }
+
+	// queue a task, the future holds its result (or the exception it threw)
+	template <typename F>
+	auto submit(F task) -> std::future<decltype(task())> {
+		typedef decltype(task()) Result;
+		std::shared_ptr<std::packaged_task<Result()>> packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+		std::future<Result> result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push([packaged]() { (*packaged)(); });
+		}
+		wake.notify_one();
+		return result;
+	}
+
+	// task(i) for every i in [0, count), returns when all calls have returned
+	// the calling thread takes indices too, so it may be called from a task running on this pool
+	void parallelFor(int count, const std::function<void(int)>& task);
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void run();
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "uniform_buffer.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+	bool hasExtension(const char* name) {
+		int count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (int i = 0; i < count; i++) {
+			const GLubyte* extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (extension && std::strcmp((const char*)extension, name) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// GL 4.4 core or ARB_buffer_storage. the loader alone does not tell: GLX and WGL can return an entry point
+	// the context does not support
+	bool hasBufferStorage() {
+		int major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		return major > 4 || (major == 4 && minor >= 4) || hasExtension("GL_ARB_buffer_storage");
+	}
+}
+
+UniformRing::UniformRing(size_t bytesPerFrame, unsigned int framesInFlight)
+	: frameSize(bytesPerFrame), frames(framesInFlight), fences(framesInFlight, nullptr) {
+}
+
+UniformRing::~UniformRing() {
+	for (GLsync fence : fences) {
+		if (fence)
+			glDeleteSync(fence);
+	}
+	if (buffer) {
+		if (mapped) {
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+}
+
+bool UniformRing::load(GLADloadproc loader) {
+	// every glBindBufferRange offset has to be a multiple of this, often 256
+	int offsetAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	if (offsetAlignment > 0)
+		alignment = (size_t)offsetAlignment;
+	// room for each block to be padded up to the alignment
+	frameSize = std140AlignUp(frameSize, alignment) + alignment;
+	size_t total = frameSize * frames;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	UNIFORMBUFFER_BUFFERSTORAGE bufferStorage = nullptr;
+	if (hasBufferStorage())
+		bufferStorage = (UNIFORMBUFFER_BUFFERSTORAGE)loader("glBufferStorage");
+	if (bufferStorage) {
+		// immutable storage mapped once, coherent so no flush is needed before drawing
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		bufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr)total, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)total, flags);
+	}
+	if (!mapped) {
+		// a buffer from glBufferStorage cannot be resized by glBufferData, start over
+		if (bufferStorage) {
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		}
+		glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)total, NULL, GL_STREAM_DRAW);
+		staging.resize(frameSize);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	return buffer != 0;
+}
+
+void UniformRing::beginFrame() {
+	used = 0;
+	GLsync& fence = fences[frame];
+	if (!fence)
+		return;
+	// normally already signaled, the slot was last used framesInFlight frames ago
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+void UniformRing::endFrame() {
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame = (frame + 1) % frames;
+}
+
+unsigned char* UniformRing::allocate(size_t size) {
+	size_t offset = std140AlignUp(used, alignment);
+	if (offset + size > frameSize) {
+		std::cout << "ERROR::UNIFORM_RING::FRAME_FULL" << std::endl;
+		return nullptr;
+	}
+	used = offset + size;
+	lastOffset = frame * frameSize + offset;
+	return mapped ? mapped + lastOffset : staging.data();
+}
+
+void UniformRing::commit(unsigned int bindingPoint, size_t size) {
+	if (!mapped) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)lastOffset, (GLsizeiptr)size, staging.data());
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, buffer, (GLintptr)lastOffset, (GLsizeiptr)size);
+}
@@ -0,0 +1,168 @@
+#pragma once
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "glm/glm.hpp"
+
+// glad is generated for GL 4.0 core, persistent mapping is GL 4.4 / ARB_buffer_storage
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP UNIFORMBUFFER_BUFFERSTORAGE)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// ------------------------------------------------------------------------------------------
+// std140 layout, computed at compile time
+//
+// describe a C++ struct of glm types once:
+//	struct FrameUniforms { glm::mat4 transform; float lerpVal; };
+//	typedef Std140Layout<FrameUniforms,
+//		STD140_MEMBER(FrameUniforms, transform),
+//		STD140_MEMBER(FrameUniforms, lerpVal)> FrameLayout;
+// the members must be listed in the order of the GLSL block, FrameLayout::size is the block size
+// and FrameLayout::pack() writes the struct with std140 padding
+// ------------------------------------------------------------------------------------------
+
+constexpr size_t std140AlignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// base alignment, size and writer of one std140 member type
+template <typename T>
+struct Std140Traits;
+
+template <typename T, size_t Alignment>
+struct Std140Plain {
+	static constexpr size_t alignment = Alignment;
+	static constexpr size_t size = sizeof(T);
+	static void write(unsigned char* dst, const T& value) { std::memcpy(dst, &value, sizeof(T)); }
+};
+
+template <> struct Std140Traits<float> : Std140Plain<float, 4> {};
+template <> struct Std140Traits<int> : Std140Plain<int, 4> {};
+template <> struct Std140Traits<unsigned int> : Std140Plain<unsigned int, 4> {};
+template <> struct Std140Traits<glm::vec2> : Std140Plain<glm::vec2, 8> {};
+template <> struct Std140Traits<glm::ivec2> : Std140Plain<glm::ivec2, 8> {};
+// a vec3 is aligned like a vec4 but a following scalar may use its last 4 bytes
+template <> struct Std140Traits<glm::vec3> : Std140Plain<glm::vec3, 16> {};
+template <> struct Std140Traits<glm::ivec3> : Std140Plain<glm::ivec3, 16> {};
+template <> struct Std140Traits<glm::vec4> : Std140Plain<glm::vec4, 16> {};
+template <> struct Std140Traits<glm::ivec4> : Std140Plain<glm::ivec4, 16> {};
+
+// GLSL bools are 4 bytes
+template <> struct Std140Traits<bool> {
+	static constexpr size_t alignment = 4;
+	static constexpr size_t size = 4;
+	static void write(unsigned char* dst, const bool& value) {
+		int v = value ? 1 : 0;
+		std::memcpy(dst, &v, sizeof(v));
+	}
+};
+
+// matrices are arrays of column vectors, every column padded to 16 bytes
+template <glm::length_t Columns, glm::length_t Rows>
+struct Std140Traits<glm::mat<Columns, Rows, float, glm::defaultp>> {
+	static constexpr size_t alignment = 16;
+	static constexpr size_t size = 16 * Columns;
+	static void write(unsigned char* dst, const glm::mat<Columns, Rows, float, glm::defaultp>& value) {
+		for (glm::length_t column = 0; column < Columns; column++)
+			std::memcpy(dst + 16 * column, &value[column], sizeof(float) * Rows);
+	}
+};
+
+// one member: its type and where it lives in the C++ struct
+template <typename T, size_t CpuOffset>
+struct Std140Member {
+	typedef T Type;
+	static constexpr size_t cpuOffset = CpuOffset;
+};
+
+#define STD140_MEMBER(Struct, member) Std140Member<decltype(Struct::member), offsetof(Struct, member)>
+
+// walks the member list, the std140 offset of every member is a template constant
+template <size_t Offset, typename... Members>
+struct Std140Packer {
+	static constexpr size_t end = Offset;
+	static void pack(const unsigned char*, unsigned char*) {}
+};
+
+template <size_t Offset, typename Member, typename... Rest>
+struct Std140Packer<Offset, Member, Rest...> {
+	typedef Std140Traits<typename Member::Type> Traits;
+	static constexpr size_t offset = std140AlignUp(Offset, Traits::alignment);
+	typedef Std140Packer<offset + Traits::size, Rest...> Next;
+	static constexpr size_t end = Next::end;
+
+	static void pack(const unsigned char* src, unsigned char* dst) {
+		Traits::write(dst + offset, *(const typename Member::Type*)(src + Member::cpuOffset));
+		Next::pack(src, dst);
+	}
+};
+
+template <typename Struct, typename... Members>
+struct Std140Layout {
+	// a block is padded to a multiple of a vec4
+	static constexpr size_t size = std140AlignUp(Std140Packer<0, Members...>::end, 16);
+
+	static void pack(const Struct& value, void* dst) {
+		Std140Packer<0, Members...>::pack((const unsigned char*)&value, (unsigned char*)dst);
+	}
+};
+
+// ------------------------------------------------------------------------------------------
+// per-frame uniform blocks in a ring of frame slots
+// with GL 4.4 / ARB_buffer_storage the buffer stays mapped for its whole life and a block is
+// written straight into it; otherwise each block is packed on the CPU and uploaded with glBufferSubData
+// a fence per slot keeps the CPU from overwriting a slot the GPU has not finished reading
+// ------------------------------------------------------------------------------------------
+class UniformRing {
+public:
+	// bytesPerFrame: total size of all blocks pushed in one frame (before offset alignment)
+	UniformRing(size_t bytesPerFrame, unsigned int framesInFlight = 3);
+	~UniformRing();
+
+	UniformRing(const UniformRing&) = delete;
+	UniformRing& operator=(const UniformRing&) = delete;
+
+	// create the buffer, with the loader given to gladLoadGLLoader
+	bool load(GLADloadproc loader);
+	bool persistent() const { return mapped != nullptr; }
+
+	// wait until the GPU is done with the slot of this frame
+	void beginFrame();
+	// fence the slot and move on to the next
+	void endFrame();
+
+	// write one block into this frame's slot and bind it to the binding point: one copy, one glBindBufferRange
+	template <typename Layout, typename Struct>
+	bool push(unsigned int bindingPoint, const Struct& value) {
+		unsigned char* dst = allocate(Layout::size);
+		if (!dst)
+			return false;
+		Layout::pack(value, dst);
+		commit(bindingPoint, Layout::size);
+		return true;
+	}
+
+private:
+	size_t frameSize;
+	unsigned int frames;
+	unsigned int frame = 0;
+	size_t used = 0;
+	size_t alignment = 256;
+	unsigned int buffer = 0;
+	unsigned char* mapped = nullptr;
+	std::vector<unsigned char> staging;
+	std::vector<GLsync> fences;
+	size_t lastOffset = 0;
+
+	unsigned char* allocate(size_t size);
+	void commit(unsigned int bindingPoint, size_t size);
+};
+
+#endif